@@ -0,0 +1,341 @@
+/*
+    Paint Program - Batch converter
+
+    Converts drawings between the formats of Paint-C and uncompressed
+    images, without a window: it builds from the drawing core alone and
+    runs on Windows as well as on Linux.
+
+        paintc-convert [-f bmp|ppm|pcnv] [-o directory] [-j threads] [-s WIDTHxHEIGHT] [-p colors] [-d none|fs|bayer] input...
+
+    Inputs are legacy pixel_data.csv saves (.csv), canvas snapshots
+    (.pcnv) and images (.bmp, .ppm). A directory stands for every such
+    file it holds. Each output takes the name of its input with the
+    extension of the output format, next to it or in the -o directory.
+
+    Files are converted in parallel, one per thread of the pool, and
+    every image is encoded one band of rows at a time. With -p, snapshots
+    are saved with a palette of that many colors at most, one byte per
+    pixel, their colors being reduced if needed, and images are drawn
+    with that many colors. -d dithers the reduced colors.
+*/
+
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "./lib/logger.h"
+#include "./lib/canvas.h"
+#include "./lib/snapshot.h"
+#include "./lib/thread.h"
+#include "./lib/pixelCsv.h"
+#include "./lib/imageFile.h"
+#include "./lib/quantize.h"
+#include "./lib/dither.h"
+
+#define CSV_WIDTH        1280 // Size of the window the legacy saves were captured from
+#define CSV_HEIGHT        720
+#define CSV_BACKGROUND   CANVAS_RGB(255, 255, 255)
+#define MAX_THREADS        64
+
+// Kinds of files the converter reads and writes.
+typedef enum FileKind {
+    KIND_NONE = 0,
+    KIND_CSV,
+    KIND_SNAPSHOT,
+    KIND_BMP,
+    KIND_PPM
+} FileKind;
+
+// One file to convert.
+typedef struct Job {
+    char* input;
+    char* output;
+    FileKind kind;
+} Job;
+
+// Options and work shared by the threads of the pool.
+typedef struct Batch {
+    Job* jobs;
+    int count;
+    int capacity;
+    FileKind target;
+    const char* outputDirectory;
+    int csvWidth;
+    int csvHeight;
+    int csvThreads;         // Threads each CSV is parsed and each drawing dithered with
+    int paletteColors;      // Colors of the outputs drawn with a palette, 0 for a palette only when lossless
+    DitherMethod dither;    // How the colors are reduced to the palette
+    atomic_int next;        // Next job to take
+    atomic_int converted;   // Jobs done successfully
+    Log* log;
+} Batch;
+
+static const char* extensions[] = { NULL, ".csv", ".pcnv", ".bmp", ".ppm" };
+
+static FileKind kindFromPath(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot == NULL) {
+        return KIND_NONE;
+    }
+    for (int kind = KIND_CSV; kind <= KIND_PPM; ++kind) {
+        const char* extension = extensions[kind];
+        size_t length = strlen(extension);
+        int same = (strlen(dot) == length);
+        for (size_t i = 0; i < length && same; ++i) {
+            same = (tolower((unsigned char)dot[i]) == extension[i]);
+        }
+        if (same) {
+            return (FileKind)kind;
+        }
+    }
+    return KIND_NONE;
+}
+
+static void addJob(Batch* batch, const char* input, FileKind kind) {
+    if (batch -> count == batch -> capacity) {
+        int capacity = (batch -> capacity > 0) ? batch -> capacity * 2 : 256;
+        Job* jobs = realloc(batch -> jobs, sizeof(Job) * capacity);
+        if (jobs == NULL) {
+            logError(batch -> log, 103, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        batch -> jobs = jobs;
+        batch -> capacity = capacity;
+    }
+
+    // Output name: the input one with the extension of the target, in the output directory if any
+    const char* name = input;
+    if (batch -> outputDirectory != NULL) {
+        for (const char* p = input; *p != '\0'; ++p) {
+            if (*p == '/' || *p == '\\') {
+                name = p + 1;
+            }
+        }
+    }
+    const char* dot = strrchr(name, '.');
+    size_t stem = (size_t)(dot - name);
+    const char* directory = (batch -> outputDirectory != NULL) ? batch -> outputDirectory : "";
+    size_t length = strlen(directory) + 1 + stem + strlen(extensions[batch -> target]) + 1;
+
+    Job* job = &batch -> jobs[batch -> count++];
+    job -> input = malloc(strlen(input) + 1);
+    job -> output = malloc(length);
+    if (job -> input == NULL || job -> output == NULL) {
+        logError(batch -> log, 128, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(job -> input, input);
+    snprintf(job -> output, length, "%s%s%.*s%s", directory, (batch -> outputDirectory != NULL) ? "/" : "",
+             (int)stem, name, extensions[batch -> target]);
+    job -> kind = kind;
+}
+
+/**
+ * @brief Adds a file, or every file a directory holds that can be converted to the target.
+ *
+ * @return 0 if the path is a file that cannot be converted, 1 otherwise.
+ */
+static int addInput(Batch* batch, const char* path) {
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        FileKind kind = kindFromPath(path);
+        if (kind == KIND_NONE || kind == batch -> target) {
+            logError(batch -> log, 147, "%s cannot be converted to %s", path, extensions[batch -> target]);
+            return 0;
+        }
+        addJob(batch, path, kind);
+        return 1;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        FileKind kind = kindFromPath(entry -> d_name);
+        if (kind == KIND_NONE || kind == batch -> target) {
+            continue;
+        }
+        char* file = malloc(strlen(path) + strlen(entry -> d_name) + 2);
+        if (file == NULL) {
+            logError(batch -> log, 162, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        sprintf(file, "%s/%s", path, entry -> d_name);
+        addJob(batch, file, kind);
+        free(file);
+    }
+    closedir(directory);
+    return 1;
+}
+
+/**
+ * @brief Reads any input into a canvas of its own size.
+ *
+ * @return The canvas, or NULL if the input cannot be read.
+ */
+static Canvas* readInput(const Batch* batch, const Job* job) {
+    Canvas* canvas = NULL;
+    if (job -> kind == KIND_CSV) {
+        canvas = canvasConstructor(batch -> csvWidth, batch -> csvHeight, CSV_BACKGROUND, batch -> log);
+        if (!pixelCsvLoad(canvas, job -> input, batch -> csvThreads, batch -> log)) {
+            canvasDeconstructor(canvas);
+            return NULL;
+        }
+    } else if (job -> kind == KIND_SNAPSHOT) {
+        int width, height;
+        uint32_t background;
+        if (!snapshotReadHeader(job -> input, &width, &height, &background) || width <= 0 || height <= 0) {
+            logError(batch -> log, 190, "%s is not a supported canvas snapshot", job -> input);
+            return NULL;
+        }
+        // Tiles are decoded as the output reads them, band after band
+        canvas = canvasConstructor(width, height, background, batch -> log);
+        if (!snapshotLoad(canvas, job -> input, batch -> log)) {
+            canvasDeconstructor(canvas);
+            return NULL;
+        }
+    } else {
+        ImageReader* reader = imageReaderConstructor(job -> input, batch -> log);
+        if (reader == NULL) {
+            return NULL;
+        }
+        canvas = canvasConstructor(reader -> width, reader -> height, CSV_BACKGROUND, batch -> log);
+        int loaded = imageLoadCanvas(reader, canvas);
+        imageReaderDeconstructor(reader);
+        if (!loaded) {
+            logError(batch -> log, 208, "%s is cut short", job -> input);
+            canvasDeconstructor(canvas);
+            return NULL;
+        }
+    }
+    return canvas;
+}
+
+static int convert(const Batch* batch, const Job* job) {
+    Canvas* canvas = readInput(batch, job);
+    if (canvas == NULL) {
+        return 0;
+    }
+
+    // Snapshots reduce their colors as they are saved, unless they are dithered first
+    if (batch -> paletteColors > 0 && (batch -> target != KIND_SNAPSHOT || batch -> dither != DITHER_NONE)) {
+        Palette palette;
+        quantizeCanvasPalette(canvas, batch -> paletteColors, 0, batch -> csvThreads, &palette, batch -> log);
+        ditherCanvas(canvas, &palette, batch -> dither, batch -> csvThreads, batch -> log);
+    }
+
+    int written;
+    if (batch -> target == KIND_SNAPSHOT && batch -> paletteColors > 0) {
+        written = snapshotSaveIndexed(canvas, job -> output, batch -> paletteColors, batch -> log);
+    } else if (batch -> target == KIND_SNAPSHOT) {
+        written = snapshotSave(canvas, job -> output, batch -> log);
+    } else {
+        written = imageSaveCanvas(canvas, job -> output, (batch -> target == KIND_BMP) ? IMAGE_FORMAT_BMP : IMAGE_FORMAT_PPM, batch -> log);
+    }
+    canvasDeconstructor(canvas);
+    return written;
+}
+
+static void runJobs(void* argument) {
+    Batch* batch = argument;
+    int index;
+    while ((index = atomic_fetch_add(&batch -> next, 1)) < batch -> count) {
+        if (convert(batch, &batch -> jobs[index])) {
+            atomic_fetch_add(&batch -> converted, 1);
+        } else {
+            logError(batch -> log, 248, "Failed to convert %s", batch -> jobs[index].input);
+        }
+    }
+}
+
+static void printUsage(void) {
+    fprintf(stderr,
+            "Usage: paintc-convert [-f bmp|ppm|pcnv] [-o directory] [-j threads] [-s WIDTHxHEIGHT] [-p colors] [-d none|fs|bayer] input...\n"
+            "  Converts .csv, .pcnv, .bmp and .ppm files, or every such file of a directory.\n"
+            "  -f  Output format (default bmp)\n"
+            "  -o  Directory of the outputs (default: next to each input)\n"
+            "  -j  Files converted at once (default: one per processor)\n"
+            "  -s  Size of the canvas the CSV saves are loaded on (default %dx%d)\n"
+            "  -p  Outputs drawn with at most this many colors (1 to %d), snapshots then taking one\n"
+            "      byte per pixel (default: snapshots of no more colors than that, other outputs unchanged)\n"
+            "  -d  Dithering of the colors reduced by -p: none, fs (Floyd-Steinberg) or bayer (default none)\n",
+            CSV_WIDTH, CSV_HEIGHT, QUANTIZE_MAX_COLORS);
+}
+
+int main(int argc, char* argv[]) {
+    Log log = { stderr };
+    Batch batch = { 0 };
+    batch.target = KIND_BMP;
+    batch.csvWidth = CSV_WIDTH;
+    batch.csvHeight = CSV_HEIGHT;
+    batch.log = &log;
+    int threadCount = threadProcessorCount();
+
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-'; first += 2) {
+        const char* option = argv[first];
+        const char* value = (first + 1 < argc) ? argv[first + 1] : NULL;
+        int valid = (value != NULL && option[1] != '\0' && option[2] == '\0');
+        if (valid && option[1] == 'f') {
+            char name[16];
+            snprintf(name, sizeof(name), ".%s", value);
+            batch.target = kindFromPath(name);
+            valid = (batch.target == KIND_SNAPSHOT || batch.target == KIND_BMP || batch.target == KIND_PPM);
+        } else if (valid && option[1] == 'o') {
+            batch.outputDirectory = value;
+        } else if (valid && option[1] == 'j') {
+            threadCount = atoi(value);
+            valid = (threadCount > 0);
+        } else if (valid && option[1] == 's') {
+            valid = (sscanf(value, "%dx%d", &batch.csvWidth, &batch.csvHeight) == 2 && batch.csvWidth > 0 && batch.csvHeight > 0);
+        } else if (valid && option[1] == 'p') {
+            batch.paletteColors = atoi(value);
+            valid = (batch.paletteColors >= 1 && batch.paletteColors <= QUANTIZE_MAX_COLORS);
+        } else if (valid && option[1] == 'd') {
+            valid = ditherMethodFromName(value, &batch.dither);
+        } else {
+            valid = 0;
+        }
+        if (!valid) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (first == argc) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    int rejected = 0;
+    for (int i = first; i < argc; ++i) {
+        rejected += !addInput(&batch, argv[i]);
+    }
+    if (threadCount > batch.count) threadCount = batch.count;
+    if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+
+    // Processors left over by the pool go to the CSV parsers and the dithering
+    batch.csvThreads = (threadCount > 0) ? threadProcessorCount() / threadCount : 1;
+    if (batch.csvThreads < 1) batch.csvThreads = 1;
+
+    time_t start = time(NULL);
+    Thread* threads[MAX_THREADS];
+    for (int i = 1; i < threadCount; ++i) {
+        threads[i] = threadStart(runJobs, &batch, &log);
+    }
+    runJobs(&batch);
+    for (int i = 1; i < threadCount; ++i) {
+        threadJoin(threads[i]);
+    }
+
+    int converted = atomic_load(&batch.converted);
+    printf("Converted %d of %d files in %ld s\n", converted, batch.count, (long)(time(NULL) - start));
+
+    for (int i = 0; i < batch.count; ++i) {
+        free(batch.jobs[i].input);
+        free(batch.jobs[i].output);
+    }
+    free(batch.jobs);
+    return (converted == batch.count && rejected == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
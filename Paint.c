@@ -44,12 +44,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 // Custom Libraries
 #include "./lib/logger.h"
 #include "./lib/color.h"
 #include "./lib/howTo.h"
+#include "./lib/canvas.h"
+#include "./lib/stamp.h"
+#include "./lib/history.h"
+#include "./lib/snapshot.h"
+#include "./lib/thread.h"
+#include "./lib/pixelCsv.h"
+#include "./lib/command.h"
+#include "./lib/journal.h"
+#include "./lib/document.h"
+#include "./lib/tileStore.h"
+#include "./lib/resourceCache.h"
 
 // Color ID
 #define ID_COLOR_BLACK         101
@@ -89,11 +99,27 @@
 #define ID_RESET               501
 #define ID_SAVE_BUTTON         502
 #define ID_LOAD_BUTTON         503
+#define SNAPSHOT_FILE          "./assets/canvas.pcnv"
+#define ID_UNDO                504 // Ctrl+Z
+#define ID_REDO                505 // Ctrl+Y
+#define HISTORY_BUDGET         (64 * 1024 * 1024) // Bytes of tiles kept for undo/redo
+#define JOURNAL_FILE           "./assets/canvas.journal"
+#define DOCUMENT_FILE          "./assets/canvas.pdoc"
+#define ID_JOURNAL_TIMER       506
+#define STORE_DIRECTORY        "./assets/store"
+#define STORE_SLOT             "canvas"
+#define STORE_VERSIONS           10 // Versions of the canvas kept in the store, older ones are deleted
+#define JOURNAL_FLUSH_MS      2000 // Interval between two writes of the journal (autosave)
+#define ID_STATUS_TIMER        507
+#define STATUS_REFRESH_MS     1000 // Interval between two counts of the GDI objects in the status bar
 
 // Progress Save-bar
 #define ID_PROGRESS_DIALOG    1001
 #define ID_PROGRESS_BAR       1002
 #define ID_PROGRESS_TEXT      1003
+#define ID_PROGRESS_TIMER     1004
+#define ID_PROGRESS_CANCEL    1005
+#define PROGRESS_POLL_MS        50 // Interval between two looks at the progress of the save
 
 // UI & Visuals (They are all defined as reserved!)
 #define COLOR_BUTTON_WIDTH      20
@@ -347,6 +373,31 @@ void brushDeconstructor(Brush* brush) {
     free(brush);
 }
 
+/**
+ * @brief Save running on a worker thread, watched by the main window on a timer.
+ */
+typedef struct SaveJob {
+    SnapshotFrame *frame;        /**< Copy of the canvas taken when the save started. */
+    SnapshotProgress progress;   /**< Tiles written so far, and the cancel request. */
+    atomic_int finished;         /**< Set by the worker once the file is written or abandoned. */
+    int saved;                   /**< Result of the write, valid once finished is set. */
+    Thread *thread;              /**< Worker thread. */
+    Log *log;                    /**< Log used by the worker. */
+    TileStore *store;            /**< Store the save also adds a version to, or NULL. Only the worker uses it meanwhile. */
+    int version;                 /**< Version added to the store, 0 if none. */
+    HWND hProgressDialog;        /**< Progress dialog shown while saving. */
+    HWND hProgressBar;           /**< Progress bar of the dialog. */
+    DWORD start;                 /**< Tick count when the save started. */
+} SaveJob;
+
+/**
+ * @brief Pixels of the region being copied to the window, kept between frames and grown as needed.
+ */
+typedef struct StagingBuffer {
+    uint32_t *pixels;            /**< Buffer of size pixels, NULL until the first frame. */
+    size_t size;                 /**< Number of pixels the buffer holds. */
+} StagingBuffer;
+
 /**
  * @brief Structure to hold parameters passed to the window procedure.
  * 
@@ -358,6 +409,15 @@ typedef struct winParams {
     Log logger;                  /**< Logger object for logging messages and errors. */
     ColorTable *colorTable;      /**< Pointer to the color table object for managing colors. */
     Brush *brush;                /**< Pointer to the brush object for drawing operations. */
+    Canvas *canvas;              /**< Pointer to the off-screen canvas holding the drawing. */
+    History *history;            /**< Pointer to the undo/redo history of the canvas. */
+    SaveJob *saveJob;            /**< Save in progress, NULL when none is running. */
+    Journal *journal;            /**< Journal of the operations since the last save, for crash recovery. */
+    Document *document;          /**< The drawing as a list of commands, saved next to the snapshot. */
+    TileStore *store;            /**< Versions of the canvas kept by the saves, or NULL if the store cannot be opened. */
+    ResourceCache *resources;    /**< Fonts, brushes, icons and cursors of the window, created once. */
+    StagingBuffer staging;       /**< Buffer the canvas is presented through. */
+    uint64_t savedGeneration;    /**< Canvas generation the saved files match, 0 until the first save of the run. */
     HWND hStatusBar;             /**< Handle to the status bar window. */
     HWND hBrushSlider;
     HINSTANCE hInstance;
@@ -369,22 +429,33 @@ typedef struct {
 } TextProperties;
 
 // Function Prototype.   
-void drawCustomLine(HWND hwnd, Brush * brush,  int startX, int startY, int endX, int endY, Log * logger); // Draws a custom line on the specified window using the provided brush, starting from (startX, startY) to (endX, endY).
+void drawCustomLine(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, int startX, int startY, int endX, int endY, Log * logger); // Draws a custom line on the canvas using the provided brush, starting from (startX, startY) to (endX, endY).
 LRESULT CALLBACK ProgressDialogProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);               // Callback function for the main window procedure.
 LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lParam);                      // Handles messages related to the main window.
 const char* getClosestColorName(ColorTable * colorTable, int r, int g, int b);                            // Returns the name of the closest color in the provided color table based on the RGB values.
-void updateStatusBarText(Brush * brush, HWND hStatusBar);                                                 // Updates the status bar text based on the current brush settings.
+void updateStatusBarText(Brush * brush, Canvas * canvas, HWND hStatusBar);                                // Updates the status bar text based on the current brush settings.
+void updateGdiStatusText(ResourceCache * resources, HWND hStatusBar);                                     // Updates the count of the GDI objects in the status bar.
 void UpdateProgressBar(HWND hProgressBar, int progress);                                                  // Updates the progress bar with the specified progress value.
-void capturePixelData(FILE *file, HWND hwnd, Log * log);                                                  // Captures pixel data from the specified window and writes it to the given file.
-void drawPixel(HWND hwnd, Brush * brush, int x, int y);                                                   // Draws a pixel at the specified coordinates on the window using the provided brush.
-void loadPixelData(FILE *file, HWND hwnd, Log * log);                                                     // Loads pixel data from the given file and renders it on the specified window.
+void drawPixel(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, int x, int y); // Draws a pixel at the specified coordinates on the canvas using the provided brush.
+void drawStroke(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, POINT from, POINT to); // Draws the area swept by the brush between two mouse positions.
 HWND* ShowProgressDialog(HWND hwndParent, Log * log);                                                     // Displays a progress dialog as a child window of the specified parent window.
 BOOL intersect(RECT rect, int x, int y, int offset);                                                      // Checks if the specified point (x, y) intersects with the given rectangle with an optional offset.
 void setColor(Brush * brush, int r, int g, int b);                                                        // Sets the color of the provided brush to the specified RGB values.
 void CloseProgressDialog(HWND hProgressDialog);                                                           // Closes and destroys the progress dialog window.
 char* GetCurrentModeText(Brush * brush);                                                                  // Retrieves the current mode text associated with the provided brush.
 void resetColorTextField(HWND hwnd);                                                                      // Resets the color text field to its default state.
-void resetCanvas(HWND hwnd);                                                                              // Resets the canvas by clearing all drawn elements from the specified window.
+void resetCanvas(HWND hwnd, Canvas * canvas, Journal * journal, Document * document);                     // Resets the canvas by clearing all drawn elements from the specified window.
+long presentCanvas(HDC hdc, Canvas * canvas, StagingBuffer * staging, RECT rect);                         // Copies the given region of the canvas to the device context.
+void presentDamage(HWND hwnd, Canvas * canvas);                                                           // Copies every region changed since the last frame to the window.
+void invalidateTextOverlay(HWND hwnd, ResourceCache * resources, Brush * brush, POINT origin, const char* text); // Schedules a repaint of the area covered by the text being typed.
+void commitText(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, POINT origin, const char* text); // Rasterizes the text being typed into the canvas.
+void renderText(void* data, Canvas * canvas, const PaintCommand * command);                              // Rasterizes a text command with GDI, used live and when replaying the journal.
+void runCommand(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, const PaintCommand * command); // Applies a drawing operation, records it in the journal and the document and shows the changed region.
+void beginOperation(History * history, Document * document);                                             // Opens an undoable operation in the history and in the document.
+void endOperation(History * history, Document * document);                                               // Closes the undoable operation, keeping the document in step with the history.
+SaveJob* startSave(HWND hwnd, Canvas * canvas, uint64_t since, TileStore * store, Log * log);            // Copies the canvas, or what changed since the last save, and starts writing it on a worker thread.
+void saveWorker(void* argument);                                                                          // Writes the copied canvas, run by the save worker thread.
+uint64_t finishSave(SaveJob * job, Journal * journal, Document * document);                               // Waits for the worker, closes the progress dialog and releases the save.
 
 
 
@@ -418,7 +489,7 @@ LONG WINAPI MyUnhandledExceptionFilter(EXCEPTION_POINTERS* ExceptionInfo) {
  * 
  * @param mainInstance Handle to the current instance of the application.
  * @param prevInstance Reserved parameter, not used.
- * @param lpCmdLine Command-line parameters, not used in this application.
+ * @param lpCmdLine Command-line parameters: "-match rgb|de76|de2000" chooses how custom colors are named.
  * @param nCmdShow Specifies how the window is to be shown.
  * @return The exit code returned when the application terminates.
  */
@@ -433,15 +504,42 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     ColorTable * colorTable = colorTableConstructor(logger);
     colorTable -> setColorDataFile(colorTable, "./assets/colormap.csv", logger);
     loadColorTableFromCSV(colorTable, logger);
+    const char* matchOption = strstr(lpCmdLine, "-match ");
+    if (matchOption != NULL) {
+        colorTable -> match = colorMatchFromName(matchOption + strlen("-match "));
+    }
 
     // Initialize the brush object.
     Brush * brush = brushConstructor("brush", ID_FREE_MODE, ID_BRUSH_MIN, &logger);
 
+    // GDI objects of the window are created once and shared by every message.
+    ResourceCache * resources = resourceCacheConstructor(&logger);
+
+    // Initialize the canvas, large enough to cover a maximized window.
+    int canvasWidth = max(SCREEN_WIDTH, GetSystemMetrics(SM_CXSCREEN));
+    int canvasHeight = max(SCREEN_HEIGHT, GetSystemMetrics(SM_CYSCREEN));
+    Canvas * canvas = canvasConstructor(canvasWidth, canvasHeight, CANVAS_RGB(255, 255, 255), &logger);
+    canvasSetClip(canvas, 0, TOOLBAR_HEIGHT, canvasWidth, canvasHeight); // Nothing is drawn below the toolbar
+
+    // Bring back the drawing of the previous run: last snapshot plus the journaled operations.
+    Journal * journal = journalConstructor(JOURNAL_FILE, canvasWidth, canvasHeight, &logger);
+    int recovered = journalRecover(journal, canvas, SNAPSHOT_FILE, renderText, resources);
+    if (recovered > 0) {
+        logDebug(&logger, "Recovered %d journaled operations.", recovered);
+    }
+    Document * document = documentConstructor(canvasWidth, canvasHeight, &logger);
+    if (canvas -> allocatedTiles > 0 || canvas -> pendingCount > 0) {
+        documentMarkRaster(document); // Recovered pixels, not commands
+    }
+    History * history = historyConstructor(canvas, HISTORY_BUDGET, &logger);
+    TileStore * store = tileStoreConstructor(STORE_DIRECTORY, &logger);
+
     // Register window class.
     WNDCLASS windowClass = { 0 };
     windowClass.lpfnWndProc = WindowProc;
     windowClass.hInstance = hInstance;
-    windowClass.hbrBackground = CreateSolidBrush(RGB(255,255,255)); 
+    windowClass.hbrBackground = NULL; // WM_PAINT covers the whole client area with the canvas
+    windowClass.hCursor = resourceCacheCursor(resources, IDC_CROSS);
     windowClass.lpszClassName = TEXT("PaintWindowClass"); 
 
     if (!RegisterClass(&windowClass)) {
@@ -466,8 +564,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         return 0;
     }
 
-    // Load the application icon.
-    HICON hIcon = (HICON) LoadImage(hInstance, "./assets/icon.ico", IMAGE_ICON, 0, 0, LR_LOADFROMFILE);
+    // Load the application icon, also drawn in the toolbar.
+    HICON hIcon = resourceCacheIcon(resources, "./assets/icon.ico", 0);
 
     // Set the icon for the window.
     SendMessage(mainHWND, WM_SETICON, ICON_SMALL, (LPARAM)hIcon);
@@ -497,6 +595,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     winParams params;
     params.logger = logger;
     params.brush = brush;
+    params.canvas = canvas;
+    params.history = history;
+    params.saveJob = NULL;
+    params.savedGeneration = 0;
+    params.journal = journal;
+    params.document = document;
+    params.store = store;
+    params.resources = resources;
+    params.staging.pixels = NULL;
+    params.staging.size = 0;
     params.colorTable = colorTable;
     params.hStatusBar = hStatusBar;
     params.hBrushSlider = hBrushSlider;
@@ -505,6 +613,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Set the Params structure as the user data associated with the mainHWND.
     SetWindowLongPtr(mainHWND, GWLP_USERDATA, (LONG_PTR)&params);
     SendMessage(mainHWND, WM_CREATE, 0, 0);
+    SetTimer(mainHWND, ID_JOURNAL_TIMER, JOURNAL_FLUSH_MS, NULL);
+    SetTimer(mainHWND, ID_STATUS_TIMER, STATUS_REFRESH_MS, NULL);
+    updateGdiStatusText(resources, hStatusBar);
 
     // Show the How To Windows
     ShowHowToDialog(mainHWND);
@@ -516,15 +627,27 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Message loop.
     MSG msg;
     while(GetMessage(&msg, NULL, 0, 0)) {
+        // Ctrl+Z / Ctrl+Y work whichever control has the focus, except the custom color field
+        if (msg.message == WM_KEYDOWN && (msg.wParam == 'Z' || msg.wParam == 'Y') && (GetKeyState(VK_CONTROL) & 0x8000)
+            && msg.hwnd != GetDlgItem(mainHWND, ID_CUSTOM_COLOR_LABEL)) {
+            SendMessage(mainHWND, WM_COMMAND, (msg.wParam == 'Z') ? ID_UNDO : ID_REDO, 0);
+            continue;
+        }
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
 
-    // Clean up resources.
-    closeLog(&logger);
+    // Clean up resources, the log last since the deconstructors may still write to it.
     brushDeconstructor(brush);
+    historyDeconstructor(history);
+    journalDeconstructor(journal);
+    documentDeconstructor(document);
+    tileStoreDeconstructor(store);
+    canvasDeconstructor(canvas);
     colorTableDeconstructor(colorTable);
-    DestroyIcon(hIcon);
+    resourceCacheDeconstructor(resources);
+    free(params.staging.pixels);
+    closeLog(&logger);
     return msg.wParam;
 }
 
@@ -550,6 +673,11 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
     Log logger = params -> logger;
     ColorTable * colorTable = params -> colorTable;
     Brush * brush = params -> brush;
+    Canvas * canvas = params -> canvas;
+    History * history = params -> history;
+    Journal * journal = params -> journal;
+    Document * document = params -> document;
+    ResourceCache * resources = params -> resources;
     HWND hStatusBar = params -> hStatusBar;
     HWND hBrushSlider = params -> hBrushSlider;
     HINSTANCE hInstance = params -> hInstance;
@@ -562,7 +690,6 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
     static BOOL useCustomColor = FALSE; // Idem
     static int customColor[3]; // Default black value.
     static int lastUsedColor[3];// last used color
-    FILE* savingFile;
 
     COLORREF buttonColors[] = {
         RGB(0, 0, 0),   // Black
@@ -576,16 +703,6 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
         RGB(165, 42, 42) // Brown
     };
 
-    // Load the default cross cursor
-    HCURSOR hCustomCursor = LoadCursor(NULL, IDC_CROSS);
-    if (hCustomCursor == NULL) {
-        DWORD error = GetLastError();
-        logError(&logger, 571, "Failed to load cursor. Error code: %lu", error);
-    }
-
-    // Set the cursor
-    SetCursor(hCustomCursor);
-
     switch (uMsg) {
         case WM_PAINT: {
             PAINTSTRUCT painter;
@@ -593,95 +710,61 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
             RECT currRect;
             GetClientRect(mainHWND, &currRect);
 
-            RECT divRect = {
-                currRect.left,
-                currRect.top,
-                currRect.right,
-                currRect.top + TOOLBAR_HEIGHT
-            };
-
-            HBRUSH hBrush = CreateSolidBrush(RGB(0,0,150));
-            FillRect(hdc, &divRect, hBrush);
-            DeleteObject(hBrush); // Free memory
-
-            // Create a font with the desired size
-            SetBkMode(hdc, TRANSPARENT);
-            HFONT hFontSmall = CreateFont(
-                30,                   // Font height
-                0,                    // Font width (0 to let Windows choose the best width)
-                0,                    // Escapement angle
-                0,                    // Orientation angle
-                FW_DEMIBOLD,          // Font weight
-                FALSE,                // Italic
-                FALSE,                 // Underline
-                FALSE,                // Strikeout
-                ANSI_CHARSET,         // Character set
-                OUT_DEFAULT_PRECIS,   // Output precision
-                CLIP_DEFAULT_PRECIS,  // Clipping precision
-                DEFAULT_QUALITY,      // Output quality
-                DEFAULT_PITCH | FF_DONTCARE, // Pitch and family
-                TEXT("Arial")         // Font name
-            );
-
-            HFONT hFontLarge = CreateFont(
-                60,                   // Font height
-                0,                    // Font width (0 to let Windows choose the best width)
-                0,                    // Escapement angle
-                0,                    // Orientation angle
-                FW_DEMIBOLD,          // Font weight
-                FALSE,                // Italic
-                FALSE,                 // Underline
-                FALSE,                // Strikeout
-                ANSI_CHARSET,         // Character set
-                OUT_DEFAULT_PRECIS,   // Output precision
-                CLIP_DEFAULT_PRECIS,  // Clipping precision
-                DEFAULT_QUALITY,      // Output quality
-                DEFAULT_PITCH | FF_DONTCARE, // Pitch and family
-                TEXT("Arial")         // Font name
-            );
-
-            // Use smaller font for the first TextOut
-            HFONT hOldFont = SelectObject(hdc, hFontLarge);
-            SetTextColor(hdc, RGB(255, 255, 255));
-            TextOut(hdc, 10, 10, TEXT("Paint-C"), lstrlen(TEXT("Paint-C")));
-            SelectObject(hdc, hOldFont);
-
-            // Use larger font for the second TextOut
-            hOldFont = SelectObject(hdc, hFontSmall);
-            SetTextColor(hdc, RGB(255, 255, 255));
-            TextOut(hdc, 585, 10, TEXT("Brush Size"), lstrlen(TEXT("Brush Size")));
-            SelectObject(hdc, hOldFont);
-
-            // Delete fonts when they are no longer needed
-            DeleteObject(hFontSmall);
-            DeleteObject(hFontLarge);
-
-            HICON hIcon = (HICON)LoadImage(NULL, "./assets/icon.ico", IMAGE_ICON, 0, 0, LR_LOADFROMFILE);
-            if (hIcon != NULL) {
-                int xPos = 200;  // X position in pixels
-                int yPos = (TOOLBAR_HEIGHT / 2 ) - (64 / 2);  // Y position in pixels
-
-                int iconWidth = 64;  // Width of the icon in pixels
-                int iconHeight = 64; // Height of the icon in pixels
-
-                // Draw the icon at the specified position and size
-                DrawIconEx(hdc, xPos, yPos, hIcon, iconWidth, iconHeight, 0, NULL, DI_NORMAL);
-                DestroyIcon(hIcon);
-            } else {
-                logDebug(&logger, "Hicon is NULL");
-            }
+            // The drawing itself lives in the canvas, only the invalidated part is copied
+            canvas -> damage.presentedPixels = presentCanvas(hdc, canvas, &params -> staging, painter.rcPaint);
 
-            SetBkMode(hdc, OPAQUE);
-            for(int i = 0; i < COLOR_BUTTON_GRID_SIZE * COLOR_BUTTON_GRID_SIZE; ++i) {
-                int buttonX = COLOR_GRID_OFFSET_X + (i % COLOR_BUTTON_GRID_SIZE) * (COLOR_BUTTON_WIDTH + COLOR_BUTTON_SPACING) + COLOR_BUTTON_SPACING;
-                int buttonY = (i / COLOR_BUTTON_GRID_SIZE) * (COLOR_BUTTON_HEIGHT + COLOR_BUTTON_SPACING) + COLOR_BUTTON_SPACING;
-                RECT colorBorder = {
-                    buttonX - 1, buttonY - 1,
-                    buttonX + COLOR_BUTTON_WIDTH + 1, buttonY + COLOR_BUTTON_HEIGHT + 1
+            // The toolbar is only redrawn when the invalidated region reaches it
+            if (painter.rcPaint.top < currRect.top + TOOLBAR_HEIGHT) {
+                RECT divRect = {
+                    currRect.left,
+                    currRect.top,
+                    currRect.right,
+                    currRect.top + TOOLBAR_HEIGHT
                 };
-                HBRUSH hColorBorderBrush = CreateSolidBrush(RGB(255,255,255));
-                FillRect(hdc, &colorBorder, hColorBorderBrush);
-                DeleteObject(hColorBorderBrush);
+
+                FillRect(hdc, &divRect, resourceCacheBrush(resources, RGB(0,0,150)));
+
+                // Fonts of the title and of the brush size label, created by the first paint
+                SetBkMode(hdc, TRANSPARENT);
+                HFONT hFontSmall = resourceCacheFont(resources, 30, FW_DEMIBOLD, DEFAULT_QUALITY, TEXT("Arial"));
+                HFONT hFontLarge = resourceCacheFont(resources, 60, FW_DEMIBOLD, DEFAULT_QUALITY, TEXT("Arial"));
+
+                // Use smaller font for the first TextOut
+                HFONT hOldFont = SelectObject(hdc, hFontLarge);
+                SetTextColor(hdc, RGB(255, 255, 255));
+                TextOut(hdc, 10, 10, TEXT("Paint-C"), lstrlen(TEXT("Paint-C")));
+                SelectObject(hdc, hOldFont);
+
+                // Use larger font for the second TextOut
+                hOldFont = SelectObject(hdc, hFontSmall);
+                SetTextColor(hdc, RGB(255, 255, 255));
+                TextOut(hdc, 585, 10, TEXT("Brush Size"), lstrlen(TEXT("Brush Size")));
+                SelectObject(hdc, hOldFont);
+
+                HICON hIcon = resourceCacheIcon(resources, "./assets/icon.ico", 0);
+                if (hIcon != NULL) {
+                    int xPos = 200;  // X position in pixels
+                    int yPos = (TOOLBAR_HEIGHT / 2 ) - (64 / 2);  // Y position in pixels
+
+                    int iconWidth = 64;  // Width of the icon in pixels
+                    int iconHeight = 64; // Height of the icon in pixels
+
+                    // Draw the icon at the specified position and size
+                    DrawIconEx(hdc, xPos, yPos, hIcon, iconWidth, iconHeight, 0, NULL, DI_NORMAL);
+                } else {
+                    logDebug(&logger, "Hicon is NULL");
+                }
+
+                SetBkMode(hdc, OPAQUE);
+                for(int i = 0; i < COLOR_BUTTON_GRID_SIZE * COLOR_BUTTON_GRID_SIZE; ++i) {
+                    int buttonX = COLOR_GRID_OFFSET_X + (i % COLOR_BUTTON_GRID_SIZE) * (COLOR_BUTTON_WIDTH + COLOR_BUTTON_SPACING) + COLOR_BUTTON_SPACING;
+                    int buttonY = (i / COLOR_BUTTON_GRID_SIZE) * (COLOR_BUTTON_HEIGHT + COLOR_BUTTON_SPACING) + COLOR_BUTTON_SPACING;
+                    RECT colorBorder = {
+                        buttonX - 1, buttonY - 1,
+                        buttonX + COLOR_BUTTON_WIDTH + 1, buttonY + COLOR_BUTTON_HEIGHT + 1
+                    };
+                    FillRect(hdc, &colorBorder, resourceCacheBrush(resources, RGB(255,255,255)));
+                }
             }
 
             if (brush->getBrushMode(brush) == ID_TEXT_MODE && GetFocus() == mainHWND) {
@@ -698,22 +781,8 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
 
                 RECT clientRect;
                 GetClientRect(mainHWND, &clientRect);
-                HFONT hFont = CreateFont(
-                    brush -> getBrushSize(brush), // Font height
-                    0,                  // Font width
-                    0,                  // Escapement angle
-                    0,                  // Orientation angle
-                    FW_NORMAL,          // Font weight
-                    FALSE,              // Italic
-                    FALSE,              // Underline
-                    FALSE,              // Strikeout
-                    ANSI_CHARSET,       // Character set
-                    OUT_DEFAULT_PRECIS, // Output precision
-                    CLIP_DEFAULT_PRECIS,// Clipping precision
-                    DEFAULT_QUALITY,    // Output quality
-                    DEFAULT_PITCH,      // Pitch and family
-                    TEXT("Arial")       // Font name
-                );
+                // Same font as the text committed to the canvas by renderText
+                HFONT hFont = resourceCacheFont(resources, brush -> getBrushSize(brush), FW_NORMAL, NONANTIALIASED_QUALITY, TEXT("Arial"));
                 HFONT hOldFont = (HFONT)SelectObject(hdc, hFont);
 
                 // Set text color
@@ -734,7 +803,6 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
 
                 // Clean up
                 SelectObject(hdc, hOldFont);
-                DeleteObject(hFont);
             }
             EndPaint(mainHWND, &painter);
             break;
@@ -754,9 +822,9 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                     buttonX - 1, buttonY - 1,
                     buttonX + COLOR_BUTTON_WIDTH + 1, buttonY + COLOR_BUTTON_HEIGHT + 1
                 };
-                HBRUSH hColorBorderBrush = CreateSolidBrush(RGB(255,255,255));
-                FillRect(GetDC(mainHWND), &colorBorder, hColorBorderBrush);
-                DeleteObject(hColorBorderBrush);
+                HDC hdc = GetDC(mainHWND);
+                FillRect(hdc, &colorBorder, resourceCacheBrush(resources, RGB(255,255,255)));
+                ReleaseDC(mainHWND, hdc);
             }
 
             // Custom color textfield and button!
@@ -778,15 +846,26 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
             HDC hdcButton = (HDC)wParam;
             HWND hButton = (HWND)lParam;
             int buttonID = GetDlgCtrlID(hButton);
+            if (buttonID < ID_COLOR_BLACK || buttonID > ID_COLOR_BROWN) {
+                return DefWindowProc(mainHWND, uMsg, wParam, lParam); // SAVE, LOAD and the other buttons
+            }
             SetBkColor(hdcButton, buttonColors[buttonID - ID_COLOR_BLACK]);
-            return (LRESULT)CreateSolidBrush(buttonColors[buttonID - ID_COLOR_BLACK]);
+            return (LRESULT)resourceCacheBrush(resources, buttonColors[buttonID - ID_COLOR_BLACK]);
         }
         case WM_LBUTTONDOWN: {
             startPoint.x = LOWORD(lParam);
             startPoint.y = HIWORD(lParam);
             if (brush->getBrushMode(brush) != ID_LINE_MODE && brush->getBrushMode(brush) != ID_TEXT_MODE) {
-                drawPixel(mainHWND, brush, startPoint.x, startPoint.y);
+                // The whole stroke, until the button is released, is undone at once
+                beginOperation(history, document);
+                drawPixel(mainHWND, canvas, journal, document, brush, startPoint.x, startPoint.y);
             } else if (brush->getBrushMode(brush) == ID_TEXT_MODE) {
+                // Keep the previous text before starting a new one
+                beginOperation(history, document);
+                commitText(mainHWND, canvas, journal, document, brush, textStartPoint, textBuffer);
+                endOperation(history, document);
+                invalidateTextOverlay(mainHWND, resources, brush, textStartPoint, textBuffer);
+
                 textStartPoint.x = LOWORD(lParam);
                 textStartPoint.y = HIWORD(lParam);
 
@@ -795,7 +874,7 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                 textProperties.numLines = 1;
 
                 SetFocus(mainHWND);
-                InvalidateRect(mainHWND, NULL, TRUE);
+                invalidateTextOverlay(mainHWND, resources, brush, textStartPoint, textBuffer);
             }
             break;
         }
@@ -804,8 +883,10 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                 POINT endPoint;
                 endPoint.x = LOWORD(lParam);
                 endPoint.y = HIWORD(lParam);
-                drawCustomLine(mainHWND, brush, startPoint.x, startPoint.y, endPoint.x, endPoint.y, &logger);
+                beginOperation(history, document);
+                drawCustomLine(mainHWND, canvas, journal, document, brush, startPoint.x, startPoint.y, endPoint.x, endPoint.y, &logger);
             }
+            endOperation(history, document);
             break;
         }
         case WM_MOUSEMOVE: {
@@ -816,7 +897,15 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                 POINT currentPoint;
                 currentPoint.x = LOWORD(lParam);
                 currentPoint.y = HIWORD(lParam);
-                drawPixel(mainHWND, brush, currentPoint.x, currentPoint.y);
+                if (!history -> recording) {
+                    beginOperation(history, document); // The button was pressed outside of the window
+                }
+                if (brush -> getBrushMode(brush) == ID_GRID_MODE) {
+                    drawPixel(mainHWND, canvas, journal, document, brush, currentPoint.x, currentPoint.y);
+                } else {
+                    // Fill the whole path since the last sample, fast moves leave no gaps
+                    drawStroke(mainHWND, canvas, journal, document, brush, startPoint, currentPoint);
+                }
                 startPoint = currentPoint;
             }
             break;
@@ -836,20 +925,20 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
         // Inside the WM_CHAR message handler
         case WM_CHAR: {
             if (brush->getBrushMode(brush) == ID_TEXT_MODE) {
+                // Only the old and the new extent of the text are repainted
+                invalidateTextOverlay(mainHWND, resources, brush, textStartPoint, textBuffer);
                 char inputChar = (char)wParam;
                 if (inputChar == '\r') {
                     // Handle newline
                     if (textProperties.numLines < 20) { // Maximum 20 lines for demonstration
                         strcat(textBuffer, "\r\n"); // Append newline characters to the existing buffer
                         textProperties.numLines++; // Increment line count
-                        InvalidateRect(mainHWND, NULL, TRUE); // Redraw window
                     }
                 } else if (inputChar == '\b') {
                     // Handle backspace
                     int len = strlen(textBuffer);
                     if (len > 0) {
                         textBuffer[len - 1] = '\0'; // Remove last character
-                        InvalidateRect(mainHWND, NULL, TRUE); // Redraw window
                     }
                 } else {
                     // Append the character to the text buffer
@@ -857,24 +946,39 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                     if (len < sizeof(textBuffer) - 1) {
                         textBuffer[len] = inputChar;
                         textBuffer[len + 1] = '\0';
-                        InvalidateRect(mainHWND, NULL, TRUE); // Redraw window
                     }
                 }
+                invalidateTextOverlay(mainHWND, resources, brush, textStartPoint, textBuffer);
             }
             break;
         }
         case WM_COMMAND: {
 
             if (LOWORD(wParam) == ID_CUSTOM_COLOR_LABEL && HIWORD(wParam) == EN_CHANGE) {
-                char buffer[12];
+                char buffer[64];
                 GetWindowText(GetDlgItem(mainHWND, ID_CUSTOM_COLOR_LABEL), buffer, sizeof(buffer));
                 int r,g,b;
-                if (sscanf(buffer, "%d,%d,%d", &r, &g, &b) == 3) {
+                int valid = (sscanf(buffer, "%d,%d,%d", &r, &g, &b) == 3);
+                const char* colorName = NULL;
+                if (!valid) {
+                    // Not an RGB value: maybe the name of a color of the palette, such as "Ruby Red"
+                    char name[64];
+                    strcpy(name, buffer);
+                    int index = colorTableFindName(colorTable, trim(name));
+                    if (index >= 0) {
+                        r = colorTable -> red[index];
+                        g = colorTable -> green[index];
+                        b = colorTable -> blue[index];
+                        colorName = colorTableName(colorTable, index);
+                        valid = 1;
+                    }
+                }
+                if (valid) {
                     customColor[0] = r;
                     customColor[1] = g;
                     customColor[2] = b;
                     
-                    const char* closestColorName = getClosestColorName(colorTable, r, g, b);
+                    const char* closestColorName = (colorName != NULL) ? colorName : getClosestColorName(colorTable, r, g, b);
                     SetWindowText(GetDlgItem(mainHWND, ID_CUSTOM_BUTTON_COLOR), closestColorName);
                     if (useCustomColor) {
                         setColor(brush, r, g, b);
@@ -883,6 +987,15 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                 }
                 logDebug(&logger, "Text Value changed: %s", buffer);
             }
+            if (brush -> getBrushMode(brush) == ID_TEXT_MODE && LOWORD(wParam) >= ID_FREE_MODE && LOWORD(wParam) <= ID_ERASER_MODE) {
+                // Leaving (or restarting) text mode, the typed text becomes part of the drawing
+                beginOperation(history, document);
+                commitText(mainHWND, canvas, journal, document, brush, textStartPoint, textBuffer);
+                endOperation(history, document);
+                invalidateTextOverlay(mainHWND, resources, brush, textStartPoint, textBuffer);
+                textBuffer[0] = '\0';
+                textProperties.numLines = 1;
+            }
             if (brush -> getBrushMode(brush) != ID_ERASER_MODE) {
                 int tempColor[] = {brush -> getCurrentColor(brush)[0], brush -> getCurrentColor(brush)[1], brush -> getCurrentColor(brush)[2]};
                 for(int i = 0; i < 3; i++) lastUsedColor[i] = tempColor[i];
@@ -1004,37 +1117,83 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
                     break;
                 }
                 case ID_RESET: {
-                    resetCanvas(mainHWND);
+                    beginOperation(history, document);
+                    resetCanvas(mainHWND, canvas, journal, document);
+                    endOperation(history, document);
+                    break;
+                }
+                case ID_UNDO: {
+                    endOperation(history, document);
+                    if (historyUndo(history)) {
+                        documentUndo(document);
+                        journalRecordTiles(journal, canvas, historyLastChange(history));
+                        presentDamage(mainHWND, canvas);
+                    }
+                    break;
+                }
+                case ID_REDO: {
+                    endOperation(history, document);
+                    if (historyRedo(history)) {
+                        documentRedo(document);
+                        journalRecordTiles(journal, canvas, historyLastChange(history));
+                        presentDamage(mainHWND, canvas);
+                    }
                     break;
                 }
                 case ID_SAVE_BUTTON: {
-                    DWORD start = GetTickCount();
-                    logDebug(&logger, "Saving started...");
-                    savingFile = fopen("./assets/pixel_data.csv", "w");
-                    if (savingFile == NULL) {
-                        logError(&logger, 584, "Failed to open file for writing");
+                    if (params -> saveJob != NULL) {
+                        logDebug(&logger, "A save is already running.");
                         break;
                     }
-                    capturePixelData(savingFile, mainHWND, &logger);
-                    fclose(savingFile);
-
-                    DWORD end = GetTickCount();
-                    DWORD duration = end - start;
-                    logDebug(&logger, "Saving done.");
-                    char durationStr[256];
-                    logDebug(&logger, "Time taken for saving: %lu milliseconds", duration);
+                    // Only the copy of the canvas happens here, drawing goes on while the worker writes it
+                    logDebug(&logger, "Saving started...");
+                    params -> saveJob = startSave(mainHWND, canvas, params -> savedGeneration, params -> store, &params -> logger);
+                    if (params -> saveJob != NULL) {
+                        journalMarkSave(journal); // Operations from here on are not in the snapshot
+                        SetTimer(mainHWND, ID_PROGRESS_TIMER, PROGRESS_POLL_MS, NULL);
+                    }
+                    break;
+                }
+                case ID_PROGRESS_CANCEL: {
+                    if (params -> saveJob != NULL) {
+                        atomic_store(&params -> saveJob -> progress.cancelled, 1);
+                    }
                     break;
                 }
                 case ID_LOAD_BUTTON: {
+                    if (params -> saveJob != NULL) {
+                        logDebug(&logger, "Loading waits for the running save.");
+                        break;
+                    }
                     DWORD start = GetTickCount();
                     logDebug(&logger, "Loading started...");
-                    savingFile = fopen("./assets/pixel_data.csv", "r");
-                    if (savingFile == NULL) {
-                        logError(&logger, 602, "Failed to open file for reading");
-                        break;
+                    beginOperation(history, document);
+                    int first = document -> count;
+                    if (documentLoad(document, DOCUMENT_FILE)) {
+                        // Drawn again from its commands, scaled to this canvas
+                        documentRender(document, first, document -> count, canvas, renderText, resources);
+                        endOperation(history, document);
+                        for (int i = first; i < document -> count; ++i) {
+                            journalRecord(journal, &document -> commands[i]);
+                        }
+                        presentDamage(mainHWND, canvas);
+                    } else if (snapshotLoad(canvas, SNAPSHOT_FILE, &logger)) {
+                        documentMarkRaster(document);
+                        endOperation(history, document);
+                        params -> savedGeneration = canvas -> generation; // Nothing to save until it changes
+                        journalRebase(journal, JOURNAL_BASE_SNAPSHOT); // The canvas is the snapshot again
+                        presentDamage(mainHWND, canvas);
+                    } else {
+                        // Drawings saved before the snapshot format are still in the legacy CSV
+                        if (!pixelCsvLoad(canvas, "./assets/pixel_data.csv", threadProcessorCount(), &logger)) {
+                            endOperation(history, document);
+                            break;
+                        }
+                        documentMarkRaster(document);
+                        endOperation(history, document);
+                        journalRecordTiles(journal, canvas, historyLastChange(history));
+                        presentDamage(mainHWND, canvas);
                     }
-                    loadPixelData(savingFile, mainHWND, &logger);
-                    fclose(savingFile);
 
                     DWORD end = GetTickCount();
                     DWORD duration = end - start;
@@ -1046,8 +1205,40 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
             }
             break;
         }
+        case WM_TIMER: {
+            if (wParam == ID_PROGRESS_TIMER && params -> saveJob != NULL) {
+                SaveJob * job = params -> saveJob;
+                if (atomic_load(&job -> finished)) {
+                    KillTimer(mainHWND, ID_PROGRESS_TIMER);
+                    uint64_t saved = finishSave(job, journal, document);
+                    if (saved > 0) {
+                        params -> savedGeneration = saved; // The next save only writes the tiles changed from here
+                    }
+                    params -> saveJob = NULL;
+                } else if (job -> progress.tilesTotal > 0) {
+                    UpdateProgressBar(job -> hProgressBar, atomic_load(&job -> progress.tilesDone) * 100 / job -> progress.tilesTotal);
+                }
+            } else if (wParam == ID_JOURNAL_TIMER) {
+                journalFlush(journal); // Autosave: only the operations since the last flush are written
+            } else if (wParam == ID_STATUS_TIMER) {
+                updateGdiStatusText(resources, hStatusBar);
+            }
+            break;
+        }
         case WM_DESTROY: {
-            DestroyCursor(hCustomCursor);
+            // A running save is allowed to complete, the drawing is not lost on exit
+            if (params -> saveJob != NULL) {
+                KillTimer(mainHWND, ID_PROGRESS_TIMER);
+                finishSave(params -> saveJob, journal, document);
+                params -> saveJob = NULL;
+            }
+            KillTimer(mainHWND, ID_JOURNAL_TIMER);
+            KillTimer(mainHWND, ID_STATUS_TIMER);
+
+            // The icons are taken back from the window before the cache releases them
+            SendMessage(mainHWND, WM_SETICON, ICON_SMALL, 0);
+            SendMessage(mainHWND, WM_SETICON, ICON_BIG, 0);
+            resourceCacheRelease(resources);
             PostQuitMessage(0);
         }
         default: {
@@ -1056,20 +1247,251 @@ LRESULT CALLBACK WindowProc(HWND mainHWND, UINT uMsg, WPARAM wParam, LPARAM lPar
     }
     char buffer[50];
     wsprintf(buffer, TEXT("Brush Size: %d"), brush -> getBrushSize(brush));
-    updateStatusBarText(brush, hStatusBar);
+    updateStatusBarText(brush, canvas, hStatusBar);
     return 0;
 }
 
 /**
- * @brief Resets the canvas background color to white.
+ * @brief Resets the canvas to its white background.
  * 
- * @param hwnd Handle to the window whose canvas background color will be reset.
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance to be cleared.
+ * @param journal Pointer to the Journal instance, started again from a blank canvas.
+ * @param document Pointer to the Document instance.
  */
+void resetCanvas(HWND hwnd, Canvas * canvas, Journal * journal, Document * document) {
+    PaintCommand command = { 0 };
+    command.type = COMMAND_RESET;
+    runCommand(hwnd, canvas, journal, document, &command);
+}
 
-void resetCanvas(HWND hwnd) {
-    SetClassLongPtr(hwnd, GCLP_HBRBACKGROUND, (LONG_PTR) CreateSolidBrush(RGB(255,255,255)));
-    InvalidateRect(hwnd, NULL, TRUE);
-    UpdateWindow(hwnd);
+/**
+ * @brief Applies a drawing operation to the canvas, appends it to the journal and shows the changed region.
+ * 
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance.
+ * @param journal Pointer to the Journal instance.
+ * @param document Pointer to the Document instance.
+ * @param command Pointer to the operation.
+ */
+void runCommand(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, const PaintCommand * command) {
+    winParams * params = (winParams*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    commandApply(canvas, command, renderText, params -> resources, canvas -> log);
+    journalRecord(journal, command);
+    documentAdd(document, command);
+    presentDamage(hwnd, canvas);
+}
+
+/**
+ * @brief Opens an undoable operation in the history and in the document, closing the open one first.
+ * 
+ * @param history Pointer to the History instance.
+ * @param document Pointer to the Document instance.
+ */
+void beginOperation(History * history, Document * document) {
+    endOperation(history, document);
+    historyBeginOperation(history);
+    documentBeginOperation(document);
+}
+
+/**
+ * @brief Closes the undoable operation; the document drops it too when the history does not keep it.
+ * 
+ * @param history Pointer to the History instance.
+ * @param document Pointer to the Document instance.
+ */
+void endOperation(History * history, Document * document) {
+    documentEndOperation(document, historyEndOperation(history));
+}
+
+/**
+ * @brief Copies a region of the canvas to a device context, clipped to the drawable area.
+ * 
+ * @param hdc Device context to draw on.
+ * @param canvas Pointer to the Canvas instance.
+ * @param staging Buffer the region is read into, grown if it is too small.
+ * @param rect Region of the canvas to copy, in client coordinates.
+ * @return Number of pixels copied.
+ */
+long presentCanvas(HDC hdc, Canvas * canvas, StagingBuffer * staging, RECT rect) {
+    if (rect.left < canvas -> clipLeft) rect.left = canvas -> clipLeft;
+    if (rect.top < canvas -> clipTop) rect.top = canvas -> clipTop;
+    if (rect.right > canvas -> clipRight) rect.right = canvas -> clipRight;
+    if (rect.bottom > canvas -> clipBottom) rect.bottom = canvas -> clipBottom;
+    if (rect.left >= rect.right || rect.top >= rect.bottom) {
+        return 0;
+    }
+
+    // The region is read into one contiguous buffer, kept between frames, and sent with a single call
+    int width = rect.right - rect.left;
+    int height = rect.bottom - rect.top;
+    if ((size_t)width * height > staging -> size) {
+        free(staging -> pixels);
+        staging -> size = (size_t)width * height;
+        staging -> pixels = malloc(sizeof(uint32_t) * staging -> size);
+        if (staging -> pixels == NULL) {
+            logError(canvas -> log, 1235, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+    }
+    canvasReadRegion(canvas, rect.left, rect.top, width, height, staging -> pixels, width);
+
+    // Top-down 32 bits DIB, same layout as the canvas pixels
+    BITMAPINFO bmi = { 0 };
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    StretchDIBits(hdc, rect.left, rect.top, width, height, 0, 0, width, height, staging -> pixels, &bmi, DIB_RGB_COLORS, SRCCOPY);
+    return (long)(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+/**
+ * @brief Copies every region changed since the last frame to the window, and nothing else.
+ * 
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance.
+ */
+void presentDamage(HWND hwnd, Canvas * canvas) {
+    Damage* damage = &canvas -> damage;
+    if (damage -> count == 0) {
+        return;
+    }
+
+    winParams * params = (winParams*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    HDC hdc = GetDC(hwnd);
+    long presented = 0;
+    for (int i = 0; i < damage -> count; ++i) {
+        RECT rect = { damage -> rects[i].left, damage -> rects[i].top, damage -> rects[i].right, damage -> rects[i].bottom };
+        presented += presentCanvas(hdc, canvas, &params -> staging, rect);
+    }
+    ReleaseDC(hwnd, hdc);
+
+    damage -> presentedPixels = presented;
+    damageReset(damage);
+}
+
+/**
+ * @brief Invalidates the area covered by the text overlay (text and blinking bar) drawn by WM_PAINT.
+ * 
+ * @param hwnd Handle to the main application window.
+ * @param resources Pointer to the ResourceCache holding the font of the text.
+ * @param brush Pointer to the Brush instance (its size is the font height).
+ * @param origin Top-left corner of the text.
+ * @param text The text being typed.
+ */
+void invalidateTextOverlay(HWND hwnd, ResourceCache * resources, Brush * brush, POINT origin, const char* text) {
+    HDC hdc = GetDC(hwnd);
+    HFONT hFont = resourceCacheFont(resources, brush -> getBrushSize(brush), FW_NORMAL, NONANTIALIASED_QUALITY, TEXT("Arial"));
+    HFONT hOldFont = (HFONT)SelectObject(hdc, hFont);
+
+    // Same layout rectangle as the overlay
+    RECT clientRect;
+    GetClientRect(hwnd, &clientRect);
+    RECT textRect = { origin.x, origin.y, clientRect.right, clientRect.bottom };
+    DrawText(hdc, text, -1, &textRect, DT_LEFT | DT_WORDBREAK | DT_CALCRECT);
+
+    SelectObject(hdc, hOldFont);
+    ReleaseDC(hwnd, hdc);
+
+    // Cover the blinking bar and a couple of pixels of glyph overhang
+    textRect.right = max(textRect.right, origin.x + 2) + 2;
+    textRect.bottom = max(textRect.bottom, origin.y + brush -> getBrushSize(brush)) + 2;
+    InvalidateRect(hwnd, &textRect, FALSE);
+}
+
+/**
+ * @brief Rasterizes the text typed in text mode into the canvas, using the same layout as the WM_PAINT overlay.
+ * 
+ * @param hwnd Handle to the main application window.
+ * @param canvas Pointer to the Canvas instance receiving the text.
+ * @param journal Pointer to the Journal instance.
+ * @param document Pointer to the Document instance.
+ * @param brush Pointer to the Brush instance (its size is the font height).
+ * @param origin Top-left corner of the text.
+ * @param text The text to commit.
+ */
+void commitText(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, POINT origin, const char* text) {
+    if (text[0] == '\0') {
+        return;
+    }
+
+    RECT clientRect;
+    GetClientRect(hwnd, &clientRect);
+
+    // The wrap width is part of the command, replaying it does not depend on the window size
+    PaintCommand command = { 0 };
+    command.type = COMMAND_TEXT;
+    command.x0 = origin.x;
+    command.y0 = origin.y;
+    command.x1 = clientRect.right - origin.x;
+    command.size = brush -> getBrushSize(brush);
+    command.color = CANVAS_RGB(0, 0, 0);
+    command.text = text;
+    runCommand(hwnd, canvas, journal, document, &command);
+}
+
+/**
+ * @brief Renders a text command with GDI as a mask, then fills the lit runs of the mask on the canvas.
+ * 
+ * @param data Pointer to the ResourceCache of the window, which holds the font.
+ * @param canvas Pointer to the Canvas instance receiving the text.
+ * @param command Pointer to the COMMAND_TEXT.
+ */
+void renderText(void* data, Canvas * canvas, const PaintCommand * command) {
+    HDC memDC = CreateCompatibleDC(NULL);
+    // Aliased glyphs, every lit pixel of the mask is filled with the full color
+    HFONT hFont = resourceCacheFont((ResourceCache*)data, command -> size, FW_NORMAL, NONANTIALIASED_QUALITY, TEXT("Arial"));
+    HFONT hOldFont = (HFONT)SelectObject(memDC, hFont);
+
+    RECT textRect = { 0, 0, command -> x1, canvas -> height - command -> y0 };
+    DrawText(memDC, command -> text, -1, &textRect, DT_LEFT | DT_WORDBREAK | DT_CALCRECT);
+
+    int width = textRect.right;
+    int height = textRect.bottom;
+    if (width > 0 && height > 0) {
+        // Render the glyphs as a white on black mask
+        BITMAPINFO bmi = { 0 };
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = width;
+        bmi.bmiHeader.biHeight = -height;
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        uint32_t* mask = NULL;
+        HBITMAP hMask = CreateDIBSection(memDC, &bmi, DIB_RGB_COLORS, (void**)&mask, NULL, 0);
+        if (hMask != NULL) {
+            HGDIOBJ hOldBitmap = SelectObject(memDC, hMask);
+            memset(mask, 0, sizeof(uint32_t) * width * height);
+            SetBkMode(memDC, TRANSPARENT);
+            SetTextColor(memDC, RGB(255, 255, 255));
+            DrawText(memDC, command -> text, -1, &textRect, DT_LEFT | DT_WORDBREAK);
+            GdiFlush();
+
+            // Every run of lit mask pixels becomes one span on the canvas
+            for (int y = 0; y < height; ++y) {
+                uint32_t* row = mask + y * width;
+                int x = 0;
+                while (x < width) {
+                    while (x < width && row[x] == 0) x++;
+                    int runStart = x;
+                    while (x < width && row[x] != 0) x++;
+                    if (x > runStart) {
+                        canvasFillSpan(canvas, command -> y0 + y, command -> x0 + runStart, command -> x0 + x, command -> color);
+                    }
+                }
+            }
+
+            SelectObject(memDC, hOldBitmap);
+            DeleteObject(hMask);
+        }
+    }
+
+    SelectObject(memDC, hOldFont);
+    DeleteDC(memDC);
 }
 
 /**
@@ -1114,22 +1536,23 @@ BOOL intersect(RECT rect, int x, int y, int offset) {
 }
 
 /**
- * @brief Draws a pixel on the canvas.
+ * @brief Draws a pixel on the canvas and shows the changed region.
  * 
- * @param hwnd Handle to the window whose canvas the pixel will be drawn on.
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance the pixel will be drawn on.
+ * @param journal Pointer to the Journal instance.
+ * @param document Pointer to the Document instance.
  * @param brush Pointer to the Brush struct containing the brush settings.
  * @param x The x-coordinate of the pixel.
  * @param y The y-coordinate of the pixel.
  */
-void drawPixel(HWND hwnd, Brush * brush, int x, int y) {
+void drawPixel(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, int x, int y) {
     int halfsize = brush -> getBrushSize(brush) / 2;
-    HDC hdc = GetDC(hwnd);
 
     RECT currRect;
     GetClientRect(hwnd, &currRect);
     RECT clientRect = { currRect.left, currRect.top, currRect.right, currRect.top + TOOLBAR_HEIGHT};
     if (intersect(clientRect, x, y, halfsize)) {
-        ReleaseDC(hwnd, hdc);
         return;
     }
 
@@ -1139,38 +1562,59 @@ void drawPixel(HWND hwnd, Brush * brush, int x, int y) {
         y = ((y + gridSize / 2) / gridSize) * gridSize;
     }
 
-    LOGBRUSH lb;
-    GetObject(brush -> getColorBrush(brush), sizeof(LOGBRUSH), &lb);
-
-    if (!(brush -> getBrushMode(brush)) == ID_ERASER_MODE) {
-        brush -> getCurrentColor(brush)[0] = GetRValue(lb.lbColor);
-        brush -> getCurrentColor(brush)[1] = GetGValue(lb.lbColor);
-        brush -> getCurrentColor(brush)[2] = GetBValue(lb.lbColor);
-    }
-
-    if (brush -> getBrushDrawMode(brush) == ID_BRUSH_SQUARE_MODE) {
-        // Squared Pixel
-        for(int i = -halfsize; i <= halfsize; ++i) {
-            for(int j = -halfsize; j <= halfsize; ++j) {
-                SetPixel(hdc, x + i, y + j, RGB(brush -> getCurrentColor(brush)[0], brush -> getCurrentColor(brush)[1], brush -> getCurrentColor(brush)[2]));
-            }
-        }
-    } else {
-        // Draw circle
-        for (int i = -halfsize; i <= halfsize; ++i) {
-            for (int j = -halfsize; j <= halfsize; ++j) {
-                if (i * i + j * j <= halfsize * halfsize) {
-                    SetPixel(hdc, x + i, y + j, RGB(brush->getCurrentColor(brush)[0], brush->getCurrentColor(brush)[1], brush->getCurrentColor(brush)[2]));
-                }
-            }
-        }
-    }
+    int* currentColor = brush -> getCurrentColor(brush);
+    PaintCommand command = { 0 };
+    command.type = COMMAND_STAMP;
+    command.x0 = command.x1 = x;
+    command.y0 = command.y1 = y;
+    command.size = brush -> getBrushSize(brush);
+    command.color = CANVAS_RGB(currentColor[0], currentColor[1], currentColor[2]);
+
+    // Square or circle, the stamp is one span fill per row
+    command.shape = (brush -> getBrushDrawMode(brush) == ID_BRUSH_SQUARE_MODE) ? STAMP_SQUARE : STAMP_CIRCLE;
+    runCommand(hwnd, canvas, journal, document, &command);
+}
 
-    ReleaseDC(hwnd, hdc);
+/**
+ * @brief Draws the area swept by the brush between two mouse positions and shows the changed region.
+ * 
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance the stroke will be drawn on.
+ * @param journal Pointer to the Journal instance.
+ * @param document Pointer to the Document instance.
+ * @param brush Pointer to the Brush struct containing the brush settings.
+ * @param from Previous mouse position.
+ * @param to Current mouse position.
+ */
+void drawStroke(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, POINT from, POINT to) {
+    int* currentColor = brush -> getCurrentColor(brush);
+    PaintCommand command = { 0 };
+    command.type = COMMAND_SEGMENT;
+    command.x0 = from.x;
+    command.y0 = from.y;
+    command.x1 = to.x;
+    command.y1 = to.y;
+    command.size = brush -> getBrushSize(brush);
+    command.shape = (brush -> getBrushDrawMode(brush) == ID_BRUSH_SQUARE_MODE) ? STAMP_SQUARE : STAMP_CIRCLE;
+    command.color = CANVAS_RGB(currentColor[0], currentColor[1], currentColor[2]);
+
+    // The canvas clip keeps the stroke out of the toolbar
+    runCommand(hwnd, canvas, journal, document, &command);
 }
 
-void drawCustomLine(HWND hwnd, Brush * brush, int startX, int startY, int endX, int endY, Log * logger) {
-    HDC hdc = GetDC(hwnd);
+/**
+ * @brief Draws a line as thick as the brush on the canvas and shows the changed region.
+ * 
+ * @param hwnd Handle to the window displaying the canvas.
+ * @param canvas Pointer to the Canvas instance the line will be drawn on.
+ * @param journal Pointer to the Journal instance.
+ * @param document Pointer to the Document instance.
+ * @param brush Pointer to the Brush struct containing the brush settings.
+ * @param startX, startY Starting point of the line.
+ * @param endX, endY Ending point of the line.
+ * @param logger Pointer to the log for debug messages.
+ */
+void drawCustomLine(HWND hwnd, Canvas * canvas, Journal * journal, Document * document, Brush * brush, int startX, int startY, int endX, int endY, Log * logger) {
     int halfSize = brush -> getBrushSize(brush) / 2;
 
     logDebug(logger, "Sx: %d, Sy: %d, Ex: %d, Ey: %d", startX, startY, endX, endY);
@@ -1180,65 +1624,65 @@ void drawCustomLine(HWND hwnd, Brush * brush, int startX, int startY, int endX,
     RECT divRect = { currRect.left, currRect.top, currRect.right, currRect.top + TOOLBAR_HEIGHT };
 
     if (intersect(divRect, startX, startY, halfSize)) {
-        ReleaseDC(hwnd, hdc);
         return;
-    } else if (intersect(divRect, endX, endY, halfSize)) {
-        endY = (currRect.top + TOOLBAR_HEIGHT - 1) + halfSize;
     }
 
-    for (int i = -halfSize; i <= halfSize; ++i) {
-        for (int j = -halfSize; j <= halfSize; ++j) {
-            int rectStartX = startX + i;
-            int rectStartY = startY + j;
-            int rectEndX = endX + i;
-            int rectEndY = endY + j;
-
-            LOGBRUSH lb;
-            GetObject(brush -> getColorBrush(brush), sizeof(LOGBRUSH), &lb);
-            
-            if (!(brush -> getBrushMode(brush)) == ID_ERASER_MODE) {
-                brush -> getCurrentColor(brush)[0] = GetRValue(lb.lbColor);
-                brush -> getCurrentColor(brush)[1] = GetGValue(lb.lbColor);
-                brush -> getCurrentColor(brush)[2] = GetBValue(lb.lbColor);
-            }
-
-            // Draw small rectangles between the starting and ending points with currentColor
-            HPEN hPen = CreatePen(PS_SOLID, 1, RGB(brush -> getCurrentColor(brush)[0], brush -> getCurrentColor(brush)[1], brush -> getCurrentColor(brush)[2]));
-            HPEN hOldPen = (HPEN)SelectObject(hdc, hPen);
-
-            MoveToEx(hdc, rectStartX, rectStartY, NULL);
-            LineTo(hdc, rectEndX, rectEndY);
-
-            SelectObject(hdc, hOldPen);
-            DeleteObject(hPen);
-        }
-    }
-    ReleaseDC(hwnd, hdc);
+    int* currentColor = brush -> getCurrentColor(brush);
+    PaintCommand command = { 0 };
+    command.type = COMMAND_LINE;
+    command.x0 = startX;
+    command.y0 = startY;
+    command.x1 = endX;
+    command.y1 = endY;
+    command.size = brush -> getBrushSize(brush);
+    command.color = CANVAS_RGB(currentColor[0], currentColor[1], currentColor[2]);
+
+    // Caps follow the brush draw mode, the part crossing the toolbar is clipped by the canvas
+    command.shape = (brush -> getBrushDrawMode(brush) == ID_BRUSH_SQUARE_MODE) ? STAMP_SQUARE : STAMP_CIRCLE;
+    runCommand(hwnd, canvas, journal, document, &command);
 }
 
 /**
- * @brief Updates the status bar text with information about the brush.
+ * @brief Updates the status bar text with information about the brush and the last frame.
  * 
  * @param brush Pointer to the Brush instance.
+ * @param canvas Pointer to the Canvas instance.
  * @param hStatusBar Handle to the status bar window.
  */
-void updateStatusBarText(Brush * brush, HWND hStatusBar) {
+void updateStatusBarText(Brush * brush, Canvas * canvas, HWND hStatusBar) {
     char brushSizeText[256];
     char colorRGBValueText[256];
     char currentModeText[256];
     char currentMousePositionText[256];
     char copyright[256];
+    char presentedPixelsText[256];
     sprintf_s(brushSizeText, sizeof(brushSizeText), "Brush Size: %d", brush -> getBrushSize(brush));
     sprintf_s(colorRGBValueText, sizeof(colorRGBValueText), "Color: RGB(%d, %d, %d)", brush -> getCurrentColor(brush)[0], brush -> getCurrentColor(brush)[1], brush -> getCurrentColor(brush)[2]);
     sprintf_s(currentModeText, sizeof(currentModeText), "Current Mode: %s", GetCurrentModeText(brush));
     sprintf_s(currentMousePositionText, sizeof(currentMousePositionText), "Mouse Pos = X: %d, Y: %d", brush -> getBrushPos(brush)[0], brush -> getBrushPos(brush)[1]);
     sprintf_s(copyright, sizeof(copyright), "Copyright William Beaudin 2024");
+    sprintf_s(presentedPixelsText, sizeof(presentedPixelsText), "Frame: %ld px", canvas -> damage.presentedPixels);
 
     SendMessage(hStatusBar, SB_SETTEXT, 0, (LPARAM)brushSizeText);
     SendMessage(hStatusBar, SB_SETTEXT, 1, (LPARAM)colorRGBValueText);
     SendMessage(hStatusBar, SB_SETTEXT, 2, (LPARAM)currentModeText);
     SendMessage(hStatusBar, SB_SETTEXT, 3, (LPARAM)currentMousePositionText);
     SendMessage(hStatusBar, SB_SETTEXT, 4, (LPARAM)copyright);
+    SendMessage(hStatusBar, SB_SETTEXT, 5, (LPARAM)presentedPixelsText);
+}
+
+/**
+ * @brief Updates the count of the GDI objects of the process and of the cache in the status bar.
+ * Called by a timer, the count is not needed on every message.
+ * 
+ * @param resources Pointer to the ResourceCache of the window, whose objects are counted.
+ * @param hStatusBar Handle to the status bar window.
+ */
+void updateGdiStatusText(ResourceCache * resources, HWND hStatusBar) {
+    char gdiObjectsText[256];
+    // Stays flat over a session unless something outside of the cache leaks
+    sprintf_s(gdiObjectsText, sizeof(gdiObjectsText), "GDI: %lu objects, %d cached", GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS), resourceCacheLiveCount(resources));
+    SendMessage(hStatusBar, SB_SETTEXT, 6, (LPARAM)gdiObjectsText);
 }
 
 /**
@@ -1262,157 +1706,20 @@ char* GetCurrentModeText(Brush * brush) {
 }
 
 /**
- * @brief Finds the name of the color closest to the specified RGB values in the color table.
+ * @brief Finds the name of the color closest to the specified RGB values in the color table,
+ * compared the way the table's `match` says.
  * 
  * @param colorTable Pointer to the ColorTable instance containing color mappings.
  * @param r The red component of the target color (0-255).
  * @param g The green component of the target color (0-255).
  * @param b The blue component of the target color (0-255).
  * 
- * @return A pointer to the name of the color closest to the specified RGB values.
- * If the color table is empty, returns the first color in the list.
+ * @return A pointer to the name of the color closest to the specified RGB values, the first
+ * one listed on a tie. If the color table is empty, returns an empty string.
  */
 const char* getClosestColorName(ColorTable * colorTable, int r, int g, int b) {
-    Color* closestMatch = NULL;
-    double minDistance = 1.79769e+308;
-
-    for(int i = 0; i < colorTable -> colorCount; ++i) {
-        Color* mapping = &colorTable -> colorMappings[i];
-        double distance = sqrt(pow(mapping -> r - r, 2) + pow(mapping -> g - g, 2) + pow(mapping -> b - b, 2));
-
-        if (distance < minDistance) {
-            minDistance = distance;
-            closestMatch = mapping;
-        }
-    }
-    return (closestMatch != NULL) ? closestMatch -> name : colorTable -> colorMappings[0].name;
-}
-
-/**
- * @brief Captures pixel data from the window and writes it to a file.
- * 
- * @param file The file pointer to write the pixel data to.
- * @param hwnd The handle to the window whose pixel data needs to be captured.
- */
-void capturePixelData(FILE *file, HWND hwnd, Log * log) {
-    // Display progress dialog
-    HWND* inValue = ShowProgressDialog(hwnd, log);
-    if (inValue == NULL) {
-        // Handle error
-        return;
-    }
-    HWND hProgressDialog = inValue[0];
-    HWND hProgressBar = inValue[1];
-    
-    // Get device context of the window
-    HDC hdc = GetDC(hwnd);
-    if (hdc == NULL) {
-        return;
-    }
-
-    // Get the dimensions of the window's client area
-    RECT currRect;
-    GetClientRect(hwnd, &currRect);
-
-    // Calculate total number of pixels
-    int totalPixels = (currRect.right - currRect.left) * (currRect.bottom - currRect.top);
-    int pixelProcessed = 0;
-    const int updateInterval = totalPixels / 100;
-
-    // Create a memory device context compatible with the window's device context
-    HDC memDC = CreateCompatibleDC(hdc);
-    if (memDC == NULL) {
-        ReleaseDC(hwnd, hdc);
-        return;
-    }
-
-    // Create a compatible bitmap to store pixel data
-    HBITMAP hBitmap = CreateCompatibleBitmap(hdc, currRect.right - currRect.left, currRect.bottom - currRect.top);
-    if (hBitmap == NULL) {
-        DeleteDC(memDC);
-        ReleaseDC(hwnd, hdc);
-        return;
-    }
-    HGDIOBJ hOldBitmap = SelectObject(memDC, hBitmap);
-
-    // Copy the window pixels to the memory device context
-    if (!BitBlt(memDC, 0, 0, currRect.right - currRect.left, currRect.bottom - currRect.top, hdc, 0, 0, SRCCOPY)) {
-        SelectObject(memDC, hOldBitmap);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(hwnd, hdc);
-        return;
-    }
-
-    // Process pixel data
-    for (int y = 0; y < currRect.bottom - currRect.top; y++) {
-        for (int x = 0; x < currRect.right - currRect.left; x++) {
-            // Get the color of the pixel at (x, y)
-            COLORREF color = GetPixel(memDC, x, y);
-            if (color == CLR_INVALID) {
-                continue; // Skip invalid pixels
-            }
-            
-            // Extract RGB values from the color
-            BYTE blue = GetBValue(color);
-            BYTE green = GetGValue(color);
-            BYTE red = GetRValue(color);
-
-            // Write pixel information to the file
-            fprintf(file, "%d,%d,%d,%d,%d\n", x, y, red, green, blue);
-            pixelProcessed++;
-            if (pixelProcessed % updateInterval == 0) {
-                int progress = (pixelProcessed * 100) / totalPixels;
-                UpdateProgressBar(hProgressBar, progress);
-            }
-        }
-    }
-
-    // Close progress dialog
-    CloseProgressDialog(hProgressDialog);
-    free(inValue);
-
-    // Clean up resources
-    SelectObject(memDC, hOldBitmap);
-    DeleteObject(hBitmap);
-    DeleteDC(memDC);
-    ReleaseDC(hwnd, hdc);
-}
-
-/**
- * @brief Loads pixel data from a file and sets the corresponding pixels on the window.
- * 
- * @param file The file pointer to read the pixel data from.
- * @param hwnd The handle to the window where pixel data needs to be loaded.
- * @param log Pointer to the log instance for logging errors or debug messages.
- */
-void loadPixelData(FILE *file, HWND hwnd, Log *log) {
-    // Reset file pointer to the beginning
-    rewind(file);
-
-    // Get device context of the window
-    HDC hdc = GetDC(hwnd);
-    if (hdc == NULL) {
-        return;
-    }
-
-    // Allocate memory for reading lines from the file
-    size_t buffer_size = 64;
-    char *buffer = malloc(buffer_size * sizeof(char));
-
-    // Read pixel data from the file and set corresponding pixels on the window
-    while(fgets(buffer, buffer_size, file) != NULL) {
-        int x, y, r, g, b;
-        if (sscanf(buffer, "%d,%d,%d,%d,%d", &x, &y, &r, &g, &b) == 5) {
-            if (r != 255 || g != 255 || b != 255) {
-                SetPixel(hdc, x, y, RGB(r,g,b));
-            }
-        }
-    }
-
-    // Release allocated resources
-    free(buffer);
-    ReleaseDC(hwnd, hdc);
+    int closest = colorTableMatch(colorTable, r, g, b, colorTable -> match);
+    return (closest >= 0) ? colorTableName(colorTable, closest) : "";
 }
 
 /**
@@ -1431,14 +1738,25 @@ HWND* ShowProgressDialog(HWND hwndParent, Log* log) {
         return NULL;
     }
 
-    HWND hProgressBar;
+    // The dialog has its own class so ProgressDialogProc receives the Cancel button
+    static BOOL classRegistered = FALSE;
+    if (!classRegistered) {
+        WNDCLASS dialogClass = { 0 };
+        dialogClass.lpfnWndProc = ProgressDialogProc;
+        dialogClass.hInstance = GetModuleHandle(NULL);
+        dialogClass.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+        dialogClass.lpszClassName = "PaintProgressDialog";
+        classRegistered = RegisterClass(&dialogClass) != 0;
+    }
+
+    HWND hProgressBar = NULL;
     HWND hProgressDialog = CreateWindowEx(
         WS_EX_DLGMODALFRAME,
-        MAKEINTATOM(WC_DIALOG),
+        "PaintProgressDialog",
         "Saving you're drawing...",
-        WS_CAPTION | WS_POPUP,
+        WS_CAPTION | WS_POPUP | WS_SYSMENU,
         CW_USEDEFAULT, CW_USEDEFAULT,
-        300, 60,
+        300, 95,
         hwndParent,
         NULL,
         NULL,
@@ -1464,6 +1782,9 @@ HWND* ShowProgressDialog(HWND hwndParent, Log* log) {
             NULL,
             NULL);
 
+        // Create the cancel button
+        CreateWindow(TEXT("BUTTON"), TEXT("Cancel"), WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON, 205, 30, 80, 25, hProgressDialog, (HMENU)ID_PROGRESS_CANCEL, NULL, NULL);
+
         // Show the dialog
         ShowWindow(hProgressDialog, SW_SHOW);
     } else {
@@ -1514,11 +1835,112 @@ void UpdateProgressBar(HWND hProgressBar, int progress) {
  */
 LRESULT CALLBACK ProgressDialogProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
+        case WM_COMMAND:
         case WM_CLOSE:
-            CloseProgressDialog(hwndDlg);
+            // Cancelling (or closing) only asks the worker to stop, the main window closes the dialog once it has
+            if (uMsg == WM_CLOSE || LOWORD(wParam) == ID_PROGRESS_CANCEL) {
+                EnableWindow(GetDlgItem(hwndDlg, ID_PROGRESS_CANCEL), FALSE);
+                SendMessage(GetWindow(hwndDlg, GW_OWNER), WM_COMMAND, ID_PROGRESS_CANCEL, 0);
+            }
             break;
         default:
             return DefWindowProc(hwndDlg, uMsg, wParam, lParam);
     }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Copies the canvas and starts writing the copy to the snapshot file on a worker thread.
+ * 
+ * Once a save of the run succeeded, only the tiles changed since are copied and added to the
+ * delta file of the snapshot, until it reaches half the size of the snapshot: the next save
+ * then writes the whole canvas again.
+ * 
+ * @param hwnd Handle to the main window, owner of the progress dialog.
+ * @param canvas Pointer to the Canvas instance to save.
+ * @param since Canvas generation of the last save, 0 to write the whole canvas.
+ * @param store Pointer to the TileStore instance the save adds a version to, or NULL.
+ * @param log Pointer to the log, which must outlive the save.
+ * @return The running save, or NULL if the worker could not be started.
+ */
+SaveJob* startSave(HWND hwnd, Canvas * canvas, uint64_t since, TileStore * store, Log * log) {
+    SaveJob* job = malloc(sizeof(SaveJob));
+    if (job == NULL) {
+        logError(log, 1749, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    job -> start = GetTickCount();
+    int whole = (since == 0 || snapshotNeedsBase(SNAPSHOT_FILE));
+    job -> frame = whole ? snapshotCapture(canvas, log) : snapshotCaptureChanges(canvas, since, log);
+    snapshotProgressInit(&job -> progress, job -> frame);
+    atomic_store(&job -> finished, 0);
+    job -> saved = 0;
+    job -> log = log;
+    job -> store = store;
+    job -> version = 0;
+
+    HWND* dialog = ShowProgressDialog(hwnd, log);
+    job -> hProgressDialog = (dialog != NULL) ? dialog[0] : NULL;
+    job -> hProgressBar = (dialog != NULL) ? dialog[1] : NULL;
+    free(dialog);
+
+    job -> thread = threadStart(saveWorker, job, log);
+    if (job -> thread == NULL) {
+        CloseProgressDialog(job -> hProgressDialog);
+        snapshotFrameDeconstructor(job -> frame);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+/**
+ * @brief Body of the save worker thread: encodes and writes the copied canvas, then adds it
+ * to the store, where only the tiles no kept version holds yet are written.
+ * 
+ * @param argument Pointer to the SaveJob being run.
+ */
+void saveWorker(void* argument) {
+    SaveJob* job = argument;
+    job -> saved = snapshotWrite(job -> frame, SNAPSHOT_FILE, &job -> progress, job -> log);
+    if (job -> saved && job -> store != NULL) {
+        job -> version = tileStoreSave(job -> store, job -> frame, STORE_SLOT);
+        tileStorePrune(job -> store, STORE_SLOT, STORE_VERSIONS);
+    }
+    atomic_store(&job -> finished, 1);
+}
+
+/**
+ * @brief Waits for the save worker to return, closes the progress dialog and releases the save.
+ * 
+ * @param job Pointer to the SaveJob, invalid once this returns.
+ * @param journal Pointer to the Journal instance, shortened to what the snapshot misses.
+ * @param document Pointer to the Document instance, written next to the snapshot.
+ * @return Canvas generation the saved files now match, 0 if the save failed.
+ */
+uint64_t finishSave(SaveJob * job, Journal * journal, Document * document) {
+    threadJoin(job -> thread);
+    CloseProgressDialog(job -> hProgressDialog);
+
+    if (job -> saved) {
+        logDebug(job -> log, "Saving done.");
+        logDebug(job -> log, "Time taken for saving: %lu milliseconds", GetTickCount() - job -> start);
+        if (job -> version > 0) {
+            logDebug(job -> log, "Saved as version %d of %s in %s.", job -> version, STORE_SLOT, STORE_DIRECTORY);
+        }
+    } else if (atomic_load(&job -> progress.cancelled)) {
+        logDebug(job -> log, "Saving cancelled.");
+    }
+
+    journalSaveDone(journal, job -> saved);
+    if (job -> saved && !documentSave(document, DOCUMENT_FILE)) {
+        remove(DOCUMENT_FILE); // An older document would no longer match the snapshot
+    }
+
+    // Changes the store missed go in the next save again
+    uint64_t generation = (job -> saved && (job -> store == NULL || job -> version > 0)) ? job -> frame -> generation : 0;
+    snapshotFrameDeconstructor(job -> frame);
+    free(job);
+    return generation;
+}
@@ -0,0 +1,434 @@
+#include <stdlib.h>
+#include <string.h>
+#include "canvas.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TILE_PIXELS (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+/**
+ * @brief Fills `count` pixels starting at `dst` with the same color.
+ *
+ * Uses 16 bytes stores when SSE2 is available, the tail (or the whole run otherwise)
+ * is a plain loop the compiler is free to vectorize.
+ */
+static void fillPixels(uint32_t* restrict dst, int count, uint32_t color) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i pattern = _mm_set1_epi32((int)color);
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128((__m128i*)(dst + i), pattern);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), pattern);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = color;
+    }
+}
+
+/**
+ * @brief Tells whether a whole tile holds only the background color.
+ */
+static int isBackground(const Canvas* canvas, const uint32_t* pixels) {
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        if (pixels[i] != canvas -> background) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int isPending(const Canvas* canvas, int index) {
+    return canvas -> pendingCount > 0 && canvas -> pendingTiles[index];
+}
+
+static void closeSource(Canvas* canvas) {
+    if (canvas -> releaseSource != NULL) {
+        canvas -> releaseSource(canvas -> sourceData);
+    }
+    canvas -> loadTile = NULL;
+    canvas -> releaseSource = NULL;
+    canvas -> sourceData = NULL;
+}
+
+/**
+ * @brief Forgets that a tile waits in the tile source, releasing the source after the last one.
+ */
+static void endPending(Canvas* canvas, int index) {
+    canvas -> pendingTiles[index] = 0;
+    if (--canvas -> pendingCount == 0) {
+        closeSource(canvas);
+    }
+}
+
+/**
+ * @brief Decodes a tile from the tile source if it still waits there.
+ */
+static void loadPending(Canvas* canvas, int index) {
+    if (!isPending(canvas, index)) {
+        return;
+    }
+    uint32_t* tile = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    if (tile == NULL) {
+        logError(canvas -> log, 75, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    canvas -> loadTile(canvas -> sourceData, index, tile);
+    if (isBackground(canvas, tile)) {
+        free(tile);
+    } else {
+        canvas -> tiles[index] = tile;
+        canvas -> allocatedTiles++;
+    }
+    endPending(canvas, index);
+}
+
+/**
+ * @brief Returns the current pixels of a tile, decoding it first if it waits in the tile source.
+ *
+ * Decoding does not change what the canvas shows, so the read functions call this on a const canvas.
+ */
+static uint32_t* tileAt(const Canvas* canvas, int index) {
+    loadPending((Canvas*)canvas, index);
+    return canvas -> tiles[index];
+}
+
+/**
+ * @brief Lets the hook see a tile before its first change in the current operation.
+ */
+static void touchTile(Canvas* canvas, int index) {
+    canvas -> tileGenerations[index] = ++canvas -> generation;
+    if (canvas -> tileOperations[index] != canvas -> operation) {
+        canvas -> tileOperations[index] = canvas -> operation;
+        if (canvas -> beforeTileWrite != NULL) {
+            // The hook reads the old pixels, a waiting tile must be decoded for it
+            loadPending(canvas, index);
+            canvas -> beforeTileWrite(canvas -> hookData, canvas, index);
+        }
+    }
+}
+
+/**
+ * @brief Makes a tile blank, without decoding it if it still waits in the tile source.
+ */
+static void dropTile(Canvas* canvas, int index) {
+    if (isPending(canvas, index)) {
+        endPending(canvas, index);
+    }
+    if (canvas -> tiles[index] != canvas -> blankTile) {
+        free(canvas -> tiles[index]);
+        canvas -> tiles[index] = canvas -> blankTile;
+        canvas -> allocatedTiles--;
+    }
+}
+
+/**
+ * @brief Returns a tile that can be written, giving it its own memory if it was blank.
+ */
+static uint32_t* writableTile(Canvas* canvas, int index) {
+    touchTile(canvas, index);
+    uint32_t* tile = tileAt(canvas, index);
+    if (tile != canvas -> blankTile) {
+        return tile;
+    }
+
+    tile = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    if (tile == NULL) {
+        logError(canvas -> log, 139, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(tile, canvas -> blankTile, sizeof(uint32_t) * TILE_PIXELS);
+    canvas -> tiles[index] = tile;
+    canvas -> allocatedTiles++;
+    return tile;
+}
+
+/**
+ * @brief Records a whole tile as changed.
+ */
+static void damageTile(Canvas* canvas, int index) {
+    int left = (index % canvas -> tilesX) * CANVAS_TILE_SIZE;
+    int top = (index / canvas -> tilesX) * CANVAS_TILE_SIZE;
+    damageAdd(&canvas -> damage, left, top,
+              (left + CANVAS_TILE_SIZE < canvas -> width) ? left + CANVAS_TILE_SIZE : canvas -> width,
+              (top + CANVAS_TILE_SIZE < canvas -> height) ? top + CANVAS_TILE_SIZE : canvas -> height);
+}
+
+Canvas* canvasConstructor(int width, int height, uint32_t background, Log* log) {
+    Canvas* canvas = malloc(sizeof(Canvas));
+    if (canvas == NULL) {
+        logError(log, 162, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    canvas -> width = width;
+    canvas -> height = height;
+    canvas -> tilesX = (width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    canvas -> tilesY = (height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    canvas -> allocatedTiles = 0;
+    canvas -> background = background;
+    canvas -> log = log;
+    canvas -> operation = 0;
+    canvas -> beforeTileWrite = NULL;
+    canvas -> hookData = NULL;
+    canvas -> pendingCount = 0;
+    canvas -> loadTile = NULL;
+    canvas -> releaseSource = NULL;
+    canvas -> sourceData = NULL;
+    canvas -> generation = 0;
+
+    canvas -> blankTile = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    canvas -> tiles = malloc(sizeof(uint32_t*) * canvas -> tilesX * canvas -> tilesY);
+    canvas -> tileOperations = calloc(canvas -> tilesX * canvas -> tilesY, sizeof(unsigned int));
+    canvas -> pendingTiles = calloc(canvas -> tilesX * canvas -> tilesY, 1);
+    canvas -> tileGenerations = calloc(canvas -> tilesX * canvas -> tilesY, sizeof(uint64_t));
+    if (canvas -> blankTile == NULL || canvas -> tiles == NULL || canvas -> tileOperations == NULL || canvas -> pendingTiles == NULL
+        || canvas -> tileGenerations == NULL) {
+        logError(log, 189, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    fillPixels(canvas -> blankTile, TILE_PIXELS, background);
+    for (int i = 0; i < canvas -> tilesX * canvas -> tilesY; ++i) {
+        canvas -> tiles[i] = canvas -> blankTile;
+    }
+
+    canvasSetClip(canvas, 0, 0, width, height);
+    damageReset(&canvas -> damage);
+    canvas -> damage.presentedPixels = 0;
+    damageAdd(&canvas -> damage, 0, 0, width, height);
+    return canvas;
+}
+
+void canvasDeconstructor(Canvas* canvas) {
+    if (canvas != NULL) {
+        canvas -> beforeTileWrite = NULL;
+        canvasClear(canvas);
+        free(canvas -> tiles);
+        free(canvas -> tileOperations);
+        free(canvas -> pendingTiles);
+        free(canvas -> tileGenerations);
+        free(canvas -> blankTile);
+        free(canvas);
+    }
+}
+
+void canvasSetClip(Canvas* canvas, int left, int top, int right, int bottom) {
+    canvas -> clipLeft = (left < 0) ? 0 : left;
+    canvas -> clipTop = (top < 0) ? 0 : top;
+    canvas -> clipRight = (right > canvas -> width) ? canvas -> width : right;
+    canvas -> clipBottom = (bottom > canvas -> height) ? canvas -> height : bottom;
+}
+
+void canvasClear(Canvas* canvas) {
+    for (int i = 0; i < canvas -> tilesX * canvas -> tilesY; ++i) {
+        if (canvas -> tiles[i] != canvas -> blankTile || isPending(canvas, i)) {
+            touchTile(canvas, i);
+            dropTile(canvas, i);
+        }
+    }
+    damageAdd(&canvas -> damage, 0, 0, canvas -> width, canvas -> height);
+}
+
+void canvasSetPixel(Canvas* canvas, int x, int y, uint32_t color) {
+    canvasFillSpan(canvas, y, x, x + 1, color);
+}
+
+uint32_t canvasGetPixel(const Canvas* canvas, int x, int y) {
+    if (x < 0 || x >= canvas -> width || y < 0 || y >= canvas -> height) {
+        return canvas -> background;
+    }
+    const uint32_t* tile = canvasGetTile(canvas, x / CANVAS_TILE_SIZE, y / CANVAS_TILE_SIZE);
+    return tile[(y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + x % CANVAS_TILE_SIZE];
+}
+
+void canvasFillSpan(Canvas* canvas, int y, int x0, int x1, uint32_t color) {
+    if (y < canvas -> clipTop || y >= canvas -> clipBottom) {
+        return;
+    }
+    if (x0 < canvas -> clipLeft) x0 = canvas -> clipLeft;
+    if (x1 > canvas -> clipRight) x1 = canvas -> clipRight;
+    if (x0 >= x1) {
+        return;
+    }
+
+    int rowIndex = (y / CANVAS_TILE_SIZE) * canvas -> tilesX;
+    int rowOffset = (y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+    int x = x0;
+    while (x < x1) {
+        int tileX = x / CANVAS_TILE_SIZE;
+        int tileEnd = (tileX + 1) * CANVAS_TILE_SIZE;
+        int runEnd = (x1 < tileEnd) ? x1 : tileEnd;
+
+        // Painting the background on a blank tile changes nothing
+        if (tileAt(canvas, rowIndex + tileX) != canvas -> blankTile || color != canvas -> background) {
+            uint32_t* tile = writableTile(canvas, rowIndex + tileX);
+            fillPixels(tile + rowOffset + x % CANVAS_TILE_SIZE, runEnd - x, color);
+        }
+        x = runEnd;
+    }
+    damageAdd(&canvas -> damage, x0, y, x1, y + 1);
+}
+
+void canvasFillRect(Canvas* canvas, int left, int top, int right, int bottom, uint32_t color) {
+    if (top < canvas -> clipTop) top = canvas -> clipTop;
+    if (bottom > canvas -> clipBottom) bottom = canvas -> clipBottom;
+    for (int y = top; y < bottom; ++y) {
+        canvasFillSpan(canvas, y, left, right, color);
+    }
+}
+
+void canvasReadRegion(const Canvas* canvas, int x, int y, int width, int height, uint32_t* dst, int dstStride) {
+    // Part of the region inside of the canvas
+    int left = (x > 0) ? x : 0;
+    int right = (x + width < canvas -> width) ? x + width : canvas -> width;
+
+    for (int row = 0; row < height; ++row, dst += dstStride) {
+        int canvasY = y + row;
+        if (canvasY < 0 || canvasY >= canvas -> height || left >= right) {
+            fillPixels(dst, width, canvas -> background);
+            continue;
+        }
+        fillPixels(dst, left - x, canvas -> background);
+        fillPixels(dst + (right - x), x + width - right, canvas -> background);
+
+        int rowIndex = (canvasY / CANVAS_TILE_SIZE) * canvas -> tilesX;
+        int rowOffset = (canvasY % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+        for (int canvasX = left; canvasX < right; ) {
+            int tileX = canvasX / CANVAS_TILE_SIZE;
+            int runEnd = ((tileX + 1) * CANVAS_TILE_SIZE < right) ? (tileX + 1) * CANVAS_TILE_SIZE : right;
+            memcpy(dst + (canvasX - x), tileAt(canvas, rowIndex + tileX) + rowOffset + canvasX % CANVAS_TILE_SIZE, sizeof(uint32_t) * (runEnd - canvasX));
+            canvasX = runEnd;
+        }
+    }
+}
+
+void canvasWriteRegion(Canvas* canvas, int x, int y, int width, int height, const uint32_t* src, int srcStride) {
+    int left = (x > canvas -> clipLeft) ? x : canvas -> clipLeft;
+    int right = (x + width < canvas -> clipRight) ? x + width : canvas -> clipRight;
+    int top = (y > canvas -> clipTop) ? y : canvas -> clipTop;
+    int bottom = (y + height < canvas -> clipBottom) ? y + height : canvas -> clipBottom;
+
+    for (int canvasY = top; canvasY < bottom; ++canvasY) {
+        // Source pixel of column left, the columns before it may be outside of src
+        const uint32_t* row = src + (size_t)(canvasY - y) * srcStride + (left - x);
+        int rowIndex = (canvasY / CANVAS_TILE_SIZE) * canvas -> tilesX;
+        int rowOffset = (canvasY % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+        int changedLeft = right;
+        int changedRight = left;
+
+        for (int canvasX = left; canvasX < right; ) {
+            int tileX = canvasX / CANVAS_TILE_SIZE;
+            int runEnd = ((tileX + 1) * CANVAS_TILE_SIZE < right) ? (tileX + 1) * CANVAS_TILE_SIZE : right;
+            size_t bytes = sizeof(uint32_t) * (runEnd - canvasX);
+            const uint32_t* current = tileAt(canvas, rowIndex + tileX) + rowOffset + canvasX % CANVAS_TILE_SIZE;
+
+            if (memcmp(current, row + (canvasX - left), bytes) != 0) {
+                uint32_t* tile = writableTile(canvas, rowIndex + tileX);
+                memcpy(tile + rowOffset + canvasX % CANVAS_TILE_SIZE, row + (canvasX - left), bytes);
+                if (canvasX < changedLeft) changedLeft = canvasX;
+                changedRight = runEnd;
+            }
+            canvasX = runEnd;
+        }
+        if (changedLeft < changedRight) {
+            damageAdd(&canvas -> damage, changedLeft, canvasY, changedRight, canvasY + 1);
+        }
+    }
+}
+
+void canvasDrawLine(Canvas* canvas, int x0, int y0, int x1, int y1, uint32_t color) {
+    // Bresenham, all octants
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int stepX = (x0 < x1) ? 1 : -1;
+    int stepY = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+
+    for (;;) {
+        canvasSetPixel(canvas, x0, y0, color);
+        if (x0 == x1 && y0 == y1) {
+            break;
+        }
+        int doubled = 2 * error;
+        if (doubled >= dy) {
+            error += dy;
+            x0 += stepX;
+        }
+        if (doubled <= dx) {
+            error += dx;
+            y0 += stepY;
+        }
+    }
+}
+
+void canvasBeginOperation(Canvas* canvas) {
+    canvas -> operation++;
+    if (canvas -> operation == 0) {
+        // Wrapped around: forget which tiles older operations touched
+        memset(canvas -> tileOperations, 0, sizeof(unsigned int) * canvas -> tilesX * canvas -> tilesY);
+        canvas -> operation = 1;
+    }
+}
+
+void canvasSwapTile(Canvas* canvas, int tileIndex, uint32_t** pixels) {
+    uint32_t* previous = tileAt(canvas, tileIndex);
+    uint32_t* next = (*pixels != NULL) ? *pixels : canvas -> blankTile;
+
+    canvas -> allocatedTiles += (next != canvas -> blankTile) - (previous != canvas -> blankTile);
+    canvas -> tiles[tileIndex] = next;
+    canvas -> tileGenerations[tileIndex] = ++canvas -> generation;
+    *pixels = (previous != canvas -> blankTile) ? previous : NULL;
+
+    damageTile(canvas, tileIndex);
+}
+
+void canvasWriteTile(Canvas* canvas, int tileX, int tileY, const uint32_t* pixels) {
+    int index = tileY * canvas -> tilesX + tileX;
+    int blank = isBackground(canvas, pixels);
+    if (blank && canvas -> tiles[index] == canvas -> blankTile && !isPending(canvas, index)) {
+        return;
+    }
+
+    // Every pixel is replaced, a waiting tile is only decoded if the hook needs its old pixels
+    touchTile(canvas, index);
+    if (blank) {
+        dropTile(canvas, index);
+    } else {
+        if (isPending(canvas, index)) {
+            endPending(canvas, index);
+        }
+        memcpy(writableTile(canvas, index), pixels, sizeof(uint32_t) * TILE_PIXELS);
+    }
+
+    damageTile(canvas, index);
+}
+
+void canvasSetTileSource(Canvas* canvas, const unsigned char* stored, CanvasTileLoader loadTile, CanvasSourceRelease releaseSource, void* data) {
+    canvasClear(canvas);
+
+    canvas -> loadTile = loadTile;
+    canvas -> releaseSource = releaseSource;
+    canvas -> sourceData = data;
+    for (int i = 0; i < canvas -> tilesX * canvas -> tilesY; ++i) {
+        if (stored[i]) {
+            // The hook sees the tile blank, as it is until decoded
+            touchTile(canvas, i);
+            canvas -> pendingTiles[i] = 1;
+            canvas -> pendingCount++;
+        }
+    }
+
+    if (canvas -> pendingCount == 0) {
+        closeSource(canvas);
+    }
+}
+
+const uint32_t* canvasGetTile(const Canvas* canvas, int tileX, int tileY) {
+    return tileAt(canvas, tileY * canvas -> tilesX + tileX);
+}
+
+int canvasIsTileBlank(const Canvas* canvas, int tileX, int tileY) {
+    return canvasGetTile(canvas, tileX, tileY) == canvas -> blankTile;
+}
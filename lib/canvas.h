@@ -0,0 +1,250 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <stdint.h>
+#include "logger.h"
+#include "damage.h"
+
+// Packs 8-bit channels into a canvas pixel (0x00RRGGBB, same memory layout as a 32-bit BI_RGB DIB).
+#define CANVAS_RGB(r, g, b) ((uint32_t)((((r) & 0xFF) << 16) | (((g) & 0xFF) << 8) | ((b) & 0xFF)))
+#define CANVAS_RED(c)       ((int)(((c) >> 16) & 0xFF))
+#define CANVAS_GREEN(c)     ((int)(((c) >> 8) & 0xFF))
+#define CANVAS_BLUE(c)      ((int)((c) & 0xFF))
+
+// Width and height of a canvas tile, in pixels.
+#define CANVAS_TILE_SIZE 64
+
+struct Canvas;
+
+/**
+ * @brief Called before the first change of a tile within an operation (see canvasBeginOperation()).
+ *
+ * @param data The `hookData` pointer of the canvas.
+ * @param canvas Pointer to the Canvas instance.
+ * @param tileIndex Index of the tile (tileY * tilesX + tileX), still holding its old pixels.
+ */
+typedef void (*CanvasTileHook)(void* data, struct Canvas* canvas, int tileIndex);
+
+/**
+ * @brief Decodes a tile of a tile source (see canvasSetTileSource()).
+ *
+ * @param data The `sourceData` pointer of the canvas.
+ * @param tileIndex Index of the tile (tileY * tilesX + tileX).
+ * @param pixels Destination, CANVAS_TILE_SIZE rows of CANVAS_TILE_SIZE pixels.
+ */
+typedef void (*CanvasTileLoader)(void* data, int tileIndex, uint32_t* pixels);
+
+/**
+ * @brief Called once no tile is left to decode from a tile source.
+ *
+ * @param data The `sourceData` pointer of the canvas.
+ */
+typedef void (*CanvasSourceRelease)(void* data);
+
+/**
+ * @brief Off-screen drawing surface, independent from any windowing API.
+ *
+ * Pixels are stored in CANVAS_TILE_SIZE x CANVAS_TILE_SIZE tiles, each tile being
+ * row-major with a stride of CANVAS_TILE_SIZE. Tiles never drawn on all point at one
+ * shared read-only blank tile and get their own memory on the first write, so memory
+ * follows the area actually drawn on. Every drawing call is clipped against the clip
+ * rectangle, which is the whole canvas unless changed with canvasSetClip(), and the
+ * pixels it changes are recorded in `damage` until they are presented.
+ *
+ * Tiles can also wait in a tile source (a mapped file) and be decoded only when they are
+ * first read or written, so what a load costs follows the area actually looked at.
+ *
+ * Every change of a tile stamps it with the next value of `generation`, so the tiles
+ * changed since any moment are the ones stamped with more than `generation` was then.
+ */
+typedef struct Canvas {
+    uint32_t** tiles;    /**< tilesX * tilesY tiles, row-major. */
+    uint32_t* blankTile; /**< Shared tile filled with the background, never written. */
+    int tilesX;          /**< Number of tile columns. */
+    int tilesY;          /**< Number of tile rows. */
+    int allocatedTiles;  /**< Number of tiles with their own memory. */
+    int width;           /**< Width of the canvas in pixels. */
+    int height;          /**< Height of the canvas in pixels. */
+    uint32_t background; /**< Color used by canvasClear() and by blank tiles. */
+    Log* log;            /**< Log used when a tile cannot be allocated. */
+
+    int clipLeft;        /**< Clip rectangle, left edge (inclusive). */
+    int clipTop;         /**< Clip rectangle, top edge (inclusive). */
+    int clipRight;       /**< Clip rectangle, right edge (exclusive). */
+    int clipBottom;      /**< Clip rectangle, bottom edge (exclusive). */
+
+    Damage damage;       /**< Regions changed since the last present. */
+
+    unsigned int operation;         /**< Current operation number, 0 when none was started. */
+    unsigned int* tileOperations;   /**< Last operation that changed each tile. */
+    CanvasTileHook beforeTileWrite; /**< Optional hook, used to capture tiles before they change. */
+    void* hookData;                 /**< Passed back to beforeTileWrite. */
+
+    unsigned char* pendingTiles;       /**< Non-zero for each tile still waiting in the tile source. */
+    int pendingCount;                  /**< Number of tiles still waiting, 0 when there is no source. */
+    CanvasTileLoader loadTile;         /**< Decodes a waiting tile. */
+    CanvasSourceRelease releaseSource; /**< Optional, called once no tile is waiting anymore. */
+    void* sourceData;                  /**< Passed back to loadTile and releaseSource. */
+
+    uint64_t generation;       /**< Number of tile changes so far. */
+    uint64_t* tileGenerations; /**< Value of `generation` at the last change of each tile. */
+} Canvas;
+
+/**
+ * @brief Constructor function to create a Canvas filled with its background color.
+ *
+ * @param width Width of the canvas in pixels.
+ * @param height Height of the canvas in pixels.
+ * @param background Background color of the canvas.
+ * @param log Pointer to the log for error handling, kept for the lifetime of the canvas.
+ * @return Pointer to the newly created Canvas instance.
+ */
+Canvas* canvasConstructor(int width, int height, uint32_t background, Log* log);
+
+/**
+ * @brief Destructor function to release the tiles of a Canvas.
+ *
+ * @param canvas Pointer to the Canvas instance to be destroyed.
+ */
+void canvasDeconstructor(Canvas* canvas);
+
+/**
+ * @brief Restricts every drawing call to the given rectangle (clamped to the canvas).
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param left Left edge, inclusive.
+ * @param top Top edge, inclusive.
+ * @param right Right edge, exclusive.
+ * @param bottom Bottom edge, exclusive.
+ */
+void canvasSetClip(Canvas* canvas, int left, int top, int right, int bottom);
+
+/**
+ * @brief Fills the whole canvas with its background color, ignoring the clip rectangle.
+ *
+ * Drawn tiles are released and point at the blank tile again, untouched tiles cost nothing.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ */
+void canvasClear(Canvas* canvas);
+
+/**
+ * @brief Sets a single pixel, if it lies inside the clip rectangle.
+ */
+void canvasSetPixel(Canvas* canvas, int x, int y, uint32_t color);
+
+/**
+ * @brief Reads a single pixel.
+ *
+ * @return The pixel color, or the background color when (x, y) is outside the canvas.
+ */
+uint32_t canvasGetPixel(const Canvas* canvas, int x, int y);
+
+/**
+ * @brief Fills the horizontal run [x0, x1) of row y. This is the primitive every shape is built on.
+ *
+ * Filling a blank tile with the background color does not allocate it.
+ */
+void canvasFillSpan(Canvas* canvas, int y, int x0, int x1, uint32_t color);
+
+/**
+ * @brief Fills the rectangle [left, right) x [top, bottom).
+ */
+void canvasFillRect(Canvas* canvas, int left, int top, int right, int bottom, uint32_t color);
+
+/**
+ * @brief Copies a rectangle of the canvas into contiguous rows, ignoring the clip rectangle.
+ *
+ * Each row is copied with one memcpy per tile it crosses. Pixels outside of the canvas
+ * are set to the background color.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param x, y Top left corner of the rectangle.
+ * @param width, height Size of the rectangle in pixels.
+ * @param dst Destination of the first row.
+ * @param dstStride Distance between two rows of `dst`, in pixels.
+ */
+void canvasReadRegion(const Canvas* canvas, int x, int y, int width, int height, uint32_t* dst, int dstStride);
+
+/**
+ * @brief Writes contiguous rows into a rectangle of the canvas, clipped like the drawing calls.
+ *
+ * Runs identical to what the canvas already holds are skipped, so unchanged tiles are not
+ * allocated, captured by the tile hook or damaged.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param x, y Top left corner of the rectangle.
+ * @param width, height Size of the rectangle in pixels.
+ * @param src First row to write.
+ * @param srcStride Distance between two rows of `src`, in pixels.
+ */
+void canvasWriteRegion(Canvas* canvas, int x, int y, int width, int height, const uint32_t* src, int srcStride);
+
+/**
+ * @brief Draws a one pixel wide line from (x0, y0) to (x1, y1), both ends included.
+ */
+void canvasDrawLine(Canvas* canvas, int x0, int y0, int x1, int y1, uint32_t color);
+
+/**
+ * @brief Starts a new operation: beforeTileWrite is called again once per tile changed from now on.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ */
+void canvasBeginOperation(Canvas* canvas);
+
+/**
+ * @brief Exchanges the memory of a tile with a caller-owned block, without calling the hook.
+ *
+ * Ownership moves both ways: the canvas keeps `*pixels` and the caller receives the previous
+ * tile. NULL stands for the blank tile in both directions.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param tileIndex Index of the tile (tileY * tilesX + tileX).
+ * @param pixels In: tile to install, or NULL. Out: previous tile, or NULL if it was blank.
+ */
+void canvasSwapTile(Canvas* canvas, int tileIndex, uint32_t** pixels);
+
+/**
+ * @brief Replaces the pixels of a whole tile, ignoring the clip rectangle.
+ *
+ * A tile made only of the background color goes back to the blank tile.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ * @param pixels CANVAS_TILE_SIZE rows of CANVAS_TILE_SIZE pixels.
+ */
+void canvasWriteTile(Canvas* canvas, int tileX, int tileY, const uint32_t* pixels);
+
+/**
+ * @brief Replaces the content of the canvas with tiles decoded on demand.
+ *
+ * The canvas is cleared, then each stored tile waits in the source until something first
+ * reads or changes it. The previous source, if any, is released.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param stored tilesX * tilesY flags, non-zero for the tiles the source holds. The others stay blank.
+ * @param loadTile Decodes a stored tile.
+ * @param releaseSource Optional, called once every stored tile was decoded or dropped.
+ * @param data Passed back to loadTile and releaseSource.
+ */
+void canvasSetTileSource(Canvas* canvas, const unsigned char* stored, CanvasTileLoader loadTile, CanvasSourceRelease releaseSource, void* data);
+
+/**
+ * @brief Returns the pixels of a tile (CANVAS_TILE_SIZE rows of CANVAS_TILE_SIZE pixels).
+ *
+ * A tile waiting in the tile source is decoded first.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ * @return Read-only pointer to the tile, which is the shared blank tile if never drawn on.
+ */
+const uint32_t* canvasGetTile(const Canvas* canvas, int tileX, int tileY);
+
+/**
+ * @brief Tells whether a tile was never drawn on since the canvas was created or cleared.
+ */
+int canvasIsTileBlank(const Canvas* canvas, int tileX, int tileY);
+
+#endif /* CANVAS_H */
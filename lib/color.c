@@ -1,36 +1,32 @@
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <sys/stat.h>
 #include "color.h"
+#include "thread.h"
 
-/**
- * @brief Gets the red component of a color.
- * 
- * @param color Pointer to the Color instance.
- * @return The red component value.
- */
-int getColorRed(const Color *color) {
-    return color -> r;
-}
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-/**
- * @brief Gets the green component of a color.
- * 
- * @param color Pointer to the Color instance.
- * @return The green component value.
- */
-int getColorGreen(const Color *color) {
-    return color -> g;
-}
+#define LAB_PADDING 1.0e6f // Lab coordinates of the padding colors, farther than any real one
+
+// Batches smaller than this are not worth a thread of their own.
+#define MIN_BATCH_PART 1024
+#define MAX_BATCH_PARTS  64
 
 /**
- * @brief Gets the blue component of a color.
- * 
- * @param color Pointer to the Color instance.
- * @return The blue component value.
+ * @brief Colors of a batch matched by one thread.
  */
-int getColorBlue(const Color *color) {
-    return color -> b;
-}
+typedef struct MatchPart {
+    const struct ColorTable* colorTable;
+    const uint32_t* colors;
+    int count;
+    ColorMatch match;
+    int* indices;
+} MatchPart;
 
 /**
  * @brief Sets the color data file for a ColorTable instance.
@@ -42,9 +38,16 @@ int getColorBlue(const Color *color) {
 void setColorDataFile(struct ColorTable * inst, char* filepath, Log log) {
     inst -> colorDataFile = fopen(filepath, "r");
     if (inst -> colorDataFile == NULL) {
-        logError(&log, 45, "File is not reading");
+        logError(&log, 41, "File is not reading");
         exit(EXIT_FAILURE);
     }
+    free(inst -> colorDataPath);
+    inst -> colorDataPath = malloc(strlen(filepath) + 1);
+    if (inst -> colorDataPath == NULL) {
+        logError(&log, 47, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(inst -> colorDataPath, filepath);
 }
 
 /**
@@ -68,66 +71,798 @@ char* trim(char *str) { // My Own implementation of the TRIM() function
     return str;
 }
 
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    put16(dst, value);
+    put16(dst + 2, value >> 16);
+}
+
+static void put64(uint8_t* dst, uint64_t value) {
+    put32(dst, (uint32_t)value);
+    put32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return get16(src) | (get16(src + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t* src) {
+    return (uint64_t)get32(src) | ((uint64_t)get32(src + 4) << 32);
+}
+
 /**
- * @brief Loads color data from a CSV file into a ColorTable instance.
- * 
- * @param colorTable Pointer to the ColorTable instance.
- * @param log Logger instance for error handling.
+ * @brief Points the arrays of a table into its block of `count` colors, the names coming last.
  */
-void loadColorTableFromCSV(struct ColorTable* colorTable, Log log) {
-    if (colorTable -> colorDataFile == NULL) {
-        logError(&log, 79, "Failed to open the file.");
-        return;
-    }
+static void layOutColors(struct ColorTable* colorTable, uint8_t* data, uint32_t count) {
+    colorTable -> colorData = data;
+    colorTable -> colorCount = (int)count;
+    colorTable -> nameOffsets = (uint32_t*)(data + COLOR_CACHE_HEADER);
+    colorTable -> red = data + COLOR_CACHE_HEADER + (size_t)count * 4;
+    colorTable -> green = colorTable -> red + count;
+    colorTable -> blue = colorTable -> green + count;
+    colorTable -> nameArena = (char*)(colorTable -> blue + count);
+}
 
+/**
+ * @brief Parses the CSV, growing the colors and the names by doubling, then moves them to
+ * the block of the table.
+ */
+static void parseColorCsv(struct ColorTable* colorTable, Log log) {
     char line[256];
+    uint32_t count = 0, capacity = 0;
+    size_t nameBytes = 0, nameCapacity = 0;
+    uint8_t* channels = NULL;
+    uint32_t* offsets = NULL;
+    char* names = NULL;
 
     while(fgets(line, sizeof(line), colorTable -> colorDataFile)) {
-        Color color;
+        int r, g, b;
         char* token = strtok(line, ",");
         if (token == NULL) continue;
-            color.r = atoi(token);
+            r = atoi(token);
 
         token = strtok(NULL, ",");
         if (token == NULL) continue;
-            color.g = atoi(token);
+            g = atoi(token);
         
         token = strtok(NULL, ",");
         if (token == NULL) continue;
-            color.b = atoi(token);
+            b = atoi(token);
         
         token = strtok(NULL, ",");
         if (token == NULL) continue;
-            color.name = strdup(trim(token));
+            token = trim(token);
+
+        size_t length = strlen(token) + 1;
+        if (count == capacity || nameBytes + length > nameCapacity) {
+            capacity = (count < capacity) ? capacity : (capacity > 0) ? capacity * 2 : 256;
+            while (nameBytes + length > nameCapacity) {
+                nameCapacity = (nameCapacity > 0) ? nameCapacity * 2 : 4096;
+            }
+            uint8_t* grownChannels = realloc(channels, (size_t)capacity * 3);
+            uint32_t* grownOffsets = realloc(offsets, sizeof(uint32_t) * capacity);
+            char* grownNames = realloc(names, nameCapacity);
+            if (grownChannels == NULL || grownOffsets == NULL || grownNames == NULL) {
+                logError(&log, 154, "Memory Allocation Error");
+                exit(EXIT_FAILURE);
+            }
+            channels = grownChannels;
+            offsets = grownOffsets;
+            names = grownNames;
+        }
+        channels[count * 3] = (uint8_t)r;
+        channels[count * 3 + 1] = (uint8_t)g;
+        channels[count * 3 + 2] = (uint8_t)b;
+        offsets[count++] = (uint32_t)nameBytes;
+        memcpy(names + nameBytes, token, length);
+        nameBytes += length;
+    }
+
+    uint8_t* data = malloc(COLOR_CACHE_HEADER + (size_t)count * 7 + nameBytes);
+    if (data == NULL) {
+        logError(&log, 171, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    layOutColors(colorTable, data, count);
+    for (uint32_t i = 0; i < count; ++i) {
+        colorTable -> nameOffsets[i] = offsets[i];
+        colorTable -> red[i] = channels[i * 3];
+        colorTable -> green[i] = channels[i * 3 + 1];
+        colorTable -> blue[i] = channels[i * 3 + 2];
+    }
+    if (nameBytes > 0) {
+        memcpy(colorTable -> nameArena, names, nameBytes);
+    }
+    colorTable -> nameBytes = nameBytes;
+    free(channels);
+    free(offsets);
+    free(names);
+}
+
+/**
+ * @brief Reads the compiled palette of the CSV with a single read, straight into the block of the table.
+ *
+ * @return 1 if the cache was read, 0 if it is missing, damaged or older than the CSV.
+ */
+static int readColorCache(struct ColorTable* colorTable, const char* path, const struct stat* csv) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    long size = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+    uint8_t* data = (size >= COLOR_CACHE_HEADER && fseek(file, 0, SEEK_SET) == 0) ? malloc((size_t)size) : NULL;
+    int valid = (data != NULL && fread(data, 1, (size_t)size, file) == (size_t)size);
+    fclose(file);
+
+    uint32_t count = valid ? get32(data + 24) : 0;
+    uint32_t nameBytes = valid ? get32(data + 28) : 0;
+    valid = valid && memcmp(data, COLOR_CACHE_MAGIC, 4) == 0 && get16(data + 4) == COLOR_CACHE_VERSION
+        && get64(data + 8) == (uint64_t)csv -> st_size && (int64_t)get64(data + 16) == (int64_t)csv -> st_mtime
+        && count <= INT_MAX / 8 && nameBytes > 0
+        && (uint64_t)size == COLOR_CACHE_HEADER + (uint64_t)count * 7 + nameBytes
+        && data[size - 1] == '\0';
+    for (uint32_t i = 0; i < count && valid; ++i) {
+        valid = (get32(data + COLOR_CACHE_HEADER + i * 4) < nameBytes);
+    }
+    if (!valid) {
+        free(data);
+        return 0;
+    }
 
-        colorTable -> colorMappings = realloc(colorTable->colorMappings, sizeof(Color) * (colorTable -> colorCount + 1));
-        if (colorTable -> colorMappings == NULL) {
-            logError(&log, 105, "Memory Allocation Error");
+    layOutColors(colorTable, data, count);
+    colorTable -> nameBytes = nameBytes;
+    for (uint32_t i = 0; i < count; ++i) {
+        colorTable -> nameOffsets[i] = get32(data + COLOR_CACHE_HEADER + i * 4);
+    }
+    return 1;
+}
+
+/**
+ * @brief Writes the block of the table as the compiled palette of the CSV, under a temporary
+ * name until it is complete.
+ */
+static void writeColorCache(const struct ColorTable* colorTable, const char* path, const struct stat* csv, Log log) {
+    uint32_t count = (uint32_t)colorTable -> colorCount;
+    if (colorTable -> nameBytes == 0 || colorTable -> nameBytes > UINT32_MAX) {
+        return;
+    }
+    // Header and offsets are encoded apart, the channels and names are written as they are
+    size_t headerSize = COLOR_CACHE_HEADER + (size_t)count * 4;
+    size_t bodySize = (size_t)count * 3 + colorTable -> nameBytes;
+    uint8_t* header = malloc(headerSize);
+    char* temporary = malloc(strlen(path) + 5);
+    if (header == NULL || temporary == NULL) {
+        logError(&log, 243, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(header, COLOR_CACHE_MAGIC, 4);
+    put16(header + 4, COLOR_CACHE_VERSION);
+    put16(header + 6, 0);
+    put64(header + 8, (uint64_t)csv -> st_size);
+    put64(header + 16, (uint64_t)(int64_t)csv -> st_mtime);
+    put32(header + 24, count);
+    put32(header + 28, (uint32_t)colorTable -> nameBytes);
+    for (uint32_t i = 0; i < count; ++i) {
+        put32(header + COLOR_CACHE_HEADER + i * 4, colorTable -> nameOffsets[i]);
+    }
+
+    sprintf(temporary, "%s.tmp", path);
+    FILE* file = fopen(temporary, "wb");
+    int written = file != NULL && fwrite(header, 1, headerSize, file) == headerSize
+        && fwrite(colorTable -> red, 1, bodySize, file) == bodySize;
+    written = (file != NULL && fclose(file) == 0) && written;
+    // rename() does not replace an existing file on Windows
+    remove(path);
+    if (!written || rename(temporary, path) != 0) {
+        logError(&log, 265, "Failed to write %s", path);
+        remove(temporary);
+    }
+    free(temporary);
+    free(header);
+}
+
+/**
+ * @brief Loads color data from a CSV file into a ColorTable instance.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param log Logger instance for error handling.
+ */
+void loadColorTableFromCSV(struct ColorTable* colorTable, Log log) {
+    if (colorTable -> colorDataFile == NULL) {
+        logError(&log, 280, "Failed to open the file.");
+        return;
+    }
+
+    struct stat csv;
+    char* cachePath = NULL;
+    if (colorTable -> colorDataPath != NULL && stat(colorTable -> colorDataPath, &csv) == 0) {
+        cachePath = malloc(strlen(colorTable -> colorDataPath) + strlen(COLOR_CACHE_SUFFIX) + 1);
+        if (cachePath == NULL) {
+            logError(&log, 289, "Memory Allocation Error");
             exit(EXIT_FAILURE);
         }
-        colorTable -> colorMappings[colorTable -> colorCount++] = color;
+        sprintf(cachePath, "%s" COLOR_CACHE_SUFFIX, colorTable -> colorDataPath);
+    }
+
+    free(colorTable -> colorData);
+    if (cachePath == NULL || !readColorCache(colorTable, cachePath, &csv)) {
+        parseColorCsv(colorTable, log);
+        if (cachePath != NULL) {
+            writeColorCache(colorTable, cachePath, &csv, log);
+        }
     }
+    free(cachePath);
     fclose(colorTable -> getColorDataFile(colorTable));
+    colorTableBuildIndex(colorTable, log);
 }   
 
 /**
- * @brief Constructor function to create a ColorTable instance.
- * 
- * @param log Logger instance for error handling.
- * @return Pointer to the newly created ColorTable instance.
+ * @brief Grid cell of a channel value, values out of 0-255 going to the first or last cell.
+ */
+static int gridCell(int value, int bits) {
+    if (value < 0) return 0;
+    if (value > 255) return (1 << bits) - 1;
+    return value >> (8 - bits);
+}
+
+/**
+ * @brief Grid cell of a color of the table.
+ */
+static int colorCell(const struct ColorTable* colorTable, int index, int bits) {
+    int shift = 8 - bits;
+    return ((colorTable -> red[index] >> shift) << (2 * bits)) | ((colorTable -> green[index] >> shift) << bits) | (colorTable -> blue[index] >> shift);
+}
+
+/**
+ * @brief Cube root part of the Lab conversion.
+ */
+static float labCurve(float t) {
+    return (t > 0.008856f) ? cbrtf(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+/**
+ * @brief CIELAB coordinates of an sRGB color, for the D65 white.
+ */
+static void colorToLab(const struct ColorTable* colorTable, int r, int g, int b, float* lab) {
+    float red = colorTable -> srgbLinear[(r < 0) ? 0 : (r > 255) ? 255 : r];
+    float green = colorTable -> srgbLinear[(g < 0) ? 0 : (g > 255) ? 255 : g];
+    float blue = colorTable -> srgbLinear[(b < 0) ? 0 : (b > 255) ? 255 : b];
+    float x = labCurve((0.4124564f * red + 0.3575761f * green + 0.1804375f * blue) / 0.95047f);
+    float y = labCurve(0.2126729f * red + 0.7151522f * green + 0.0721750f * blue);
+    float z = labCurve((0.0193339f * red + 0.1191920f * green + 0.9503041f * blue) / 1.08883f);
+    lab[0] = 116.0f * y - 16.0f;
+    lab[1] = 500.0f * (x - y);
+    lab[2] = 200.0f * (y - z);
+}
+
+const char* colorTableName(const struct ColorTable* colorTable, int index) {
+    return colorTable -> nameArena + colorTable -> nameOffsets[index];
+}
+
+/**
+ * @brief FNV-1a hash of a name, taken in lower case.
+ */
+static uint32_t nameHash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; ++name) {
+        hash = (hash ^ (uint8_t)tolower((unsigned char)*name)) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Compares two names whatever their case.
+ */
+static int sameName(const char* a, const char* b) {
+    for (; *a != '\0' && *b != '\0'; ++a, ++b) {
+        if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
+            return 0;
+        }
+    }
+    return *a == *b;
+}
+
+/**
+ * @brief Slot of the name table holding a name, or the empty slot where it would go.
+ */
+static int nameSlot(const struct ColorTable* colorTable, const char* name) {
+    int mask = colorTable -> nameSlotCount - 1;
+    int slot = (int)(nameHash(name) & (uint32_t)mask);
+    while (colorTable -> nameSlots[slot] >= 0 && !sameName(colorTableName(colorTable, colorTable -> nameSlots[slot]), name)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+int colorTableFindName(const struct ColorTable* colorTable, const char* name) {
+    if (colorTable -> nameSlots == NULL) {
+        return -1;
+    }
+    return colorTable -> nameSlots[nameSlot(colorTable, name)];
+}
+
+void colorTableBuildIndex(struct ColorTable* colorTable, Log log) {
+    // About one color per cell: a finer grid only adds empty cells to search
+    int bits = 0;
+    while (bits < COLOR_GRID_MAX_BITS && (1 << (3 * (bits + 1))) <= colorTable -> colorCount) {
+        bits++;
+    }
+    int cells = 1 << (3 * bits);
+
+    free(colorTable -> gridStart);
+    free(colorTable -> gridColors);
+    colorTable -> gridBits = bits;
+    colorTable -> gridStart = calloc(cells + 1, sizeof(int));
+    colorTable -> gridColors = malloc(sizeof(int) * (colorTable -> colorCount + 1));
+    int* fill = malloc(sizeof(int) * cells);
+    if (colorTable -> gridStart == NULL || colorTable -> gridColors == NULL || fill == NULL) {
+        logError(&log, 407, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    // Counting sort: colors per cell, then where each cell starts, then the colors in table order
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        colorTable -> gridStart[colorCell(colorTable, i, bits) + 1]++;
+    }
+    for (int cell = 0; cell < cells; ++cell) {
+        colorTable -> gridStart[cell + 1] += colorTable -> gridStart[cell];
+    }
+    memcpy(fill, colorTable -> gridStart, sizeof(int) * cells);
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        colorTable -> gridColors[fill[colorCell(colorTable, i, bits)]++] = i;
+    }
+    free(fill);
+
+    // Lab coordinates, one array per coordinate so that 4 colors are compared at once
+    int padded = (colorTable -> colorCount + 3) & ~3;
+    free(colorTable -> labL);
+    colorTable -> labL = malloc(sizeof(float) * 4 * (padded + 4));
+    if (colorTable -> labL == NULL) {
+        logError(&log, 429, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    colorTable -> labA = colorTable -> labL + padded + 4;
+    colorTable -> labB = colorTable -> labA + padded + 4;
+    colorTable -> labC = colorTable -> labB + padded + 4;
+    for (int i = 0; i < padded + 4; ++i) {
+        float lab[3] = { LAB_PADDING, LAB_PADDING, LAB_PADDING };
+        if (i < colorTable -> colorCount) {
+            colorToLab(colorTable, colorTable -> red[i], colorTable -> green[i], colorTable -> blue[i], lab);
+        }
+        colorTable -> labL[i] = lab[0];
+        colorTable -> labA[i] = lab[1];
+        colorTable -> labB[i] = lab[2];
+        colorTable -> labC[i] = sqrtf(lab[1] * lab[1] + lab[2] * lab[2]);
+    }
+
+    // Names, at most half of the slots used so that a lookup only probes a few of them
+    int slots = 16;
+    while (slots < 2 * colorTable -> colorCount) {
+        slots *= 2;
+    }
+    free(colorTable -> nameSlots);
+    colorTable -> nameSlots = malloc(sizeof(int) * slots);
+    if (colorTable -> nameSlots == NULL) {
+        logError(&log, 454, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    colorTable -> nameSlotCount = slots;
+    memset(colorTable -> nameSlots, 0xFF, sizeof(int) * slots);
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        int slot = nameSlot(colorTable, colorTableName(colorTable, i));
+        if (colorTable -> nameSlots[slot] < 0) {
+            colorTable -> nameSlots[slot] = i;
+        }
+    }
+}
+
+/**
+ * @brief Nearest-color search state: the color looked for and the best match so far.
  */
+typedef struct ColorSearch {
+    int r, g, b;
+    int bits;
+    int best;
+    int bestDistance;
+} ColorSearch;
+
+/**
+ * @brief Squared distance from a channel value to the values of a grid cell, 0 inside it.
+ */
+static int cellGap(int value, int cell, int bits) {
+    int low = cell << (8 - bits);
+    int high = low + (1 << (8 - bits)) - 1;
+    int gap = (value < low) ? low - value : (value > high) ? value - high : 0;
+    return gap * gap;
+}
+
+/**
+ * @brief Compares the colors of a grid cell with the best match, unless the whole cell is farther.
+ */
+static void searchCell(const struct ColorTable* colorTable, ColorSearch* search, int x, int y, int z) {
+    int bits = search -> bits;
+    int cell = (x << (2 * bits)) | (y << bits) | z;
+    if (colorTable -> gridStart[cell] == colorTable -> gridStart[cell + 1]
+        || cellGap(search -> r, x, bits) + cellGap(search -> g, y, bits) + cellGap(search -> b, z, bits) > search -> bestDistance) {
+        return;
+    }
+    for (int k = colorTable -> gridStart[cell]; k < colorTable -> gridStart[cell + 1]; ++k) {
+        int i = colorTable -> gridColors[k];
+        int dr = colorTable -> red[i] - search -> r;
+        int dg = colorTable -> green[i] - search -> g;
+        int db = colorTable -> blue[i] - search -> b;
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < search -> bestDistance || (distance == search -> bestDistance && i < search -> best)) {
+            search -> bestDistance = distance;
+            search -> best = i;
+        }
+    }
+}
+
+/**
+ * @brief Distance from a channel value to the cells out of [cell - radius, cell + radius],
+ * INT_MAX if there are none.
+ */
+static int reachOut(int value, int cell, int radius, int bits) {
+    int reach = INT_MAX;
+    if (cell - radius > 0) {
+        reach = value - (((cell - radius) << (8 - bits)) - 1);
+    }
+    if (cell + radius < (1 << bits) - 1) {
+        int up = ((cell + radius + 1) << (8 - bits)) - value;
+        reach = (up < reach) ? up : reach;
+    }
+    return reach;
+}
+
+int colorTableFindClosest(const struct ColorTable* colorTable, int r, int g, int b) {
+    if (colorTable -> colorCount == 0 || colorTable -> gridStart == NULL) {
+        return -1;
+    }
+    int bits = colorTable -> gridBits;
+    int size = 1 << bits;
+    ColorSearch search = { r, g, b, bits, -1, INT_MAX };
+    int cr = gridCell(r, bits), cg = gridCell(g, bits), cb = gridCell(b, bits);
+
+    // Shells of cells around the cell of the color, until no cell left can hold a closer one
+    for (int radius = 0; radius < size; ++radius) {
+        for (int x = cr - radius; x <= cr + radius; ++x) {
+            for (int y = cg - radius; y <= cg + radius; ++y) {
+                if (x < 0 || y < 0 || x >= size || y >= size) {
+                    continue;
+                }
+                if (abs(x - cr) == radius || abs(y - cg) == radius) {
+                    for (int z = cb - radius; z <= cb + radius; ++z) {
+                        if (z >= 0 && z < size) {
+                            searchCell(colorTable, &search, x, y, z);
+                        }
+                    }
+                } else {
+                    // Inside the shell on x and y, only its two faces on z are new
+                    if (cb - radius >= 0) {
+                        searchCell(colorTable, &search, x, y, cb - radius);
+                    }
+                    if (cb + radius < size) {
+                        searchCell(colorTable, &search, x, y, cb + radius);
+                    }
+                }
+            }
+        }
+
+        int reach = reachOut(r, cr, radius, bits);
+        int reachG = reachOut(g, cg, radius, bits);
+        int reachB = reachOut(b, cb, radius, bits);
+        reach = (reachG < reach) ? reachG : reach;
+        reach = (reachB < reach) ? reachB : reach;
+        if (reach == INT_MAX || (search.best >= 0 && search.bestDistance < reach * reach)) {
+            break;
+        }
+    }
+    return search.best;
+}
+
+/**
+ * @brief Index of the color whose Lab coordinates are the closest to `lab`, Delta E 1976.
+ */
+static int closestLab(const struct ColorTable* colorTable, const float* lab) {
+    int best = -1;
+    float bestDistance = FLT_MAX;
+#if defined(__SSE2__)
+    // 4 colors per step, each lane keeping its closest one; the padding colors never win
+    __m128 l = _mm_set1_ps(lab[0]);
+    __m128 a = _mm_set1_ps(lab[1]);
+    __m128 b = _mm_set1_ps(lab[2]);
+    __m128 laneDistance = _mm_set1_ps(FLT_MAX);
+    __m128i laneBest = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i step = _mm_set1_epi32(4);
+    for (int i = 0; i < colorTable -> colorCount; i += 4) {
+        __m128 dl = _mm_sub_ps(_mm_loadu_ps(colorTable -> labL + i), l);
+        __m128 da = _mm_sub_ps(_mm_loadu_ps(colorTable -> labA + i), a);
+        __m128 db = _mm_sub_ps(_mm_loadu_ps(colorTable -> labB + i), b);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dl, dl), _mm_mul_ps(da, da)), _mm_mul_ps(db, db));
+        __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, laneDistance));
+        laneDistance = _mm_min_ps(distance, laneDistance);
+        laneBest = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, laneBest));
+        index = _mm_add_epi32(index, step);
+    }
+    float distances[4];
+    int indices[4];
+    _mm_storeu_ps(distances, laneDistance);
+    _mm_storeu_si128((__m128i*)indices, laneBest);
+    for (int lane = 0; lane < 4; ++lane) {
+        if (distances[lane] < bestDistance || (distances[lane] == bestDistance && indices[lane] < best)) {
+            bestDistance = distances[lane];
+            best = indices[lane];
+        }
+    }
+#else
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        float dl = colorTable -> labL[i] - lab[0];
+        float da = colorTable -> labA[i] - lab[1];
+        float db = colorTable -> labB[i] - lab[2];
+        float distance = dl * dl + da * da + db * db;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = i;
+        }
+    }
+#endif
+    return best;
+}
+
+/**
+ * @brief Hue angle in degrees, 0-360.
+ */
+static float hueAngle(float b, float a) {
+    if (a == 0.0f && b == 0.0f) {
+        return 0.0f;
+    }
+    float hue = atan2f(b, a) * (180.0f / 3.14159265f);
+    return (hue < 0.0f) ? hue + 360.0f : hue;
+}
+
+/**
+ * @brief Square of the CIEDE2000 difference between the color `lab` of chroma `chroma` and
+ * the color `index` of the table.
+ *
+ * The hue terms cost most, so a lower bound is worked out first from the corrected chroma
+ * alone, taking T and the rotation term at their worst (T is within 0.362-1.573 and the
+ * rotation removes at most sin(60) of RC times the chroma and hue product). Past `limit`,
+ * the bound is returned instead of the difference.
+ */
+static float deltaE2000(const struct ColorTable* colorTable, const float* lab, float chroma, int index, float limit) {
+    const float radians = 3.14159265f / 180.0f;
+    const float pow25to7 = 6103515625.0f;
+    float l2 = colorTable -> labL[index], a2 = colorTable -> labA[index], b2 = colorTable -> labB[index];
+
+    float meanChroma = (chroma + colorTable -> labC[index]) / 2.0f;
+    float meanChroma7 = meanChroma * meanChroma * meanChroma;
+    meanChroma7 = meanChroma7 * meanChroma7 * meanChroma;
+    float g = 0.5f * (1.0f - sqrtf(meanChroma7 / (meanChroma7 + pow25to7)));
+    float a1 = (1.0f + g) * lab[1];
+    a2 = (1.0f + g) * a2;
+    float c1 = sqrtf(a1 * a1 + lab[2] * lab[2]);
+    float c2 = sqrtf(a2 * a2 + b2 * b2);
+
+    float deltaL = l2 - lab[0];
+    float deltaC = c2 - c1;
+    float meanL = (lab[0] + l2) / 2.0f - 50.0f;
+    float meanC = (c1 + c2) / 2.0f;
+    float meanC7 = meanC * meanC * meanC;
+    meanC7 = meanC7 * meanC7 * meanC;
+    float rc = 2.0f * sqrtf(meanC7 / (meanC7 + pow25to7));
+    float sl = 1.0f + 0.015f * meanL * meanL / sqrtf(20.0f + meanL * meanL);
+    float sc = 1.0f + 0.045f * meanC;
+    float lightness = deltaL / sl, chromaTerm = deltaC / sc;
+
+    // Lower bound: |dH| is known without the hue angles, SH and RT are taken at their worst
+    float hueSquare = (a2 - a1) * (a2 - a1) + (b2 - lab[2]) * (b2 - lab[2]) - deltaC * deltaC;
+    float hueLength = sqrtf((hueSquare > 0.0f) ? hueSquare : 0.0f);
+    float rotationMax = 0.8661f * rc * fabsf(chromaTerm);
+    float hueLow = hueLength / (1.0f + 0.015f * meanC * 1.573f);
+    float hueHigh = hueLength / (1.0f + 0.015f * meanC * 0.362f);
+    float hueWorst = rotationMax / 2.0f;
+    hueWorst = (hueWorst < hueLow) ? hueLow : (hueWorst > hueHigh) ? hueHigh : hueWorst;
+    float bound = lightness * lightness + chromaTerm * chromaTerm + hueWorst * hueWorst - rotationMax * hueWorst;
+    if (bound > limit) {
+        return bound;
+    }
+
+    // The mean hue is the direction halfway between the two hues, and T a sum of its multiples
+    float deltaHue = (a1 * b2 - a2 * lab[2] < 0.0f) ? -hueLength : hueLength;
+    float x = (c1 > 0.0f) ? a1 / c1 : 0.0f, y = (c1 > 0.0f) ? lab[2] / c1 : 0.0f;
+    if (c1 * c2 != 0.0f) {
+        x += a2 / c2;
+        y += b2 / c2;
+        if (x == 0.0f && y == 0.0f) {
+            // Opposite hues, both halves are as far: the one a quarter turn after the first hue
+            x = -lab[2] / c1;
+            y = a1 / c1;
+        }
+    } else if (c2 > 0.0f) {
+        x = a2 / c2;
+        y = b2 / c2;
+    }
+    float length = sqrtf(x * x + y * y);
+    float cos1 = (length > 0.0f) ? x / length : 1.0f, sin1 = (length > 0.0f) ? y / length : 0.0f;
+    float cos2 = cos1 * cos1 - sin1 * sin1, sin2 = 2.0f * sin1 * cos1;
+    float cos3 = cos2 * cos1 - sin2 * sin1, sin3 = sin2 * cos1 + cos2 * sin1;
+    float cos4 = cos2 * cos2 - sin2 * sin2, sin4 = 2.0f * sin2 * cos2;
+    float t = 1.0f - 0.17f * (cos1 * 0.8660254f + sin1 * 0.5f) + 0.24f * cos2
+            + 0.32f * (cos3 * 0.9945219f - sin3 * 0.1045285f) - 0.20f * (cos4 * 0.4539905f + sin4 * 0.8910065f);
+    float meanHue = hueAngle(sin1, cos1);
+    float rotation = 30.0f * expf(-((meanHue - 275.0f) / 25.0f) * ((meanHue - 275.0f) / 25.0f));
+    float rt = -rc * sinf(2.0f * rotation * radians);
+    float hueTerm = deltaHue / (1.0f + 0.015f * meanC * t);
+    return lightness * lightness + chromaTerm * chromaTerm + hueTerm * hueTerm + rt * chromaTerm * hueTerm;
+}
+
+/**
+ * @brief Compares the color `index` with the best match by CIEDE2000.
+ */
+static void searchDeltaE2000(const struct ColorTable* colorTable, const float* lab, float chroma, int index, int* best, float* bestDistance) {
+    if (index == *best) {
+        return;
+    }
+    float distance = deltaE2000(colorTable, lab, chroma, index, *bestDistance);
+    if (distance < *bestDistance || (distance == *bestDistance && index < *best)) {
+        *bestDistance = distance;
+        *best = index;
+    }
+}
+
+/**
+ * @brief Index of the closest color to `lab` by CIEDE2000.
+ *
+ * The square of CIEDE2000 is at least (dL / SL)^2 + 0.133 (da^2 + db^2) / SC^2, with SL
+ * taken as 1 + 0.015 |mean L - 50| (never less than the real one) and SC for the largest
+ * chroma the two colors can have once corrected: the rotation term removes at most 87% of
+ * the chroma and hue part, and SH never exceeds SC. This bound is
+ * worked out 4 colors at a time, and deltaE2000() only sees the colors it leaves, starting
+ * with the closest one by Delta E 1976.
+ */
+static int closestDeltaE2000(const struct ColorTable* colorTable, const float* lab) {
+    float chroma = sqrtf(lab[1] * lab[1] + lab[2] * lab[2]);
+    int best = closestLab(colorTable, lab);
+    float bestDistance = deltaE2000(colorTable, lab, chroma, best, FLT_MAX);
+#if defined(__SSE2__)
+    __m128 l = _mm_set1_ps(lab[0]);
+    __m128 a = _mm_set1_ps(lab[1]);
+    __m128 b = _mm_set1_ps(lab[2]);
+    __m128 c = _mm_set1_ps(chroma);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (int i = 0; i < colorTable -> colorCount; i += 4) {
+        __m128 colorL = _mm_loadu_ps(colorTable -> labL + i);
+        __m128 dl = _mm_sub_ps(colorL, l);
+        __m128 da = _mm_sub_ps(_mm_loadu_ps(colorTable -> labA + i), a);
+        __m128 db = _mm_sub_ps(_mm_loadu_ps(colorTable -> labB + i), b);
+        __m128 meanL = _mm_and_ps(_mm_sub_ps(_mm_mul_ps(_mm_add_ps(colorL, l), _mm_set1_ps(0.5f)), _mm_set1_ps(50.0f)), magnitude);
+        __m128 sl = _mm_add_ps(one, _mm_mul_ps(_mm_set1_ps(0.015f), meanL));
+        __m128 sc = _mm_add_ps(one, _mm_mul_ps(_mm_set1_ps(0.045f * 1.5f * 0.5f), _mm_add_ps(c, _mm_loadu_ps(colorTable -> labC + i))));
+        __m128 sl2 = _mm_mul_ps(sl, sl), sc2 = _mm_mul_ps(sc, sc);
+        // Both sides multiplied by SL^2 SC^2, no division
+        __m128 bound = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(dl, dl), sc2),
+                                  _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.133f), _mm_add_ps(_mm_mul_ps(da, da), _mm_mul_ps(db, db))), sl2));
+        int candidates = _mm_movemask_ps(_mm_cmple_ps(bound, _mm_mul_ps(_mm_set1_ps(bestDistance), _mm_mul_ps(sl2, sc2))));
+        for (int lane = 0; lane < 4 && candidates != 0; ++lane, candidates >>= 1) {
+            if ((candidates & 1) && i + lane < colorTable -> colorCount) {
+                searchDeltaE2000(colorTable, lab, chroma, i + lane, &best, &bestDistance);
+            }
+        }
+    }
+#else
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        float dl = colorTable -> labL[i] - lab[0];
+        float da = colorTable -> labA[i] - lab[1];
+        float db = colorTable -> labB[i] - lab[2];
+        float sl = 1.0f + 0.015f * fabsf((colorTable -> labL[i] + lab[0]) / 2.0f - 50.0f);
+        float sc = 1.0f + 0.045f * 1.5f * (chroma + colorTable -> labC[i]) / 2.0f;
+        if (dl * dl * sc * sc + 0.133f * (da * da + db * db) * sl * sl <= bestDistance * sl * sl * sc * sc) {
+            searchDeltaE2000(colorTable, lab, chroma, i, &best, &bestDistance);
+        }
+    }
+#endif
+    return best;
+}
+
+int colorTableMatch(const struct ColorTable* colorTable, int r, int g, int b, ColorMatch match) {
+    if (match == COLOR_MATCH_RGB || colorTable -> colorCount == 0 || colorTable -> labL == NULL) {
+        return colorTableFindClosest(colorTable, r, g, b);
+    }
+    float lab[3];
+    colorToLab(colorTable, r, g, b, lab);
+    return (match == COLOR_MATCH_DE2000) ? closestDeltaE2000(colorTable, lab) : closestLab(colorTable, lab);
+}
+
+static void matchPart(void* argument) {
+    MatchPart* part = argument;
+    for (int i = 0; i < part -> count; ++i) {
+        uint32_t color = part -> colors[i];
+        part -> indices[i] = colorTableMatch(part -> colorTable, (int)((color >> 16) & 0xFF), (int)((color >> 8) & 0xFF), (int)(color & 0xFF), part -> match);
+    }
+}
+
+void colorTableMatchBatch(const struct ColorTable* colorTable, const uint32_t* colors, int count, ColorMatch match, int* indices, Log log) {
+    int partCount = threadProcessorCount();
+    if (partCount > MAX_BATCH_PARTS) partCount = MAX_BATCH_PARTS;
+    if ((long)partCount * MIN_BATCH_PART > count) partCount = count / MIN_BATCH_PART + 1;
+
+    MatchPart parts[MAX_BATCH_PARTS];
+    Thread* threads[MAX_BATCH_PARTS];
+    for (int i = 0; i < partCount; ++i) {
+        int begin = (int)((long)count * i / partCount);
+        int end = (int)((long)count * (i + 1) / partCount);
+        parts[i] = (MatchPart){ colorTable, colors + begin, end - begin, match, indices + begin };
+    }
+
+    // The first part is matched on the calling thread, or every part if no thread can be started
+    for (int i = 1; i < partCount; ++i) {
+        threads[i] = threadStart(matchPart, &parts[i], &log);
+    }
+    matchPart(&parts[0]);
+    for (int i = 1; i < partCount; ++i) {
+        if (threads[i] != NULL) {
+            threadJoin(threads[i]);
+        } else {
+            matchPart(&parts[i]);
+        }
+    }
+}
+
+ColorMatch colorMatchFromName(const char* name) {
+    if (strncmp(name, "de2000", 6) == 0) {
+        return COLOR_MATCH_DE2000;
+    }
+    if (strncmp(name, "de76", 4) == 0) {
+        return COLOR_MATCH_DE76;
+    }
+    return COLOR_MATCH_RGB;
+}
+
 ColorTable* colorTableConstructor(Log log) {
     ColorTable* colorTable = malloc(sizeof(ColorTable));
     if (colorTable == NULL) {
-        logError(&log, 121, "Memory Allocation Error");
+        logError(&log, 835, "Memory Allocation Error");
         exit(EXIT_FAILURE);
     }
 
     colorTable -> setColorDataFile = &setColorDataFile;
     colorTable -> getColorDataFile = &getColorDataFile;
 
-    colorTable -> colorMappings = NULL;
     colorTable -> colorCount = 0;
+    colorTable -> red = NULL;
+    colorTable -> green = NULL;
+    colorTable -> blue = NULL;
+    colorTable -> nameOffsets = NULL;
+    colorTable -> nameArena = NULL;
+    colorTable -> nameBytes = 0;
+    colorTable -> colorData = NULL;
+    colorTable -> colorDataFile = NULL;
+    colorTable -> colorDataPath = NULL;
+    colorTable -> gridBits = 0;
+    colorTable -> gridStart = NULL;
+    colorTable -> gridColors = NULL;
+    colorTable -> match = COLOR_MATCH_RGB;
+    colorTable -> labL = NULL;
+    colorTable -> labA = NULL;
+    colorTable -> labB = NULL;
+    colorTable -> labC = NULL;
+    colorTable -> nameSlots = NULL;
+    colorTable -> nameSlotCount = 0;
+    for (int i = 0; i < 256; ++i) {
+        float value = i / 255.0f;
+        colorTable -> srgbLinear[i] = (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
     return colorTable;
 }
 
@@ -138,7 +873,12 @@ ColorTable* colorTableConstructor(Log log) {
  */
 void colorTableDeconstructor(ColorTable* colorTable) {
     if (colorTable != NULL) {
-        free(colorTable -> colorMappings);
+        free(colorTable -> colorData); // Colors and names, in one block
+        free(colorTable -> colorDataPath);
+        free(colorTable -> gridStart);
+        free(colorTable -> gridColors);
+        free(colorTable -> labL); // labA, labB and labC are in the same block
+        free(colorTable -> nameSlots);
         free(colorTable);
     }
 }
@@ -3,29 +3,69 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "logger.h"
 
-/**
- * @brief Structure representing a color.
+#define COLOR_GRID_MAX_BITS 5 // The nearest-color grid has at most 32 cells per channel
+
+/*
+ * The palette of a CSV is kept compiled next to it, in <csv>.cache, and read back while the
+ * CSV keeps the same size and modification time. A ColorTable holds its colors in one block
+ * laid out the same way. All integers are little-endian in the file.
+ *
+ *   Header (32 bytes)
+ *     char[4]  magic       "PCOL"
+ *     uint16   version     COLOR_CACHE_VERSION
+ *     uint16   reserved    0
+ *     uint64   csvSize     Size of the CSV in bytes
+ *     int64    csvTime     Modification time of the CSV, in seconds
+ *     uint32   colorCount  Number of colors
+ *     uint32   nameBytes   Size of the name arena
+ *   colorCount * uint32  offset of each name in the arena
+ *   colorCount * uint8   red values, then as many green and blue values
+ *   nameBytes            names, each ending with '\0'
  */
-typedef struct Color {
-    int r; /**< Red component of the color. */
-    int g; /**< Green component of the color. */
-    int b; /**< Blue component of the color. */
-    const char* name; /**< Name of the color. */
+#define COLOR_CACHE_MAGIC   "PCOL"
+#define COLOR_CACHE_VERSION 1
+#define COLOR_CACHE_HEADER  32
+#define COLOR_CACHE_SUFFIX  ".cache"
 
-    int(*getColorRed)(struct Color *); // Red getter
-    int(*getColorGreen)(struct Color *); // Green getter
-    int(*getColorBlue)(struct Color *); // Blue getter
-} Color;
+/**
+ * @brief How colors are compared to find the closest one.
+ */
+typedef enum ColorMatch {
+    COLOR_MATCH_RGB = 0, /**< Squared distance of the RGB values, the fastest. */
+    COLOR_MATCH_DE76,    /**< CIELAB Delta E 1976, the distance of the Lab coordinates. */
+    COLOR_MATCH_DE2000   /**< CIEDE2000, the closest to the differences the eye sees. */
+} ColorMatch;
 
 /**
  * @brief Structure representing a color table to manage colors.
+ *
+ * Each channel is an array of its own, so a nearest-color scan only reads 3 bytes per color.
  */
 typedef struct ColorTable { 
-    Color* colorMappings; // Dynamic array of Colors
     int colorCount;
+    uint8_t* red;           // Red component of each color
+    uint8_t* green;         // Green component of each color
+    uint8_t* blue;          // Blue component of each color
+    uint32_t* nameOffsets;  // Where the name of each color starts in nameArena
+    char* nameArena;        // Names of the colors, each ending with '\0'
+    size_t nameBytes;       // Size of nameArena
+    uint8_t* colorData;     // The one block the arrays above are in, laid out like the cache
     FILE* colorDataFile;
+    char* colorDataPath;  // Path of the CSV, to find its cache
+    int gridBits;         // The nearest-color grid has 1 << gridBits cells per channel
+    int* gridStart;       // Where each cell of the grid starts in gridColors, one more entry than cells
+    int* gridColors;      // Indices of the colors, sorted by grid cell
+    ColorMatch match;     // How getClosestColorName() compares colors, COLOR_MATCH_RGB by default
+    float* labL;          // Lab coordinates and chroma of the colors, one block padded to a multiple of 4
+    float* labA;
+    float* labB;
+    float* labC;
+    float srgbLinear[256]; // Linear value of each sRGB channel value
+    int* nameSlots;       // Open addressing table of the names, whatever their case: color index or -1
+    int nameSlotCount;    // Size of nameSlots, a power of 2 at least twice colorCount
 
     void(*setColorDataFile)(struct ColorTable *, char* filepath, Log log);
     FILE*(*getColorDataFile)(struct ColorTable *);
@@ -49,11 +89,95 @@ void colorTableDeconstructor(ColorTable* colorTable);
 /**
  * @brief Loads color data from a CSV file into a ColorTable instance.
  * 
+ * The compiled palette is read instead if the CSV has not changed since it was written, and
+ * written again otherwise.
+ * 
  * @param colorTable Pointer to the ColorTable instance.
  * @param log Logger instance for error handling.
  */
 void loadColorTableFromCSV(struct ColorTable* colorTable, Log log);
 
+/**
+ * @brief Name of a color of the table.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param index Index of the color, 0 to colorCount - 1.
+ * @return The name, owned by the table.
+ */
+const char* colorTableName(const struct ColorTable* colorTable, int index);
+
+/**
+ * @brief Finds a color by its name, whatever its case, for example "ruby red".
+ * 
+ * The names are looked up in a hash table, so the time does not depend on the number of
+ * colors. When several colors have the same name, the first one of the table is returned.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param name Name of the color.
+ * @return Index of the color, or -1 if no color has this name.
+ */
+int colorTableFindName(const struct ColorTable* colorTable, const char* name);
+
+/**
+ * @brief Sorts the colors of a ColorTable into the nearest-color grid, sized for about one
+ * color per cell, computes their Lab coordinates and hashes their names. Called by
+ * loadColorTableFromCSV(), and again whenever the colors change.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param log Logger instance for error handling.
+ */
+void colorTableBuildIndex(struct ColorTable* colorTable, Log log);
+
+/**
+ * @brief Finds the color closest to the given RGB values, by squared distance.
+ * 
+ * Only the grid cells around the color are searched, so the time does not depend on the
+ * number of colors. Among equally close colors, the first one of the table is returned.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param r The red component (0-255).
+ * @param g The green component (0-255).
+ * @param b The blue component (0-255).
+ * @return Index of the closest color, or -1 if the table is empty.
+ */
+int colorTableFindClosest(const struct ColorTable* colorTable, int r, int g, int b);
+
+/**
+ * @brief Finds the color closest to the given RGB values, compared the given way.
+ * 
+ * Lab distances are computed 4 colors at a time when SSE2 is available. CIEDE2000 is only
+ * computed for the colors a cheap lower bound of it does not rule out.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param r The red component (0-255).
+ * @param g The green component (0-255).
+ * @param b The blue component (0-255).
+ * @param match How colors are compared.
+ * @return Index of the closest color, or -1 if the table is empty.
+ */
+int colorTableMatch(const struct ColorTable* colorTable, int r, int g, int b, ColorMatch match);
+
+/**
+ * @brief Finds the closest color of many colors at once, for example every distinct color
+ * of a canvas. Large batches are split between the processors.
+ * 
+ * @param colorTable Pointer to the ColorTable instance.
+ * @param colors Colors to match, packed as 0x00RRGGBB like the canvas pixels.
+ * @param count Number of colors.
+ * @param match How colors are compared.
+ * @param indices Receives the index of the closest color of each one, -1 if the table is empty.
+ * @param log Logger instance for error handling.
+ */
+void colorTableMatchBatch(const struct ColorTable* colorTable, const uint32_t* colors, int count, ColorMatch match, int* indices, Log log);
+
+/**
+ * @brief Reads the name of a way of comparing colors: "rgb", "de76" or "de2000".
+ * 
+ * @param name Name to read, anything after it is ignored.
+ * @return The way of comparing colors, COLOR_MATCH_RGB if the name is unknown.
+ */
+ColorMatch colorMatchFromName(const char* name);
+
 /**
  * @brief Trim a given String to remove any whitespaces
  * 
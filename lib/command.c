@@ -0,0 +1,164 @@
+#include <string.h>
+#include "command.h"
+#include "stroke.h"
+#include "line.h"
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+// Coordinates are stored on 16 bits
+static void putCoordinate(uint8_t* dst, int value) {
+    if (value < -32768) value = -32768;
+    if (value > 32767) value = 32767;
+    put16(dst, (uint32_t)(value & 0xFFFF));
+}
+
+static int getCoordinate(const uint8_t* src) {
+    return (int16_t)get16(src);
+}
+
+void commandApply(Canvas* canvas, const PaintCommand* command, CommandTextRenderer renderText, void* data, Log* log) {
+    switch (command -> type) {
+        case COMMAND_STAMP:
+            stampDraw(canvas, command -> x0, command -> y0, command -> size, command -> shape, command -> color);
+            break;
+        case COMMAND_SEGMENT:
+            strokeDrawSegment(canvas, command -> x0, command -> y0, command -> x1, command -> y1,
+                              command -> size, command -> shape, command -> color, log);
+            break;
+        case COMMAND_LINE:
+            lineDrawThick(canvas, command -> x0, command -> y0, command -> x1, command -> y1,
+                          command -> size, command -> shape, command -> color);
+            break;
+        case COMMAND_TEXT:
+            if (renderText != NULL && command -> text != NULL && command -> text[0] != '\0') {
+                renderText(data, canvas, command);
+            }
+            break;
+        case COMMAND_RESET:
+            canvasClear(canvas);
+            break;
+    }
+}
+
+size_t commandEncode(CommandEncoder* encoder, const PaintCommand* command, uint8_t* dst) {
+    if (command -> type == COMMAND_RESET) {
+        return 0;
+    }
+
+    size_t size = 0;
+    if (!encoder -> stateWritten || command -> color != encoder -> color) {
+        dst[size] = COMMAND_RECORD_COLOR;
+        put16(dst + size + 1, command -> color & 0xFFFF);
+        put16(dst + size + 3, command -> color >> 16);
+        size += 5;
+        encoder -> color = command -> color;
+    }
+    // A text only uses the size, as its height
+    StampShape shape = (command -> type == COMMAND_TEXT && encoder -> stateWritten) ? encoder -> shape : command -> shape;
+    if (!encoder -> stateWritten || command -> size != encoder -> size || shape != encoder -> shape) {
+        dst[size] = COMMAND_RECORD_BRUSH;
+        dst[size + 1] = (uint8_t)((command -> size < 0) ? 0 : (command -> size > 0xFF) ? 0xFF : command -> size);
+        dst[size + 2] = (uint8_t)shape;
+        size += 3;
+        encoder -> size = command -> size;
+        encoder -> shape = shape;
+    }
+    encoder -> stateWritten = 1;
+
+    uint8_t* record = dst + size;
+    putCoordinate(record + 1, command -> x0);
+    putCoordinate(record + 3, command -> y0);
+    switch (command -> type) {
+        case COMMAND_STAMP:
+            record[0] = COMMAND_RECORD_STAMP;
+            return size + 5;
+        case COMMAND_SEGMENT:
+        case COMMAND_LINE:
+            record[0] = (command -> type == COMMAND_SEGMENT) ? COMMAND_RECORD_SEGMENT : COMMAND_RECORD_LINE;
+            putCoordinate(record + 5, command -> x1);
+            putCoordinate(record + 7, command -> y1);
+            return size + 9;
+        case COMMAND_TEXT: {
+            size_t length = (command -> text != NULL) ? strlen(command -> text) : 0;
+            if (length > COMMAND_TEXT_MAX) length = COMMAND_TEXT_MAX;
+            int wrap = (command -> x1 < 0) ? 0 : (command -> x1 > 0xFFFF) ? 0xFFFF : command -> x1;
+            record[0] = COMMAND_RECORD_TEXT;
+            put16(record + 5, (uint32_t)wrap);
+            put16(record + 7, (uint32_t)length);
+            memcpy(record + 9, command -> text, length);
+            return size + 9 + length;
+        }
+        default:
+            return size;
+    }
+}
+
+size_t commandRecordSize(const uint8_t* data, size_t remaining) {
+    if (remaining == 0) {
+        return 0;
+    }
+    switch (data[0]) {
+        case COMMAND_RECORD_COLOR:   return (remaining >= 5) ? 5 : 0;
+        case COMMAND_RECORD_BRUSH:   return (remaining >= 3) ? 3 : 0;
+        case COMMAND_RECORD_STAMP:   return (remaining >= 5) ? 5 : 0;
+        case COMMAND_RECORD_SEGMENT:
+        case COMMAND_RECORD_LINE:    return (remaining >= 9) ? 9 : 0;
+        case COMMAND_RECORD_TEXT: {
+            if (remaining < 9) {
+                return 0;
+            }
+            size_t size = 9 + get16(data + 7);
+            return (remaining >= size) ? size : 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+int commandDecode(const uint8_t* data, PaintCommand* command, char* text) {
+    switch (data[0]) {
+        case COMMAND_RECORD_COLOR:
+            command -> color = get16(data + 1) | (get16(data + 3) << 16);
+            return 0;
+        case COMMAND_RECORD_BRUSH:
+            command -> size = data[1];
+            command -> shape = (data[2] == STAMP_SQUARE) ? STAMP_SQUARE : STAMP_CIRCLE;
+            return 0;
+        case COMMAND_RECORD_STAMP:
+            command -> type = COMMAND_STAMP;
+            command -> x0 = command -> x1 = getCoordinate(data + 1);
+            command -> y0 = command -> y1 = getCoordinate(data + 3);
+            command -> text = NULL;
+            return 1;
+        case COMMAND_RECORD_SEGMENT:
+        case COMMAND_RECORD_LINE:
+            command -> type = (data[0] == COMMAND_RECORD_SEGMENT) ? COMMAND_SEGMENT : COMMAND_LINE;
+            command -> x0 = getCoordinate(data + 1);
+            command -> y0 = getCoordinate(data + 3);
+            command -> x1 = getCoordinate(data + 5);
+            command -> y1 = getCoordinate(data + 7);
+            command -> text = NULL;
+            return 1;
+        case COMMAND_RECORD_TEXT: {
+            size_t length = get16(data + 7);
+            memcpy(text, data + 9, length);
+            text[length] = '\0';
+            command -> type = COMMAND_TEXT;
+            command -> x0 = getCoordinate(data + 1);
+            command -> y0 = getCoordinate(data + 3);
+            command -> x1 = (int)get16(data + 5);
+            command -> y1 = command -> y0;
+            command -> text = text;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
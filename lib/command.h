@@ -0,0 +1,119 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "canvas.h"
+#include "stamp.h"
+#include "logger.h"
+
+/*
+ * Command records, shared by the journal and the document files, all integers little-endian.
+ * One type byte followed by:
+ *   COLOR    uint32 color                    Color of the next operations
+ *   BRUSH    uint8 size, uint8 shape         Brush (or text height) of the next operations
+ *   STAMP    int16 x, y
+ *   SEGMENT  int16 x0, y0, x1, y1
+ *   LINE     int16 x0, y0, x1, y1
+ *   TEXT     int16 x, y, uint16 wrap width, uint16 length, `length` bytes of text
+ */
+#define COMMAND_RECORD_COLOR   1
+#define COMMAND_RECORD_BRUSH   2
+#define COMMAND_RECORD_STAMP   3
+#define COMMAND_RECORD_SEGMENT 4
+#define COMMAND_RECORD_LINE    5
+#define COMMAND_RECORD_TEXT    6
+
+// Longest text a record holds, and most bytes commandEncode() writes for one command.
+#define COMMAND_TEXT_MAX       0xFFFF
+#define COMMAND_MAX_BYTES      (5 + 3 + 9 + COMMAND_TEXT_MAX)
+
+/**
+ * @brief Kind of drawing operation.
+ */
+typedef enum CommandType {
+    COMMAND_STAMP = 1,   /**< One brush stamp centered on (x0, y0). */
+    COMMAND_SEGMENT = 2, /**< Area swept by the brush from (x0, y0) to (x1, y1). */
+    COMMAND_LINE = 3,    /**< Thick line from (x0, y0) to (x1, y1), caps given by the shape. */
+    COMMAND_TEXT = 4,    /**< Text drawn at (x0, y0), wrapped at x1 pixels wide, `size` pixels high. */
+    COMMAND_RESET = 5    /**< Whole canvas cleared. */
+} CommandType;
+
+/**
+ * @brief One drawing operation, with everything needed to draw it again.
+ */
+typedef struct PaintCommand {
+    CommandType type;  /**< Kind of operation. */
+    int x0, y0;        /**< First point (center of a stamp, origin of a text). */
+    int x1, y1;        /**< Second point (x1 is the wrap width of a text). */
+    int size;          /**< Brush size, or text height. */
+    StampShape shape;  /**< Brush shape. */
+    uint32_t color;    /**< Color of the operation. */
+    const char* text;  /**< Text of a COMMAND_TEXT, NULL otherwise. */
+} PaintCommand;
+
+/**
+ * @brief Rasterizes a COMMAND_TEXT, text layout being left to the platform.
+ *
+ * @param data The `data` pointer given to commandApply().
+ * @param canvas Pointer to the Canvas instance.
+ * @param command Pointer to the text command.
+ */
+typedef void (*CommandTextRenderer)(void* data, Canvas* canvas, const PaintCommand* command);
+
+/**
+ * @brief Draws a command on the canvas.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param command Pointer to the command to draw.
+ * @param renderText Renderer used for COMMAND_TEXT, which is skipped if NULL.
+ * @param data Passed back to renderText.
+ * @param log Pointer to the log for error handling.
+ */
+void commandApply(Canvas* canvas, const PaintCommand* command, CommandTextRenderer renderText, void* data, Log* log);
+
+/**
+ * @brief Color and brush last written by an encoder, so they are written again only when they change.
+ */
+typedef struct CommandEncoder {
+    int stateWritten; /**< Zero until the first command, or to write the state again. */
+    uint32_t color;   /**< Color of the last COLOR record. */
+    int size;         /**< Size of the last BRUSH record. */
+    StampShape shape; /**< Shape of the last BRUSH record. */
+} CommandEncoder;
+
+/**
+ * @brief Encodes a command as records, preceded by the color and brush records it needs.
+ *
+ * COMMAND_RESET has no record, and encodes to nothing.
+ *
+ * @param encoder Pointer to the state of the stream, zeroed before the first command.
+ * @param command Pointer to the command.
+ * @param dst Destination, at least COMMAND_MAX_BYTES long.
+ * @return Number of bytes written.
+ */
+size_t commandEncode(CommandEncoder* encoder, const PaintCommand* command, uint8_t* dst);
+
+/**
+ * @brief Size of the command record at `data`, checking it is complete.
+ *
+ * @param data Start of the record.
+ * @param remaining Bytes available from `data`.
+ * @return Size of the record in bytes, or 0 if it is cut short or not a command record.
+ */
+size_t commandRecordSize(const uint8_t* data, size_t remaining);
+
+/**
+ * @brief Decodes a record checked by commandRecordSize().
+ *
+ * Color and brush records update `command` for the records that follow. Operation records
+ * fill in the rest of it; the text of a TEXT record is copied to `text`.
+ *
+ * @param data Start of the record.
+ * @param command State of the stream, starting zeroed, and the decoded command.
+ * @param text Buffer of COMMAND_TEXT_MAX + 1 bytes receiving the text.
+ * @return 1 if `command` is an operation to draw, 0 after a color or brush record.
+ */
+int commandDecode(const uint8_t* data, PaintCommand* command, char* text);
+
+#endif /* COMMAND_H */
@@ -0,0 +1,95 @@
+#include "damage.h"
+
+static long rectArea(const DamageRect* rect) {
+    return (long)(rect -> right - rect -> left) * (rect -> bottom - rect -> top);
+}
+
+static DamageRect rectUnion(const DamageRect* a, const DamageRect* b) {
+    DamageRect result = {
+        a -> left < b -> left ? a -> left : b -> left,
+        a -> top < b -> top ? a -> top : b -> top,
+        a -> right > b -> right ? a -> right : b -> right,
+        a -> bottom > b -> bottom ? a -> bottom : b -> bottom,
+        a -> covered + b -> covered
+    };
+    return result;
+}
+
+/**
+ * @brief Number of pixels the union of a and b would present without them having changed.
+ *
+ * Uses the recorded pixel counts rather than the rectangle areas, so a long diagonal
+ * stroke grows a chain of rectangles instead of one huge bounding box.
+ */
+static long mergeWaste(const DamageRect* a, const DamageRect* b) {
+    DamageRect merged = rectUnion(a, b);
+    long waste = rectArea(&merged) - merged.covered;
+    return (waste > 0) ? waste : 0;
+}
+
+static void removeRect(Damage* damage, int index) {
+    damage -> rects[index] = damage -> rects[--damage -> count];
+}
+
+void damageReset(Damage* damage) {
+    damage -> count = 0;
+}
+
+void damageAdd(Damage* damage, int left, int top, int right, int bottom) {
+    if (left >= right || top >= bottom) {
+        return;
+    }
+    DamageRect rect = { left, top, right, bottom, 0 };
+    rect.covered = rectArea(&rect);
+
+    // Fast path: consecutive spans of one shape usually land in the last rectangle
+    if (damage -> count > 0) {
+        DamageRect* last = &damage -> rects[damage -> count - 1];
+        if (left >= last -> left && right <= last -> right && top >= last -> top && bottom <= last -> bottom) {
+            last -> covered += rect.covered;
+            if (last -> covered > rectArea(last)) {
+                last -> covered = rectArea(last); // Same pixels drawn again
+            }
+            return;
+        }
+    }
+
+    for (;;) {
+        int best = -1;
+        for (int i = damage -> count - 1; i >= 0; --i) {
+            if (mergeWaste(&rect, &damage -> rects[i]) <= DAMAGE_MERGE_SLACK) {
+                best = i;
+                break;
+            }
+        }
+
+        if (best < 0 && damage -> count == DAMAGE_MAX_RECTS) {
+            // List full: merge with the rectangle wasting the least area
+            long bestWaste = 0;
+            for (int i = 0; i < damage -> count; ++i) {
+                long waste = mergeWaste(&rect, &damage -> rects[i]);
+                if (best < 0 || waste < bestWaste) {
+                    best = i;
+                    bestWaste = waste;
+                }
+            }
+        }
+
+        if (best < 0) {
+            break;
+        }
+        // The grown rectangle may now be worth merging with another one
+        rect = rectUnion(&rect, &damage -> rects[best]);
+        removeRect(damage, best);
+    }
+
+    damage -> rects[damage -> count++] = rect;
+}
+
+long damageArea(const Damage* damage) {
+    long area = 0;
+    for (int i = 0; i < damage -> count; ++i) {
+        area += rectArea(&damage -> rects[i]);
+    }
+    return area;
+}
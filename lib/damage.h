@@ -0,0 +1,52 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+// Maximum number of separate rectangles kept before the closest ones are merged.
+#define DAMAGE_MAX_RECTS   16
+// Two rectangles are merged when their union holds at most this many pixels that were not recorded.
+#define DAMAGE_MERGE_SLACK 4096
+
+/**
+ * @brief Rectangle [left, right) x [top, bottom) in canvas coordinates.
+ */
+typedef struct DamageRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+    long covered; /**< Pixels actually recorded inside the rectangle (upper bound). */
+} DamageRect;
+
+/**
+ * @brief Coalesced list of the regions changed since they were last presented.
+ */
+typedef struct Damage {
+    DamageRect rects[DAMAGE_MAX_RECTS]; /**< Changed regions, most recent last. */
+    int count;                          /**< Number of rectangles in use. */
+    long presentedPixels;               /**< Pixels copied to the screen by the last frame. */
+} Damage;
+
+/**
+ * @brief Forgets every changed region (the presented pixels counter is kept).
+ *
+ * @param damage Pointer to the Damage instance.
+ */
+void damageReset(Damage* damage);
+
+/**
+ * @brief Records a changed rectangle, merging it with the recorded ones when cheap.
+ *
+ * @param damage Pointer to the Damage instance.
+ * @param left, top, right, bottom Changed rectangle, right and bottom exclusive.
+ */
+void damageAdd(Damage* damage, int left, int top, int right, int bottom);
+
+/**
+ * @brief Total number of pixels covered by the recorded rectangles.
+ *
+ * @param damage Pointer to the Damage instance.
+ * @return Sum of the areas of the rectangles.
+ */
+long damageArea(const Damage* damage);
+
+#endif /* DAMAGE_H */
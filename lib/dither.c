@@ -0,0 +1,296 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dither.h"
+#include "thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MAX_THREADS    64
+#define BLOCK_PIXELS   64 // Pixels of a row done between two updates of its progress
+#define BAND_ROWS      16 // Rows taken at once by the methods without error diffusion
+
+// Thresholds of the ordered dithering, 0 to 63.
+static const unsigned char bayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+/**
+ * @brief Image and state shared by the threads dithering it.
+ */
+typedef struct DitherJob {
+    uint32_t* pixels;
+    int width;
+    int height;
+    int stride;
+    const PaletteMap* map;
+    DitherMethod method;
+    atomic_int next;     /**< Next row to take. */
+    atomic_int* done;    /**< Pixels of each row already dithered, Floyd-Steinberg only. */
+    int* errors;         /**< Ring of `ringRows` rows of errors, Floyd-Steinberg only. */
+    int ringRows;
+    short offsets[8][8]; /**< Bayer threshold of each pixel, scaled to the spacing of the palette. */
+} DitherJob;
+
+int ditherMethodFromName(const char* name, DitherMethod* method) {
+    if (strcmp(name, "none") == 0) {
+        *method = DITHER_NONE;
+    } else if (strcmp(name, "fs") == 0) {
+        *method = DITHER_FLOYD_STEINBERG;
+    } else if (strcmp(name, "bayer") == 0) {
+        *method = DITHER_BAYER;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int clampChannel(int value) {
+    return (value < 0) ? 0 : (value > 255) ? 255 : value;
+}
+
+/**
+ * @brief Dithers row `y` by Floyd-Steinberg, the previous row being done by another thread.
+ *
+ * Errors are kept in sixteenths. A pixel receives 7/16 of the error of its left neighbor and
+ * 3/16, 5/16 and 1/16 of the errors of the three pixels above it, so it waits until the row
+ * above is done one pixel past it.
+ */
+static void diffuseRow(DitherJob* job, int y) {
+    const Palette* palette = job -> map -> palette;
+    int width = job -> width;
+    int rowSize = (width + 2) * 3;
+    int* current = job -> errors + (size_t)(y % job -> ringRows) * rowSize;
+    int* below = job -> errors + (size_t)((y + 1) % job -> ringRows) * rowSize;
+    uint32_t* row = job -> pixels + (size_t)y * job -> stride;
+
+    // The rows using this part of the ring before are done, rows finishing in order
+    memset(below, 0, sizeof(int) * rowSize);
+
+    int carry[3] = { 0, 0, 0 };
+    for (int start = 0; start < width; start += BLOCK_PIXELS) {
+        int end = (start + BLOCK_PIXELS < width) ? start + BLOCK_PIXELS : width;
+        if (y > 0) {
+            int needed = (end + 1 < width) ? end + 1 : width;
+            while (atomic_load_explicit(&job -> done[y - 1], memory_order_acquire) < needed) {
+                threadYield();
+            }
+        }
+
+        for (int x = start; x < end; ++x) {
+            int* error = current + (x + 1) * 3;
+            int* spread = below + (x + 1) * 3;
+            int wanted[3] = {
+                CANVAS_RED(row[x]) + ((error[0] + carry[0] + 8) >> 4),
+                CANVAS_GREEN(row[x]) + ((error[1] + carry[1] + 8) >> 4),
+                CANVAS_BLUE(row[x]) + ((error[2] + carry[2] + 8) >> 4)
+            };
+            for (int c = 0; c < 3; ++c) {
+                wanted[c] = clampChannel(wanted[c]);
+            }
+            uint32_t color = palette -> colors[paletteMapClosest(job -> map, CANVAS_RGB(wanted[0], wanted[1], wanted[2]))];
+            row[x] = color;
+
+            int chosen[3] = { CANVAS_RED(color), CANVAS_GREEN(color), CANVAS_BLUE(color) };
+            for (int c = 0; c < 3; ++c) {
+                int e = wanted[c] - chosen[c];
+                carry[c] = 7 * e;
+                spread[c - 3] += 3 * e;
+                spread[c] += 5 * e;
+                spread[c + 3] += e;
+            }
+        }
+        atomic_store_explicit(&job -> done[y], end, memory_order_release);
+    }
+}
+
+/**
+ * @brief Whether a pixel is a color of the palette, remembering the answer for the run of
+ * pixels of the same color that usually follows.
+ */
+static int inPalette(const PaletteMap* map, uint32_t pixel, uint32_t* last, int* lastFound) {
+    if (pixel != *last) {
+        *last = pixel;
+        *lastFound = (paletteMapFind(map, pixel) >= 0);
+    }
+    return *lastFound;
+}
+
+/**
+ * @brief Dithers row `y` with the Bayer thresholds. Pixels already of a color of the palette
+ * are kept, the thresholds assuming a regular grid of colors would move them.
+ */
+static void orderRow(DitherJob* job, int y) {
+    const PaletteMap* map = job -> map;
+    const uint32_t* colors = map -> palette -> colors;
+    const short* offsets = job -> offsets[y & 7];
+    uint32_t* row = job -> pixels + (size_t)y * job -> stride;
+    uint32_t last = 0xFFFFFFFF; // Never a pixel, whose high byte is 0
+    int lastFound = 0;
+    int x = 0;
+
+#if defined(__SSE2__)
+    // Four pixels at a time: the thresholds are added to the channels with saturation, and
+    // the cells computed at once, leaving only the palette lookups
+    __m128i thresholds[4];
+    for (int i = 0; i < 4; ++i) {
+        short a = offsets[i * 2];
+        short b = offsets[i * 2 + 1];
+        thresholds[i] = _mm_setr_epi16(a, a, a, a, b, b, b, b);
+    }
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 4 <= job -> width; x += 4) {
+        __m128i four = _mm_loadu_si128((const __m128i*)(row + x));
+        int half = (x & 4) >> 1;
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(four, zero), thresholds[half]);
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(four, zero), thresholds[half + 1]);
+        four = _mm_packus_epi16(low, high);
+        __m128i cells = _mm_or_si128(_mm_or_si128(
+            _mm_and_si128(_mm_srli_epi32(four, 9), _mm_set1_epi32(0x7C00)),
+            _mm_and_si128(_mm_srli_epi32(four, 6), _mm_set1_epi32(0x03E0))),
+            _mm_and_si128(_mm_srli_epi32(four, 3), _mm_set1_epi32(0x001F)));
+        uint32_t cell[4];
+        _mm_storeu_si128((__m128i*)cell, cells);
+        for (int i = 0; i < 4; ++i) {
+            if (!inPalette(map, row[x + i], &last, &lastFound)) {
+                row[x + i] = colors[map -> cells[cell[i]]];
+            }
+        }
+    }
+#endif
+
+    for (; x < job -> width; ++x) {
+        if (inPalette(map, row[x], &last, &lastFound)) {
+            continue;
+        }
+        int offset = offsets[x & 7];
+        uint32_t color = CANVAS_RGB(clampChannel(CANVAS_RED(row[x]) + offset),
+                                    clampChannel(CANVAS_GREEN(row[x]) + offset),
+                                    clampChannel(CANVAS_BLUE(row[x]) + offset));
+        row[x] = colors[map -> cells[QUANTIZE_CELL(color)]];
+    }
+}
+
+/**
+ * @brief Gives row `y` the closest colors of the palette.
+ */
+static void mapRow(DitherJob* job, int y) {
+    uint32_t* row = job -> pixels + (size_t)y * job -> stride;
+    uint32_t last = row[0];
+    uint32_t lastColor = job -> map -> palette -> colors[paletteMapIndex(job -> map, last)];
+    for (int x = 0; x < job -> width; ++x) {
+        if (row[x] != last) {
+            last = row[x];
+            lastColor = job -> map -> palette -> colors[paletteMapIndex(job -> map, last)];
+        }
+        row[x] = lastColor;
+    }
+}
+
+/**
+ * @brief Takes rows until none is left, one at a time for Floyd-Steinberg so that the rows
+ * in progress stay next to each other.
+ */
+static void runJob(void* argument) {
+    DitherJob* job = argument;
+    int rows = (job -> method == DITHER_FLOYD_STEINBERG) ? 1 : BAND_ROWS;
+    int first;
+    while ((first = atomic_fetch_add(&job -> next, rows)) < job -> height) {
+        int last = (first + rows < job -> height) ? first + rows : job -> height;
+        for (int y = first; y < last; ++y) {
+            if (job -> method == DITHER_FLOYD_STEINBERG) {
+                diffuseRow(job, y);
+            } else if (job -> method == DITHER_BAYER) {
+                orderRow(job, y);
+            } else {
+                mapRow(job, y);
+            }
+        }
+    }
+}
+
+void ditherPixels(uint32_t* pixels, int width, int height, int stride, const PaletteMap* map, DitherMethod method,
+                  int threadCount, Log* log) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+    if (threadCount > height) threadCount = height;
+    if (threadCount < 1) threadCount = 1;
+
+    DitherJob job = { 0 };
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.stride = stride;
+    job.map = map;
+    job.method = method;
+    atomic_init(&job.next, 0);
+    job.ringRows = threadCount + 2;
+
+    if (method == DITHER_FLOYD_STEINBERG) {
+        // At most `threadCount` rows are in progress, each one writing the errors of the next
+        job.done = malloc(sizeof(atomic_int) * height);
+        job.errors = calloc((size_t)job.ringRows * (width + 2) * 3, sizeof(int));
+        if (job.done == NULL || job.errors == NULL) {
+            logError(log, 245, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        for (int y = 0; y < height; ++y) {
+            atomic_init(&job.done[y], 0);
+        }
+    } else if (method == DITHER_BAYER) {
+        // Thresholds span the spacing of the colors, as if the palette were a regular grid
+        int levels = 1;
+        while (levels * levels * levels < map -> palette -> count) {
+            levels++;
+        }
+        int spacing = 256 / levels;
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                job.offsets[y][x] = (short)((bayer[y][x] * 2 + 1 - 64) * spacing / 128);
+            }
+        }
+    }
+
+    // The calling thread takes rows too, and takes those of the threads that cannot be started
+    Thread* threads[MAX_THREADS];
+    for (int i = 1; i < threadCount; ++i) {
+        threads[i] = threadStart(runJob, &job, log);
+    }
+    runJob(&job);
+    for (int i = 1; i < threadCount; ++i) {
+        threadJoin(threads[i]);
+    }
+
+    free(job.done);
+    free(job.errors);
+}
+
+void ditherCanvas(Canvas* canvas, const Palette* palette, DitherMethod method, int threadCount, Log* log) {
+    if (palette -> exact) {
+        return;
+    }
+    uint32_t* pixels = malloc(sizeof(uint32_t) * (size_t)canvas -> width * canvas -> height);
+    if (pixels == NULL) {
+        logError(log, 285, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    canvasReadRegion(canvas, 0, 0, canvas -> width, canvas -> height, pixels, canvas -> width);
+
+    PaletteMap* map = paletteMapConstructor(palette, log);
+    ditherPixels(pixels, canvas -> width, canvas -> height, canvas -> width, map, method, threadCount, log);
+    paletteMapDeconstructor(map);
+
+    canvasWriteRegion(canvas, 0, 0, canvas -> width, canvas -> height, pixels, canvas -> width);
+    free(pixels);
+}
@@ -0,0 +1,60 @@
+#ifndef DITHER_H
+#define DITHER_H
+
+#include <stdint.h>
+#include "canvas.h"
+#include "quantize.h"
+#include "logger.h"
+
+/**
+ * @brief Ways of drawing an image with the colors of a palette.
+ */
+typedef enum DitherMethod {
+    DITHER_NONE = 0,        /**< Each pixel takes the closest color, flat areas stay flat. */
+    DITHER_FLOYD_STEINBERG, /**< The error of each pixel is spread over its neighbors, the closest to the image. */
+    DITHER_BAYER            /**< An 8x8 threshold pattern is added before taking the closest color, each pixel on its own.
+                                 Pixels already of a color of the palette are kept. */
+} DitherMethod;
+
+/**
+ * @brief Reads the name of a method: "none", "fs" or "bayer".
+ *
+ * @param name The name.
+ * @param method Receives the method.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int ditherMethodFromName(const char* name, DitherMethod* method);
+
+/**
+ * @brief Replaces every pixel of an image with a color of the palette.
+ *
+ * Rows are shared between up to `threadCount` threads. Floyd-Steinberg carries the error of
+ * each pixel to the next row, so each row follows the one above it a few pixels behind; the
+ * rows then run side by side as a wavefront and give the same pixels as a single thread.
+ *
+ * @param pixels The image, 0x00RRGGBB like the canvas pixels.
+ * @param width Width of the image in pixels.
+ * @param height Height of the image in pixels.
+ * @param stride Pixels from one row to the next.
+ * @param map Map of the palette.
+ * @param method How to choose the colors.
+ * @param threadCount Most threads to work with.
+ * @param log Pointer to the log for error handling.
+ */
+void ditherPixels(uint32_t* pixels, int width, int height, int stride, const PaletteMap* map, DitherMethod method,
+                  int threadCount, Log* log);
+
+/**
+ * @brief Draws the whole canvas with the colors of a palette, see ditherPixels().
+ *
+ * Nothing changes if the palette is exact, the canvas already being drawn with its colors.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param palette The palette, from quantizeCanvasPalette() or any other colors.
+ * @param method How to choose the colors.
+ * @param threadCount Most threads to work with.
+ * @param log Pointer to the log for error handling.
+ */
+void ditherCanvas(Canvas* canvas, const Palette* palette, DitherMethod method, int threadCount, Log* log);
+
+#endif /* DITHER_H */
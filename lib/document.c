@@ -0,0 +1,370 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "document.h"
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    put16(dst, value);
+    put16(dst + 2, value >> 16);
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return get16(src) | (get16(src + 2) << 16);
+}
+
+/**
+ * @brief Frees the texts of the commands from `first` on and forgets those commands.
+ */
+static void dropCommands(Document* document, int first) {
+    for (int i = first; i < document -> count; ++i) {
+        free((char*)document -> commands[i].text);
+    }
+    document -> count = first;
+}
+
+/**
+ * @brief Index after the last command of an operation.
+ */
+static int operationEnd(const Document* document, int operation) {
+    return (operation + 1 < document -> operationCount) ? document -> operations[operation + 1].first : document -> count;
+}
+
+static int scaleValue(int value, double scale) {
+    return (int)lround(value * scale);
+}
+
+/**
+ * @brief Draws stamps sharing the same brush, each distinct position once.
+ *
+ * The grid mode stamps the same few points again on every mouse move; with one color
+ * the order does not matter, so a repeated stamp is skipped instead of filled again.
+ */
+static void renderStamps(Canvas* canvas, const PaintCommand* stamps, int count, Log* log) {
+    if (count == 1) {
+        stampDraw(canvas, stamps[0].x0, stamps[0].y0, stamps[0].size, stamps[0].shape, stamps[0].color);
+        return;
+    }
+
+    // Open addressing set of the positions drawn, at most half full
+    int capacity = 16;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    uint32_t* drawn = calloc(capacity, sizeof(uint32_t));
+    if (drawn == NULL) {
+        logError(log, 65, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        // Coordinates fit 16 bits in the files, +1 keeps 0 free for empty slots
+        uint32_t key = (((uint32_t)stamps[i].x0 & 0xFFFF) << 16 | ((uint32_t)stamps[i].y0 & 0xFFFF)) + 1;
+        uint32_t slot = (key * 2654435761u) & (capacity - 1);
+        while (drawn[slot] != 0 && drawn[slot] != key) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (drawn[slot] == 0) {
+            drawn[slot] = key;
+            stampDraw(canvas, stamps[i].x0, stamps[i].y0, stamps[i].size, stamps[i].shape, stamps[i].color);
+        }
+    }
+    free(drawn);
+}
+
+Document* documentConstructor(int width, int height, Log* log) {
+    Document* document = malloc(sizeof(Document));
+    if (document == NULL) {
+        logError(log, 87, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    document -> commands = NULL;
+    document -> count = 0;
+    document -> capacity = 0;
+    document -> operations = NULL;
+    document -> operationCount = 0;
+    document -> operationCapacity = 0;
+    document -> position = 0;
+    document -> recording = 0;
+    document -> rasterBase = 0;
+    document -> width = width;
+    document -> height = height;
+    document -> log = log;
+    return document;
+}
+
+void documentDeconstructor(Document* document) {
+    if (document != NULL) {
+        dropCommands(document, 0);
+        free(document -> commands);
+        free(document -> operations);
+        free(document);
+    }
+}
+
+void documentBeginOperation(Document* document) {
+    if (document -> recording) {
+        documentEndOperation(document, 1);
+    }
+
+    // Redoable operations are lost, as in the history
+    if (document -> position < document -> operationCount) {
+        dropCommands(document, document -> operations[document -> position].first);
+        document -> operationCount = document -> position;
+    }
+
+    if (document -> operationCount == document -> operationCapacity) {
+        int capacity = (document -> operationCapacity > 0) ? document -> operationCapacity * 2 : 64;
+        DocumentOperation* operations = realloc(document -> operations, sizeof(DocumentOperation) * capacity);
+        if (operations == NULL) {
+            logError(document -> log, 129, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        document -> operations = operations;
+        document -> operationCapacity = capacity;
+    }
+    document -> operations[document -> operationCount].first = document -> count;
+    document -> operations[document -> operationCount].raster = 0;
+    document -> operationCount++;
+    document -> position = document -> operationCount;
+    document -> recording = 1;
+}
+
+void documentEndOperation(Document* document, int kept) {
+    if (!document -> recording) {
+        return;
+    }
+    document -> recording = 0;
+
+    if (!kept) {
+        document -> operationCount--;
+        dropCommands(document, document -> operations[document -> operationCount].first);
+        document -> position = document -> operationCount;
+    }
+}
+
+void documentAdd(Document* document, const PaintCommand* command) {
+    if (!document -> recording) {
+        documentBeginOperation(document);
+    }
+
+    if (document -> count == document -> capacity) {
+        int capacity = (document -> capacity > 0) ? document -> capacity * 2 : 1024;
+        PaintCommand* commands = realloc(document -> commands, sizeof(PaintCommand) * capacity);
+        if (commands == NULL) {
+            logError(document -> log, 164, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        document -> commands = commands;
+        document -> capacity = capacity;
+    }
+
+    PaintCommand* copy = &document -> commands[document -> count++];
+    *copy = *command;
+    if (command -> text != NULL) {
+        char* text = malloc(strlen(command -> text) + 1);
+        if (text == NULL) {
+            logError(document -> log, 176, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        strcpy(text, command -> text);
+        copy -> text = text;
+    }
+}
+
+void documentMarkRaster(Document* document) {
+    if (document -> recording) {
+        document -> operations[document -> operationCount - 1].raster = 1;
+    } else {
+        document -> rasterBase = 1;
+    }
+}
+
+int documentUndo(Document* document) {
+    if (document -> recording || document -> position == 0) {
+        return 0;
+    }
+    document -> position--;
+    return 1;
+}
+
+int documentRedo(Document* document) {
+    if (document -> recording || document -> position == document -> operationCount) {
+        return 0;
+    }
+    document -> position++;
+    return 1;
+}
+
+int documentOperationStart(const Document* document) {
+    return (document -> operationCount > 0) ? document -> operations[document -> operationCount - 1].first : document -> count;
+}
+
+int documentSave(const Document* document, const char* path) {
+    int end = (document -> position < document -> operationCount) ? document -> operations[document -> position].first : document -> count;
+
+    // Everything before the last reset is hidden by it
+    int start = 0;
+    for (int i = end - 1; i >= 0; --i) {
+        if (document -> commands[i].type == COMMAND_RESET) {
+            start = i + 1;
+            break;
+        }
+    }
+    int raster = (start == 0 && document -> rasterBase);
+    for (int i = 0; i < document -> position && !raster; ++i) {
+        raster = document -> operations[i].raster && operationEnd(document, i) >= start;
+    }
+    if (raster) {
+        logDebug(document -> log, "The drawing holds loaded pixels, it cannot be saved as commands.");
+        return 0;
+    }
+
+    uint8_t* record = malloc(COMMAND_MAX_BYTES);
+    if (record == NULL) {
+        logError(document -> log, 234, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    // Written under a temporary name, the previous document stays until this one is complete
+    char* temporary = malloc(strlen(path) + 5);
+    if (temporary == NULL) {
+        logError(document -> log, 241, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(temporary, "%s.tmp", path);
+
+    FILE* file = fopen(temporary, "wb");
+    if (file == NULL) {
+        logError(document -> log, 248, "Failed to open %s for writing", temporary);
+        free(temporary);
+        free(record);
+        return 0;
+    }
+
+    uint8_t header[DOCUMENT_HEADER_SIZE];
+    memcpy(header, DOCUMENT_MAGIC, 4);
+    put16(header + 4, DOCUMENT_VERSION);
+    put16(header + 6, 0);
+    put32(header + 8, (uint32_t)document -> width);
+    put32(header + 12, (uint32_t)document -> height);
+    int written = (fwrite(header, 1, sizeof(header), file) == sizeof(header));
+
+    CommandEncoder encoder = { 0 };
+    for (int i = start; i < end && written; ++i) {
+        size_t size = commandEncode(&encoder, &document -> commands[i], record);
+        written = (fwrite(record, 1, size, file) == size);
+    }
+    written = (fclose(file) == 0) && written;
+
+    if (written) {
+        remove(path);
+        written = (rename(temporary, path) == 0);
+    }
+    if (!written) {
+        logError(document -> log, 274, "Failed to write %s", path);
+        remove(temporary);
+    }
+    free(temporary);
+    free(record);
+    return written;
+}
+
+int documentLoad(Document* document, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    long length = -1;
+    uint8_t* content = NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= DOCUMENT_HEADER_SIZE && fseek(file, 0, SEEK_SET) == 0) {
+        content = malloc((size_t)length);
+        if (content == NULL) {
+            logError(document -> log, 293, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        if (fread(content, 1, (size_t)length, file) != (size_t)length) {
+            free(content);
+            content = NULL;
+        }
+    }
+    fclose(file);
+
+    int valid = (content != NULL && memcmp(content, DOCUMENT_MAGIC, 4) == 0 && get16(content + 4) == DOCUMENT_VERSION
+                 && get32(content + 8) > 0 && get32(content + 12) > 0);
+
+    // Every record is checked before the drawing is touched
+    size_t offset = DOCUMENT_HEADER_SIZE;
+    while (valid && offset < (size_t)length) {
+        size_t size = commandRecordSize(content + offset, (size_t)length - offset);
+        valid = (size > 0);
+        offset += size;
+    }
+    if (!valid) {
+        logError(document -> log, 314, "%s is not a valid document", path);
+        free(content);
+        return 0;
+    }
+
+    char* text = malloc(COMMAND_TEXT_MAX + 1);
+    if (text == NULL) {
+        logError(document -> log, 321, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    // Same proportions, as large as the canvas allows
+    double scaleX = (double)document -> width / get32(content + 8);
+    double scaleY = (double)document -> height / get32(content + 12);
+    double scale = (scaleX < scaleY) ? scaleX : scaleY;
+
+    PaintCommand command = { 0 };
+    command.type = COMMAND_RESET;
+    documentAdd(document, &command);
+
+    offset = DOCUMENT_HEADER_SIZE;
+    while (offset < (size_t)length) {
+        if (commandDecode(content + offset, &command, text)) {
+            PaintCommand scaled = command;
+            scaled.x0 = scaleValue(command.x0, scale);
+            scaled.y0 = scaleValue(command.y0, scale);
+            scaled.x1 = scaleValue(command.x1, scale);
+            scaled.y1 = scaleValue(command.y1, scale);
+            scaled.size = scaleValue(command.size, scale);
+            if (scaled.type != COMMAND_TEXT && scaled.size > STAMP_MAX_SIZE) scaled.size = STAMP_MAX_SIZE;
+            documentAdd(document, &scaled);
+        }
+        offset += commandRecordSize(content + offset, (size_t)length - offset);
+    }
+
+    free(text);
+    free(content);
+    return 1;
+}
+
+void documentRender(const Document* document, int first, int last, Canvas* canvas, CommandTextRenderer renderText, void* data) {
+    int i = first;
+    while (i < last) {
+        const PaintCommand* command = &document -> commands[i];
+        int end = i + 1;
+        if (command -> type == COMMAND_STAMP) {
+            while (end < last && document -> commands[end].type == COMMAND_STAMP && document -> commands[end].size == command -> size
+                   && document -> commands[end].shape == command -> shape && document -> commands[end].color == command -> color) {
+                end++;
+            }
+            renderStamps(canvas, command, end - i, document -> log);
+        } else {
+            commandApply(canvas, command, renderText, data, document -> log);
+        }
+        i = end;
+    }
+}
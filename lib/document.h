@@ -0,0 +1,162 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "canvas.h"
+#include "command.h"
+#include "logger.h"
+
+/*
+ * Document file, all integers little-endian:
+ *
+ *   Header (16 bytes)
+ *     char[4]  magic     "PDOC"
+ *     uint16   version   DOCUMENT_VERSION
+ *     uint16   reserved  0
+ *     uint32   width     Width of the canvas the commands were drawn on
+ *     uint32   height    Height of the canvas the commands were drawn on
+ *
+ *   Command records of command.h up to the end of the file, starting from a blank canvas.
+ */
+#define DOCUMENT_MAGIC       "PDOC"
+#define DOCUMENT_VERSION     1
+#define DOCUMENT_HEADER_SIZE 16
+
+/**
+ * @brief Group of commands undone and redone together, matching one History operation.
+ */
+typedef struct DocumentOperation {
+    int first;  /**< Index of its first command. */
+    int raster; /**< Non-zero if it also changed pixels no command describes (a loaded image). */
+} DocumentOperation;
+
+/**
+ * @brief The drawing as the list of commands that produced it, instead of its pixels.
+ *
+ * Operations follow the History ones, so undoing and redoing keep the list in step with the
+ * canvas. A drawing made only of commands saves in a few kilobytes and can be drawn again on
+ * a canvas of any size.
+ */
+typedef struct Document {
+    PaintCommand* commands;         /**< Commands, oldest first. Texts are owned by the document. */
+    int count;                      /**< Number of commands stored (applied and redoable). */
+    int capacity;                   /**< Allocated size of `commands`. */
+    DocumentOperation* operations;  /**< Operations, oldest first. */
+    int operationCount;             /**< Number of operations stored. */
+    int operationCapacity;          /**< Allocated size of `operations`. */
+    int position;                   /**< Operations below are applied, operations from here on are redoable. */
+    int recording;                  /**< Non-zero while an operation is open. */
+    int rasterBase;                 /**< Non-zero if the canvas held pixels no command describes before the first operation. */
+    int width;                      /**< Width of the canvas the commands are drawn on. */
+    int height;                     /**< Height of the canvas the commands are drawn on. */
+    Log* log;                       /**< Log used for error handling. */
+} Document;
+
+/**
+ * @brief Constructor function to create an empty Document.
+ *
+ * @param width Width of the canvas.
+ * @param height Height of the canvas.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created Document instance.
+ */
+Document* documentConstructor(int width, int height, Log* log);
+
+/**
+ * @brief Destructor function to free a Document and its commands.
+ *
+ * @param document Pointer to the Document instance to be destroyed.
+ */
+void documentDeconstructor(Document* document);
+
+/**
+ * @brief Opens a new operation, dropping the redoable ones.
+ *
+ * @param document Pointer to the Document instance.
+ */
+void documentBeginOperation(Document* document);
+
+/**
+ * @brief Closes the current operation.
+ *
+ * @param document Pointer to the Document instance.
+ * @param kept Result of historyEndOperation(): the operation is dropped if the history did not keep it.
+ */
+void documentEndOperation(Document* document, int kept);
+
+/**
+ * @brief Appends a command to the current operation, opening one if none is.
+ *
+ * @param document Pointer to the Document instance.
+ * @param command Pointer to the command, its text is copied.
+ */
+void documentAdd(Document* document, const PaintCommand* command);
+
+/**
+ * @brief Records that the current operation (or the canvas before any, if none is open) changed
+ * pixels that no command describes. The document cannot be saved until a reset covers them.
+ *
+ * @param document Pointer to the Document instance.
+ */
+void documentMarkRaster(Document* document);
+
+/**
+ * @brief Moves the last applied operation to the redoable ones.
+ *
+ * @param document Pointer to the Document instance.
+ * @return 1 if an operation was undone, 0 if there was nothing to undo.
+ */
+int documentUndo(Document* document);
+
+/**
+ * @brief Applies again the last undone operation.
+ *
+ * @param document Pointer to the Document instance.
+ * @return 1 if an operation was redone, 0 if there was nothing to redo.
+ */
+int documentRedo(Document* document);
+
+/**
+ * @brief Index of the first command of the operation last opened.
+ *
+ * @param document Pointer to the Document instance.
+ * @return Index in `commands`, or `count` if there is no operation.
+ */
+int documentOperationStart(const Document* document);
+
+/**
+ * @brief Writes the applied commands, from the last reset on, to a document file.
+ *
+ * @param document Pointer to the Document instance.
+ * @param path Path of the file to create or replace.
+ * @return 1 on success, 0 if the drawing holds loaded pixels or the file could not be written.
+ */
+int documentSave(const Document* document, const char* path);
+
+/**
+ * @brief Appends a reset and the commands of a document file to the current operation.
+ *
+ * The commands are scaled to the size of the document, keeping their proportions. Brush
+ * sizes stay within STAMP_MAX_SIZE.
+ *
+ * @param document Pointer to the Document instance.
+ * @param path Path of the document file.
+ * @return 1 on success, 0 if the file is missing or is not a valid document.
+ */
+int documentLoad(Document* document, const char* path);
+
+/**
+ * @brief Draws a range of commands on a canvas.
+ *
+ * Consecutive stamps of the same brush are drawn as one batch, in which a position
+ * stamped several times is filled only once.
+ *
+ * @param document Pointer to the Document instance.
+ * @param first Index of the first command to draw.
+ * @param last Index after the last command to draw.
+ * @param canvas Pointer to the Canvas instance.
+ * @param renderText Renderer used for the texts, which are skipped if NULL.
+ * @param data Passed back to renderText.
+ */
+void documentRender(const Document* document, int first, int last, Canvas* canvas, CommandTextRenderer renderText, void* data);
+
+#endif /* DOCUMENT_H */
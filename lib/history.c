@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+
+#define TILE_BYTES (sizeof(uint32_t) * CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+static size_t entryBytes(const HistoryEntry* entry) {
+    size_t bytes = sizeof(HistoryTile) * entry -> capacity;
+    for (int i = 0; i < entry -> count; ++i) {
+        if (entry -> tiles[i].pixels != NULL) {
+            bytes += TILE_BYTES;
+        }
+    }
+    return bytes;
+}
+
+static void freeEntry(History* history, HistoryEntry* entry) {
+    for (int i = 0; i < entry -> count; ++i) {
+        free(entry -> tiles[i].pixels);
+    }
+    free(entry -> tiles);
+    history -> bytes -= entry -> bytes;
+}
+
+/**
+ * @brief Canvas hook: saves a tile the open operation is about to change.
+ */
+static void saveTile(void* data, Canvas* canvas, int tileIndex) {
+    History* history = data;
+    if (!history -> recording) {
+        return;
+    }
+
+    HistoryEntry* entry = &history -> entries[history -> count - 1];
+    if (entry -> count == entry -> capacity) {
+        int capacity = (entry -> capacity == 0) ? 16 : entry -> capacity * 2;
+        HistoryTile* tiles = realloc(entry -> tiles, sizeof(HistoryTile) * capacity);
+        if (tiles == NULL) {
+            logError(history -> log, 39, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        entry -> tiles = tiles;
+        history -> bytes += sizeof(HistoryTile) * (capacity - entry -> capacity);
+        entry -> bytes += sizeof(HistoryTile) * (capacity - entry -> capacity);
+        entry -> capacity = capacity;
+    }
+
+    HistoryTile* saved = &entry -> tiles[entry -> count++];
+    saved -> index = tileIndex;
+    saved -> pixels = NULL;
+    if (canvas -> tiles[tileIndex] != canvas -> blankTile) {
+        saved -> pixels = malloc(TILE_BYTES);
+        if (saved -> pixels == NULL) {
+            logError(history -> log, 54, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(saved -> pixels, canvas -> tiles[tileIndex], TILE_BYTES);
+        history -> bytes += TILE_BYTES;
+        entry -> bytes += TILE_BYTES;
+    }
+}
+
+/**
+ * @brief Drops the redoable operations.
+ */
+static void dropRedo(History* history) {
+    while (history -> count > history -> position) {
+        freeEntry(history, &history -> entries[--history -> count]);
+    }
+    if (history -> lastChange >= history -> count) {
+        history -> lastChange = -1;
+    }
+}
+
+/**
+ * @brief Forgets the oldest operations until the history fits in its budget.
+ */
+static void enforceBudget(History* history) {
+    int dropped = 0;
+    while (history -> bytes > history -> budget && dropped < history -> count) {
+        freeEntry(history, &history -> entries[dropped++]);
+    }
+    if (dropped > 0) {
+        memmove(history -> entries, history -> entries + dropped, sizeof(HistoryEntry) * (history -> count - dropped));
+        history -> count -= dropped;
+        history -> position = (history -> position > dropped) ? history -> position - dropped : 0;
+        history -> lastChange = (history -> lastChange >= dropped) ? history -> lastChange - dropped : -1;
+    }
+}
+
+/**
+ * @brief Exchanges the tiles of an entry with the canvas ones, turning an undo into a redo and back.
+ */
+static void swapEntry(History* history, HistoryEntry* entry) {
+    for (int i = 0; i < entry -> count; ++i) {
+        canvasSwapTile(history -> canvas, entry -> tiles[i].index, &entry -> tiles[i].pixels);
+    }
+    history -> bytes -= entry -> bytes;
+    entry -> bytes = entryBytes(entry);
+    history -> bytes += entry -> bytes;
+}
+
+History* historyConstructor(Canvas* canvas, size_t budget, Log* log) {
+    History* history = malloc(sizeof(History));
+    if (history == NULL) {
+        logError(log, 106, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    history -> canvas = canvas;
+    history -> entries = NULL;
+    history -> count = 0;
+    history -> capacity = 0;
+    history -> position = 0;
+    history -> recording = 0;
+    history -> lastChange = -1;
+    history -> bytes = 0;
+    history -> budget = budget;
+    history -> log = log;
+
+    canvas -> beforeTileWrite = saveTile;
+    canvas -> hookData = history;
+    return history;
+}
+
+void historyDeconstructor(History* history) {
+    if (history != NULL) {
+        if (history -> canvas -> hookData == history) {
+            history -> canvas -> beforeTileWrite = NULL;
+            history -> canvas -> hookData = NULL;
+        }
+        history -> position = 0;
+        dropRedo(history);
+        free(history -> entries);
+        free(history);
+    }
+}
+
+void historyBeginOperation(History* history) {
+    if (history -> recording) {
+        historyEndOperation(history);
+    }
+    dropRedo(history);
+
+    if (history -> count == history -> capacity) {
+        int capacity = (history -> capacity == 0) ? 32 : history -> capacity * 2;
+        HistoryEntry* entries = realloc(history -> entries, sizeof(HistoryEntry) * capacity);
+        if (entries == NULL) {
+            logError(history -> log, 149, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        history -> entries = entries;
+        history -> capacity = capacity;
+    }
+
+    HistoryEntry* entry = &history -> entries[history -> count++];
+    entry -> tiles = NULL;
+    entry -> count = 0;
+    entry -> capacity = 0;
+    entry -> bytes = 0;
+    history -> position = history -> count;
+    history -> recording = 1;
+    canvasBeginOperation(history -> canvas);
+}
+
+int historyEndOperation(History* history) {
+    if (!history -> recording) {
+        return 0;
+    }
+    history -> recording = 0;
+
+    HistoryEntry* entry = &history -> entries[history -> count - 1];
+    int kept = (entry -> count > 0);
+    history -> lastChange = history -> count - 1;
+    if (!kept) {
+        freeEntry(history, entry);
+        history -> count--;
+        history -> position = history -> count;
+        history -> lastChange = -1;
+    }
+    enforceBudget(history);
+    return kept;
+}
+
+int historyUndo(History* history) {
+    historyEndOperation(history);
+    if (history -> position == 0) {
+        return 0;
+    }
+    swapEntry(history, &history -> entries[--history -> position]);
+    history -> lastChange = history -> position;
+    return 1;
+}
+
+int historyRedo(History* history) {
+    historyEndOperation(history);
+    if (history -> position == history -> count) {
+        return 0;
+    }
+    swapEntry(history, &history -> entries[history -> position++]);
+    history -> lastChange = history -> position - 1;
+    return 1;
+}
+
+const HistoryEntry* historyLastChange(const History* history) {
+    return (history -> lastChange >= 0) ? &history -> entries[history -> lastChange] : NULL;
+}
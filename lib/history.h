@@ -0,0 +1,108 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "canvas.h"
+#include "logger.h"
+
+/**
+ * @brief Copy of one canvas tile, as it was before (or after, once undone) an operation.
+ */
+typedef struct HistoryTile {
+    int index;        /**< Index of the tile in the canvas. */
+    uint32_t* pixels; /**< Saved pixels, NULL when the tile was blank. */
+} HistoryTile;
+
+/**
+ * @brief Tiles changed by one operation (a stroke, a line, a text commit, a reset...).
+ */
+typedef struct HistoryEntry {
+    HistoryTile* tiles; /**< Saved tiles, in the order they were first changed. */
+    int count;          /**< Number of saved tiles. */
+    int capacity;       /**< Allocated size of `tiles`. */
+    size_t bytes;       /**< Memory held by the entry. */
+} HistoryEntry;
+
+/**
+ * @brief Undo/redo stack storing only the tiles each operation changed.
+ *
+ * A tile is copied the first time an operation is about to change it (copy-on-write,
+ * through the canvas tile hook), so an operation costs the tiles it touched and nothing
+ * else. Undoing and redoing swap the saved tiles with the canvas ones without copying.
+ * When the stack holds more than `budget` bytes the oldest operations are forgotten.
+ */
+typedef struct History {
+    Canvas* canvas;         /**< Canvas the history is attached to. */
+    HistoryEntry* entries;  /**< Operations, oldest first. */
+    int count;              /**< Number of operations stored (undoable and redoable). */
+    int capacity;           /**< Allocated size of `entries`. */
+    int position;           /**< Entries below are undoable, entries from here on are redoable. */
+    int recording;          /**< Non-zero while an operation is open. */
+    int lastChange;         /**< Entry last closed, undone or redone, -1 if none or dropped. */
+    size_t bytes;           /**< Memory held by all the entries. */
+    size_t budget;          /**< Maximum memory kept for the history. */
+    Log* log;               /**< Log used for error handling. */
+} History;
+
+/**
+ * @brief Constructor function to create a History and attach it to a canvas.
+ *
+ * @param canvas Pointer to the Canvas instance, whose tile hook is taken over.
+ * @param budget Maximum number of bytes kept for undo and redo.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created History instance.
+ */
+History* historyConstructor(Canvas* canvas, size_t budget, Log* log);
+
+/**
+ * @brief Destructor function to detach a History from its canvas and free the saved tiles.
+ *
+ * @param history Pointer to the History instance to be destroyed.
+ */
+void historyDeconstructor(History* history);
+
+/**
+ * @brief Opens a new operation: every tile changed until historyEndOperation() is saved first.
+ *
+ * Redoable operations are dropped. An operation still open is closed first.
+ *
+ * @param history Pointer to the History instance.
+ */
+void historyBeginOperation(History* history);
+
+/**
+ * @brief Closes the current operation, then forgets the oldest ones while over budget.
+ *
+ * An operation that changed nothing is not kept.
+ *
+ * @param history Pointer to the History instance.
+ * @return 1 if the operation was kept, 0 if it changed nothing or none was open.
+ */
+int historyEndOperation(History* history);
+
+/**
+ * @brief Restores the tiles changed by the last operation.
+ *
+ * @param history Pointer to the History instance.
+ * @return 1 if an operation was undone, 0 if there was nothing to undo.
+ */
+int historyUndo(History* history);
+
+/**
+ * @brief Applies again the last undone operation.
+ *
+ * @param history Pointer to the History instance.
+ * @return 1 if an operation was redone, 0 if there was nothing to redo.
+ */
+int historyRedo(History* history);
+
+/**
+ * @brief Returns the operation last closed, undone or redone, to know which tiles it changed.
+ *
+ * @param history Pointer to the History instance.
+ * @return The entry, or NULL if there is none or it was forgotten since.
+ */
+const HistoryEntry* historyLastChange(const History* history);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,298 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imageFile.h"
+
+#define BMP_HEADER_SIZE 54 // File header (14 bytes) followed by a BITMAPINFOHEADER (40 bytes)
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    put16(dst, value);
+    put16(dst + 2, value >> 16);
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return get16(src) | (get16(src + 2) << 16);
+}
+
+ImageWriter* imageWriterConstructor(const char* path, ImageFormat format, int width, int height, Log* log) {
+    ImageWriter* writer = malloc(sizeof(ImageWriter));
+    if (writer == NULL) {
+        logError(log, 29, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    writer -> format = format;
+    writer -> width = width;
+    writer -> height = height;
+    writer -> rowsWritten = 0;
+    writer -> failed = 0;
+    writer -> log = log;
+    // Bitmap rows are padded to 4 bytes
+    writer -> rowBytes = (format == IMAGE_FORMAT_BMP) ? ((size_t)width * 3 + 3) & ~(size_t)3 : (size_t)width * 3;
+    writer -> row = calloc(writer -> rowBytes > 0 ? writer -> rowBytes : 1, 1);
+    writer -> path = malloc(strlen(path) + 5);
+    if (writer -> row == NULL || writer -> path == NULL) {
+        logError(log, 43, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    // Written under a temporary name, the previous file stays until this one is complete
+    sprintf(writer -> path, "%s.tmp", path);
+    writer -> file = fopen(writer -> path, "wb");
+    if (writer -> file == NULL) {
+        logError(log, 51, "Failed to open %s for writing", writer -> path);
+        free(writer -> row);
+        free(writer -> path);
+        free(writer);
+        return NULL;
+    }
+    strcpy(writer -> path, path);
+
+    if (format == IMAGE_FORMAT_BMP) {
+        uint8_t header[BMP_HEADER_SIZE] = { 'B', 'M' };
+        uint32_t imageBytes = (uint32_t)(writer -> rowBytes * (size_t)height);
+        put32(header + 2, BMP_HEADER_SIZE + imageBytes);
+        put32(header + 10, BMP_HEADER_SIZE);
+        put32(header + 14, 40);
+        put32(header + 18, (uint32_t)width);
+        put32(header + 22, (uint32_t)-height); // Negative: top-down, the rows are written in canvas order
+        put16(header + 26, 1);
+        put16(header + 28, 24);
+        put32(header + 34, imageBytes);
+        put32(header + 38, 2835); // 72 DPI
+        put32(header + 42, 2835);
+        writer -> failed = (fwrite(header, 1, sizeof(header), writer -> file) != sizeof(header));
+    } else {
+        writer -> failed = (fprintf(writer -> file, "P6\n%d %d\n255\n", width, height) < 0);
+    }
+    return writer;
+}
+
+void imageWriteRows(ImageWriter* writer, const uint32_t* pixels, int count, int stride) {
+    int bgr = (writer -> format == IMAGE_FORMAT_BMP);
+    for (int y = 0; y < count && !writer -> failed; ++y, pixels += stride) {
+        uint8_t* dst = writer -> row;
+        for (int x = 0; x < writer -> width; ++x, dst += 3) {
+            dst[0] = (uint8_t)(bgr ? CANVAS_BLUE(pixels[x]) : CANVAS_RED(pixels[x]));
+            dst[1] = (uint8_t)CANVAS_GREEN(pixels[x]);
+            dst[2] = (uint8_t)(bgr ? CANVAS_RED(pixels[x]) : CANVAS_BLUE(pixels[x]));
+        }
+        writer -> failed = (fwrite(writer -> row, 1, writer -> rowBytes, writer -> file) != writer -> rowBytes);
+        writer -> rowsWritten++;
+    }
+}
+
+int imageWriterDeconstructor(ImageWriter* writer) {
+    char* temporary = malloc(strlen(writer -> path) + 5);
+    if (temporary == NULL) {
+        logError(writer -> log, 96, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(temporary, "%s.tmp", writer -> path);
+
+    int complete = (fclose(writer -> file) == 0) && !writer -> failed && writer -> rowsWritten == writer -> height;
+    if (complete) {
+        remove(writer -> path);
+        complete = (rename(temporary, writer -> path) == 0);
+    }
+    if (!complete) {
+        logError(writer -> log, 107, "Failed to write %s", writer -> path);
+        remove(temporary);
+    }
+
+    free(temporary);
+    free(writer -> row);
+    free(writer -> path);
+    free(writer);
+    return complete;
+}
+
+/**
+ * @brief Reads the next number of a PPM header, skipping blanks and comments.
+ *
+ * @return The number, or -1 if there is none or it is larger than IMAGE_MAX_SIZE.
+ */
+static int readHeaderNumber(FILE* file) {
+    int c = fgetc(file);
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+
+    int value = -1;
+    while (c != EOF && isdigit(c)) {
+        value = (value < 0 ? 0 : value * 10) + (c - '0');
+        if (value > IMAGE_MAX_SIZE) {
+            return -1;
+        }
+        c = fgetc(file);
+    }
+    // A single blank ends the number, which for the last one is also the start of the pixels
+    return (c != EOF && isspace(c)) ? value : -1;
+}
+
+/**
+ * @brief Reads the header of a bitmap, the "BM" signature being already read.
+ */
+static int readBitmapHeader(ImageReader* reader) {
+    uint8_t header[BMP_HEADER_SIZE];
+    if (fread(header + 2, 1, BMP_HEADER_SIZE - 2, reader -> file) != BMP_HEADER_SIZE - 2) {
+        return 0;
+    }
+    int32_t height = (int32_t)get32(header + 22);
+    uint32_t bits = get16(header + 28);
+    if (get32(header + 14) < 40 || get16(header + 26) != 1 || (bits != 24 && bits != 32) || get32(header + 30) != 0
+        || height == INT32_MIN || fseek(reader -> file, (long)get32(header + 10), SEEK_SET) != 0) {
+        return 0;
+    }
+
+    reader -> format = IMAGE_FORMAT_BMP;
+    reader -> width = (int32_t)get32(header + 18);
+    reader -> height = (height < 0) ? -height : height;
+    reader -> bottomUp = (height > 0);
+    reader -> channels = (int)bits / 8;
+    reader -> maxValue = 255;
+    return 1;
+}
+
+/**
+ * @brief Reads the header of a binary pixmap, the "P6" signature being already read.
+ */
+static int readPixmapHeader(ImageReader* reader) {
+    reader -> format = IMAGE_FORMAT_PPM;
+    reader -> width = readHeaderNumber(reader -> file);
+    reader -> height = readHeaderNumber(reader -> file);
+    reader -> maxValue = readHeaderNumber(reader -> file);
+    reader -> bottomUp = 0;
+    reader -> channels = 3;
+    // Two bytes per channel above 255, not supported
+    return reader -> maxValue > 0 && reader -> maxValue <= 255;
+}
+
+ImageReader* imageReaderConstructor(const char* path, Log* log) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    ImageReader* reader = malloc(sizeof(ImageReader));
+    if (reader == NULL) {
+        logError(log, 191, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    reader -> file = file;
+    reader -> rowsRead = 0;
+    reader -> row = NULL;
+    reader -> log = log;
+
+    uint8_t signature[2];
+    int valid = 0;
+    if (fread(signature, 1, 2, file) == 2) {
+        if (signature[0] == 'B' && signature[1] == 'M') {
+            valid = readBitmapHeader(reader);
+        } else if (signature[0] == 'P' && signature[1] == '6') {
+            valid = readPixmapHeader(reader);
+        }
+    }
+    valid = valid && reader -> width > 0 && reader -> width <= IMAGE_MAX_SIZE && reader -> height > 0 && reader -> height <= IMAGE_MAX_SIZE;
+    if (!valid) {
+        logError(log, 210, "%s is not a supported image", path);
+        fclose(file);
+        free(reader);
+        return NULL;
+    }
+
+    reader -> rowBytes = (size_t)reader -> width * reader -> channels;
+    if (reader -> format == IMAGE_FORMAT_BMP) {
+        reader -> rowBytes = (reader -> rowBytes + 3) & ~(size_t)3;
+    }
+    reader -> row = malloc(reader -> rowBytes);
+    if (reader -> row == NULL) {
+        logError(log, 222, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    return reader;
+}
+
+int imageReadRow(ImageReader* reader, uint32_t* pixels) {
+    if (reader -> rowsRead == reader -> height || fread(reader -> row, 1, reader -> rowBytes, reader -> file) != reader -> rowBytes) {
+        return -1;
+    }
+
+    const uint8_t* src = reader -> row;
+    if (reader -> format == IMAGE_FORMAT_BMP) {
+        for (int x = 0; x < reader -> width; ++x, src += reader -> channels) {
+            pixels[x] = CANVAS_RGB(src[2], src[1], src[0]);
+        }
+    } else if (reader -> maxValue == 255) {
+        for (int x = 0; x < reader -> width; ++x, src += 3) {
+            pixels[x] = CANVAS_RGB(src[0], src[1], src[2]);
+        }
+    } else {
+        int full = reader -> maxValue;
+        for (int x = 0; x < reader -> width; ++x, src += 3) {
+            int r = (src[0] > full) ? full : src[0];
+            int g = (src[1] > full) ? full : src[1];
+            int b = (src[2] > full) ? full : src[2];
+            pixels[x] = CANVAS_RGB(r * 255 / full, g * 255 / full, b * 255 / full);
+        }
+    }
+
+    int row = reader -> rowsRead++;
+    return reader -> bottomUp ? reader -> height - 1 - row : row;
+}
+
+void imageReaderDeconstructor(ImageReader* reader) {
+    if (reader != NULL) {
+        fclose(reader -> file);
+        free(reader -> row);
+        free(reader);
+    }
+}
+
+int imageSaveCanvas(const Canvas* canvas, const char* path, ImageFormat format, Log* log) {
+    ImageWriter* writer = imageWriterConstructor(path, format, canvas -> width, canvas -> height, log);
+    if (writer == NULL) {
+        return 0;
+    }
+
+    // One band of tiles at a time, each row read with one memcpy per tile
+    uint32_t* band = malloc(sizeof(uint32_t) * canvas -> width * CANVAS_TILE_SIZE);
+    if (band == NULL) {
+        logError(log, 273, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    for (int y = 0; y < canvas -> height && !writer -> failed; y += CANVAS_TILE_SIZE) {
+        int rows = (canvas -> height - y < CANVAS_TILE_SIZE) ? canvas -> height - y : CANVAS_TILE_SIZE;
+        canvasReadRegion(canvas, 0, y, canvas -> width, rows, band, canvas -> width);
+        imageWriteRows(writer, band, rows, canvas -> width);
+    }
+    free(band);
+    return imageWriterDeconstructor(writer);
+}
+
+int imageLoadCanvas(ImageReader* reader, Canvas* canvas) {
+    uint32_t* pixels = malloc(sizeof(uint32_t) * reader -> width);
+    if (pixels == NULL) {
+        logError(reader -> log, 288, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    int y;
+    while ((y = imageReadRow(reader, pixels)) >= 0) {
+        canvasWriteRegion(canvas, 0, y, reader -> width, 1, pixels, reader -> width);
+    }
+    free(pixels);
+    return reader -> rowsRead == reader -> height;
+}
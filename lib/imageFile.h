@@ -0,0 +1,132 @@
+#ifndef IMAGE_FILE_H
+#define IMAGE_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "canvas.h"
+#include "logger.h"
+
+// Largest width or height accepted from an image file.
+#define IMAGE_MAX_SIZE 65535
+
+/**
+ * @brief Uncompressed image formats, both 8 bits per channel.
+ */
+typedef enum ImageFormat {
+    IMAGE_FORMAT_NONE = 0,
+    IMAGE_FORMAT_BMP = 1, /**< Windows bitmap, 24-bit BI_RGB, written top-down. 32-bit ones are read too. */
+    IMAGE_FORMAT_PPM = 2  /**< Binary portable pixmap (P6). */
+} ImageFormat;
+
+/**
+ * @brief Encoder writing an image one row at a time, so memory does not depend on its height.
+ */
+typedef struct ImageWriter {
+    FILE* file;         /**< Temporary file being written. */
+    char* path;         /**< Path the file gets once complete. */
+    ImageFormat format; /**< Format being written. */
+    int width;          /**< Width of the image in pixels. */
+    int height;         /**< Height of the image in pixels. */
+    int rowsWritten;    /**< Rows written so far. */
+    uint8_t* row;       /**< One encoded row. */
+    size_t rowBytes;    /**< Size of an encoded row, padding included. */
+    int failed;         /**< Non-zero once a write failed. */
+    Log* log;           /**< Log used for error handling. */
+} ImageWriter;
+
+/**
+ * @brief Decoder reading an image one row at a time, in the order the rows are stored.
+ */
+typedef struct ImageReader {
+    FILE* file;         /**< Image file. */
+    ImageFormat format; /**< Format of the file. */
+    int width;          /**< Width of the image in pixels. */
+    int height;         /**< Height of the image in pixels. */
+    int bottomUp;       /**< Non-zero if the rows are stored from the bottom one up. */
+    int channels;       /**< Bytes per pixel in the file. */
+    int maxValue;       /**< Value of a full channel (PPM), 255 for a bitmap. */
+    int rowsRead;       /**< Rows read so far. */
+    uint8_t* row;       /**< One encoded row. */
+    size_t rowBytes;    /**< Size of an encoded row, padding included. */
+    Log* log;           /**< Log used for error handling. */
+} ImageReader;
+
+/**
+ * @brief Creates an image file and writes its header.
+ *
+ * The file is written under a temporary name and only replaces `path` once complete.
+ *
+ * @param path Path of the file to create or replace.
+ * @param format Format to write.
+ * @param width Width of the image in pixels.
+ * @param height Height of the image in pixels.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created ImageWriter, or NULL if the file cannot be created.
+ */
+ImageWriter* imageWriterConstructor(const char* path, ImageFormat format, int width, int height, Log* log);
+
+/**
+ * @brief Encodes and writes the next rows of the image, from the top one down.
+ *
+ * @param writer Pointer to the ImageWriter instance.
+ * @param pixels First row, canvas pixels (0x00RRGGBB).
+ * @param count Number of rows.
+ * @param stride Distance between two rows of `pixels`, in pixels.
+ */
+void imageWriteRows(ImageWriter* writer, const uint32_t* pixels, int count, int stride);
+
+/**
+ * @brief Closes the file, gives it its final name if every row was written, then frees the writer.
+ *
+ * @param writer Pointer to the ImageWriter instance, invalid once this returns.
+ * @return 1 if the image is complete, 0 otherwise (the partial file is removed).
+ */
+int imageWriterDeconstructor(ImageWriter* writer);
+
+/**
+ * @brief Opens an image file and reads its header. The format is found from the content.
+ *
+ * @param path Path of the image file.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created ImageReader, or NULL if the file is missing or not supported.
+ */
+ImageReader* imageReaderConstructor(const char* path, Log* log);
+
+/**
+ * @brief Reads and decodes the next row stored in the file.
+ *
+ * @param reader Pointer to the ImageReader instance.
+ * @param pixels Destination, `width` canvas pixels.
+ * @return Row of the image the pixels belong to (rows of a bottom-up bitmap come last first),
+ *         or -1 once every row was read or if the file is cut short.
+ */
+int imageReadRow(ImageReader* reader, uint32_t* pixels);
+
+/**
+ * @brief Closes the file and frees the reader.
+ *
+ * @param reader Pointer to the ImageReader instance to be destroyed.
+ */
+void imageReaderDeconstructor(ImageReader* reader);
+
+/**
+ * @brief Writes a whole canvas to an image file, CANVAS_TILE_SIZE rows at a time.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param path Path of the file to create or replace.
+ * @param format Format to write.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int imageSaveCanvas(const Canvas* canvas, const char* path, ImageFormat format, Log* log);
+
+/**
+ * @brief Writes every row of an image onto a canvas, clipped like the drawing calls.
+ *
+ * @param reader Pointer to the ImageReader instance, just constructed.
+ * @param canvas Pointer to the Canvas instance.
+ * @return 1 on success, 0 if the file is cut short.
+ */
+int imageLoadCanvas(ImageReader* reader, Canvas* canvas);
+
+#endif /* IMAGE_FILE_H */
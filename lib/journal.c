@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+#include "snapshot.h"
+
+#define JOURNAL_BUFFER (64 * 1024)
+#define TILE_PIXELS    (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    put16(dst, value);
+    put16(dst + 2, value >> 16);
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return get16(src) | (get16(src + 2) << 16);
+}
+
+static void appendBytes(Journal* journal, const uint8_t* bytes, size_t count) {
+    if (journal -> used + count > JOURNAL_BUFFER) {
+        journalFlush(journal);
+    }
+    if (count > JOURNAL_BUFFER) {
+        if (journal -> file != NULL) {
+            fwrite(bytes, 1, count, journal -> file);
+        }
+    } else {
+        memcpy(journal -> buffer + journal -> used, bytes, count);
+        journal -> used += count;
+    }
+    journal -> size += (long)count;
+}
+
+/**
+ * @brief Creates the journal file with only a header, replacing any previous one.
+ */
+static void startFile(Journal* journal, int base) {
+    if (journal -> file != NULL) {
+        fclose(journal -> file);
+    }
+    journal -> file = fopen(journal -> path, "wb");
+    if (journal -> file == NULL) {
+        logError(journal -> log, 52, "Failed to open %s for writing", journal -> path);
+    }
+
+    journal -> used = 0;
+    journal -> size = 0;
+    journal -> mark = -1;
+    journal -> encoder.stateWritten = 0;
+
+    uint8_t header[JOURNAL_HEADER_SIZE];
+    memcpy(header, JOURNAL_MAGIC, 4);
+    put16(header + 4, JOURNAL_VERSION);
+    put16(header + 6, (uint32_t)base);
+    put32(header + 8, (uint32_t)journal -> width);
+    put32(header + 12, (uint32_t)journal -> height);
+    appendBytes(journal, header, sizeof(header));
+}
+
+/**
+ * @brief Size of the record at `data`, or 0 if it is cut short or unknown.
+ */
+static size_t recordSize(const uint8_t* data, size_t remaining) {
+    if (data[0] != JOURNAL_RECORD_TILES) {
+        return commandRecordSize(data, remaining);
+    }
+    if (remaining < 3) {
+        return 0;
+    }
+    size_t size = 3;
+    for (uint32_t i = 0; i < get16(data + 1); ++i) {
+        if (remaining - size < 4) {
+            return 0;
+        }
+        size_t tile = snapshotTileRecordSize(data + size + 4, remaining - size - 4);
+        if (tile == 0) {
+            return 0;
+        }
+        size += 4 + tile;
+    }
+    return size;
+}
+
+/**
+ * @brief Applies the records of `data` to the canvas, stopping at the first incomplete one.
+ *
+ * @return Number of bytes of complete records.
+ */
+static size_t replay(const uint8_t* data, size_t size, Canvas* canvas, CommandTextRenderer renderText, void* userData, int* records, Log* log) {
+    PaintCommand command = { 0 };
+    uint32_t* pixels = NULL;
+    char* text = malloc(COMMAND_TEXT_MAX + 1);
+    if (text == NULL) {
+        logError(log, 103, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t offset = 0;
+    for (;;) {
+        size_t record = (offset < size) ? recordSize(data + offset, size - offset) : 0;
+        if (record == 0) {
+            break;
+        }
+        const uint8_t* p = data + offset;
+        if (p[0] != JOURNAL_RECORD_TILES) {
+            if (commandDecode(p, &command, text)) {
+                commandApply(canvas, &command, renderText, userData, log);
+            }
+        } else {
+            if (pixels == NULL && (pixels = malloc(sizeof(uint32_t) * TILE_PIXELS)) == NULL) {
+                logError(log, 120, "Memory Allocation Error");
+                exit(EXIT_FAILURE);
+            }
+            size_t tileOffset = 3;
+            for (uint32_t i = 0; i < get16(p + 1); ++i) {
+                uint32_t index = get32(p + tileOffset);
+                size_t tile = snapshotTileRecordSize(p + tileOffset + 4, record - tileOffset - 4);
+                if (index < (uint32_t)(canvas -> tilesX * canvas -> tilesY)) {
+                    snapshotDecodeTile(p + tileOffset + 4, canvas -> background, pixels);
+                    canvasWriteTile(canvas, (int)index % canvas -> tilesX, (int)index / canvas -> tilesX, pixels);
+                }
+                tileOffset += 4 + tile;
+            }
+        }
+        (*records)++;
+        offset += record;
+    }
+
+    free(pixels);
+    free(text);
+    return offset;
+}
+
+Journal* journalConstructor(const char* path, int width, int height, Log* log) {
+    Journal* journal = malloc(sizeof(Journal));
+    if (journal == NULL) {
+        logError(log, 146, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    journal -> path = malloc(strlen(path) + 1);
+    journal -> buffer = malloc(JOURNAL_BUFFER);
+    journal -> scratch = malloc((COMMAND_MAX_BYTES > 4 + SNAPSHOT_TILE_MAX_BYTES) ? COMMAND_MAX_BYTES : 4 + SNAPSHOT_TILE_MAX_BYTES);
+    if (journal -> path == NULL || journal -> buffer == NULL || journal -> scratch == NULL) {
+        logError(log, 153, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(journal -> path, path);
+    journal -> file = NULL;
+    journal -> used = 0;
+    journal -> size = 0;
+    journal -> mark = -1;
+    journal -> width = width;
+    journal -> height = height;
+    journal -> encoder.stateWritten = 0;
+    journal -> log = log;
+    return journal;
+}
+
+void journalDeconstructor(Journal* journal) {
+    if (journal != NULL) {
+        journalFlush(journal);
+        if (journal -> file != NULL) {
+            fclose(journal -> file);
+        }
+        free(journal -> buffer);
+        free(journal -> scratch);
+        free(journal -> path);
+        free(journal);
+    }
+}
+
+int journalRecover(Journal* journal, Canvas* canvas, const char* snapshotPath, CommandTextRenderer renderText, void* data) {
+    int records = 0;
+    int base = JOURNAL_BASE_BLANK;
+    uint8_t* content = NULL;
+    size_t valid = 0;
+
+    FILE* file = fopen(journal -> path, "rb");
+    if (file != NULL) {
+        long length = -1;
+        if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= JOURNAL_HEADER_SIZE && fseek(file, 0, SEEK_SET) == 0) {
+            content = malloc((size_t)length);
+            if (content == NULL) {
+                logError(journal -> log, 193, "Memory Allocation Error");
+                exit(EXIT_FAILURE);
+            }
+            if (fread(content, 1, (size_t)length, file) != (size_t)length
+                || memcmp(content, JOURNAL_MAGIC, 4) != 0 || get16(content + 4) != JOURNAL_VERSION) {
+                free(content);
+                content = NULL;
+            }
+        }
+        fclose(file);
+
+        if (content != NULL) {
+            base = (int)get16(content + 6);
+            if (base == JOURNAL_BASE_SNAPSHOT && !snapshotLoad(canvas, snapshotPath, journal -> log)) {
+                logError(journal -> log, 207, "The snapshot the journal is based on could not be loaded");
+            }
+            valid = replay(content + JOURNAL_HEADER_SIZE, (size_t)length - JOURNAL_HEADER_SIZE, canvas, renderText, data, &records, journal -> log);
+        }
+    }
+
+    // Keep the complete records, the journal goes on from there
+    startFile(journal, base);
+    if (content != NULL) {
+        appendBytes(journal, content + JOURNAL_HEADER_SIZE, valid);
+        journalFlush(journal);
+        free(content);
+    }
+    return records;
+}
+
+void journalRecord(Journal* journal, const PaintCommand* command) {
+    if (command -> type == COMMAND_RESET) {
+        journalRebase(journal, JOURNAL_BASE_BLANK);
+        return;
+    }
+    appendBytes(journal, journal -> scratch, commandEncode(&journal -> encoder, command, journal -> scratch));
+}
+
+void journalRecordTiles(Journal* journal, const Canvas* canvas, const HistoryEntry* entry) {
+    int total = (entry != NULL) ? entry -> count : canvas -> tilesX * canvas -> tilesY;
+    uint8_t* scratch = journal -> scratch;
+
+    for (int first = 0; first < total; first += 0xFFFF) {
+        int count = (total - first < 0xFFFF) ? total - first : 0xFFFF;
+        uint8_t header[3] = { JOURNAL_RECORD_TILES };
+        put16(header + 1, (uint32_t)count);
+        appendBytes(journal, header, sizeof(header));
+
+        for (int i = first; i < first + count; ++i) {
+            int index = (entry != NULL) ? entry -> tiles[i].index : i;
+            const uint32_t* pixels = canvasGetTile(canvas, index % canvas -> tilesX, index / canvas -> tilesX);
+            put32(scratch, (uint32_t)index);
+            size_t size = snapshotEncodeTile((pixels != canvas -> blankTile) ? pixels : NULL, canvas -> background, scratch + 4);
+            appendBytes(journal, scratch, 4 + size);
+        }
+    }
+}
+
+void journalRebase(Journal* journal, int base) {
+    startFile(journal, base);
+    journalFlush(journal);
+}
+
+void journalMarkSave(Journal* journal) {
+    journal -> mark = journal -> size;
+    // Records after the mark must not depend on color or brush records before it
+    journal -> encoder.stateWritten = 0;
+}
+
+void journalSaveDone(Journal* journal, int saved) {
+    long mark = journal -> mark;
+    journal -> mark = -1;
+    if (!saved || mark < 0) {
+        return;
+    }
+
+    // Read back what was appended while the snapshot was being written
+    journalFlush(journal);
+    size_t length = (size_t)(journal -> size - mark);
+    uint8_t* tail = malloc(length > 0 ? length : 1);
+    if (tail == NULL) {
+        logError(journal -> log, 274, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    FILE* file = fopen(journal -> path, "rb");
+    int readBack = (file != NULL && fseek(file, mark, SEEK_SET) == 0 && fread(tail, 1, length, file) == length);
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    // Without the tail the journal stays as it is: complete, only longer than needed
+    if (readBack) {
+        CommandEncoder encoder = journal -> encoder;
+        startFile(journal, JOURNAL_BASE_SNAPSHOT);
+        appendBytes(journal, tail, length);
+        journalFlush(journal);
+        journal -> encoder = encoder;
+    }
+    free(tail);
+}
+
+void journalFlush(Journal* journal) {
+    if (journal -> file == NULL) {
+        journal -> used = 0;
+        return;
+    }
+    if (journal -> used > 0 && fwrite(journal -> buffer, 1, journal -> used, journal -> file) != journal -> used) {
+        logError(journal -> log, 300, "Failed to write %s", journal -> path);
+    }
+    journal -> used = 0;
+    fflush(journal -> file);
+}
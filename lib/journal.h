@@ -0,0 +1,139 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "canvas.h"
+#include "command.h"
+#include "history.h"
+#include "logger.h"
+
+/*
+ * Journal file, all integers little-endian:
+ *
+ *   Header (16 bytes)
+ *     char[4]  magic     "PJRN"
+ *     uint16   version   JOURNAL_VERSION
+ *     uint16   base      JOURNAL_BASE_BLANK or JOURNAL_BASE_SNAPSHOT: what the records are replayed on
+ *     uint32   width     Canvas width when the journal was started
+ *     uint32   height    Canvas height when the journal was started
+ *
+ *   Records: the command records of command.h, and
+ *     TILES    uint8 JOURNAL_RECORD_TILES, uint16 count, then `count` times uint32 tile index
+ *              and a snapshot tile record
+ */
+#define JOURNAL_MAGIC          "PJRN"
+#define JOURNAL_VERSION        1
+#define JOURNAL_HEADER_SIZE    16
+
+#define JOURNAL_BASE_BLANK     0
+#define JOURNAL_BASE_SNAPSHOT  1
+
+#define JOURNAL_RECORD_TILES   7 // Follows the COMMAND_RECORD_ types
+
+/**
+ * @brief Append-only log of the drawing operations done since the last snapshot (or a blank canvas).
+ *
+ * Records are a few bytes each and are kept in memory until journalFlush() writes them as one
+ * group, so keeping the journal up to date costs only the bytes of the new operations.
+ * Operations that cannot be replayed from their parameters (undo, redo, loading a CSV) are
+ * recorded as the tiles they changed.
+ */
+typedef struct Journal {
+    char* path;         /**< Path of the journal file. */
+    FILE* file;         /**< Journal file, open for appending. */
+    uint8_t* buffer;    /**< Records not written to the file yet. */
+    size_t used;        /**< Bytes used in `buffer`. */
+    long size;          /**< Size of the journal, written and buffered records included. */
+    long mark;          /**< Size of the journal when the running save copied the canvas, -1 if none. */
+    int width;          /**< Canvas width written in the header. */
+    int height;         /**< Canvas height written in the header. */
+    CommandEncoder encoder; /**< Color and brush the records are at. */
+    uint8_t* scratch;   /**< Encoding buffer for one command or one tile. */
+    Log* log;           /**< Log used for error handling. */
+} Journal;
+
+/**
+ * @brief Constructor function to create a Journal. The file is opened by journalRecover().
+ *
+ * @param path Path of the journal file.
+ * @param width Width of the canvas.
+ * @param height Height of the canvas.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created Journal instance.
+ */
+Journal* journalConstructor(const char* path, int width, int height, Log* log);
+
+/**
+ * @brief Flushes the pending records and closes the journal. The file is kept for the next start.
+ *
+ * @param journal Pointer to the Journal instance to be destroyed.
+ */
+void journalDeconstructor(Journal* journal);
+
+/**
+ * @brief Replays the journal left by the previous run, then opens it to record new operations.
+ *
+ * If the journal is based on a snapshot, the snapshot is loaded first. A record cut short
+ * by a crash ends the replay and is dropped from the file.
+ *
+ * @param journal Pointer to the Journal instance.
+ * @param canvas Pointer to the Canvas instance, expected blank.
+ * @param snapshotPath Path of the snapshot the journal may be based on.
+ * @param renderText Renderer for the text records.
+ * @param data Passed back to renderText.
+ * @return Number of records replayed.
+ */
+int journalRecover(Journal* journal, Canvas* canvas, const char* snapshotPath, CommandTextRenderer renderText, void* data);
+
+/**
+ * @brief Appends a drawing operation. COMMAND_RESET starts a new journal based on a blank canvas.
+ *
+ * @param journal Pointer to the Journal instance.
+ * @param command Pointer to the command just applied to the canvas.
+ */
+void journalRecord(Journal* journal, const PaintCommand* command);
+
+/**
+ * @brief Appends the current content of the tiles an operation changed.
+ *
+ * @param journal Pointer to the Journal instance.
+ * @param canvas Pointer to the Canvas instance.
+ * @param entry History entry listing the tiles, or NULL to record every tile.
+ */
+void journalRecordTiles(Journal* journal, const Canvas* canvas, const HistoryEntry* entry);
+
+/**
+ * @brief Drops every record and starts the journal again from the given base.
+ *
+ * @param journal Pointer to the Journal instance.
+ * @param base JOURNAL_BASE_BLANK or JOURNAL_BASE_SNAPSHOT, which the canvas must match.
+ */
+void journalRebase(Journal* journal, int base);
+
+/**
+ * @brief Remembers the current end of the journal, when a save copies the canvas.
+ *
+ * @param journal Pointer to the Journal instance.
+ */
+void journalMarkSave(Journal* journal);
+
+/**
+ * @brief Called once a save started with journalMarkSave() is over.
+ *
+ * If the snapshot was written, the journal is based on it and keeps only the records
+ * appended since the mark.
+ *
+ * @param journal Pointer to the Journal instance.
+ * @param saved Non-zero if the snapshot was written.
+ */
+void journalSaveDone(Journal* journal, int saved);
+
+/**
+ * @brief Writes the pending records to the file as one group.
+ *
+ * @param journal Pointer to the Journal instance.
+ */
+void journalFlush(Journal* journal);
+
+#endif /* JOURNAL_H */
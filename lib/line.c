@@ -0,0 +1,130 @@
+#include <math.h>
+#include <stdlib.h>
+#include "line.h"
+
+// Tolerance used when rounding outline edges to pixel centers
+#define LINE_EPSILON 1e-9
+
+/**
+ * @brief Grows [*left, *right] to include the pixels of the real interval [a, b].
+ */
+static void includeInterval(double a, double b, int* left, int* right) {
+    int first = (int)ceil(a - LINE_EPSILON);
+    int last = (int)floor(b + LINE_EPSILON);
+    if (first > last) {
+        return;
+    }
+    if (first < *left) *left = first;
+    if (last > *right) *right = last;
+}
+
+/**
+ * @brief Row y of the area swept by the square [-h, h] x [-h, h] along the segment.
+ */
+static void squareRow(int y, int x0, int y0, int dx, int dy, int h, int* left, int* right) {
+    double tLow = 0.0, tHigh = 1.0;
+    if (dy == 0) {
+        if (abs(y - y0) > h) {
+            return;
+        }
+    } else {
+        // Positions of the segment whose square still reaches row y
+        double ta = (double)(y - h - y0) / dy;
+        double tb = (double)(y + h - y0) / dy;
+        if (ta > tb) {
+            double swap = ta; ta = tb; tb = swap;
+        }
+        if (ta > tLow) tLow = ta;
+        if (tb < tHigh) tHigh = tb;
+        if (tLow > tHigh) {
+            return;
+        }
+    }
+    double xa = x0 + tLow * dx;
+    double xb = x0 + tHigh * dx;
+    includeInterval(fmin(xa, xb) - h, fmax(xa, xb) + h, left, right);
+}
+
+/**
+ * @brief Row y of the band of half-thickness h around the segment, between its two ends.
+ */
+static void bandRow(int y, int x0, int y0, int dx, int dy, int h, int* left, int* right) {
+    double low = -INFINITY, high = INFINITY;
+    double lengthSq = (double)dx * dx + (double)dy * dy;
+    double length = sqrt(lengthSq);
+    int ry = y - y0;
+
+    // Projection on the segment within [0, 1]: 0 <= (rx * dx + ry * dy) / lengthSq <= 1
+    if (dx == 0) {
+        double t = (double)ry * dy / lengthSq;
+        if (t < 0.0 || t > 1.0) return;
+    } else {
+        double a = (0.0 - (double)ry * dy) / dx;
+        double b = (lengthSq - (double)ry * dy) / dx;
+        low = fmax(low, fmin(a, b));
+        high = fmin(high, fmax(a, b));
+    }
+
+    // Distance to the supporting line at most h: |rx * dy - ry * dx| <= h * length
+    if (dy == 0) {
+        if (fabs((double)ry * dx) > h * length) return;
+    } else {
+        double a = ((double)ry * dx - h * length) / dy;
+        double b = ((double)ry * dx + h * length) / dy;
+        low = fmax(low, fmin(a, b));
+        high = fmin(high, fmax(a, b));
+    }
+
+    if (low <= high) {
+        includeInterval(x0 + low, x0 + high, left, right);
+    }
+}
+
+/**
+ * @brief Row y of a round cap, using the same span table as the circle brush.
+ */
+static void capRow(int y, int cx, int cy, const int* widths, int h, int* left, int* right) {
+    int dy = y - cy;
+    if (dy < -h || dy > h) {
+        return;
+    }
+    int width = widths[dy + h];
+    if (cx - width < *left) *left = cx - width;
+    if (cx + width > *right) *right = cx + width;
+}
+
+void lineDrawThick(Canvas* canvas, int x0, int y0, int x1, int y1, int size, StampShape cap, uint32_t color) {
+    int h = size / 2;
+    if (h > STAMP_MAX_SIZE / 2) h = STAMP_MAX_SIZE / 2;
+    if (h == 0) {
+        // The outline of a one pixel line has no width, most rows would get no span
+        canvasDrawLine(canvas, x0, y0, x1, y1, color);
+        return;
+    }
+    const int* widths = stampHalfWidths(STAMP_CIRCLE, size);
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+
+    int top = ((y0 < y1) ? y0 : y1) - h;
+    int bottom = ((y0 > y1) ? y0 : y1) + h;
+    if (top < canvas -> clipTop) top = canvas -> clipTop;
+    if (bottom >= canvas -> clipBottom) bottom = canvas -> clipBottom - 1;
+
+    for (int y = top; y <= bottom; ++y) {
+        // The outline is convex, so every row is a single span
+        int left = INT32_MAX;
+        int right = INT32_MIN;
+        if (cap == STAMP_SQUARE) {
+            squareRow(y, x0, y0, dx, dy, h, &left, &right);
+        } else {
+            capRow(y, x0, y0, widths, h, &left, &right);
+            capRow(y, x1, y1, widths, h, &left, &right);
+            if (dx != 0 || dy != 0) {
+                bandRow(y, x0, y0, dx, dy, h, &left, &right);
+            }
+        }
+        if (left <= right) {
+            canvasFillSpan(canvas, y, left, right + 1, color);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef LINE_H
+#define LINE_H
+
+#include "canvas.h"
+#include "stamp.h"
+
+/**
+ * @brief Draws a thick line in a single pass over its outline.
+ *
+ * With STAMP_SQUARE the line is the area swept by a square brush (square caps), with
+ * STAMP_CIRCLE it is a capsule whose round caps are the circle brush. Each row of the
+ * outline is computed directly and filled with one span, clipped to the canvas clip rectangle.
+ * Sizes 0 and 1 draw the one pixel line of canvasDrawLine().
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param x0, y0 Starting point of the line.
+ * @param x1, y1 Ending point of the line.
+ * @param size Brush size, the line is size/2 * 2 + 1 pixels thick.
+ * @param cap Shape of the brush giving the caps.
+ * @param color Color of the line.
+ */
+void lineDrawThick(Canvas* canvas, int x0, int y0, int x1, int y1, int size, StampShape cap, uint32_t color);
+
+#endif /* LINE_H */
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct MappedFile {
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    const uint8_t* data;
+    size_t size;
+};
+
+MappedFile* mappedFileOpen(const char* path, Log* log) {
+    MappedFile* mapped = malloc(sizeof(MappedFile));
+    if (mapped == NULL) {
+        logError(log, 25, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    mapped -> data = NULL;
+    mapped -> size = 0;
+
+#ifdef _WIN32
+    mapped -> mapping = NULL;
+    mapped -> file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (mapped -> file != INVALID_HANDLE_VALUE && GetFileSizeEx(mapped -> file, &size) && size.QuadPart > 0
+        && (uint64_t)size.QuadPart <= (size_t)-1) {
+        mapped -> size = (size_t)size.QuadPart;
+        mapped -> mapping = CreateFileMappingA(mapped -> file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapped -> mapping != NULL) {
+            mapped -> data = MapViewOfFile(mapped -> mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+    if (mapped -> data == NULL) {
+        if (mapped -> mapping != NULL) {
+            CloseHandle(mapped -> mapping);
+        }
+        if (mapped -> file != INVALID_HANDLE_VALUE) {
+            CloseHandle(mapped -> file);
+        }
+    }
+#else
+    int descriptor = open(path, O_RDONLY);
+    struct stat status;
+    if (descriptor >= 0 && fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        void* data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (data != MAP_FAILED) {
+            mapped -> data = data;
+            mapped -> size = (size_t)status.st_size;
+        }
+    }
+    // The mapping stays valid once the descriptor is closed
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+#endif
+
+    if (mapped -> data == NULL) {
+        free(mapped);
+        return NULL;
+    }
+    return mapped;
+}
+
+void mappedFileClose(MappedFile* file) {
+    if (file != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile(file -> data);
+        CloseHandle(file -> mapping);
+        CloseHandle(file -> file);
+#else
+        munmap((void*)file -> data, file -> size);
+#endif
+        free(file);
+    }
+}
+
+const uint8_t* mappedFileData(const MappedFile* file) {
+    return file -> data;
+}
+
+size_t mappedFileSize(const MappedFile* file) {
+    return file -> size;
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "logger.h"
+
+/**
+ * @brief Read-only view of a whole file, mapped with Win32 file mappings or POSIX mmap().
+ *
+ * Nothing is read when the file is opened: the system reads a page the first time it is
+ * touched, so only the parts of the file actually used are read from the disk.
+ */
+typedef struct MappedFile MappedFile;
+
+/**
+ * @brief Maps a whole file into memory.
+ *
+ * @param path Path of the file.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the new MappedFile, or NULL if the file is missing, empty or cannot be mapped.
+ */
+MappedFile* mappedFileOpen(const char* path, Log* log);
+
+/**
+ * @brief Unmaps a file, then frees it.
+ *
+ * @param file Pointer to the MappedFile instance, invalid once this returns.
+ */
+void mappedFileClose(MappedFile* file);
+
+/**
+ * @brief First byte of the file, valid until mappedFileClose().
+ */
+const uint8_t* mappedFileData(const MappedFile* file);
+
+/**
+ * @brief Size of the file in bytes.
+ */
+size_t mappedFileSize(const MappedFile* file);
+
+#endif /* MAPPED_FILE_H */
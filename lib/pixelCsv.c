@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "pixelCsv.h"
+#include "thread.h"
+
+// Parts smaller than this are not worth a thread of their own.
+#define MIN_CHUNK_BYTES (1024 * 1024)
+#define MAX_CHUNKS      64
+
+/**
+ * @brief Part of the file parsed by one thread, always ending after a newline or at the end of the file.
+ */
+typedef struct Chunk {
+    const char* begin;
+    const char* end;
+    uint32_t* pixels; /**< Copy of the canvas, shared by every chunk. */
+    int width;
+    int height;
+} Chunk;
+
+/**
+ * @brief Reads an unsigned decimal number.
+ *
+ * @return Pointer past the digits, or NULL if there is no digit or the number is too large.
+ */
+static const char* scanNumber(const char* p, const char* end, unsigned int* value) {
+    if (p >= end || (unsigned int)(*p - '0') > 9) {
+        return NULL;
+    }
+    unsigned int result = 0;
+    int digits = 0;
+    while (p < end && (unsigned int)(*p - '0') <= 9) {
+        result = result * 10 + (unsigned int)(*p++ - '0');
+        if (++digits > 9) {
+            return NULL;
+        }
+    }
+    *value = result;
+    return p;
+}
+
+static void parseChunk(void* argument) {
+    Chunk* chunk = argument;
+    const char* p = chunk -> begin;
+    const char* end = chunk -> end;
+
+    while (p < end) {
+        unsigned int values[5];
+        const char* cursor = p;
+        for (int field = 0; field < 5 && cursor != NULL; ++field) {
+            cursor = scanNumber(cursor, end, &values[field]);
+            if (cursor != NULL && field < 4) {
+                cursor = (cursor < end && *cursor == ',') ? cursor + 1 : NULL;
+            }
+        }
+
+        // Files written by the old save hold each coordinate once, so chunks never write the same pixel
+        if (cursor != NULL && values[0] < (unsigned int)chunk -> width && values[1] < (unsigned int)chunk -> height
+            && values[2] <= 255 && values[3] <= 255 && values[4] <= 255
+            && (values[2] != 255 || values[3] != 255 || values[4] != 255)) {
+            chunk -> pixels[(size_t)values[1] * chunk -> width + values[0]] = CANVAS_RGB(values[2], values[3], values[4]);
+        }
+
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        p++;
+    }
+}
+
+int pixelCsvLoad(Canvas* canvas, const char* path, int threadCount, Log* log) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        logError(log, 74, "Failed to open %s for reading", path);
+        return 0;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        logError(log, 79, "Failed to read %s", path);
+        fclose(file);
+        return 0;
+    }
+
+    char* data = malloc(size > 0 ? (size_t)size : 1);
+    uint32_t* pixels = malloc(sizeof(uint32_t) * canvas -> width * canvas -> height);
+    if (data == NULL || pixels == NULL) {
+        logError(log, 87, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    size_t length = fread(data, 1, (size_t)size, file);
+    fclose(file);
+
+    // The lines are applied over what is already drawn, like the original loader did
+    canvasReadRegion(canvas, 0, 0, canvas -> width, canvas -> height, pixels, canvas -> width);
+
+    int chunkCount = (threadCount > 0) ? threadCount : 1;
+    if (chunkCount > MAX_CHUNKS) chunkCount = MAX_CHUNKS;
+    if ((size_t)chunkCount * MIN_CHUNK_BYTES > length) chunkCount = (int)(length / MIN_CHUNK_BYTES) + 1;
+
+    Chunk chunks[MAX_CHUNKS];
+    Thread* threads[MAX_CHUNKS];
+    const char* begin = data;
+    const char* end = data + length;
+    for (int i = 0; i < chunkCount; ++i) {
+        const char* chunkEnd = (i == chunkCount - 1) ? end : data + length / chunkCount * (i + 1);
+        if (chunkEnd < begin) chunkEnd = begin;
+        while (chunkEnd < end && chunkEnd[-1] != '\n') {
+            chunkEnd++;
+        }
+        chunks[i] = (Chunk){ begin, chunkEnd, pixels, canvas -> width, canvas -> height };
+        begin = chunkEnd;
+    }
+
+    // The first chunk is parsed on the calling thread, or every chunk if no thread can be started
+    for (int i = 1; i < chunkCount; ++i) {
+        threads[i] = threadStart(parseChunk, &chunks[i], log);
+    }
+    parseChunk(&chunks[0]);
+    for (int i = 1; i < chunkCount; ++i) {
+        if (threads[i] != NULL) {
+            threadJoin(threads[i]);
+        } else {
+            parseChunk(&chunks[i]);
+        }
+    }
+
+    canvasWriteRegion(canvas, 0, 0, canvas -> width, canvas -> height, pixels, canvas -> width);
+    free(pixels);
+    free(data);
+    return 1;
+}
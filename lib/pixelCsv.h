@@ -0,0 +1,23 @@
+#ifndef PIXEL_CSV_H
+#define PIXEL_CSV_H
+
+#include "canvas.h"
+#include "logger.h"
+
+/**
+ * @brief Loads a legacy pixel_data.csv file (one `x,y,r,g,b` line per pixel) onto the canvas.
+ *
+ * The file is read in one block and split on line boundaries between up to `threadCount`
+ * threads, each one parsing its part with a hand-written integer scanner into a copy of the
+ * canvas. The copy is then written back in one pass. As with the original loader, white
+ * pixels are skipped and malformed lines are ignored.
+ *
+ * @param canvas Pointer to the Canvas instance receiving the pixels.
+ * @param path Path of the CSV file.
+ * @param threadCount Most threads to parse with, threadProcessorCount() unless other threads already keep the processors busy.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file cannot be read.
+ */
+int pixelCsvLoad(Canvas* canvas, const char* path, int threadCount, Log* log);
+
+#endif /* PIXEL_CSV_H */
@@ -0,0 +1,548 @@
+#include <stdlib.h>
+#include <string.h>
+#include "quantize.h"
+#include "thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TILE_PIXELS (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+#define CELL_BITS   5 // The histogram keeps 32 values per channel
+#define CELLS       (1 << (3 * CELL_BITS))
+
+// Parts smaller than this are not worth a thread of their own.
+#define MIN_PART_TILES 16
+#define MAX_PARTS      64
+
+/**
+ * @brief Open addressing set of colors.
+ */
+typedef struct ColorSet {
+    uint32_t* keys;
+    unsigned char* used;
+    int bits;     /**< The set has 1 << bits slots. */
+    int count;
+    int limit;    /**< Most colors collected, 0 for no limit. */
+    int overflow; /**< Set once a color beyond the limit was met. */
+} ColorSet;
+
+/**
+ * @brief Tiles handled by one thread, and what it collected from them.
+ */
+typedef struct QuantizePart {
+    uint32_t* const* tiles;
+    int first;
+    int last;
+    int width;           /**< Size of the canvas, the tiles may hold pixels past it. */
+    int height;
+    uint32_t background;
+    ColorSet set;
+    uint64_t* histogram; /**< Pixel count and red, green and blue sums of each cell. */
+    Log* log;
+} QuantizePart;
+
+/**
+ * @brief Box of histogram cells, split by the median cut.
+ */
+typedef struct Box {
+    int low[3];
+    int high[3];
+    uint64_t count;
+} Box;
+
+
+static int colorHash(uint32_t color, int bits) {
+    return (int)((color * 2654435761u) >> (32 - bits));
+}
+
+static void setInit(ColorSet* set, int limit, Log* log) {
+    set -> bits = 10;
+    set -> count = 0;
+    set -> limit = limit;
+    set -> overflow = 0;
+    set -> keys = malloc(sizeof(uint32_t) << set -> bits);
+    set -> used = calloc((size_t)1 << set -> bits, 1);
+    if (set -> keys == NULL || set -> used == NULL) {
+        logError(log, 67, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void setRelease(ColorSet* set) {
+    free(set -> keys);
+    free(set -> used);
+}
+
+/**
+ * @brief Adds a color to a set, growing it once half full.
+ */
+static void setInsert(ColorSet* set, uint32_t color, Log* log) {
+    int mask = (1 << set -> bits) - 1;
+    int slot = colorHash(color, set -> bits);
+    while (set -> used[slot]) {
+        if (set -> keys[slot] == color) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (set -> limit > 0 && set -> count == set -> limit) {
+        set -> overflow = 1;
+        return;
+    }
+    set -> keys[slot] = color;
+    set -> used[slot] = 1;
+    set -> count++;
+
+    if (set -> count * 2 > mask) {
+        ColorSet grown = *set;
+        grown.bits = set -> bits + 1;
+        grown.count = 0;
+        grown.keys = malloc(sizeof(uint32_t) << grown.bits);
+        grown.used = calloc((size_t)1 << grown.bits, 1);
+        if (grown.keys == NULL || grown.used == NULL) {
+            logError(log, 104, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i <= mask; ++i) {
+            if (set -> used[i]) {
+                setInsert(&grown, set -> keys[i], log);
+            }
+        }
+        setRelease(set);
+        *set = grown;
+    }
+}
+
+/**
+ * @brief Columns and rows of a tile that lie inside the canvas.
+ */
+static void visibleSize(const QuantizePart* part, int tile, int* columns, int* rows) {
+    int tilesX = (part -> width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    *columns = part -> width - (tile % tilesX) * CANVAS_TILE_SIZE;
+    *rows = part -> height - (tile / tilesX) * CANVAS_TILE_SIZE;
+    if (*columns > CANVAS_TILE_SIZE) *columns = CANVAS_TILE_SIZE;
+    if (*rows > CANVAS_TILE_SIZE) *rows = CANVAS_TILE_SIZE;
+}
+
+static void collectColors(void* argument) {
+    QuantizePart* part = argument;
+    for (int tile = part -> first; tile < part -> last && !part -> set.overflow; ++tile) {
+        const uint32_t* pixels = part -> tiles[tile];
+        if (pixels == NULL) {
+            setInsert(&part -> set, part -> background, part -> log);
+            continue;
+        }
+        // Drawings are made of runs of one color, most pixels are the same as the one before
+        int columns, rows;
+        visibleSize(part, tile, &columns, &rows);
+        uint32_t last = pixels[0];
+        setInsert(&part -> set, last, part -> log);
+        for (int y = 0; y < rows && !part -> set.overflow; ++y) {
+            const uint32_t* row = pixels + y * CANVAS_TILE_SIZE;
+            int x = 0;
+#if defined(__SSE2__)
+            // 4 pixels equal to the last one are skipped at once
+            for (; x + 4 <= columns; x += 4) {
+                __m128i same = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(row + x)), _mm_set1_epi32((int)last));
+                if (_mm_movemask_epi8(same) == 0xFFFF) {
+                    continue;
+                }
+                for (int i = x; i < x + 4; ++i) {
+                    if (row[i] != last) {
+                        last = row[i];
+                        setInsert(&part -> set, last, part -> log);
+                    }
+                }
+            }
+#endif
+            for (; x < columns; ++x) {
+                if (row[x] != last) {
+                    last = row[x];
+                    setInsert(&part -> set, last, part -> log);
+                }
+            }
+        }
+    }
+}
+
+static void collectHistogram(void* argument) {
+    QuantizePart* part = argument;
+    uint64_t* histogram = part -> histogram;
+    for (int tile = part -> first; tile < part -> last; ++tile) {
+        const uint32_t* pixels = part -> tiles[tile];
+        int columns, rows;
+        visibleSize(part, tile, &columns, &rows);
+        if (pixels == NULL) {
+            uint64_t count = (uint64_t)columns * rows;
+            uint64_t* cell = histogram + QUANTIZE_CELL(part -> background) * 4;
+            cell[0] += count;
+            cell[1] += CANVAS_RED(part -> background) * count;
+            cell[2] += CANVAS_GREEN(part -> background) * count;
+            cell[3] += CANVAS_BLUE(part -> background) * count;
+            continue;
+        }
+        for (int y = 0; y < rows; ++y) {
+            const uint32_t* row = pixels + y * CANVAS_TILE_SIZE;
+            for (int x = 0; x < columns; ++x) {
+                uint64_t* cell = histogram + QUANTIZE_CELL(row[x]) * 4;
+                cell[0]++;
+                cell[1] += CANVAS_RED(row[x]);
+                cell[2] += CANVAS_GREEN(row[x]);
+                cell[3] += CANVAS_BLUE(row[x]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Splits the tiles between the parts, and runs them.
+ *
+ * @return Number of parts used.
+ */
+static int runParts(QuantizePart* parts, uint32_t* const* tiles, int width, int height, uint32_t background, int threadCount,
+                    ThreadFunction function, int limit, int histogram, Log* log) {
+    int tileCount = ((width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE) * ((height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE);
+    int partCount = (threadCount > 0) ? threadCount : 1;
+    if (partCount > MAX_PARTS) partCount = MAX_PARTS;
+    if (partCount * MIN_PART_TILES > tileCount) partCount = tileCount / MIN_PART_TILES + 1;
+
+    for (int i = 0; i < partCount; ++i) {
+        parts[i].tiles = tiles;
+        parts[i].first = (int)((long long)tileCount * i / partCount);
+        parts[i].last = (int)((long long)tileCount * (i + 1) / partCount);
+        parts[i].width = width;
+        parts[i].height = height;
+        parts[i].background = background;
+        parts[i].histogram = NULL;
+        parts[i].log = log;
+        setInit(&parts[i].set, limit, log);
+        if (histogram) {
+            parts[i].histogram = calloc((size_t)CELLS * 4, sizeof(uint64_t));
+            if (parts[i].histogram == NULL) {
+                logError(log, 223, "Memory Allocation Error");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    // The first part runs on the calling thread, or every part if no thread can be started
+    Thread* threads[MAX_PARTS];
+    for (int i = 1; i < partCount; ++i) {
+        threads[i] = threadStart(function, &parts[i], log);
+    }
+    function(&parts[0]);
+    for (int i = 1; i < partCount; ++i) {
+        if (threads[i] != NULL) {
+            threadJoin(threads[i]);
+        } else {
+            function(&parts[i]);
+        }
+    }
+    return partCount;
+}
+
+/**
+ * @brief Merges the colors of every part into the first one, then frees the others.
+ */
+static void mergeSets(QuantizePart* parts, int partCount, Log* log) {
+    ColorSet* set = &parts[0].set;
+    for (int i = 1; i < partCount; ++i) {
+        ColorSet* other = &parts[i].set;
+        set -> overflow |= other -> overflow;
+        for (int slot = 0; slot < (1 << other -> bits) && !set -> overflow; ++slot) {
+            if (other -> used[slot]) {
+                setInsert(set, other -> keys[slot], log);
+            }
+        }
+        setRelease(other);
+    }
+}
+
+int quantizeCountColors(uint32_t* const* tiles, int width, int height, uint32_t background, int threadCount, Log* log) {
+    QuantizePart parts[MAX_PARTS];
+    int partCount = runParts(parts, tiles, width, height, background, threadCount, collectColors, 0, 0, log);
+    mergeSets(parts, partCount, log);
+    int count = parts[0].set.count;
+    setRelease(&parts[0].set);
+    return count;
+}
+
+static int compareColors(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Narrows a box to the cells that hold pixels, and counts them.
+ */
+static void shrinkBox(Box* box, const uint64_t* histogram) {
+    int low[3] = { 31, 31, 31 };
+    int high[3] = { 0, 0, 0 };
+    box -> count = 0;
+    for (int r = box -> low[0]; r <= box -> high[0]; ++r) {
+        for (int g = box -> low[1]; g <= box -> high[1]; ++g) {
+            for (int b = box -> low[2]; b <= box -> high[2]; ++b) {
+                uint64_t count = histogram[((r << 10) | (g << 5) | b) * 4];
+                if (count == 0) {
+                    continue;
+                }
+                box -> count += count;
+                int value[3] = { r, g, b };
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (value[axis] < low[axis]) low[axis] = value[axis];
+                    if (value[axis] > high[axis]) high[axis] = value[axis];
+                }
+            }
+        }
+    }
+    memcpy(box -> low, low, sizeof(low));
+    memcpy(box -> high, high, sizeof(high));
+}
+
+/**
+ * @brief Splits a box across its longest side, where half of its pixels are on each side.
+ */
+static void splitBox(Box* box, Box* other, const uint64_t* histogram) {
+    int axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (box -> high[i] - box -> low[i] > box -> high[axis] - box -> low[axis]) {
+            axis = i;
+        }
+    }
+
+    uint64_t planes[32] = { 0 };
+    for (int r = box -> low[0]; r <= box -> high[0]; ++r) {
+        for (int g = box -> low[1]; g <= box -> high[1]; ++g) {
+            for (int b = box -> low[2]; b <= box -> high[2]; ++b) {
+                int value[3] = { r, g, b };
+                planes[value[axis]] += histogram[((r << 10) | (g << 5) | b) * 4];
+            }
+        }
+    }
+    // Both ends of a shrunk box hold pixels, so both halves do
+    int split = box -> low[axis];
+    uint64_t below = planes[split];
+    while (split + 1 < box -> high[axis] && below * 2 < box -> count) {
+        below += planes[++split];
+    }
+
+    *other = *box;
+    box -> high[axis] = split;
+    other -> low[axis] = split + 1;
+    shrinkBox(box, histogram);
+    shrinkBox(other, histogram);
+}
+
+/**
+ * @brief Reduces a histogram to at most `maxColors` colors by median cut.
+ */
+static void medianCut(const uint64_t* histogram, int maxColors, Palette* palette) {
+    Box boxes[QUANTIZE_MAX_COLORS];
+    int count = 1;
+    boxes[0] = (Box){ { 0, 0, 0 }, { 31, 31, 31 }, 0 };
+    shrinkBox(&boxes[0], histogram);
+
+    // The box to split next is the one with the most pixels times its longest side
+    while (count < maxColors) {
+        int best = -1;
+        uint64_t bestScore = 0;
+        for (int i = 0; i < count; ++i) {
+            int side = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (boxes[i].high[axis] - boxes[i].low[axis] > side) {
+                    side = boxes[i].high[axis] - boxes[i].low[axis];
+                }
+            }
+            if (side > 0 && boxes[i].count * (uint64_t)side > bestScore) {
+                best = i;
+                bestScore = boxes[i].count * (uint64_t)side;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        splitBox(&boxes[best], &boxes[count++], histogram);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        uint64_t sums[4] = { 0, 0, 0, 0 };
+        for (int r = boxes[i].low[0]; r <= boxes[i].high[0]; ++r) {
+            for (int g = boxes[i].low[1]; g <= boxes[i].high[1]; ++g) {
+                for (int b = boxes[i].low[2]; b <= boxes[i].high[2]; ++b) {
+                    const uint64_t* cell = histogram + ((r << 10) | (g << 5) | b) * 4;
+                    for (int k = 0; k < 4; ++k) {
+                        sums[k] += cell[k];
+                    }
+                }
+            }
+        }
+        uint64_t half = sums[0] / 2;
+        palette -> colors[i] = CANVAS_RGB((sums[1] + half) / sums[0], (sums[2] + half) / sums[0], (sums[3] + half) / sums[0]);
+    }
+    palette -> count = count;
+    palette -> exact = 0;
+}
+
+int quantizePalette(uint32_t* const* tiles, int width, int height, uint32_t background, int maxColors, int exactOnly,
+                    int threadCount, Palette* palette, Log* log) {
+    if (maxColors < 1) maxColors = 1;
+    if (maxColors > QUANTIZE_MAX_COLORS) maxColors = QUANTIZE_MAX_COLORS;
+
+    // Most drawings hold a few colors: counting them stops as soon as there are too many
+    QuantizePart parts[MAX_PARTS];
+    int partCount = runParts(parts, tiles, width, height, background, threadCount, collectColors, maxColors, 0, log);
+    mergeSets(parts, partCount, log);
+    ColorSet* set = &parts[0].set;
+    if (!set -> overflow) {
+        palette -> count = 0;
+        for (int slot = 0; slot < (1 << set -> bits); ++slot) {
+            if (set -> used[slot]) {
+                palette -> colors[palette -> count++] = set -> keys[slot];
+            }
+        }
+        if (palette -> count == 0) {
+            palette -> colors[palette -> count++] = background;
+        }
+        qsort(palette -> colors, palette -> count, sizeof(uint32_t), compareColors);
+        palette -> exact = 1;
+    }
+    int overflow = set -> overflow;
+    setRelease(set);
+    if (!overflow) {
+        return 1;
+    }
+    if (exactOnly) {
+        return 0;
+    }
+
+    partCount = runParts(parts, tiles, width, height, background, threadCount, collectHistogram, 0, 1, log);
+    uint64_t* histogram = parts[0].histogram;
+    setRelease(&parts[0].set);
+    for (int i = 1; i < partCount; ++i) {
+        for (int k = 0; k < CELLS * 4; ++k) {
+            histogram[k] += parts[i].histogram[k];
+        }
+        free(parts[i].histogram);
+        setRelease(&parts[i].set);
+    }
+    medianCut(histogram, maxColors, palette);
+    free(histogram);
+    return 1;
+}
+
+int quantizeCanvasPalette(const Canvas* canvas, int maxColors, int exactOnly, int threadCount, Palette* palette, Log* log) {
+    int tileCount = canvas -> tilesX * canvas -> tilesY;
+    uint32_t** tiles = malloc(sizeof(uint32_t*) * tileCount);
+    if (tiles == NULL) {
+        logError(log, 439, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < tileCount; ++i) {
+        int tileX = i % canvas -> tilesX;
+        int tileY = i / canvas -> tilesX;
+        tiles[i] = canvasIsTileBlank(canvas, tileX, tileY) ? NULL : (uint32_t*)canvasGetTile(canvas, tileX, tileY);
+    }
+    int built = quantizePalette(tiles, canvas -> width, canvas -> height, canvas -> background, maxColors, exactOnly,
+                                threadCount, palette, log);
+    free(tiles);
+    return built;
+}
+
+/**
+ * @brief Index of the palette color closest to a color, by squared distance.
+ */
+static int closestColor(const Palette* palette, int r, int g, int b) {
+    int best = 0;
+    int bestDistance = -1;
+    for (int i = 0; i < palette -> count; ++i) {
+        int dr = CANVAS_RED(palette -> colors[i]) - r;
+        int dg = CANVAS_GREEN(palette -> colors[i]) - g;
+        int db = CANVAS_BLUE(palette -> colors[i]) - b;
+        int distance = dr * dr + dg * dg + db * db;
+        if (bestDistance < 0 || distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+PaletteMap* paletteMapConstructor(const Palette* palette, Log* log) {
+    PaletteMap* map = malloc(sizeof(PaletteMap));
+    if (map == NULL) {
+        logError(log, 475, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    map -> palette = palette;
+    memset(map -> slots, 0xFF, sizeof(map -> slots));
+
+    // Colors of the palette, exact or not, so that they always map to themselves
+    int bits = 9; // QUANTIZE_MAX_COLORS * 2 slots
+    for (int i = 0; i < palette -> count; ++i) {
+        int slot = colorHash(palette -> colors[i], bits);
+        while (map -> slots[slot] >= 0) {
+            slot = (slot + 1) & ((1 << bits) - 1);
+        }
+        map -> keys[slot] = palette -> colors[i];
+        map -> slots[slot] = (int16_t)i;
+    }
+
+    // Each cell takes the color closest to its center
+    map -> cells = malloc(CELLS);
+    if (map -> cells == NULL) {
+        logError(log, 495, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    for (int cell = 0; cell < CELLS; ++cell) {
+        int r = ((cell >> 10) << 3) | 4;
+        int g = (((cell >> 5) & 31) << 3) | 4;
+        int b = ((cell & 31) << 3) | 4;
+        map -> cells[cell] = (uint8_t)closestColor(palette, r, g, b);
+    }
+    return map;
+}
+
+void paletteMapDeconstructor(PaletteMap* map) {
+    if (map != NULL) {
+        free(map -> cells);
+        free(map);
+    }
+}
+
+int paletteMapFind(const PaletteMap* map, uint32_t color) {
+    int slot = colorHash(color, 9);
+    while (map -> slots[slot] >= 0) {
+        if (map -> keys[slot] == color) {
+            return map -> slots[slot];
+        }
+        slot = (slot + 1) & (QUANTIZE_MAX_COLORS * 2 - 1);
+    }
+    return -1;
+}
+
+int paletteMapIndex(const PaletteMap* map, uint32_t color) {
+    int index = paletteMapFind(map, color);
+    if (index >= 0) {
+        return index;
+    }
+    // A color the palette was not built from
+    return map -> cells[QUANTIZE_CELL(color)];
+}
+
+int paletteMapClosest(const PaletteMap* map, uint32_t color) {
+    return map -> cells[QUANTIZE_CELL(color)];
+}
+
+void paletteMapTile(const PaletteMap* map, const uint32_t* pixels, uint8_t* indices) {
+    uint32_t last = pixels[0];
+    uint8_t index = (uint8_t)paletteMapIndex(map, last);
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        if (pixels[i] != last) {
+            last = pixels[i];
+            index = (uint8_t)paletteMapIndex(map, last);
+        }
+        indices[i] = index;
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdint.h>
+#include "canvas.h"
+#include "logger.h"
+
+// Most colors of a palette, so that an index fits a byte.
+#define QUANTIZE_MAX_COLORS 256
+
+/**
+ * @brief Colors a drawing is reduced to, each pixel then being stored as the index of one of them.
+ */
+typedef struct Palette {
+    int count;                             /**< Number of colors, 1 to QUANTIZE_MAX_COLORS. */
+    int exact;                             /**< Non-zero if every pixel is one of the colors. */
+    uint32_t colors[QUANTIZE_MAX_COLORS];  /**< The colors, 0x00RRGGBB like the canvas pixels. */
+} Palette;
+
+// Grid cell of a color in a PaletteMap, 32 values per channel.
+#define QUANTIZE_CELL(c) ((int)((((c) >> 9) & 0x7C00) | (((c) >> 6) & 0x03E0) | (((c) >> 3) & 0x001F)))
+
+/**
+ * @brief Finds the palette index of any pixel.
+ *
+ * Colors of the palette are found in a hash table. Other colors fall in a grid of 32 values
+ * per channel, each cell of which knows the palette color closest to its center.
+ */
+typedef struct PaletteMap {
+    const Palette* palette;
+    uint32_t keys[QUANTIZE_MAX_COLORS * 2];  /**< Colors of the palette, by hash. */
+    int16_t slots[QUANTIZE_MAX_COLORS * 2];  /**< Index of each color of `keys`, -1 for an empty slot. */
+    uint8_t* cells;                          /**< Index of the closest color of each grid cell, by QUANTIZE_CELL(). */
+} PaletteMap;
+
+/**
+ * @brief Counts the distinct colors of the tiles of a canvas, blank tiles standing for the background.
+ *
+ * The tiles are split between up to `threadCount` threads, each one collecting the colors
+ * of its tiles before the sets are merged. Pixels of the last tiles past the edges of the
+ * canvas are ignored.
+ *
+ * @param tiles Tiles of CANVAS_TILE_SIZE x CANVAS_TILE_SIZE pixels, row-major, NULL for a blank tile.
+ * @param width Width of the canvas in pixels.
+ * @param height Height of the canvas in pixels.
+ * @param background Color of the blank tiles.
+ * @param threadCount Most threads to count with.
+ * @param log Pointer to the log for error handling.
+ * @return Number of distinct colors.
+ */
+int quantizeCountColors(uint32_t* const* tiles, int width, int height, uint32_t background, int threadCount, Log* log);
+
+/**
+ * @brief Chooses at most `maxColors` colors to draw the tiles of a canvas with.
+ *
+ * The colors are the exact ones when the tiles hold no more than `maxColors` of them.
+ * Otherwise, unless `exactOnly` is set, they are reduced by median cut: the histogram of the
+ * colors (32 values per channel) is split into boxes holding as many pixels as possible, and
+ * each box gives the average of its pixels. Both passes run in parallel over the tiles.
+ *
+ * @param tiles Tiles of CANVAS_TILE_SIZE x CANVAS_TILE_SIZE pixels, row-major, NULL for a blank tile.
+ * @param width Width of the canvas in pixels.
+ * @param height Height of the canvas in pixels.
+ * @param background Color of the blank tiles.
+ * @param maxColors Most colors of the palette, 1 to QUANTIZE_MAX_COLORS.
+ * @param exactOnly Non-zero to give up rather than reduce the colors.
+ * @param threadCount Most threads to work with.
+ * @param palette Receives the palette.
+ * @param log Pointer to the log for error handling.
+ * @return 1 if the palette was built, 0 if `exactOnly` is set and the tiles hold too many colors.
+ */
+int quantizePalette(uint32_t* const* tiles, int width, int height, uint32_t background, int maxColors, int exactOnly,
+                    int threadCount, Palette* palette, Log* log);
+
+/**
+ * @brief Chooses the palette of a canvas like quantizePalette(), over all of its tiles.
+ *
+ * @param canvas Pointer to the Canvas instance, left unchanged.
+ * @param maxColors Most colors of the palette, 1 to QUANTIZE_MAX_COLORS.
+ * @param exactOnly Non-zero to give up rather than reduce the colors.
+ * @param threadCount Most threads to work with.
+ * @param palette Receives the palette.
+ * @param log Pointer to the log for error handling.
+ * @return 1 if the palette was built, 0 if `exactOnly` is set and the canvas holds too many colors.
+ */
+int quantizeCanvasPalette(const Canvas* canvas, int maxColors, int exactOnly, int threadCount, Palette* palette, Log* log);
+
+/**
+ * @brief Constructor function to create a map giving the index of any pixel in a palette.
+ *
+ * @param palette Pointer to the palette, which must outlive the map.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created PaletteMap instance.
+ */
+PaletteMap* paletteMapConstructor(const Palette* palette, Log* log);
+
+/**
+ * @brief Destructor function to free a PaletteMap.
+ *
+ * @param map Pointer to the PaletteMap instance to be destroyed.
+ */
+void paletteMapDeconstructor(PaletteMap* map);
+
+/**
+ * @brief Index of a color of the palette.
+ *
+ * @param map Pointer to the PaletteMap instance.
+ * @param color Any color.
+ * @return Index of the color in the palette, -1 if it is not one of its colors.
+ */
+int paletteMapFind(const PaletteMap* map, uint32_t color);
+
+/**
+ * @brief Index of a pixel in the palette: its own color if the palette has it, else the closest one.
+ *
+ * @param map Pointer to the PaletteMap instance.
+ * @param color The pixel.
+ * @return Index of the color in the palette.
+ */
+int paletteMapIndex(const PaletteMap* map, uint32_t color);
+
+/**
+ * @brief Index of the palette color closest to the grid cell of a color, without looking for
+ * the color itself. This is the lookup of dithering, whose colors are rarely in the palette.
+ *
+ * @param map Pointer to the PaletteMap instance.
+ * @param color Any color.
+ * @return Index of a color in the palette.
+ */
+int paletteMapClosest(const PaletteMap* map, uint32_t color);
+
+/**
+ * @brief Converts a tile to palette indices.
+ *
+ * @param map Pointer to the PaletteMap instance.
+ * @param pixels The tile, CANVAS_TILE_SIZE x CANVAS_TILE_SIZE pixels.
+ * @param indices Receives one index per pixel.
+ */
+void paletteMapTile(const PaletteMap* map, const uint32_t* pixels, uint8_t* indices);
+
+#endif /* QUANTIZE_H */
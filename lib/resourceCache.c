@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include "resourceCache.h"
+
+ResourceCache* resourceCacheConstructor(Log* log) {
+    ResourceCache* cache = malloc(sizeof(ResourceCache));
+    if (cache == NULL) {
+        logError(log, 8, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    memset(cache, 0, sizeof(ResourceCache));
+    cache -> log = log;
+    return cache;
+}
+
+void resourceCacheDeconstructor(ResourceCache* cache) {
+    if (cache != NULL) {
+        resourceCacheRelease(cache);
+        free(cache -> entries);
+        free(cache);
+    }
+}
+
+void resourceCacheRelease(ResourceCache* cache) {
+    for (int i = 0; i < cache -> count; ++i) {
+        ResourceEntry* entry = &cache -> entries[i];
+        free(entry -> name);
+        if (entry -> handle == NULL) {
+            continue; // A failure, nothing to release
+        }
+        // System cursors are shared and never destroyed
+        if (entry -> kind == RESOURCE_ICON) {
+            DestroyIcon((HICON)entry -> handle);
+        } else if (entry -> kind != RESOURCE_CURSOR) {
+            DeleteObject((HGDIOBJ)entry -> handle);
+        }
+        cache -> live[entry -> kind]--;
+        cache -> released++;
+    }
+    cache -> count = 0;
+}
+
+/**
+ * @brief Entry of the cache matching the parameters, or NULL if there is none yet.
+ */
+static ResourceEntry* findEntry(ResourceCache* cache, ResourceKind kind, int size, int style, COLORREF color,
+                                const char* name, LPCSTR cursor) {
+    for (int i = 0; i < cache -> count; ++i) {
+        ResourceEntry* entry = &cache -> entries[i];
+        if (entry -> kind == kind && entry -> size == size && entry -> style == style && entry -> color == color
+            && entry -> cursor == cursor
+            && (entry -> name == name || (entry -> name != NULL && name != NULL && strcmp(entry -> name, name) == 0))) {
+            cache -> hits++;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Keeps a newly created object. An object that could not be created is logged and
+ * kept as NULL, so that it is not tried again on every message.
+ *
+ * @return The object.
+ */
+static HANDLE addEntry(ResourceCache* cache, ResourceKind kind, int size, int style, COLORREF color,
+                       const char* name, LPCSTR cursor, HANDLE handle) {
+    if (handle == NULL) {
+        logError(cache -> log, 69, "Failed to create a GDI object of kind %d. Error code: %lu", (int)kind, GetLastError());
+    }
+    if (cache -> count == cache -> capacity) {
+        int capacity = (cache -> capacity > 0) ? cache -> capacity * 2 : 32;
+        ResourceEntry* entries = realloc(cache -> entries, sizeof(ResourceEntry) * capacity);
+        if (entries == NULL) {
+            logError(cache -> log, 75, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        cache -> entries = entries;
+        cache -> capacity = capacity;
+    }
+
+    ResourceEntry* entry = &cache -> entries[cache -> count++];
+    entry -> kind = kind;
+    entry -> size = size;
+    entry -> style = style;
+    entry -> color = color;
+    entry -> name = NULL;
+    entry -> cursor = cursor;
+    entry -> handle = handle;
+    if (name != NULL) {
+        entry -> name = malloc(strlen(name) + 1);
+        if (entry -> name == NULL) {
+            logError(cache -> log, 93, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        strcpy(entry -> name, name);
+    }
+    if (handle != NULL) {
+        cache -> live[kind]++;
+        cache -> created++;
+    }
+    return handle;
+}
+
+HFONT resourceCacheFont(ResourceCache* cache, int height, int weight, int quality, const char* face) {
+    ResourceEntry* entry = findEntry(cache, RESOURCE_FONT, height, weight, (COLORREF)quality, face, NULL);
+    if (entry != NULL) {
+        return (HFONT)entry -> handle;
+    }
+    HFONT font = CreateFont(height, 0, 0, 0, weight, FALSE, FALSE, FALSE, ANSI_CHARSET, OUT_DEFAULT_PRECIS,
+                            CLIP_DEFAULT_PRECIS, quality, DEFAULT_PITCH | FF_DONTCARE, face);
+    return (HFONT)addEntry(cache, RESOURCE_FONT, height, weight, (COLORREF)quality, face, NULL, font);
+}
+
+HBRUSH resourceCacheBrush(ResourceCache* cache, COLORREF color) {
+    ResourceEntry* entry = findEntry(cache, RESOURCE_BRUSH, 0, 0, color, NULL, NULL);
+    if (entry != NULL) {
+        return (HBRUSH)entry -> handle;
+    }
+    return (HBRUSH)addEntry(cache, RESOURCE_BRUSH, 0, 0, color, NULL, NULL, CreateSolidBrush(color));
+}
+
+HICON resourceCacheIcon(ResourceCache* cache, const char* path, int size) {
+    ResourceEntry* entry = findEntry(cache, RESOURCE_ICON, size, 0, 0, path, NULL);
+    if (entry != NULL) {
+        return (HICON)entry -> handle;
+    }
+    HICON icon = (HICON)LoadImage(NULL, path, IMAGE_ICON, size, size, LR_LOADFROMFILE);
+    return (HICON)addEntry(cache, RESOURCE_ICON, size, 0, 0, path, NULL, icon);
+}
+
+HCURSOR resourceCacheCursor(ResourceCache* cache, LPCSTR cursor) {
+    ResourceEntry* entry = findEntry(cache, RESOURCE_CURSOR, 0, 0, 0, NULL, cursor);
+    if (entry != NULL) {
+        return (HCURSOR)entry -> handle;
+    }
+    return (HCURSOR)addEntry(cache, RESOURCE_CURSOR, 0, 0, 0, NULL, cursor, LoadCursor(NULL, cursor));
+}
+
+int resourceCacheLiveCount(const ResourceCache* cache) {
+    int total = 0;
+    for (int kind = 0; kind < RESOURCE_KINDS; ++kind) {
+        total += cache -> live[kind];
+    }
+    return total;
+}
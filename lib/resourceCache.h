@@ -0,0 +1,123 @@
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+#include <windows.h>
+#include "logger.h"
+
+/**
+ * @brief Kinds of objects held by a ResourceCache.
+ */
+typedef enum ResourceKind {
+    RESOURCE_FONT = 0,
+    RESOURCE_BRUSH,
+    RESOURCE_ICON,
+    RESOURCE_CURSOR,
+    RESOURCE_KINDS
+} ResourceKind;
+
+/**
+ * @brief Object of the cache with the parameters it was created with.
+ */
+typedef struct ResourceEntry {
+    ResourceKind kind;
+    int size;           /**< Font height or icon size, 0 if unused. */
+    int style;          /**< Font weight, 0 if unused. */
+    COLORREF color;     /**< Brush color, or quality of a font. */
+    char* name;         /**< Font face or icon file, NULL if unused. */
+    LPCSTR cursor;      /**< System cursor identifier, as given to LoadCursor(). */
+    HANDLE handle;      /**< The object, NULL if it could not be created (it is not tried again). */
+} ResourceEntry;
+
+/**
+ * @brief Fonts, brushes, icons and cursors of the window, each created the first time it is
+ * asked for and kept until released.
+ *
+ * Painting and the message loop ask the cache instead of creating and deleting the same
+ * objects on every message. The counters tell how many objects the cache holds and has ever
+ * created, so that a growing number of GDI handles can be told apart from the cache.
+ */
+typedef struct ResourceCache {
+    ResourceEntry* entries;
+    int count;
+    int capacity;
+    int live[RESOURCE_KINDS]; /**< Objects of each kind held by the cache, failures excluded. */
+    long created;             /**< Objects created since the cache was constructed. */
+    long released;            /**< Objects released since the cache was constructed. */
+    long hits;                /**< Requests answered with an object already created. */
+    Log* log;                 /**< Log used for error handling. */
+} ResourceCache;
+
+/**
+ * @brief Constructor function to create an empty cache.
+ *
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created ResourceCache instance.
+ */
+ResourceCache* resourceCacheConstructor(Log* log);
+
+/**
+ * @brief Destructor function to release the objects of the cache and free it.
+ *
+ * @param cache Pointer to the ResourceCache instance to be destroyed.
+ */
+void resourceCacheDeconstructor(ResourceCache* cache);
+
+/**
+ * @brief Releases every object of the cache, which stays usable and creates them again if asked.
+ *
+ * Called when the window is destroyed. Objects still selected in a device context or set as
+ * the icon of a window must be put back first.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ */
+void resourceCacheRelease(ResourceCache* cache);
+
+/**
+ * @brief Font of the given height, weight and quality.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ * @param height Height of the characters in pixels.
+ * @param weight Weight such as FW_NORMAL.
+ * @param quality DEFAULT_QUALITY, or NONANTIALIASED_QUALITY for text drawn on the canvas.
+ * @param face Name of the font, such as "Arial".
+ * @return The font, owned by the cache, or NULL if it cannot be created.
+ */
+HFONT resourceCacheFont(ResourceCache* cache, int height, int weight, int quality, const char* face);
+
+/**
+ * @brief Solid brush of the given color.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ * @param color Color of the brush.
+ * @return The brush, owned by the cache, or NULL if it cannot be created.
+ */
+HBRUSH resourceCacheBrush(ResourceCache* cache, COLORREF color);
+
+/**
+ * @brief Icon read from a .ico file, read once. A missing file is only looked for once too.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ * @param path Path of the file.
+ * @param size Width and height of the icon, 0 for the size stored in the file.
+ * @return The icon, owned by the cache, or NULL if the file cannot be read.
+ */
+HICON resourceCacheIcon(ResourceCache* cache, const char* path, int size);
+
+/**
+ * @brief Cursor of the system, such as IDC_CROSS.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ * @param cursor Identifier of the cursor.
+ * @return The cursor, shared by the system, or NULL if it cannot be loaded.
+ */
+HCURSOR resourceCacheCursor(ResourceCache* cache, LPCSTR cursor);
+
+/**
+ * @brief Number of objects held by the cache, of every kind.
+ *
+ * @param cache Pointer to the ResourceCache instance.
+ * @return The number of objects.
+ */
+int resourceCacheLiveCount(const ResourceCache* cache);
+
+#endif /* RESOURCE_CACHE_H */
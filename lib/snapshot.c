@@ -0,0 +1,935 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mappedFile.h"
+#include "quantize.h"
+#include "snapshot.h"
+#include "thread.h"
+
+#define TILE_PIXELS   (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+#define RAW_BYTES     (TILE_PIXELS * 4)
+#define RUN_BYTES     6
+#define WRITE_BUFFER  (256 * 1024)
+#define SERIAL_BYTES  8
+#define DELTA_HEADER  24
+#define SEGMENT_HEADER 12
+#define RECORD_SCRATCH ((SNAPSHOT_TILE_MAX_BYTES + 3) & ~3) // Rounded so that pixels can follow it
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+static void put64(uint8_t* dst, uint64_t value) {
+    put32(dst, (uint32_t)value);
+    put32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* src) {
+    return (uint64_t)get32(src) | ((uint64_t)get32(src + 4) << 32);
+}
+
+/**
+ * @brief FNV-1a, continued from `hash` (2166136261 to start).
+ */
+static uint32_t checksum(uint32_t hash, const uint8_t* data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Output buffer written to the file in WRITE_BUFFER sized blocks.
+ */
+typedef struct Writer {
+    FILE* file;
+    uint8_t* buffer;
+    size_t used;
+    size_t position; /**< Bytes written so far, buffered ones included. */
+    int failed;
+} Writer;
+
+static void writerFlush(Writer* writer) {
+    if (writer -> used > 0 && fwrite(writer -> buffer, 1, writer -> used, writer -> file) != writer -> used) {
+        writer -> failed = 1;
+    }
+    writer -> used = 0;
+}
+
+static void writeBytes(Writer* writer, const uint8_t* bytes, size_t count) {
+    if (writer -> used + count > WRITE_BUFFER) {
+        writerFlush(writer);
+    }
+    if (count > WRITE_BUFFER) {
+        if (fwrite(bytes, 1, count, writer -> file) != count) {
+            writer -> failed = 1;
+        }
+    } else {
+        memcpy(writer -> buffer + writer -> used, bytes, count);
+        writer -> used += count;
+    }
+    writer -> position += count;
+}
+
+/**
+ * @brief Run-length encodes a tile into `dst` (less than `limit` - 4 bytes).
+ *
+ * @return Number of bytes written, or 0 if the runs would not be smaller than a record of
+ * `limit` bytes after its encoding byte.
+ */
+static size_t encodeRuns(const uint32_t* pixels, uint8_t* dst, size_t limit) {
+    size_t size = 0;
+    int i = 0;
+    while (i < TILE_PIXELS) {
+        int length = 1;
+        while (i + length < TILE_PIXELS && pixels[i + length] == pixels[i]) {
+            length++;
+        }
+        // An RLE record (5 bytes of header) must stay smaller than the other one (1 byte of header)
+        if (size + RUN_BYTES + 4 >= limit) {
+            return 0;
+        }
+        put16(dst + size, (uint32_t)length);
+        put32(dst + size + 2, pixels[i]);
+        size += RUN_BYTES;
+        i += length;
+    }
+    return size;
+}
+
+size_t snapshotEncodeTile(const uint32_t* pixels, uint32_t background, uint8_t* dst) {
+    if (pixels == NULL) {
+        dst[0] = SNAPSHOT_TILE_BLANK;
+        return 1;
+    }
+
+    size_t size = encodeRuns(pixels, dst + 5, RAW_BYTES);
+    if (size == RUN_BYTES && pixels[0] == background) {
+        dst[0] = SNAPSHOT_TILE_BLANK;
+        return 1;
+    }
+    if (size > 0) {
+        dst[0] = SNAPSHOT_TILE_RLE;
+        put32(dst + 1, (uint32_t)size);
+        return 5 + size;
+    }
+
+    dst[0] = SNAPSHOT_TILE_RAW;
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        put32(dst + 1 + i * 4, pixels[i]);
+    }
+    return 1 + RAW_BYTES;
+}
+
+/**
+ * @brief Encodes a tile of an indexed snapshot (blank, run-length or indexed, whichever is the smallest).
+ *
+ * The pixels of a palette that is not exact are replaced by their palette color first.
+ *
+ * @param scratch Room for a tile followed by TILE_PIXELS indices.
+ */
+static size_t encodeIndexedTile(const uint32_t* pixels, uint32_t background, const PaletteMap* map, uint8_t* scratch, uint8_t* dst) {
+    if (pixels == NULL) {
+        dst[0] = SNAPSHOT_TILE_BLANK;
+        return 1;
+    }
+
+    // With an exact palette, the indices are only needed if the runs are too long
+    uint8_t* indices = NULL;
+    if (!map -> palette -> exact) {
+        uint32_t* reduced = (uint32_t*)scratch;
+        indices = scratch + RAW_BYTES;
+        paletteMapTile(map, pixels, indices);
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            reduced[i] = map -> palette -> colors[indices[i]];
+        }
+        pixels = reduced;
+    }
+
+    size_t size = encodeRuns(pixels, dst + 5, TILE_PIXELS);
+    if (size == RUN_BYTES && pixels[0] == background) {
+        dst[0] = SNAPSHOT_TILE_BLANK;
+        return 1;
+    }
+    if (size > 0) {
+        dst[0] = SNAPSHOT_TILE_RLE;
+        put32(dst + 1, (uint32_t)size);
+        return 5 + size;
+    }
+
+    dst[0] = SNAPSHOT_TILE_INDEXED;
+    if (indices != NULL) {
+        memcpy(dst + 1, indices, TILE_PIXELS);
+    } else {
+        paletteMapTile(map, pixels, dst + 1);
+    }
+    return 1 + TILE_PIXELS;
+}
+
+/**
+ * @brief Copies the tiles changed after `since`, every tile that is not blank for 0.
+ */
+static SnapshotFrame* captureTiles(const Canvas* canvas, uint64_t since, int changesOnly, Log* log) {
+    SnapshotFrame* frame = malloc(sizeof(SnapshotFrame));
+    if (frame == NULL) {
+        logError(log, 193, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    frame -> width = canvas -> width;
+    frame -> height = canvas -> height;
+    frame -> tilesX = canvas -> tilesX;
+    frame -> tilesY = canvas -> tilesY;
+    frame -> background = canvas -> background;
+    frame -> generation = canvas -> generation;
+    frame -> tiles = calloc(canvas -> tilesX * canvas -> tilesY, sizeof(uint32_t*));
+    frame -> changed = changesOnly ? calloc(canvas -> tilesX * canvas -> tilesY, 1) : NULL;
+    if (frame -> tiles == NULL || (changesOnly && frame -> changed == NULL)) {
+        logError(log, 205, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int tileY = 0; tileY < canvas -> tilesY; ++tileY) {
+        for (int tileX = 0; tileX < canvas -> tilesX; ++tileX) {
+            int index = tileY * canvas -> tilesX + tileX;
+            // A tile never changed is blank, the generation alone tells which tiles to look at
+            if (canvas -> tileGenerations[index] <= since) {
+                continue;
+            }
+            if (changesOnly) {
+                frame -> changed[index] = 1;
+            }
+            if (canvasIsTileBlank(canvas, tileX, tileY)) {
+                continue;
+            }
+            uint32_t* copy = malloc(RAW_BYTES);
+            if (copy == NULL) {
+                logError(log, 224, "Memory Allocation Error");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(copy, canvasGetTile(canvas, tileX, tileY), RAW_BYTES);
+            frame -> tiles[index] = copy;
+        }
+    }
+    return frame;
+}
+
+SnapshotFrame* snapshotCapture(const Canvas* canvas, Log* log) {
+    return captureTiles(canvas, 0, 0, log);
+}
+
+SnapshotFrame* snapshotCaptureChanges(const Canvas* canvas, uint64_t since, Log* log) {
+    return captureTiles(canvas, since, 1, log);
+}
+
+void snapshotFrameDeconstructor(SnapshotFrame* frame) {
+    if (frame != NULL) {
+        for (int i = 0; i < frame -> tilesX * frame -> tilesY; ++i) {
+            free(frame -> tiles[i]);
+        }
+        free(frame -> tiles);
+        free(frame -> changed);
+        free(frame);
+    }
+}
+
+void snapshotProgressInit(SnapshotProgress* progress, const SnapshotFrame* frame) {
+    atomic_store(&progress -> tilesDone, 0);
+    atomic_store(&progress -> cancelled, 0);
+    progress -> tilesTotal = frame -> tilesX * frame -> tilesY;
+}
+
+/**
+ * @brief Encodes every tile of a frame, stopping early if the progress is cancelled.
+ *
+ * Blank tiles get no record, the position of the others is stored in `index`. Tiles are
+ * indexed with `map` if it is not NULL.
+ */
+static void writeTiles(Writer* writer, const SnapshotFrame* frame, uint8_t* index, const PaletteMap* map, SnapshotProgress* progress) {
+    uint8_t* scratch = writer -> buffer + WRITE_BUFFER;
+    int count = frame -> tilesX * frame -> tilesY;
+    for (int i = 0; i < count && !writer -> failed; ++i) {
+        if (progress != NULL) {
+            if (atomic_load(&progress -> cancelled)) {
+                return;
+            }
+            atomic_store(&progress -> tilesDone, i);
+        }
+
+        size_t size = (map != NULL) ? encodeIndexedTile(frame -> tiles[i], frame -> background, map, scratch + RECORD_SCRATCH, scratch)
+                                    : snapshotEncodeTile(frame -> tiles[i], frame -> background, scratch);
+        if (scratch[0] != SNAPSHOT_TILE_BLANK) {
+            put32(index + i * 4, (uint32_t)writer -> position);
+            writeBytes(writer, scratch, size);
+        }
+    }
+    if (progress != NULL) {
+        atomic_store(&progress -> tilesDone, count);
+    }
+}
+
+/**
+ * @brief Mixes the clock and a counter into a serial, never 0.
+ */
+static uint64_t newSerial(void) {
+    static atomic_uint counter;
+    uint64_t serial = ((uint64_t)time(NULL) << 32) ^ (uint64_t)clock() ^ ((uint64_t)atomic_fetch_add(&counter, 1) << 48);
+    // Finalizer of MurmurHash3, so two close clocks give unrelated serials
+    serial ^= serial >> 33;
+    serial *= 0xFF51AFD7ED558CCDull;
+    serial ^= serial >> 33;
+    serial *= 0xC4CEB9FE1A85EC53ull;
+    serial ^= serial >> 33;
+    return (serial != 0) ? serial : 1;
+}
+
+/**
+ * @brief Writes a whole frame as a new snapshot, which makes the delta file of the previous one useless.
+ *
+ * The frame is indexed if its colors fit a palette of `maxColors`, or are reduced to one
+ * unless `exactOnly` is set.
+ */
+static int writeBase(const SnapshotFrame* frame, const char* path, int maxColors, int exactOnly, SnapshotProgress* progress, Log* log) {
+    char temporary[FILENAME_MAX];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* file = fopen(temporary, "wb");
+    if (file == NULL) {
+        logError(log, 314, "Failed to open %s for writing", temporary);
+        return 0;
+    }
+
+    // Drawings of a few colors take one byte per pixel
+    int count = frame -> tilesX * frame -> tilesY;
+    Palette palette;
+    PaletteMap* map = NULL;
+    if (quantizePalette(frame -> tiles, frame -> width, frame -> height, frame -> background, maxColors, exactOnly, threadProcessorCount(), &palette, log)) {
+        map = paletteMapConstructor(&palette, log);
+    }
+    size_t paletteBytes = (map != NULL) ? 4 + (size_t)palette.count * 4 : 0;
+
+    // One block holds the output buffer followed by the tile encoding scratch area, then the indexing one
+    Writer writer = { file, malloc(WRITE_BUFFER + RECORD_SCRATCH + RAW_BYTES + TILE_PIXELS), 0, 0, 0 };
+    uint8_t* index = calloc(count, 4);
+    if (writer.buffer == NULL || index == NULL) {
+        logError(log, 331, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    memcpy(header, SNAPSHOT_MAGIC, 4);
+    put16(header + 4, SNAPSHOT_VERSION);
+    put16(header + 6, (map != NULL) ? SNAPSHOT_FORMAT_INDEXED8 : SNAPSHOT_FORMAT_XRGB8888);
+    put32(header + 8, (uint32_t)frame -> width);
+    put32(header + 12, (uint32_t)frame -> height);
+    put32(header + 16, CANVAS_TILE_SIZE);
+    put32(header + 20, CANVAS_TILE_SIZE * 4);
+    put32(header + 24, frame -> background);
+    put32(header + 28, (uint32_t)count);
+    writeBytes(&writer, header, sizeof(header));
+    uint8_t serial[SERIAL_BYTES];
+    put64(serial, newSerial());
+    writeBytes(&writer, serial, sizeof(serial));
+    if (map != NULL) {
+        uint8_t colors[4 + QUANTIZE_MAX_COLORS * 4];
+        put32(colors, (uint32_t)palette.count);
+        for (int i = 0; i < palette.count; ++i) {
+            put32(colors + 4 + i * 4, palette.colors[i]);
+        }
+        writeBytes(&writer, colors, paletteBytes);
+    }
+
+    // The index is written blank first, then again once the records are in place
+    writeBytes(&writer, index, (size_t)count * 4);
+    writeTiles(&writer, frame, index, map, progress);
+    writerFlush(&writer);
+    if (fseek(file, (long)(SNAPSHOT_HEADER_SIZE + SERIAL_BYTES + paletteBytes), SEEK_SET) != 0
+        || fwrite(index, 1, (size_t)count * 4, file) != (size_t)count * 4) {
+        writer.failed = 1;
+    }
+    free(writer.buffer);
+    free(index);
+    paletteMapDeconstructor(map);
+
+    int cancelled = (progress != NULL && atomic_load(&progress -> cancelled));
+    if (fclose(file) != 0 || writer.failed || cancelled) {
+        if (!cancelled) {
+            logError(log, 373, "Failed to write %s", temporary);
+        }
+        remove(temporary);
+        return 0;
+    }
+
+    // rename() does not replace an existing file on Windows
+    remove(path);
+    if (rename(temporary, path) != 0) {
+        logError(log, 382, "Failed to replace %s", path);
+        return 0;
+    }
+    char delta[FILENAME_MAX];
+    snprintf(delta, sizeof(delta), "%s" SNAPSHOT_DELTA_SUFFIX, path);
+    remove(delta);
+    return 1;
+}
+
+/**
+ * @brief Reads the serial of a snapshot, checking it was saved from a canvas like the frame.
+ *
+ * @return The serial, or 0 if there is no such snapshot (or it is older than serials).
+ */
+static uint64_t readSerial(const char* path, const SnapshotFrame* frame, long* size) {
+    uint8_t header[SNAPSHOT_HEADER_SIZE + SERIAL_BYTES];
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int valid = fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, SNAPSHOT_MAGIC, 4) == 0
+                && get16(header + 4) == SNAPSHOT_VERSION;
+    if (valid && frame != NULL) {
+        valid = get32(header + 8) == (uint32_t)frame -> width && get32(header + 12) == (uint32_t)frame -> height
+                && get32(header + 24) == frame -> background;
+    }
+    if (valid && size != NULL) {
+        valid = (fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0);
+    }
+    fclose(file);
+    return valid ? get64(header + SNAPSHOT_HEADER_SIZE) : 0;
+}
+
+/**
+ * @brief Opens the delta file of a snapshot for appending a segment, starting it anew if it
+ * belongs to another snapshot or is damaged.
+ *
+ * @param end Receives the position of the next segment.
+ */
+static FILE* openDelta(const char* path, uint64_t serial, long* end) {
+    uint8_t header[DELTA_HEADER];
+    FILE* file = fopen(path, "r+b");
+    if (file != NULL) {
+        long size = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+        int valid = size >= DELTA_HEADER && fseek(file, 0, SEEK_SET) == 0 && fread(header, 1, sizeof(header), file) == sizeof(header)
+                    && memcmp(header, SNAPSHOT_DELTA_MAGIC, 4) == 0 && get16(header + 4) == SNAPSHOT_DELTA_VERSION
+                    && get64(header + 8) == serial && get64(header + 16) >= DELTA_HEADER && get64(header + 16) <= (uint64_t)size;
+        if (valid) {
+            *end = (long)get64(header + 16);
+            return file;
+        }
+        fclose(file);
+    }
+
+    file = fopen(path, "w+b");
+    memset(header, 0, sizeof(header));
+    memcpy(header, SNAPSHOT_DELTA_MAGIC, 4);
+    put16(header + 4, SNAPSHOT_DELTA_VERSION);
+    put64(header + 8, serial);
+    put64(header + 16, DELTA_HEADER);
+    if (file != NULL && fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        return NULL;
+    }
+    *end = DELTA_HEADER;
+    return file;
+}
+
+/**
+ * @brief Appends the tiles of a frame of changes as a segment of the delta file of `path`.
+ */
+static int writeDelta(const SnapshotFrame* frame, const char* path, SnapshotProgress* progress, Log* log) {
+    uint64_t serial = readSerial(path, frame, NULL);
+    if (serial == 0) {
+        logError(log, 456, "%s is missing or was saved from another canvas, changes cannot be added to it", path);
+        return 0;
+    }
+    char deltaPath[FILENAME_MAX];
+    snprintf(deltaPath, sizeof(deltaPath), "%s" SNAPSHOT_DELTA_SUFFIX, path);
+    long end;
+    FILE* file = openDelta(deltaPath, serial, &end);
+    if (file == NULL) {
+        logError(log, 464, "Failed to open %s for writing", deltaPath);
+        return 0;
+    }
+
+    // The scratch area holds the tile index followed by its record
+    Writer writer = { file, malloc(WRITE_BUFFER + 4 + SNAPSHOT_TILE_MAX_BYTES), 0, 0, 0 };
+    if (writer.buffer == NULL) {
+        logError(log, 471, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    uint8_t* scratch = writer.buffer + WRITE_BUFFER;
+
+    // The segment header is written blank first, then again once the tiles are in place
+    uint8_t segment[SEGMENT_HEADER] = { 0 };
+    writer.failed = (fseek(file, end, SEEK_SET) != 0);
+    writeBytes(&writer, segment, sizeof(segment));
+    int count = frame -> tilesX * frame -> tilesY;
+    uint32_t tileCount = 0;
+    uint32_t sum = 2166136261u;
+    int cancelled = 0;
+    for (int i = 0; i < count && !writer.failed && !cancelled; ++i) {
+        if (progress != NULL) {
+            cancelled = atomic_load(&progress -> cancelled);
+            atomic_store(&progress -> tilesDone, i);
+        }
+        if (!frame -> changed[i] || cancelled) {
+            continue;
+        }
+        put32(scratch, (uint32_t)i);
+        size_t size = 4 + snapshotEncodeTile(frame -> tiles[i], frame -> background, scratch + 4);
+        sum = checksum(sum, scratch, size);
+        writeBytes(&writer, scratch, size);
+        tileCount++;
+    }
+    writerFlush(&writer);
+    free(writer.buffer);
+
+    // The new end goes in the header last: until then, the segment is not part of the file
+    long segmentEnd = end + (long)writer.position;
+    uint8_t header[8];
+    put32(segment, tileCount);
+    put32(segment + 4, (uint32_t)(writer.position - SEGMENT_HEADER));
+    put32(segment + 8, sum);
+    put64(header, (uint64_t)segmentEnd);
+    if (!cancelled && tileCount > 0 && !writer.failed) {
+        writer.failed = fseek(file, end, SEEK_SET) != 0 || fwrite(segment, 1, sizeof(segment), file) != sizeof(segment) || fflush(file) != 0
+                        || fseek(file, 16, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    }
+    if (fclose(file) != 0 || writer.failed) {
+        logError(log, 513, "Failed to write %s", deltaPath);
+        return 0;
+    }
+    if (progress != NULL && !cancelled) {
+        atomic_store(&progress -> tilesDone, count);
+    }
+    return !cancelled;
+}
+
+int snapshotWrite(const SnapshotFrame* frame, const char* path, SnapshotProgress* progress, Log* log) {
+    return (frame -> changed != NULL) ? writeDelta(frame, path, progress, log)
+                                      : writeBase(frame, path, QUANTIZE_MAX_COLORS, 1, progress, log);
+}
+
+int snapshotNeedsBase(const char* path) {
+    long baseSize;
+    uint64_t serial = readSerial(path, NULL, &baseSize);
+    if (serial == 0) {
+        return 1;
+    }
+
+    char deltaPath[FILENAME_MAX];
+    snprintf(deltaPath, sizeof(deltaPath), "%s" SNAPSHOT_DELTA_SUFFIX, path);
+    FILE* file = fopen(deltaPath, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    uint8_t header[DELTA_HEADER];
+    int valid = fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, SNAPSHOT_DELTA_MAGIC, 4) == 0
+                && get64(header + 8) == serial;
+    fclose(file);
+    // A delta file of another snapshot is started anew by the next delta
+    return valid && (get64(header + 16) - DELTA_HEADER) * 2 > (uint64_t)baseSize;
+}
+
+/**
+ * @brief Writes the whole canvas, indexed like writeBase() does.
+ */
+static int saveCanvas(const Canvas* canvas, const char* path, int maxColors, int exactOnly, Log* log) {
+    // The frame borrows the canvas tiles, nothing changes them until the save returns
+    SnapshotFrame frame = { canvas -> width, canvas -> height, canvas -> tilesX, canvas -> tilesY, canvas -> background, NULL, NULL, canvas -> generation };
+    frame.tiles = malloc(sizeof(uint32_t*) * canvas -> tilesX * canvas -> tilesY);
+    if (frame.tiles == NULL) {
+        logError(log, 556, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < canvas -> tilesX * canvas -> tilesY; ++i) {
+        int tileX = i % canvas -> tilesX;
+        int tileY = i / canvas -> tilesX;
+        frame.tiles[i] = canvasIsTileBlank(canvas, tileX, tileY) ? NULL : (uint32_t*)canvasGetTile(canvas, tileX, tileY);
+    }
+
+    int saved = writeBase(&frame, path, maxColors, exactOnly, NULL, log);
+    free(frame.tiles);
+    return saved;
+}
+
+int snapshotSave(const Canvas* canvas, const char* path, Log* log) {
+    return saveCanvas(canvas, path, QUANTIZE_MAX_COLORS, 1, log);
+}
+
+int snapshotSaveIndexed(const Canvas* canvas, const char* path, int colors, Log* log) {
+    return saveCanvas(canvas, path, colors, 0, log);
+}
+
+/**
+ * @brief Size of a tile record like snapshotTileRecordSize(), indexed records being valid if
+ * the palette has `paletteCount` colors (none outside of indexed snapshots).
+ */
+static size_t recordSize(const uint8_t* data, size_t remaining, uint32_t paletteCount) {
+    if (remaining < 1) {
+        return 0;
+    }
+    switch (data[0]) {
+        case SNAPSHOT_TILE_BLANK:
+            return 1;
+        case SNAPSHOT_TILE_RAW:
+            return (remaining >= 1 + RAW_BYTES) ? 1 + RAW_BYTES : 0;
+        case SNAPSHOT_TILE_RLE: {
+            if (remaining < 5) {
+                return 0;
+            }
+            size_t size = get32(data + 1);
+            if (size % RUN_BYTES != 0 || size > remaining - 5) {
+                return 0;
+            }
+            size_t covered = 0;
+            for (size_t run = 0; run < size; run += RUN_BYTES) {
+                covered += get16(data + 5 + run);
+            }
+            return (covered == TILE_PIXELS) ? 5 + size : 0;
+        }
+        case SNAPSHOT_TILE_INDEXED: {
+            if (paletteCount == 0 || remaining < 1 + TILE_PIXELS) {
+                return 0;
+            }
+            for (int i = 0; i < TILE_PIXELS && paletteCount < QUANTIZE_MAX_COLORS; ++i) {
+                if (data[1 + i] >= paletteCount) {
+                    return 0;
+                }
+            }
+            return 1 + TILE_PIXELS;
+        }
+        default:
+            return 0;
+    }
+}
+
+size_t snapshotTileRecordSize(const uint8_t* data, size_t remaining) {
+    return recordSize(data, remaining, 0);
+}
+
+/**
+ * @brief Decodes a tile record checked by recordSize(), with the palette of its snapshot if indexed.
+ */
+static void decodeRecord(const uint8_t* data, uint32_t background, const uint32_t* palette, uint32_t* pixels) {
+    if (data[0] == SNAPSHOT_TILE_BLANK) {
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            pixels[i] = background;
+        }
+    } else if (data[0] == SNAPSHOT_TILE_RAW) {
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            pixels[i] = get32(data + 1 + i * 4);
+        }
+    } else if (data[0] == SNAPSHOT_TILE_INDEXED) {
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            pixels[i] = palette[data[1 + i]];
+        }
+    } else {
+        size_t size = get32(data + 1);
+        uint32_t* dst = pixels;
+        for (size_t run = 0; run < size; run += RUN_BYTES) {
+            uint32_t length = get16(data + 5 + run);
+            uint32_t color = get32(data + 7 + run);
+            for (uint32_t i = 0; i < length; ++i) {
+                *dst++ = color;
+            }
+        }
+    }
+}
+
+void snapshotDecodeTile(const uint8_t* data, uint32_t background, uint32_t* pixels) {
+    decodeRecord(data, background, NULL, pixels);
+}
+
+/**
+ * @brief Tells whether a header describes a snapshot this version can load.
+ */
+static int isSupportedHeader(const uint8_t* header) {
+    uint32_t version = get16(header + 4);
+    uint32_t format = get16(header + 6);
+    return memcmp(header, SNAPSHOT_MAGIC, 4) == 0 && (version == SNAPSHOT_VERSION || version == SNAPSHOT_VERSION_NO_SERIAL
+           || version == SNAPSHOT_VERSION_NO_INDEX)
+           && (format == SNAPSHOT_FORMAT_XRGB8888 || (format == SNAPSHOT_FORMAT_INDEXED8 && version == SNAPSHOT_VERSION))
+           && get32(header + 16) == CANVAS_TILE_SIZE
+           && get32(header + 20) == CANVAS_TILE_SIZE * 4 && get32(header + 8) <= INT_MAX && get32(header + 12) <= INT_MAX;
+}
+
+int snapshotReadHeader(const char* path, int* width, int* height, uint32_t* background) {
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int valid = (fread(header, 1, sizeof(header), file) == sizeof(header)) && isSupportedHeader(header);
+    fclose(file);
+    if (valid) {
+        *width = (int)get32(header + 8);
+        *height = (int)get32(header + 12);
+        *background = get32(header + 24);
+    }
+    return valid;
+}
+
+/**
+ * @brief Snapshot file mapped while some of its tiles wait in the canvas.
+ */
+typedef struct MappedSnapshot {
+    MappedFile* file;
+    const uint8_t* index;  /**< Tile index of the file. */
+    uint32_t tilesX;       /**< Tile columns of the snapshot. */
+    int canvasTilesX;      /**< Tile columns of the canvas. */
+    uint32_t background;   /**< Background color of the snapshot. */
+    uint32_t paletteCount; /**< Colors of the palette of an indexed snapshot, else 0. */
+    uint32_t palette[QUANTIZE_MAX_COLORS];
+    Log* log;
+} MappedSnapshot;
+
+static void loadMappedTile(void* data, int tileIndex, uint32_t* pixels) {
+    static const uint8_t blank = SNAPSHOT_TILE_BLANK;
+    MappedSnapshot* snapshot = data;
+    const uint8_t* file = mappedFileData(snapshot -> file);
+    size_t size = mappedFileSize(snapshot -> file);
+
+    uint32_t tile = (uint32_t)(tileIndex / snapshot -> canvasTilesX) * snapshot -> tilesX + (uint32_t)(tileIndex % snapshot -> canvasTilesX);
+    uint32_t offset = get32(snapshot -> index + tile * 4);
+    const uint8_t* record = &blank;
+    if (offset != 0) {
+        // Records are only checked now, reading them all at load time would read the whole file
+        if (recordSize(file + offset, size - offset, snapshot -> paletteCount) != 0) {
+            record = file + offset;
+        } else {
+            logError(snapshot -> log, 715, "Tile %u of the snapshot is damaged", tile);
+        }
+    }
+    decodeRecord(record, snapshot -> background, snapshot -> palette, pixels);
+}
+
+static void releaseMappedSnapshot(void* data) {
+    MappedSnapshot* snapshot = data;
+    mappedFileClose(snapshot -> file);
+    free(snapshot);
+}
+
+/**
+ * @brief Loads a version 1 snapshot, whose records can only be found by decoding the ones before.
+ */
+static int loadWithoutIndex(Canvas* canvas, const uint8_t* data, size_t size, const char* path, Log* log) {
+    uint32_t background = get32(data + 24);
+    uint32_t tileCount = get32(data + 28);
+    uint32_t tilesX = (get32(data + 8) + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+
+    // Check every record before touching the canvas, a damaged file leaves it as it was
+    size_t offset = SNAPSHOT_HEADER_SIZE;
+    int valid = 1;
+    for (uint32_t i = 0; i < tileCount && valid; ++i) {
+        size_t record = snapshotTileRecordSize(data + offset, size - offset);
+        valid = (record != 0);
+        offset += record;
+    }
+    if (!valid) {
+        logError(log, 744, "%s is damaged", path);
+        return 0;
+    }
+
+    uint32_t* pixels = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    if (pixels == NULL) {
+        logError(log, 750, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    canvasClear(canvas);
+    offset = SNAPSHOT_HEADER_SIZE;
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        int tileX = (int)(i % tilesX);
+        int tileY = (int)(i / tilesX);
+        int blank = (data[offset] == SNAPSHOT_TILE_BLANK && background == canvas -> background);
+        if (!blank && tileX < canvas -> tilesX && tileY < canvas -> tilesY) {
+            snapshotDecodeTile(data + offset, background, pixels);
+            canvasWriteTile(canvas, tileX, tileY, pixels);
+        }
+        offset += snapshotTileRecordSize(data + offset, size - offset);
+    }
+
+    free(pixels);
+    return 1;
+}
+
+/**
+ * @brief Checks a segment of a delta file: every tile index and record must lie inside it.
+ *
+ * @return Size of the segment, or 0 if it is cut short or damaged.
+ */
+static size_t checkSegment(const uint8_t* data, size_t remaining, uint32_t tileCount) {
+    if (remaining < SEGMENT_HEADER || get32(data + 4) > remaining - SEGMENT_HEADER
+        || checksum(2166136261u, data + SEGMENT_HEADER, get32(data + 4)) != get32(data + 8)) {
+        return 0;
+    }
+    size_t end = SEGMENT_HEADER + get32(data + 4);
+    size_t offset = SEGMENT_HEADER;
+    for (uint32_t i = 0; i < get32(data); ++i) {
+        size_t record = (end - offset > 4) ? snapshotTileRecordSize(data + offset + 4, end - offset - 4) : 0;
+        if (record == 0 || get32(data + offset) >= tileCount) {
+            return 0;
+        }
+        offset += 4 + record;
+    }
+    return (offset == end) ? end : 0;
+}
+
+/**
+ * @brief Writes the tiles of the segments of a delta file onto the canvas, the last version of
+ * each tile only. Segments after a damaged one are ignored.
+ */
+static void applyDelta(Canvas* canvas, const char* path, uint64_t serial, uint32_t tilesX, uint32_t tileCount, uint32_t background, Log* log) {
+    MappedFile* file = mappedFileOpen(path, log);
+    if (file == NULL) {
+        return;
+    }
+    const uint8_t* data = mappedFileData(file);
+    size_t size = mappedFileSize(file);
+    if (size < DELTA_HEADER || memcmp(data, SNAPSHOT_DELTA_MAGIC, 4) != 0 || get16(data + 4) != SNAPSHOT_DELTA_VERSION
+        || get64(data + 8) != serial) {
+        // Left by a snapshot that replaced this one
+        mappedFileClose(file);
+        return;
+    }
+    size_t end = (get64(data + 16) < size) ? (size_t)get64(data + 16) : size;
+
+    const uint8_t** latest = calloc(tileCount + 1, sizeof(const uint8_t*));
+    uint32_t* pixels = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    if (latest == NULL || pixels == NULL) {
+        logError(log, 815, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    size_t offset = DELTA_HEADER;
+    while (offset < end) {
+        size_t segment = checkSegment(data + offset, end - offset, tileCount);
+        if (segment == 0) {
+            logError(log, 822, "%s is damaged, the changes after byte %zu are lost", path, offset);
+            break;
+        }
+        const uint8_t* tile = data + offset + SEGMENT_HEADER;
+        for (uint32_t i = 0; i < get32(data + offset); ++i) {
+            latest[get32(tile)] = tile + 4;
+            tile += 4 + snapshotTileRecordSize(tile + 4, (size_t)(data + offset + segment - tile - 4));
+        }
+        offset += segment;
+    }
+
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        int tileX = (int)(i % tilesX);
+        int tileY = (int)(i / tilesX);
+        if (latest[i] != NULL && tileX < canvas -> tilesX && tileY < canvas -> tilesY) {
+            snapshotDecodeTile(latest[i], background, pixels);
+            canvasWriteTile(canvas, tileX, tileY, pixels);
+        }
+    }
+    free(latest);
+    free(pixels);
+    mappedFileClose(file);
+}
+
+int snapshotLoad(Canvas* canvas, const char* path, Log* log) {
+    MappedFile* file = mappedFileOpen(path, log);
+    if (file == NULL) {
+        return 0;
+    }
+    const uint8_t* data = mappedFileData(file);
+    size_t size = mappedFileSize(file);
+
+    if (size < SNAPSHOT_HEADER_SIZE || !isSupportedHeader(data)) {
+        logError(log, 855, "%s is not a supported canvas snapshot", path);
+        mappedFileClose(file);
+        return 0;
+    }
+    uint32_t width = get32(data + 8);
+    uint32_t height = get32(data + 12);
+    uint32_t background = get32(data + 24);
+    uint32_t tileCount = get32(data + 28);
+    uint32_t tilesX = (width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    uint32_t tilesY = (height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    if (tileCount != tilesX * tilesY) {
+        logError(log, 866, "%s is damaged", path);
+        mappedFileClose(file);
+        return 0;
+    }
+
+    if (get16(data + 4) == SNAPSHOT_VERSION_NO_INDEX) {
+        int loaded = loadWithoutIndex(canvas, data, size, path, log);
+        mappedFileClose(file);
+        return loaded;
+    }
+
+    // The palette of an indexed snapshot comes before the index
+    size_t indexStart = SNAPSHOT_HEADER_SIZE + ((get16(data + 4) == SNAPSHOT_VERSION) ? SERIAL_BYTES : 0);
+    size_t serialEnd = indexStart;
+    uint32_t paletteCount = 0;
+    int valid = 1;
+    if (get16(data + 6) == SNAPSHOT_FORMAT_INDEXED8) {
+        paletteCount = (size >= indexStart + 4) ? get32(data + indexStart) : 0;
+        valid = (paletteCount >= 1 && paletteCount <= QUANTIZE_MAX_COLORS);
+        indexStart += 4 + (size_t)paletteCount * 4;
+    }
+
+    // Only the index is read, the offsets it holds must point inside the file
+    size_t recordsStart = indexStart + (size_t)tileCount * 4;
+    valid = valid && (size >= recordsStart);
+    for (uint32_t i = 0; i < tileCount && valid; ++i) {
+        uint32_t offset = get32(data + indexStart + i * 4);
+        valid = (offset == 0 || (offset >= recordsStart && offset < size));
+    }
+    if (!valid) {
+        logError(log, 896, "%s is damaged", path);
+        mappedFileClose(file);
+        return 0;
+    }
+
+    MappedSnapshot* snapshot = malloc(sizeof(MappedSnapshot));
+    unsigned char* stored = calloc(canvas -> tilesX * canvas -> tilesY, 1);
+    if (snapshot == NULL || stored == NULL) {
+        logError(log, 904, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    snapshot -> file = file;
+    snapshot -> index = data + indexStart;
+    snapshot -> tilesX = tilesX;
+    snapshot -> canvasTilesX = canvas -> tilesX;
+    snapshot -> background = background;
+    snapshot -> paletteCount = paletteCount;
+    for (uint32_t i = 0; i < paletteCount; ++i) {
+        snapshot -> palette[i] = get32(data + serialEnd + 4 + i * 4);
+    }
+    snapshot -> log = log;
+
+    // A blank tile only needs decoding if the snapshot was drawn on another background
+    for (int tileY = 0; tileY < canvas -> tilesY && (uint32_t)tileY < tilesY; ++tileY) {
+        for (int tileX = 0; tileX < canvas -> tilesX && (uint32_t)tileX < tilesX; ++tileX) {
+            uint32_t offset = get32(snapshot -> index + ((uint32_t)tileY * tilesX + (uint32_t)tileX) * 4);
+            stored[tileY * canvas -> tilesX + tileX] = (offset != 0 || background != canvas -> background);
+        }
+    }
+    uint64_t serial = (serialEnd > SNAPSHOT_HEADER_SIZE) ? get64(data + SNAPSHOT_HEADER_SIZE) : 0;
+    canvasSetTileSource(canvas, stored, loadMappedTile, releaseMappedSnapshot, snapshot);
+    free(stored);
+
+    if (serial != 0) {
+        char deltaPath[FILENAME_MAX];
+        snprintf(deltaPath, sizeof(deltaPath), "%s" SNAPSHOT_DELTA_SUFFIX, path);
+        applyDelta(canvas, deltaPath, serial, tilesX, tileCount, background, log);
+    }
+    return 1;
+}
@@ -0,0 +1,262 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "canvas.h"
+#include "logger.h"
+
+/*
+ * Canvas snapshot file, all integers little-endian:
+ *
+ *   Header (32 bytes)
+ *     char[4]  magic        "PCNV"
+ *     uint16   version      SNAPSHOT_VERSION
+ *     uint16   pixelFormat  SNAPSHOT_FORMAT_XRGB8888 (0x00RRGGBB, same as the canvas), or
+ *                           SNAPSHOT_FORMAT_INDEXED8 when the file has a palette
+ *     uint32   width        Canvas width in pixels
+ *     uint32   height       Canvas height in pixels
+ *     uint32   tileSize     Width and height of a tile in pixels
+ *     uint32   stride       Bytes per row of a raw tile (tileSize * 4)
+ *     uint32   background   Background color of the canvas
+ *     uint32   tileCount    Number of tiles, row-major
+ *
+ *   uint64     serial       Number telling this file from any other, repeated by its delta file
+ *
+ *   Palette, in SNAPSHOT_FORMAT_INDEXED8 files only
+ *     uint32   colorCount   Number of colors, 1 to 256
+ *     colorCount * uint32 color (0x00RRGGBB)
+ *
+ *   Tile index (tileCount * 4 bytes)
+ *     uint32   offset       Position of the record of each tile in the file, 0 for a blank tile
+ *
+ *   Tile records of the tiles that are not blank, in any order
+ *
+ *   Version 2 files have no serial. Version 1 files have no serial and no index, and hold
+ *   one record per tile, blank ones included. Only version 3 files can have a palette.
+ *
+ *   Tile record
+ *     uint8    encoding     SNAPSHOT_TILE_BLANK, SNAPSHOT_TILE_RAW, SNAPSHOT_TILE_RLE or SNAPSHOT_TILE_INDEXED
+ *     BLANK:   nothing, the tile is filled with the background
+ *     RAW:     tileSize rows of `stride` bytes
+ *     RLE:     uint32 byte count, then runs of (uint16 length, uint32 pixel) in row-major order
+ *     INDEXED: tileSize rows of tileSize bytes, the palette index of each pixel (files with a palette only)
+ *
+ * Delta file, named after the snapshot with SNAPSHOT_DELTA_SUFFIX, holding the tiles changed
+ * by the saves since the snapshot was written:
+ *
+ *   Header (24 bytes)
+ *     char[4]  magic        "PDLT"
+ *     uint16   version      SNAPSHOT_DELTA_VERSION
+ *     uint16   reserved     0
+ *     uint64   serial       Serial of the snapshot the segments apply to
+ *     uint64   end          Size of the file up to the end of the last complete segment
+ *
+ *   Segments, one per save, applied in order
+ *     uint32   tileCount    Number of tiles in the segment
+ *     uint32   byteCount    Size of the tiles that follow the checksum
+ *     uint32   checksum     FNV-1a of those bytes
+ *     tileCount * (uint32 tile index, tile record)
+ */
+#define SNAPSHOT_MAGIC           "PCNV"
+#define SNAPSHOT_VERSION         3
+#define SNAPSHOT_VERSION_NO_SERIAL 2
+#define SNAPSHOT_VERSION_NO_INDEX 1
+#define SNAPSHOT_FORMAT_XRGB8888 1
+#define SNAPSHOT_FORMAT_INDEXED8 2
+#define SNAPSHOT_HEADER_SIZE     32
+
+#define SNAPSHOT_DELTA_MAGIC     "PDLT"
+#define SNAPSHOT_DELTA_VERSION   1
+#define SNAPSHOT_DELTA_SUFFIX    ".delta"
+
+#define SNAPSHOT_TILE_BLANK      0
+#define SNAPSHOT_TILE_RAW        1
+#define SNAPSHOT_TILE_RLE        2
+#define SNAPSHOT_TILE_INDEXED    3
+
+// Largest encoded tile record: encoding byte followed by a raw tile.
+#define SNAPSHOT_TILE_MAX_BYTES  (1 + CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * 4)
+
+/**
+ * @brief Encodes a tile as a tile record (blank, run-length or raw, whichever is the smallest).
+ * Indexed records are only written to snapshots, which keep their palette.
+ *
+ * @param pixels The tile, NULL for a blank tile.
+ * @param background Background color, a tile made only of it is stored blank.
+ * @param dst Destination, at least SNAPSHOT_TILE_MAX_BYTES long.
+ * @return Size of the record in bytes.
+ */
+size_t snapshotEncodeTile(const uint32_t* pixels, uint32_t background, uint8_t* dst);
+
+/**
+ * @brief Size of the tile record at `data`, checking it is complete and well formed. Indexed
+ * records, which need the palette of their snapshot, are not.
+ *
+ * @param data Start of the record.
+ * @param remaining Bytes available from `data`.
+ * @return Size of the record in bytes, or 0 if it is invalid.
+ */
+size_t snapshotTileRecordSize(const uint8_t* data, size_t remaining);
+
+/**
+ * @brief Decodes a tile record checked by snapshotTileRecordSize().
+ *
+ * @param data Start of the record.
+ * @param background Color of a blank tile.
+ * @param pixels Destination tile.
+ */
+void snapshotDecodeTile(const uint8_t* data, uint32_t background, uint32_t* pixels);
+
+/**
+ * @brief Copy of the tiles of a canvas, taken so it can be saved while the canvas keeps changing.
+ *
+ * A frame holds either the whole canvas or only the tiles changed since an earlier save.
+ */
+typedef struct SnapshotFrame {
+    int width;              /**< Width of the canvas in pixels. */
+    int height;             /**< Height of the canvas in pixels. */
+    int tilesX;             /**< Number of tile columns. */
+    int tilesY;             /**< Number of tile rows. */
+    uint32_t background;    /**< Background color of the canvas. */
+    uint32_t** tiles;       /**< tilesX * tilesY tiles, row-major, NULL for blank tiles. */
+    unsigned char* changed; /**< NULL for a whole canvas, else non-zero for the tiles the frame holds. */
+    uint64_t generation;    /**< The `generation` of the canvas when the frame was taken. */
+} SnapshotFrame;
+
+/**
+ * @brief Progress of a snapshot being written, shared between the writer and the thread watching it.
+ */
+typedef struct SnapshotProgress {
+    atomic_int tilesDone; /**< Tiles written so far. */
+    int tilesTotal;       /**< Tiles to write, set before the write starts. */
+    atomic_int cancelled; /**< Set to non-zero to stop the write. */
+} SnapshotProgress;
+
+/**
+ * @brief Copies the tiles of a canvas that are not blank.
+ *
+ * Tiles still waiting in a loaded snapshot are decoded, which lets the canvas unmap the
+ * file before a save replaces it.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created SnapshotFrame instance.
+ */
+SnapshotFrame* snapshotCapture(const Canvas* canvas, Log* log);
+
+/**
+ * @brief Copies the tiles of a canvas changed since an earlier frame was taken, for a delta save.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param since The `generation` of the earlier frame.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created SnapshotFrame instance.
+ */
+SnapshotFrame* snapshotCaptureChanges(const Canvas* canvas, uint64_t since, Log* log);
+
+/**
+ * @brief Destructor function to free a SnapshotFrame and its tiles.
+ *
+ * @param frame Pointer to the SnapshotFrame instance to be destroyed.
+ */
+void snapshotFrameDeconstructor(SnapshotFrame* frame);
+
+/**
+ * @brief Resets a progress counter for a frame, before handing both to snapshotWrite().
+ *
+ * @param progress Pointer to the SnapshotProgress instance.
+ * @param frame Pointer to the frame that will be written.
+ */
+void snapshotProgressInit(SnapshotProgress* progress, const SnapshotFrame* frame);
+
+/**
+ * @brief Writes a frame to a snapshot file. Safe to call from a worker thread.
+ *
+ * A whole frame is written under a temporary name and only replaces `path` once complete, so
+ * a cancelled or failed save leaves the previous snapshot untouched. The delta file of the
+ * previous snapshot is removed. A frame of at most 256 colors is written with a palette, one
+ * byte per pixel.
+ *
+ * A frame of changes is appended as a segment to the delta file of `path`, which must be a
+ * snapshot of the canvas the frame comes from. The segment only counts once complete.
+ *
+ * @param frame Pointer to the frame to write.
+ * @param path Path of the file to create or replace.
+ * @param progress Optional progress counter (may be NULL), updated after each tile.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file could not be written or the save was cancelled.
+ */
+int snapshotWrite(const SnapshotFrame* frame, const char* path, SnapshotProgress* progress, Log* log);
+
+/**
+ * @brief Tells whether the next save should write a whole snapshot rather than a delta: there is
+ * no snapshot a delta could apply to, or its delta file reached half of its size.
+ *
+ * @param path Path of the snapshot file.
+ * @return 1 if a whole snapshot should be written, 0 if a delta will do.
+ */
+int snapshotNeedsBase(const char* path);
+
+/**
+ * @brief Writes the whole canvas to a snapshot file.
+ *
+ * Each tile is stored blank, run-length encoded or raw, whichever is the smallest, and the
+ * file is written with a few large buffered writes. A canvas of at most 256 colors is saved
+ * with a palette, its tiles being indexed rather than raw, which takes 4 times less room.
+ *
+ * @param canvas Pointer to the Canvas instance to save.
+ * @param path Path of the file to create or replace.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int snapshotSave(const Canvas* canvas, const char* path, Log* log);
+
+/**
+ * @brief Writes the whole canvas to a snapshot file with a palette, reducing its colors if needed.
+ *
+ * Each tile is stored blank, run-length encoded or one byte per pixel. A canvas of more
+ * colors than `colors` has them reduced by quantizePalette(), each pixel being saved as the
+ * closest color of the palette.
+ *
+ * @param canvas Pointer to the Canvas instance to save.
+ * @param path Path of the file to create or replace.
+ * @param colors Most colors of the palette, 1 to QUANTIZE_MAX_COLORS.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int snapshotSaveIndexed(const Canvas* canvas, const char* path, int colors, Log* log);
+
+/**
+ * @brief Reads the size of the canvas a snapshot file was saved from, to create a canvas to load it in.
+ *
+ * @param path Path of the snapshot file.
+ * @param width Receives the width in pixels.
+ * @param height Receives the height in pixels.
+ * @param background Receives the background color.
+ * @return 1 on success, 0 if the file is missing or is not a supported snapshot.
+ */
+int snapshotReadHeader(const char* path, int* width, int* height, uint32_t* background);
+
+/**
+ * @brief Replaces the content of the canvas with a snapshot file.
+ *
+ * The part of the snapshot that does not fit the canvas is ignored, the part of the
+ * canvas the snapshot does not cover is cleared.
+ *
+ * The file is mapped and only its index is read here: each tile is decoded the first time
+ * the canvas reads or changes it, and the file stays mapped until every tile was. A tile
+ * record found damaged then is loaded blank. Version 1 files are decoded at once.
+ *
+ * The segments of the delta file are then applied, the tiles they hold being decoded at once.
+ * A delta file written for another snapshot is ignored.
+ *
+ * @param canvas Pointer to the Canvas instance receiving the snapshot.
+ * @param path Path of the snapshot file.
+ * @param log Pointer to the log for error handling.
+ * @return 1 on success, 0 if the file is missing or is not a valid snapshot.
+ */
+int snapshotLoad(Canvas* canvas, const char* path, Log* log);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,60 @@
+#include <stdatomic.h>
+#include "stamp.h"
+#include "thread.h"
+
+#define STAMP_MAX_RADIUS (STAMP_MAX_SIZE / 2)
+#define STAMP_MAX_ROWS   (2 * STAMP_MAX_RADIUS + 1)
+
+// halfWidths[shape][radius][dy + radius], filled once on first use
+static int halfWidths[2][STAMP_MAX_RADIUS + 1][STAMP_MAX_ROWS];
+
+// 0 until the tables are built, 1 while one thread builds them, 2 once they are ready
+static atomic_int tablesState = 0;
+
+/**
+ * @brief Precomputes the half-width of every row, for every radius and shape.
+ *
+ * The disc keeps the historical test of drawPixel: (i, j) is covered when i*i + j*j <= r*r.
+ */
+static void initTables(void) {
+    for (int radius = 0; radius <= STAMP_MAX_RADIUS; ++radius) {
+        for (int dy = -radius; dy <= radius; ++dy) {
+            int width = 0;
+            while ((width + 1) * (width + 1) + dy * dy <= radius * radius) {
+                width++;
+            }
+            halfWidths[STAMP_SQUARE][radius][dy + radius] = radius;
+            halfWidths[STAMP_CIRCLE][radius][dy + radius] = width;
+        }
+    }
+}
+
+const int* stampHalfWidths(StampShape shape, int size) {
+    // Canvases may be drawn on from several threads: the first caller builds the tables, the others wait
+    if (atomic_load_explicit(&tablesState, memory_order_acquire) != 2) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&tablesState, &expected, 1)) {
+            initTables();
+            atomic_store_explicit(&tablesState, 2, memory_order_release);
+        } else {
+            while (atomic_load_explicit(&tablesState, memory_order_acquire) != 2) {
+                threadYield();
+            }
+        }
+    }
+    int radius = size / 2;
+    if (radius < 0) radius = 0;
+    if (radius > STAMP_MAX_RADIUS) radius = STAMP_MAX_RADIUS;
+    return halfWidths[shape == STAMP_CIRCLE][radius];
+}
+
+void stampDraw(Canvas* canvas, int x, int y, int size, StampShape shape, uint32_t color) {
+    const int* widths = stampHalfWidths(shape, size);
+    int radius = size / 2;
+    if (radius > STAMP_MAX_RADIUS) radius = STAMP_MAX_RADIUS;
+
+    for (int dy = -radius; dy <= radius; ++dy) {
+        int width = widths[dy + radius];
+        canvasFillSpan(canvas, y + dy, x - width, x + width + 1, color);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef STAMP_H
+#define STAMP_H
+
+#include "canvas.h"
+
+// Largest brush size with a precomputed span table (same value as ID_BRUSH in Paint.c).
+#define STAMP_MAX_SIZE 26
+
+/**
+ * @brief Shape of a brush stamp.
+ */
+typedef enum StampShape {
+    STAMP_SQUARE = 0, /**< Filled square, drawn by the S-Draw mode. */
+    STAMP_CIRCLE = 1  /**< Filled disc, drawn by the C-Draw mode. */
+} StampShape;
+
+/**
+ * @brief Returns the span table of a stamp.
+ *
+ * A stamp of the given size covers the rows -size/2 to size/2 around its center. Entry
+ * `dy + size/2` of the table is the half-width of row dy: the row covers [x - w, x + w].
+ * Sizes above STAMP_MAX_SIZE are clamped.
+ *
+ * @param shape Shape of the stamp.
+ * @param size Brush size (0 to STAMP_MAX_SIZE).
+ * @return Pointer to size/2 * 2 + 1 half-widths.
+ */
+const int* stampHalfWidths(StampShape shape, int size);
+
+/**
+ * @brief Stamps a brush on the canvas, one span fill per row.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param x The x-coordinate of the stamp center.
+ * @param y The y-coordinate of the stamp center.
+ * @param size Brush size (0 to STAMP_MAX_SIZE).
+ * @param shape Shape of the stamp.
+ * @param color Color of the stamp.
+ */
+void stampDraw(Canvas* canvas, int x, int y, int size, StampShape shape, uint32_t color);
+
+#endif /* STAMP_H */
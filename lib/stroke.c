@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include "stroke.h"
+
+void strokeDrawSegment(Canvas* canvas, int x0, int y0, int x1, int y1, int size, StampShape shape, uint32_t color, Log* log) {
+    const int* widths = stampHalfWidths(shape, size);
+    int radius = size / 2;
+    if (radius > STAMP_MAX_SIZE / 2) radius = STAMP_MAX_SIZE / 2;
+
+    int top = (y0 < y1) ? y0 : y1;
+    int rows = abs(y1 - y0) + 1;
+
+    // Leftmost and rightmost pixel of the center line on every row it crosses
+    int* extents = malloc(sizeof(int) * 2 * rows);
+    if (extents == NULL) {
+        logError(log, 15, "Memory Allocation Error");
+        return;
+    }
+    for (int i = 0; i < rows; ++i) {
+        extents[2 * i] = (x0 > x1) ? x0 : x1;
+        extents[2 * i + 1] = (x0 > x1) ? x1 : x0;
+    }
+
+    // Bresenham, same pixels as canvasDrawLine
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int stepX = (x0 < x1) ? 1 : -1;
+    int stepY = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+    int x = x0, y = y0;
+    for (;;) {
+        int* extent = extents + 2 * (y - top);
+        if (x < extent[0]) extent[0] = x;
+        if (x > extent[1]) extent[1] = x;
+        if (x == x1 && y == y1) {
+            break;
+        }
+        int doubled = 2 * error;
+        if (doubled >= dy) {
+            error += dy;
+            x += stepX;
+        }
+        if (doubled <= dx) {
+            error += dx;
+            y += stepY;
+        }
+    }
+
+    // Each output row is a single span: every stamp covering it contains its own center,
+    // and the centers of neighbouring rows are at most one pixel apart.
+    int bottom = top + rows - 1;
+    int firstRow = top - radius;
+    int lastRow = bottom + radius;
+    if (firstRow < canvas -> clipTop) firstRow = canvas -> clipTop;
+    if (lastRow >= canvas -> clipBottom) lastRow = canvas -> clipBottom - 1;
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        int left = canvas -> clipRight;
+        int right = canvas -> clipLeft - 1;
+        int first = (row - radius > top) ? row - radius : top;
+        int last = (row + radius < bottom) ? row + radius : bottom;
+        for (int center = first; center <= last; ++center) {
+            const int* extent = extents + 2 * (center - top);
+            int width = widths[row - center + radius];
+            if (extent[0] - width < left) left = extent[0] - width;
+            if (extent[1] + width > right) right = extent[1] + width;
+        }
+        canvasFillSpan(canvas, row, left, right + 1, color);
+    }
+
+    free(extents);
+}
@@ -0,0 +1,24 @@
+#ifndef STROKE_H
+#define STROKE_H
+
+#include "canvas.h"
+#include "stamp.h"
+
+/**
+ * @brief Draws the area swept by a brush moving from (x0, y0) to (x1, y1).
+ *
+ * The result is the same as stamping the brush on every pixel of the segment, but each
+ * row of the swept area is filled once, as the union of the spans of every stamp
+ * crossing it. Cost is proportional to the painted area, not to the number of stamps.
+ *
+ * @param canvas Pointer to the Canvas instance.
+ * @param x0, y0 Starting point of the segment.
+ * @param x1, y1 Ending point of the segment.
+ * @param size Brush size (0 to STAMP_MAX_SIZE).
+ * @param shape Shape of the brush.
+ * @param color Color of the stroke.
+ * @param log Pointer to the log for error handling.
+ */
+void strokeDrawSegment(Canvas* canvas, int x0, int y0, int x1, int y1, int size, StampShape shape, uint32_t color, Log* log);
+
+#endif /* STROKE_H */
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+struct Thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadFunction function;
+    void* argument;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI threadEntry(LPVOID data) {
+#else
+static void* threadEntry(void* data) {
+#endif
+    Thread* thread = data;
+    thread -> function(thread -> argument);
+    return 0;
+}
+
+Thread* threadStart(ThreadFunction function, void* argument, Log* log) {
+    Thread* thread = malloc(sizeof(Thread));
+    if (thread == NULL) {
+        logError(log, 33, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    thread -> function = function;
+    thread -> argument = argument;
+
+#ifdef _WIN32
+    thread -> handle = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    int started = (thread -> handle != NULL);
+#else
+    int started = (pthread_create(&thread -> handle, NULL, threadEntry, thread) == 0);
+#endif
+    if (!started) {
+        logError(log, 46, "Failed to start a thread");
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void threadJoin(Thread* thread) {
+    if (thread != NULL) {
+#ifdef _WIN32
+        WaitForSingleObject(thread -> handle, INFINITE);
+        CloseHandle(thread -> handle);
+#else
+        pthread_join(thread -> handle, NULL);
+#endif
+        free(thread);
+    }
+}
+
+int threadProcessorCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (count > 0) ? count : 1;
+}
+
+void threadYield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
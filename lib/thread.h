@@ -0,0 +1,48 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "logger.h"
+
+/**
+ * @brief Function run by a thread.
+ *
+ * @param argument The pointer given to threadStart().
+ */
+typedef void (*ThreadFunction)(void* argument);
+
+/**
+ * @brief Worker thread, running on Win32 threads or POSIX threads.
+ */
+typedef struct Thread Thread;
+
+/**
+ * @brief Starts a thread running `function(argument)`.
+ *
+ * @param function Function run by the thread.
+ * @param argument Pointer passed to the function.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the new Thread, or NULL if it could not be started.
+ */
+Thread* threadStart(ThreadFunction function, void* argument, Log* log);
+
+/**
+ * @brief Waits for a thread to return, then frees it.
+ *
+ * @param thread Pointer to the Thread instance, invalid once this returns.
+ */
+void threadJoin(Thread* thread);
+
+/**
+ * @brief Number of processors available to run threads.
+ *
+ * @return The processor count, at least 1.
+ */
+int threadProcessorCount(void);
+
+/**
+ * @brief Gives the rest of the time slice of the calling thread to another one, for threads
+ * waiting on each other without a lock.
+ */
+void threadYield(void);
+
+#endif /* THREAD_H */
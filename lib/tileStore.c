@@ -0,0 +1,785 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "tileStore.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define TILE_PIXELS    (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+#define PACK_NAME      "tiles.pack"
+#define MANIFEST_EXT   ".pman"
+#define KEY_SEED       0x243F6A8885A308D3ull
+#define CHECK_SEED     0x13198A2E03707344ull
+
+static void put16(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* dst, uint32_t value) {
+    put16(dst, value);
+    put16(dst + 2, value >> 16);
+}
+
+static void put64(uint8_t* dst, uint64_t value) {
+    put32(dst, (uint32_t)value);
+    put32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get16(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* src) {
+    return get16(src) | (get16(src + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t* src) {
+    return (uint64_t)get32(src) | ((uint64_t)get32(src + 4) << 32);
+}
+
+/**
+ * @brief Hashes a tile record 8 bytes at a time. Records are a function of the pixels alone,
+ * and most are a few runs long, so this is cheaper than hashing the pixels.
+ */
+static uint64_t hashRecord(const uint8_t* data, size_t length, uint64_t seed) {
+    uint64_t hash = seed ^ (length * 0x9E3779B97F4A7C15ull);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        hash = (hash ^ get64(data + i)) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < length; ++i, shift += 8) {
+        tail |= (uint64_t)data[i] << shift;
+    }
+    hash = (hash ^ tail) * 0x9E3779B97F4A7C15ull;
+
+    // Finalizer of MurmurHash3, every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static char* joinPath(const TileStore* store, const char* name) {
+    char* path = malloc(strlen(store -> directory) + strlen(name) + 2);
+    if (path == NULL) {
+        logError(store -> log, 75, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%s/%s", store -> directory, name);
+    return path;
+}
+
+static int isValidSlot(const char* slot) {
+    size_t length = strlen(slot);
+    if (length == 0 || length > TILE_STORE_SLOT_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        char c = slot[i];
+        int valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+        if (!valid) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char* manifestPath(const TileStore* store, const char* slot, int version) {
+    char name[TILE_STORE_SLOT_MAX + 32];
+    sprintf(name, "%s.%d" MANIFEST_EXT, slot, version);
+    return joinPath(store, name);
+}
+
+/**
+ * @brief Splits a file name of the form <slot>.<version>.pman.
+ *
+ * @return The version, or 0 if the name is not the one of a manifest of `slot` (any slot if NULL).
+ */
+static int parseManifestName(const char* name, const char* slot) {
+    const char* extension = strrchr(name, '.');
+    if (extension == NULL || strcmp(extension, MANIFEST_EXT) != 0) {
+        return 0;
+    }
+    const char* dot = extension - 1;
+    while (dot > name && *dot != '.') {
+        dot--;
+    }
+    if (dot == name || dot + 1 == extension) {
+        return 0;
+    }
+    if (slot != NULL && (strlen(slot) != (size_t)(dot - name) || strncmp(name, slot, (size_t)(dot - name)) != 0)) {
+        return 0;
+    }
+
+    int version = 0;
+    for (const char* p = dot + 1; p < extension; ++p) {
+        if (*p < '0' || *p > '9' || version > 100000000) {
+            return 0;
+        }
+        version = version * 10 + (*p - '0');
+    }
+    return version;
+}
+
+/**
+ * @brief Finds a tile by key.
+ *
+ * @return The entry of the tile, or the empty entry where it would go.
+ */
+static TileStoreEntry* findEntry(const TileStore* store, uint64_t key) {
+    int mask = store -> capacity - 1;
+    int i = (int)(key & (uint64_t)mask);
+    while (store -> entries[i].key != 0 && store -> entries[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return &store -> entries[i];
+}
+
+/**
+ * @brief Rebuilds the table with `capacity` entries, keeping only the tiles stored before `limit`.
+ */
+static void rehash(TileStore* store, int capacity, long limit) {
+    TileStoreEntry* old = store -> entries;
+    int oldCapacity = store -> capacity;
+    store -> entries = calloc(capacity, sizeof(TileStoreEntry));
+    if (store -> entries == NULL) {
+        logError(store -> log, 156, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    store -> capacity = capacity;
+    store -> count = 0;
+    for (int i = 0; i < oldCapacity; ++i) {
+        if (old[i].key != 0 && old[i].offset < limit) {
+            *findEntry(store, old[i].key) = old[i];
+            store -> count++;
+        }
+    }
+    free(old);
+}
+
+/**
+ * @brief Adds a tile to the table, growing it past half full.
+ */
+static TileStoreEntry* insertEntry(TileStore* store, uint64_t key, uint64_t check, long offset, uint32_t length) {
+    if ((store -> count + 1) * 2 > store -> capacity) {
+        rehash(store, store -> capacity * 2, LONG_MAX);
+    }
+    TileStoreEntry* entry = findEntry(store, key);
+    entry -> key = key;
+    entry -> check = check;
+    entry -> offset = offset;
+    entry -> length = length;
+    entry -> references = 0;
+    store -> count++;
+    store -> garbageBytes += TILE_STORE_RECORD_HEADER + (long)length;
+    return entry;
+}
+
+static void addReferences(TileStore* store, TileStoreEntry* entry, int delta) {
+    long size = TILE_STORE_RECORD_HEADER + (long)entry -> length;
+    if (entry -> references == 0) {
+        store -> garbageBytes -= size;
+    }
+    entry -> references += delta;
+    if (entry -> references == 0) {
+        store -> garbageBytes += size;
+    }
+}
+
+/**
+ * @brief Reads the header and keys of a manifest.
+ *
+ * @param keys Receives the keys, to be freed by the caller.
+ * @return 1 on success, 0 if the manifest is missing or damaged.
+ */
+static int readManifest(const TileStore* store, const char* path, uint8_t* header, uint64_t** keys) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int valid = fread(header, 1, TILE_STORE_MANIFEST_HEADER, file) == TILE_STORE_MANIFEST_HEADER
+                && memcmp(header, TILE_STORE_MANIFEST_MAGIC, 4) == 0 && get16(header + 4) == TILE_STORE_VERSION;
+    uint32_t width = valid ? get32(header + 8) : 0;
+    uint32_t height = valid ? get32(header + 12) : 0;
+    uint32_t tileCount = valid ? get32(header + 20) : 0;
+    valid = valid && width > 0 && height > 0 && width <= INT32_MAX && height <= INT32_MAX
+            && (uint64_t)tileCount == (uint64_t)((width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE) * (uint64_t)((height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE);
+
+    uint8_t* data = valid ? malloc((size_t)tileCount * 8 + 1) : NULL;
+    *keys = valid ? malloc((size_t)tileCount * sizeof(uint64_t) + 1) : NULL;
+    if (valid && (data == NULL || *keys == NULL)) {
+        logError(store -> log, 221, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    valid = valid && fread(data, 8, tileCount, file) == tileCount;
+    fclose(file);
+    for (uint32_t i = 0; valid && i < tileCount; ++i) {
+        (*keys)[i] = get64(data + (size_t)i * 8);
+    }
+    free(data);
+    if (!valid) {
+        free(*keys);
+        *keys = NULL;
+    }
+    return valid;
+}
+
+/**
+ * @brief Reads the tile record of an entry into the scratch buffer.
+ */
+static int readRecord(TileStore* store, const TileStoreEntry* entry) {
+    return entry -> length <= SNAPSHOT_TILE_MAX_BYTES
+           && fseek(store -> pack, entry -> offset + TILE_STORE_RECORD_HEADER, SEEK_SET) == 0
+           && fread(store -> scratch, 1, entry -> length, store -> pack) == entry -> length
+           && snapshotTileRecordSize(store -> scratch, entry -> length) == entry -> length;
+}
+
+/**
+ * @brief Indexes every complete record of the pack, then counts the uses of each tile.
+ */
+static void scanStore(TileStore* store) {
+    uint8_t header[TILE_STORE_RECORD_HEADER];
+    long offset = TILE_STORE_PACK_HEADER;
+    fseek(store -> pack, offset, SEEK_SET);
+    while (fread(header, 1, TILE_STORE_RECORD_HEADER, store -> pack) == TILE_STORE_RECORD_HEADER) {
+        uint64_t key = get64(header);
+        uint32_t length = get32(header + 16);
+        long end = offset + TILE_STORE_RECORD_HEADER + (long)length;
+        if (key == 0 || length == 0 || length > SNAPSHOT_TILE_MAX_BYTES || fseek(store -> pack, end, SEEK_SET) != 0) {
+            break;
+        }
+        // fseek goes past the end of the file without failing, a record cut short is found by its last byte
+        if (fseek(store -> pack, end - 1, SEEK_SET) != 0 || fgetc(store -> pack) == EOF) {
+            break;
+        }
+        if (findEntry(store, key) -> key == 0) {
+            insertEntry(store, key, get64(header + 8), offset, length);
+        }
+        offset = end;
+    }
+    store -> packSize = offset;
+
+    DIR* directory = opendir(store -> directory);
+    struct dirent* file;
+    while (directory != NULL && (file = readdir(directory)) != NULL) {
+        if (parseManifestName(file -> d_name, NULL) == 0) {
+            continue;
+        }
+        char* path = joinPath(store, file -> d_name);
+        uint8_t manifest[TILE_STORE_MANIFEST_HEADER];
+        uint64_t* keys;
+        if (readManifest(store, path, manifest, &keys)) {
+            uint32_t tileCount = get32(manifest + 20);
+            int missing = 0;
+            for (uint32_t i = 0; i < tileCount; ++i) {
+                TileStoreEntry* entry = (keys[i] != 0) ? findEntry(store, keys[i]) : NULL;
+                if (entry != NULL && entry -> key != 0) {
+                    addReferences(store, entry, 1);
+                } else {
+                    missing += (keys[i] != 0);
+                }
+            }
+            if (missing > 0) {
+                logError(store -> log, 293, "%s refers to %d tiles the store lost", path, missing);
+            }
+            free(keys);
+        } else {
+            logError(store -> log, 297, "%s is damaged", path);
+        }
+        free(path);
+    }
+    if (directory != NULL) {
+        closedir(directory);
+    }
+}
+
+TileStore* tileStoreConstructor(const char* directory, Log* log) {
+    TileStore* store = malloc(sizeof(TileStore));
+    if (store == NULL) {
+        logError(log, 309, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    store -> directory = malloc(strlen(directory) + 1);
+    store -> scratch = malloc(SNAPSHOT_TILE_MAX_BYTES);
+    store -> entries = calloc(1024, sizeof(TileStoreEntry));
+    if (store -> directory == NULL || store -> scratch == NULL || store -> entries == NULL) {
+        logError(log, 316, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(store -> directory, directory);
+    store -> capacity = 1024;
+    store -> count = 0;
+    store -> packSize = TILE_STORE_PACK_HEADER;
+    store -> garbageBytes = 0;
+    store -> log = log;
+
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0777);
+#endif
+
+    char* path = joinPath(store, PACK_NAME);
+    char* temporary = joinPath(store, PACK_NAME ".tmp");
+    store -> pack = fopen(path, "r+b");
+    if (store -> pack == NULL && rename(temporary, path) == 0) {
+        // Interrupted collection, between removing the old pack and renaming the new one
+        store -> pack = fopen(path, "r+b");
+    }
+    if (store -> pack == NULL) {
+        store -> pack = fopen(path, "w+b");
+        uint8_t header[TILE_STORE_PACK_HEADER] = { 0 };
+        memcpy(header, TILE_STORE_PACK_MAGIC, 4);
+        put16(header + 4, TILE_STORE_VERSION);
+        if (store -> pack != NULL && fwrite(header, 1, sizeof(header), store -> pack) != sizeof(header)) {
+            fclose(store -> pack);
+            store -> pack = NULL;
+        }
+    } else {
+        uint8_t header[TILE_STORE_PACK_HEADER];
+        if (fread(header, 1, sizeof(header), store -> pack) != sizeof(header) || memcmp(header, TILE_STORE_PACK_MAGIC, 4) != 0
+            || get16(header + 4) != TILE_STORE_VERSION) {
+            logError(log, 352, "%s is not a supported tile pack", path);
+            fclose(store -> pack);
+            store -> pack = NULL;
+        }
+    }
+    if (store -> pack == NULL) {
+        logError(log, 358, "Failed to open %s", path);
+        free(path);
+        free(temporary);
+        tileStoreDeconstructor(store);
+        return NULL;
+    }
+    free(path);
+    free(temporary);
+
+    scanStore(store);
+    return store;
+}
+
+void tileStoreDeconstructor(TileStore* store) {
+    if (store != NULL) {
+        if (store -> pack != NULL) {
+            fclose(store -> pack);
+        }
+        free(store -> directory);
+        free(store -> scratch);
+        free(store -> entries);
+        free(store);
+    }
+}
+
+/**
+ * @brief Finds the tile matching the record in the scratch buffer, appending it to the pack if new.
+ *
+ * @return Key of the tile, or 0 if it could not be written.
+ */
+static uint64_t storeRecord(TileStore* store, uint32_t length) {
+    uint64_t key = hashRecord(store -> scratch, length, KEY_SEED);
+    uint64_t check = hashRecord(store -> scratch, length, CHECK_SEED);
+    key += (key == 0);
+    TileStoreEntry* entry = findEntry(store, key);
+    // Another tile with the same key: 128 bits told them apart, try the next key
+    while (entry -> key != 0 && (entry -> check != check || entry -> length != length)) {
+        key += 1 + (key == UINT64_MAX);
+        entry = findEntry(store, key);
+    }
+    if (entry -> key != 0) {
+        return key;
+    }
+
+    uint8_t header[TILE_STORE_RECORD_HEADER];
+    put64(header, key);
+    put64(header + 8, check);
+    put32(header + 16, length);
+    if (fseek(store -> pack, store -> packSize, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), store -> pack) != sizeof(header)
+        || fwrite(store -> scratch, 1, length, store -> pack) != length) {
+        return 0;
+    }
+    insertEntry(store, key, check, store -> packSize, length);
+    store -> packSize += TILE_STORE_RECORD_HEADER + (long)length;
+    return key;
+}
+
+int tileStoreSave(TileStore* store, const SnapshotFrame* frame, const char* slot) {
+    if (!isValidSlot(slot)) {
+        logError(store -> log, 417, "%s is not a valid slot name", slot);
+        return 0;
+    }
+    int version = 1;
+    int count = tileStoreVersions(store, slot, NULL, 0);
+    if (count > 0) {
+        int* versions = malloc(sizeof(int) * count);
+        if (versions == NULL) {
+            logError(store -> log, 425, "Memory Allocation Error");
+            exit(EXIT_FAILURE);
+        }
+        count = tileStoreVersions(store, slot, versions, count);
+        version = (count > 0) ? versions[count - 1] + 1 : 1;
+        free(versions);
+    }
+
+    uint32_t tileCount = (uint32_t)(frame -> tilesX * frame -> tilesY);
+    uint8_t* manifest = malloc(TILE_STORE_MANIFEST_HEADER + (size_t)tileCount * 8);
+    uint64_t* keys = malloc(sizeof(uint64_t) * tileCount + 1);
+    if (manifest == NULL || keys == NULL) {
+        logError(store -> log, 437, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    memset(manifest, 0, TILE_STORE_MANIFEST_HEADER);
+    memcpy(manifest, TILE_STORE_MANIFEST_MAGIC, 4);
+    put16(manifest + 4, TILE_STORE_VERSION);
+    put32(manifest + 8, (uint32_t)frame -> width);
+    put32(manifest + 12, (uint32_t)frame -> height);
+    put32(manifest + 16, frame -> background);
+    put32(manifest + 20, tileCount);
+
+    // A frame of changes takes the other tiles from the latest version
+    uint64_t* previous = NULL;
+    if (frame -> changed != NULL) {
+        uint8_t header[TILE_STORE_MANIFEST_HEADER];
+        char* path = (version > 1) ? manifestPath(store, slot, version - 1) : NULL;
+        int valid = path != NULL && readManifest(store, path, header, &previous) && memcmp(header + 8, manifest + 8, 16) == 0;
+        for (uint32_t i = 0; i < tileCount && valid; ++i) {
+            valid = (frame -> changed[i] || previous[i] == 0 || findEntry(store, previous[i]) -> key != 0);
+        }
+        free(path);
+        if (!valid) {
+            logError(store -> log, 459, "%s has no version like the canvas the changes come from", slot);
+            free(previous);
+            free(manifest);
+            free(keys);
+            return 0;
+        }
+    }
+
+    // Only the tiles the pack does not hold yet are written, the others are referred to by key
+    long packSize = store -> packSize;
+    int failed = 0;
+    for (uint32_t i = 0; i < tileCount && !failed; ++i) {
+        if (previous != NULL && !frame -> changed[i]) {
+            keys[i] = previous[i];
+            put64(manifest + TILE_STORE_MANIFEST_HEADER + (size_t)i * 8, keys[i]);
+            continue;
+        }
+        uint32_t length = (uint32_t)snapshotEncodeTile(frame -> tiles[i], frame -> background, store -> scratch);
+        keys[i] = (store -> scratch[0] == SNAPSHOT_TILE_BLANK) ? 0 : storeRecord(store, length);
+        failed = (store -> scratch[0] != SNAPSHOT_TILE_BLANK && keys[i] == 0);
+        put64(manifest + TILE_STORE_MANIFEST_HEADER + (size_t)i * 8, keys[i]);
+    }
+    failed = failed || fflush(store -> pack) != 0;
+    if (failed) {
+        // What this save appended may be torn, the next one writes over it
+        logError(store -> log, 484, "Failed to write the tiles of %s", slot);
+        for (int i = 0; i < store -> capacity; ++i) {
+            if (store -> entries[i].key != 0 && store -> entries[i].offset >= packSize) {
+                store -> garbageBytes -= TILE_STORE_RECORD_HEADER + (long)store -> entries[i].length;
+            }
+        }
+        rehash(store, store -> capacity, packSize);
+        store -> packSize = packSize;
+        free(previous);
+        free(manifest);
+        free(keys);
+        return 0;
+    }
+
+    // The manifest goes last and under a temporary name: a crash leaves unused tiles, never a broken save
+    char* path = manifestPath(store, slot, version);
+    char* temporary = malloc(strlen(path) + 5);
+    if (temporary == NULL) {
+        logError(store -> log, 502, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(temporary, "%s.tmp", path);
+    size_t size = TILE_STORE_MANIFEST_HEADER + (size_t)tileCount * 8;
+    FILE* file = fopen(temporary, "wb");
+    int written = file != NULL && fwrite(manifest, 1, size, file) == size;
+    written = (file != NULL && fclose(file) == 0) && written && rename(temporary, path) == 0;
+    if (written) {
+        for (uint32_t i = 0; i < tileCount; ++i) {
+            if (keys[i] != 0) {
+                addReferences(store, findEntry(store, keys[i]), 1);
+            }
+        }
+    } else {
+        logError(store -> log, 517, "Failed to write %s", path);
+        remove(temporary);
+    }
+
+    free(path);
+    free(temporary);
+    free(previous);
+    free(manifest);
+    free(keys);
+    return written ? version : 0;
+}
+
+static int compareVersions(const void* a, const void* b) {
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+int tileStoreVersions(const TileStore* store, const char* slot, int* versions, int capacity) {
+    DIR* directory = opendir(store -> directory);
+    if (directory == NULL) {
+        return 0;
+    }
+    int count = 0;
+    struct dirent* file;
+    while ((file = readdir(directory)) != NULL) {
+        int version = parseManifestName(file -> d_name, slot);
+        if (version > 0) {
+            if (versions != NULL && count < capacity) {
+                versions[count] = version;
+            }
+            count++;
+        }
+    }
+    closedir(directory);
+    if (versions != NULL) {
+        qsort(versions, (count < capacity) ? count : capacity, sizeof(int), compareVersions);
+    }
+    return count;
+}
+
+/**
+ * @brief Resolves version 0 to the latest version of the slot.
+ *
+ * @return The version, or 0 if the slot has none.
+ */
+static int resolveVersion(const TileStore* store, const char* slot, int version) {
+    if (version != 0) {
+        return version;
+    }
+    int count = tileStoreVersions(store, slot, NULL, 0);
+    int* versions = malloc(sizeof(int) * count + 1);
+    if (versions == NULL) {
+        logError(store -> log, 570, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    count = tileStoreVersions(store, slot, versions, count);
+    version = (count > 0) ? versions[count - 1] : 0;
+    free(versions);
+    return version;
+}
+
+int tileStoreReadInfo(const TileStore* store, const char* slot, int version, int* width, int* height, uint32_t* background) {
+    version = resolveVersion(store, slot, version);
+    if (version <= 0 || !isValidSlot(slot)) {
+        return 0;
+    }
+    char* path = manifestPath(store, slot, version);
+    FILE* file = fopen(path, "rb");
+    free(path);
+    if (file == NULL) {
+        return 0;
+    }
+    uint8_t header[TILE_STORE_MANIFEST_HEADER];
+    int valid = fread(header, 1, sizeof(header), file) == sizeof(header)
+                && memcmp(header, TILE_STORE_MANIFEST_MAGIC, 4) == 0 && get16(header + 4) == TILE_STORE_VERSION
+                && get32(header + 8) <= INT32_MAX && get32(header + 12) <= INT32_MAX;
+    fclose(file);
+    if (valid) {
+        *width = (int)get32(header + 8);
+        *height = (int)get32(header + 12);
+        *background = get32(header + 16);
+    }
+    return valid;
+}
+
+int tileStoreLoad(TileStore* store, Canvas* canvas, const char* slot, int version) {
+    version = resolveVersion(store, slot, version);
+    if (version <= 0 || !isValidSlot(slot)) {
+        return 0;
+    }
+    char* path = manifestPath(store, slot, version);
+    uint8_t header[TILE_STORE_MANIFEST_HEADER];
+    uint64_t* keys;
+    if (!readManifest(store, path, header, &keys)) {
+        logError(store -> log, 612, "%s is missing or damaged", path);
+        free(path);
+        return 0;
+    }
+
+    // Check every key before touching the canvas, a damaged save leaves it as it was
+    uint32_t tileCount = get32(header + 20);
+    int missing = 0;
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        missing += (keys[i] != 0 && findEntry(store, keys[i]) -> key == 0);
+    }
+    if (missing > 0) {
+        logError(store -> log, 624, "%s refers to %d tiles the store lost", path, missing);
+        free(path);
+        free(keys);
+        return 0;
+    }
+
+    uint32_t* pixels = malloc(sizeof(uint32_t) * TILE_PIXELS);
+    if (pixels == NULL) {
+        logError(store -> log, 632, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t background = get32(header + 16);
+    int tilesX = (int)((get32(header + 8) + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE);
+    canvasClear(canvas);
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        int tileX = (int)(i % (uint32_t)tilesX);
+        int tileY = (int)(i / (uint32_t)tilesX);
+        if (tileX >= canvas -> tilesX || tileY >= canvas -> tilesY || (keys[i] == 0 && background == canvas -> background)) {
+            continue;
+        }
+        if (keys[i] == 0) {
+            store -> scratch[0] = SNAPSHOT_TILE_BLANK;
+        } else if (!readRecord(store, findEntry(store, keys[i]))) {
+            logError(store -> log, 647, "Tile %u of %s is damaged, loaded blank", i, path);
+            continue;
+        }
+        snapshotDecodeTile(store -> scratch, background, pixels);
+        canvasWriteTile(canvas, tileX, tileY, pixels);
+    }
+
+    free(pixels);
+    free(path);
+    free(keys);
+    return 1;
+}
+
+int tileStoreDelete(TileStore* store, const char* slot, int version) {
+    if (version <= 0 || !isValidSlot(slot)) {
+        return 0;
+    }
+    char* path = manifestPath(store, slot, version);
+    uint8_t header[TILE_STORE_MANIFEST_HEADER];
+    uint64_t* keys = NULL;
+    int valid = readManifest(store, path, header, &keys);
+    if (remove(path) != 0) {
+        free(path);
+        free(keys);
+        return 0;
+    }
+    free(path);
+
+    // A damaged manifest counted no use of any tile when the store was opened
+    for (uint32_t i = 0; valid && i < get32(header + 20); ++i) {
+        TileStoreEntry* entry = (keys[i] != 0) ? findEntry(store, keys[i]) : NULL;
+        if (entry != NULL && entry -> key != 0 && entry -> references > 0) {
+            addReferences(store, entry, -1);
+        }
+    }
+    free(keys);
+
+    if (store -> garbageBytes * 2 > store -> packSize) {
+        tileStoreCollect(store);
+    }
+    return 1;
+}
+
+void tileStorePrune(TileStore* store, const char* slot, int keep) {
+    int count = tileStoreVersions(store, slot, NULL, 0);
+    if (count <= keep) {
+        return;
+    }
+    int* versions = malloc(sizeof(int) * count);
+    if (versions == NULL) {
+        logError(store -> log, 697, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    count = tileStoreVersions(store, slot, versions, count);
+    for (int i = 0; i < count - keep; ++i) {
+        tileStoreDelete(store, slot, versions[i]);
+    }
+    free(versions);
+}
+
+static int compareOffsets(const void* a, const void* b) {
+    long left = (*(TileStoreEntry* const*)a) -> offset;
+    long right = (*(TileStoreEntry* const*)b) -> offset;
+    return (left > right) - (left < right);
+}
+
+int tileStoreCollect(TileStore* store) {
+    // Used tiles, in the order of the pack so it is read once from start to end
+    TileStoreEntry** live = malloc(sizeof(TileStoreEntry*) * store -> count + 1);
+    if (live == NULL) {
+        logError(store -> log, 717, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    int liveCount = 0;
+    for (int i = 0; i < store -> capacity; ++i) {
+        if (store -> entries[i].key != 0 && store -> entries[i].references > 0) {
+            live[liveCount++] = &store -> entries[i];
+        }
+    }
+    qsort(live, liveCount, sizeof(TileStoreEntry*), compareOffsets);
+
+    char* path = joinPath(store, PACK_NAME);
+    char* temporary = joinPath(store, PACK_NAME ".tmp");
+    FILE* file = fopen(temporary, "wb");
+    uint8_t header[TILE_STORE_PACK_HEADER] = { 0 };
+    memcpy(header, TILE_STORE_PACK_MAGIC, 4);
+    put16(header + 4, TILE_STORE_VERSION);
+    int written = file != NULL && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    long offset = TILE_STORE_PACK_HEADER;
+    long* offsets = malloc(sizeof(long) * liveCount + 1);
+    if (offsets == NULL) {
+        logError(store -> log, 738, "Memory Allocation Error");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < liveCount && written; ++i) {
+        uint8_t record[TILE_STORE_RECORD_HEADER];
+        put64(record, live[i] -> key);
+        put64(record + 8, live[i] -> check);
+        put32(record + 16, live[i] -> length);
+        written = readRecord(store, live[i]) && fwrite(record, 1, sizeof(record), file) == sizeof(record)
+                  && fwrite(store -> scratch, 1, live[i] -> length, file) == live[i] -> length;
+        offsets[i] = offset;
+        offset += TILE_STORE_RECORD_HEADER + (long)live[i] -> length;
+    }
+    written = (file != NULL && fclose(file) == 0) && written;
+
+    if (written) {
+        fclose(store -> pack);
+        remove(path);
+        // Left under the temporary name, the new pack is renamed the next time the store is opened
+        int renamed = (rename(temporary, path) == 0);
+        store -> pack = fopen(renamed ? path : temporary, "r+b");
+        if (store -> pack == NULL) {
+            logError(store -> log, 760, "Failed to open %s", path);
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < liveCount; ++i) {
+            live[i] -> offset = offsets[i];
+        }
+        // The unused tiles are left out of the rebuilt table
+        for (int i = 0; i < store -> capacity; ++i) {
+            if (store -> entries[i].key != 0 && store -> entries[i].references == 0) {
+                store -> entries[i].offset = LONG_MAX;
+            }
+        }
+        rehash(store, store -> capacity, LONG_MAX);
+        store -> packSize = offset;
+        store -> garbageBytes = 0;
+    } else {
+        logError(store -> log, 776, "Failed to rewrite %s", path);
+        remove(temporary);
+    }
+
+    free(offsets);
+    free(live);
+    free(path);
+    free(temporary);
+    return written;
+}
@@ -0,0 +1,173 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "canvas.h"
+#include "snapshot.h"
+#include "logger.h"
+
+/*
+ * A store is a directory holding the tiles of every save once, and one manifest per save.
+ * All integers are little-endian.
+ *
+ *   tiles.pack, tiles of every save, appended and never rewritten in place
+ *     Header (8 bytes)
+ *       char[4]  magic     "PTPK"
+ *       uint16   version   TILE_STORE_VERSION
+ *       uint16   reserved  0
+ *     Records
+ *       uint64   key       Hash of the tile pixels, never 0 (on a collision, the next free value)
+ *       uint64   check     Second hash of the pixels, with another seed
+ *       uint32   length    Size of the tile record that follows
+ *       A snapshot tile record of `length` bytes
+ *
+ *   <slot>.<version>.pman, one save
+ *     Header (24 bytes)
+ *       char[4]  magic       "PMAN"
+ *       uint16   version     TILE_STORE_VERSION
+ *       uint16   reserved    0
+ *       uint32   width       Canvas width in pixels
+ *       uint32   height      Canvas height in pixels
+ *       uint32   background  Background color of the canvas
+ *       uint32   tileCount   Number of keys that follow, row-major
+ *     tileCount * uint64 key of the tile in the pack, 0 for a blank tile
+ */
+#define TILE_STORE_PACK_MAGIC      "PTPK"
+#define TILE_STORE_MANIFEST_MAGIC  "PMAN"
+#define TILE_STORE_VERSION         1
+#define TILE_STORE_PACK_HEADER     8
+#define TILE_STORE_RECORD_HEADER   20
+#define TILE_STORE_MANIFEST_HEADER 24
+#define TILE_STORE_SLOT_MAX        64 // Longest slot name, letters, digits, '-' and '_' only
+
+/**
+ * @brief Tile of the pack, with the number of manifests using it.
+ */
+typedef struct TileStoreEntry {
+    uint64_t key;    /**< Hash of the pixels, 0 for an empty slot of the table. */
+    uint64_t check;  /**< Second hash, told apart from `key` to detect collisions. */
+    long offset;     /**< Position of the tile record in the pack. */
+    uint32_t length; /**< Size of the tile record. */
+    int references;  /**< Number of times manifests use the tile, 0 once it is garbage. */
+} TileStoreEntry;
+
+/**
+ * @brief Save slots sharing their tiles: each distinct tile is written once, whatever the
+ * number of saves and versions using it.
+ *
+ * A save writes only the tiles the pack does not hold yet and a manifest of a few bytes per
+ * tile, so versions of a mostly unchanged drawing cost little more than one. Deleting a
+ * version releases its tiles, and the pack is rewritten without the unused ones once they
+ * make up half of it.
+ */
+typedef struct TileStore {
+    char* directory;         /**< Directory of the store. */
+    FILE* pack;              /**< tiles.pack, open for reading and appending. */
+    long packSize;           /**< Bytes of complete records in the pack, header included. */
+    long garbageBytes;       /**< Bytes of the records no manifest uses. */
+    TileStoreEntry* entries; /**< Open addressing table of the tiles, by key. */
+    int capacity;            /**< Size of `entries`, a power of 2. */
+    int count;               /**< Tiles in the table. */
+    uint8_t* scratch;        /**< Encoding buffer for one tile. */
+    Log* log;                /**< Log used for error handling. */
+} TileStore;
+
+/**
+ * @brief Opens a store, creating its directory and pack if needed.
+ *
+ * The pack is scanned and every manifest is read to count the uses of each tile. A record
+ * cut short at the end of the pack (a save interrupted by a crash) is dropped.
+ *
+ * @param directory Directory of the store.
+ * @param log Pointer to the log for error handling.
+ * @return Pointer to the newly created TileStore instance, or NULL if the pack cannot be opened.
+ */
+TileStore* tileStoreConstructor(const char* directory, Log* log);
+
+/**
+ * @brief Destructor function to close a store.
+ *
+ * @param store Pointer to the TileStore instance to be destroyed.
+ */
+void tileStoreDeconstructor(TileStore* store);
+
+/**
+ * @brief Saves a frame as the next version of a slot. Safe to call from a worker thread as
+ * long as nothing else uses the store meanwhile.
+ *
+ * A frame of changes takes the tiles it does not hold from the latest version of the slot,
+ * which must have been saved from the same canvas.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param frame Pointer to the frame to save.
+ * @param slot Name of the slot.
+ * @return The version number of the new save (1 for the first one), or 0 on failure.
+ */
+int tileStoreSave(TileStore* store, const SnapshotFrame* frame, const char* slot);
+
+/**
+ * @brief Lists the versions saved in a slot.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param slot Name of the slot.
+ * @param versions Receives up to `capacity` version numbers, oldest first. May be NULL.
+ * @param capacity Size of `versions`.
+ * @return Number of versions of the slot (which may exceed `capacity`).
+ */
+int tileStoreVersions(const TileStore* store, const char* slot, int* versions, int capacity);
+
+/**
+ * @brief Reads the size and background of a saved version, to create a canvas to load it in.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param slot Name of the slot.
+ * @param version Version number, 0 for the latest.
+ * @param width Receives the width in pixels.
+ * @param height Receives the height in pixels.
+ * @param background Receives the background color.
+ * @return 1 on success, 0 if the version does not exist.
+ */
+int tileStoreReadInfo(const TileStore* store, const char* slot, int version, int* width, int* height, uint32_t* background);
+
+/**
+ * @brief Replaces the content of the canvas with a saved version.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param canvas Pointer to the Canvas instance. What does not fit is ignored.
+ * @param slot Name of the slot.
+ * @param version Version number, 0 for the latest.
+ * @return 1 on success, 0 if the version does not exist or its tiles cannot be read.
+ */
+int tileStoreLoad(TileStore* store, Canvas* canvas, const char* slot, int version);
+
+/**
+ * @brief Deletes a saved version and releases its tiles.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param slot Name of the slot.
+ * @param version Version number.
+ * @return 1 if the version was deleted, 0 if it does not exist.
+ */
+int tileStoreDelete(TileStore* store, const char* slot, int version);
+
+/**
+ * @brief Deletes the oldest versions of a slot, keeping the `keep` latest ones.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @param slot Name of the slot.
+ * @param keep Number of versions to keep.
+ */
+void tileStorePrune(TileStore* store, const char* slot, int keep);
+
+/**
+ * @brief Rewrites the pack without the tiles no manifest uses.
+ *
+ * Called by tileStoreDelete() once the unused tiles make up half of the pack.
+ *
+ * @param store Pointer to the TileStore instance.
+ * @return 1 on success, 0 if the pack could not be rewritten (it is then kept as it was).
+ */
+int tileStoreCollect(TileStore* store);
+
+#endif /* TILE_STORE_H */
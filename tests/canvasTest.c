@@ -0,0 +1,399 @@
+/*
+    Tests of the drawing core: drawing, reading and clearing the canvas,
+    clipping, thick lines, region copies and the snapshot round trip.
+    Every result is compared with a plain array of pixels drawn the
+    obvious way.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/line.h"
+#include "../lib/snapshot.h"
+
+#define WIDTH      200 // Not a multiple of the tile size, so the last tiles are cut
+#define HEIGHT     150
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define SNAPSHOT   "canvasTest.pcnv"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief The canvas as a plain array, drawn pixel by pixel.
+ */
+typedef struct Model {
+    uint32_t pixels[WIDTH * HEIGHT];
+    int clipLeft, clipTop, clipRight, clipBottom;
+} Model;
+
+static void modelInit(Model* model) {
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        model -> pixels[i] = BACKGROUND;
+    }
+    model -> clipLeft = 0;
+    model -> clipTop = 0;
+    model -> clipRight = WIDTH;
+    model -> clipBottom = HEIGHT;
+}
+
+static void modelFillRect(Model* model, int left, int top, int right, int bottom, uint32_t color) {
+    for (int y = top; y < bottom; ++y) {
+        for (int x = left; x < right; ++x) {
+            if (x >= model -> clipLeft && x < model -> clipRight && y >= model -> clipTop && y < model -> clipBottom) {
+                model -> pixels[y * WIDTH + x] = color;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Counts the pixels of the canvas that differ from the model.
+ */
+static int countDifferences(const Canvas* canvas, const Model* model) {
+    int differences = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            differences += (canvasGetPixel(canvas, x, y) != model -> pixels[y * WIDTH + x]);
+        }
+    }
+    return differences;
+}
+
+static uint32_t randomColor(void) {
+    return CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+}
+
+static void testDrawAndClear(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Model* model = malloc(sizeof(Model));
+    modelInit(model);
+    CHECK(countDifferences(canvas, model) == 0);
+    CHECK(canvas -> allocatedTiles == 0);
+
+    // Pixels, spans and rectangles, some of them past the edges
+    for (int i = 0; i < 500; ++i) {
+        int x = rand() % (WIDTH + 40) - 20;
+        int y = rand() % (HEIGHT + 40) - 20;
+        uint32_t color = randomColor();
+        switch (i % 3) {
+            case 0:
+                canvasSetPixel(canvas, x, y, color);
+                modelFillRect(model, x, y, x + 1, y + 1, color);
+                break;
+            case 1: {
+                int length = rand() % 150;
+                canvasFillSpan(canvas, y, x, x + length, color);
+                modelFillRect(model, x, y, x + length, y + 1, color);
+                break;
+            }
+            default: {
+                int right = x + rand() % 90;
+                int bottom = y + rand() % 90;
+                canvasFillRect(canvas, x, y, right, bottom, color);
+                modelFillRect(model, x, y, right, bottom, color);
+                break;
+            }
+        }
+    }
+    CHECK(countDifferences(canvas, model) == 0);
+
+    // Lines reach both of their ends and nothing outside of their bounding box
+    canvasClear(canvas);
+    canvasDrawLine(canvas, 10, 20, 150, 90, CANVAS_RGB(1, 2, 3));
+    CHECK(canvasGetPixel(canvas, 10, 20) == CANVAS_RGB(1, 2, 3));
+    CHECK(canvasGetPixel(canvas, 150, 90) == CANVAS_RGB(1, 2, 3));
+    int outside = 0;
+    int inside = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            int drawn = (canvasGetPixel(canvas, x, y) != BACKGROUND);
+            if (x < 10 || x > 150 || y < 20 || y > 90) {
+                outside += drawn;
+            } else {
+                inside += drawn;
+            }
+        }
+    }
+    CHECK(outside == 0);
+    CHECK(inside == 141); // One pixel per column of a line wider than high
+
+    // Pixels outside of the canvas read as the background
+    CHECK(canvasGetPixel(canvas, -1, 0) == BACKGROUND);
+    CHECK(canvasGetPixel(canvas, WIDTH, HEIGHT - 1) == BACKGROUND);
+
+    canvasClear(canvas);
+    modelInit(model);
+    CHECK(countDifferences(canvas, model) == 0);
+
+    free(model);
+    canvasDeconstructor(canvas);
+}
+
+static void testClip(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Model* model = malloc(sizeof(Model));
+    modelInit(model);
+
+    canvasSetClip(canvas, 30, 40, 120, 100);
+    model -> clipLeft = 30;
+    model -> clipTop = 40;
+    model -> clipRight = 120;
+    model -> clipBottom = 100;
+    for (int i = 0; i < 200; ++i) {
+        int x = rand() % WIDTH;
+        int y = rand() % HEIGHT;
+        int right = x + rand() % 80;
+        int bottom = y + rand() % 80;
+        uint32_t color = randomColor();
+        canvasFillRect(canvas, x, y, right, bottom, color);
+        modelFillRect(model, x, y, right, bottom, color);
+        canvasSetPixel(canvas, right, y, color);
+        modelFillRect(model, right, y, right + 1, y + 1, color);
+    }
+    canvasDrawLine(canvas, 0, 0, WIDTH - 1, HEIGHT - 1, CANVAS_RGB(9, 9, 9));
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            if (x < 30 || x >= 120 || y < 40 || y >= 100) {
+                CHECK(canvasGetPixel(canvas, x, y) == BACKGROUND);
+            }
+        }
+    }
+
+    // A clip larger than the canvas is clamped to it
+    canvasSetClip(canvas, -50, -50, WIDTH + 50, HEIGHT + 50);
+    CHECK(canvas -> clipLeft == 0 && canvas -> clipTop == 0);
+    CHECK(canvas -> clipRight == WIDTH && canvas -> clipBottom == HEIGHT);
+
+    // Clearing ignores the clip rectangle
+    canvasSetClip(canvas, 0, 0, 10, 10);
+    canvasClear(canvas);
+    modelInit(model);
+    CHECK(countDifferences(canvas, model) == 0);
+
+    free(model);
+    canvasDeconstructor(canvas);
+}
+
+/**
+ * @brief Squared distance from the pixel to the segment, as a multiple of the squared length.
+ */
+static double segmentDistanceSq(int x, int y, int x0, int y0, int x1, int y1) {
+    double dx = x1 - x0, dy = y1 - y0;
+    double lengthSq = dx * dx + dy * dy;
+    double t = (lengthSq > 0) ? ((x - x0) * dx + (y - y0) * dy) / lengthSq : 0;
+    t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+    double ex = x - (x0 + t * dx), ey = y - (y0 + t * dy);
+    return ex * ex + ey * ey;
+}
+
+static void testThickLines(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Canvas* thin = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Sizes 0 and 1 are the one pixel line, crossing every row and column between the ends
+    canvasDrawLine(thin, 10, 10, 110, 47, CANVAS_RGB(1, 2, 3));
+    for (int size = 0; size <= 1; ++size) {
+        for (int cap = STAMP_SQUARE; cap <= STAMP_CIRCLE; ++cap) {
+            canvasClear(canvas);
+            lineDrawThick(canvas, 10, 10, 110, 47, size, (StampShape)cap, CANVAS_RGB(1, 2, 3));
+            int differences = 0;
+            int emptyColumns = 0;
+            int emptyRows = 0;
+            for (int y = 0; y < HEIGHT; ++y) {
+                for (int x = 0; x < WIDTH; ++x) {
+                    differences += (canvasGetPixel(canvas, x, y) != canvasGetPixel(thin, x, y));
+                }
+            }
+            for (int x = 10; x <= 110; ++x) {
+                int drawn = 0;
+                for (int y = 10; y <= 47; ++y) {
+                    drawn |= (canvasGetPixel(canvas, x, y) != BACKGROUND);
+                }
+                emptyColumns += !drawn;
+            }
+            for (int y = 10; y <= 47; ++y) {
+                int drawn = 0;
+                for (int x = 10; x <= 110; ++x) {
+                    drawn |= (canvasGetPixel(canvas, x, y) != BACKGROUND);
+                }
+                emptyRows += !drawn;
+            }
+            CHECK(differences == 0);
+            CHECK(emptyColumns == 0 && emptyRows == 0);
+        }
+    }
+
+    // Round lines are every pixel within size/2 of the segment
+    for (int i = 0; i < 40; ++i) {
+        int x0 = rand() % WIDTH, y0 = rand() % HEIGHT;
+        int x1 = rand() % WIDTH, y1 = rand() % HEIGHT;
+        int size = 2 + rand() % (STAMP_MAX_SIZE - 1);
+        int h = size / 2;
+        canvasClear(canvas);
+        lineDrawThick(canvas, x0, y0, x1, y1, size, STAMP_CIRCLE, CANVAS_RGB(4, 5, 6));
+        int differences = 0;
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                int inside = (segmentDistanceSq(x, y, x0, y0, x1, y1) <= h * h + 1e-9);
+                differences += (inside != (canvasGetPixel(canvas, x, y) != BACKGROUND));
+            }
+        }
+        CHECK(differences == 0);
+    }
+
+    canvasDeconstructor(thin);
+    canvasDeconstructor(canvas);
+}
+
+static void testRegions(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    uint32_t* image = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        image[i] = randomColor();
+    }
+
+    // The whole canvas written and read back
+    canvasWriteRegion(canvas, 0, 0, WIDTH, HEIGHT, image, WIDTH);
+    uint32_t* copy = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    canvasReadRegion(canvas, 0, 0, WIDTH, HEIGHT, copy, WIDTH);
+    CHECK(memcmp(copy, image, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+    for (int i = 0; i < 1000; ++i) {
+        int x = rand() % WIDTH;
+        int y = rand() % HEIGHT;
+        CHECK(canvasGetPixel(canvas, x, y) == image[y * WIDTH + x]);
+    }
+
+    // A region crossing the edges reads the background outside of the canvas
+    enum { SIZE = 80, STRIDE = 90 };
+    uint32_t region[SIZE * STRIDE];
+    canvasReadRegion(canvas, WIDTH - 40, -30, SIZE, SIZE, region, STRIDE);
+    for (int y = 0; y < SIZE; ++y) {
+        for (int x = 0; x < SIZE; ++x) {
+            int canvasX = WIDTH - 40 + x;
+            int canvasY = y - 30;
+            uint32_t expected = (canvasX < WIDTH && canvasY >= 0) ? image[canvasY * WIDTH + canvasX] : BACKGROUND;
+            CHECK(region[y * STRIDE + x] == expected);
+        }
+    }
+
+    // Writes are clipped, and identical rows allocate nothing
+    canvasClear(canvas);
+    canvasSetClip(canvas, 10, 10, 60, 60);
+    canvasWriteRegion(canvas, 0, 0, WIDTH, HEIGHT, image, WIDTH);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            int clipped = (x >= 10 && x < 60 && y >= 10 && y < 60);
+            CHECK(canvasGetPixel(canvas, x, y) == (clipped ? image[y * WIDTH + x] : BACKGROUND));
+        }
+    }
+    canvasSetClip(canvas, 0, 0, WIDTH, HEIGHT);
+
+    // A region starting left of and above the canvas only writes its part inside of it
+    canvasClear(canvas);
+    canvasWriteRegion(canvas, -30, -20, 100, 90, image, WIDTH);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            int inside = (x < 70 && y < 70);
+            CHECK(canvasGetPixel(canvas, x, y) == (inside ? image[(y + 20) * WIDTH + x + 30] : BACKGROUND));
+        }
+    }
+
+    canvasClear(canvas);
+    int allocated = canvas -> allocatedTiles;
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        copy[i] = BACKGROUND;
+    }
+    canvasWriteRegion(canvas, 0, 0, WIDTH, HEIGHT, copy, WIDTH);
+    CHECK(canvas -> allocatedTiles == allocated);
+
+    free(copy);
+    free(image);
+    canvasDeconstructor(canvas);
+}
+
+/**
+ * @brief Saves a canvas, loads it into another one and compares every pixel.
+ */
+static void checkRoundTrip(const Canvas* canvas, Log* log) {
+    remove(SNAPSHOT ".delta");
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+
+    int width, height;
+    uint32_t background;
+    CHECK(snapshotReadHeader(SNAPSHOT, &width, &height, &background));
+    CHECK(width == WIDTH && height == HEIGHT && background == BACKGROUND);
+
+    Canvas* loaded = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    canvasFillRect(loaded, 0, 0, WIDTH, HEIGHT, CANVAS_RGB(7, 7, 7)); // Must be replaced
+    CHECK(snapshotLoad(loaded, SNAPSHOT, log));
+    int differences = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            differences += (canvasGetPixel(loaded, x, y) != canvasGetPixel(canvas, x, y));
+        }
+    }
+    CHECK(differences == 0);
+    canvasDeconstructor(loaded);
+    remove(SNAPSHOT);
+}
+
+static void testSnapshot(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Blank, then a few colors (saved with a palette), then noise (saved as raw tiles)
+    checkRoundTrip(canvas, log);
+    canvasFillRect(canvas, 5, 5, 120, 70, CANVAS_RGB(255, 0, 0));
+    canvasDrawLine(canvas, 0, HEIGHT - 1, WIDTH - 1, 0, CANVAS_RGB(0, 0, 255));
+    checkRoundTrip(canvas, log);
+    for (int y = 64; y < HEIGHT; ++y) {
+        for (int x = 128; x < WIDTH; ++x) {
+            canvasSetPixel(canvas, x, y, randomColor());
+        }
+    }
+    checkRoundTrip(canvas, log);
+
+    // Files that are not snapshots are refused, the error going to a scratch log
+    FILE* file = fopen(SNAPSHOT, "wb");
+    fputs("x,y,r,g,b\n", file);
+    fclose(file);
+    Log quiet = { tmpfile() };
+    Canvas* loaded = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    CHECK(!snapshotLoad(loaded, SNAPSHOT, (quiet.file != NULL) ? &quiet : log));
+    canvasDeconstructor(loaded);
+    if (quiet.file != NULL) {
+        fclose(quiet.file);
+    }
+    remove(SNAPSHOT);
+
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(1);
+
+    testDrawAndClear(&log);
+    testClip(&log);
+    testThickLines(&log);
+    testRegions(&log);
+    testSnapshot(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "canvasTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("canvasTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
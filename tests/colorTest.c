@@ -0,0 +1,447 @@
+/*
+    Tests of the color table: the nearest color found through the grid,
+    or by Delta E 1976 and CIEDE2000, is the one a search over every
+    color finds, for palettes of 1 to 40,000 colors and for any color
+    looked for, the colors and names of the CSV are loaded in the
+    arrays and the name arena of the table, names are found whatever
+    their case, and the compiled palette is read back while the CSV is
+    unchanged.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#include "../lib/logger.h"
+#include "../lib/color.h"
+
+#define PALETTE    "colorTest.csv"
+#define CACHE      PALETTE COLOR_CACHE_SUFFIX
+#define QUERIES    3000
+#define PI         3.14159265358979323846
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Writes a palette of random colors in the format of colormap.csv, a few of them twice.
+ */
+static void writePalette(int count) {
+    FILE* file = fopen(PALETTE, "w");
+    for (int i = 0; i < count; ++i) {
+        if (i > 0 && i % 50 == 0) {
+            fprintf(file, "%d, %d, %d, Copy %d\n", 10 * (i % 7), 20, 30, i);
+        } else {
+            fprintf(file, "%d, %d, %d, Color %d\n", rand() & 255, rand() & 255, rand() & 255, i);
+        }
+    }
+    fclose(file);
+}
+
+static ColorTable* openPalette(Log log) {
+    ColorTable* colorTable = colorTableConstructor(log);
+    colorTable -> setColorDataFile(colorTable, PALETTE, log);
+    loadColorTableFromCSV(colorTable, log);
+    return colorTable;
+}
+
+/**
+ * @brief Loads the palette written last, from the CSV rather than from a cache of an earlier one.
+ */
+static ColorTable* loadPalette(Log log) {
+    remove(CACHE);
+    return openPalette(log);
+}
+
+static long fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static int sameTable(const ColorTable* a, const ColorTable* b) {
+    if (a -> colorCount != b -> colorCount) {
+        return 0;
+    }
+    for (int i = 0; i < a -> colorCount; ++i) {
+        if (a -> red[i] != b -> red[i] || a -> green[i] != b -> green[i] || a -> blue[i] != b -> blue[i]
+            || strcmp(colorTableName(a, i), colorTableName(b, i)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief The closest color by squared RGB distance, the first one of the table among equals.
+ */
+static int closestByScan(const ColorTable* colorTable, int r, int g, int b) {
+    int best = -1;
+    long bestDistance = 0;
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        long dr = colorTable -> red[i] - r, dg = colorTable -> green[i] - g, db = colorTable -> blue[i] - b;
+        long distance = dr * dr + dg * dg + db * db;
+        if (best < 0 || distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief CIELAB coordinates of an sRGB color for the D65 white, in double precision.
+ */
+static void toLab(int r, int g, int b, double* lab) {
+    double linear[3];
+    int channels[3] = { r, g, b };
+    for (int i = 0; i < 3; ++i) {
+        double value = channels[i] / 255.0;
+        linear[i] = (value <= 0.04045) ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+    }
+    double xyz[3] = {
+        (0.4124564 * linear[0] + 0.3575761 * linear[1] + 0.1804375 * linear[2]) / 0.95047,
+        0.2126729 * linear[0] + 0.7151522 * linear[1] + 0.0721750 * linear[2],
+        (0.0193339 * linear[0] + 0.1191920 * linear[1] + 0.9503041 * linear[2]) / 1.08883
+    };
+    for (int i = 0; i < 3; ++i) {
+        xyz[i] = (xyz[i] > 0.008856) ? cbrt(xyz[i]) : 7.787 * xyz[i] + 16.0 / 116.0;
+    }
+    lab[0] = 116.0 * xyz[1] - 16.0;
+    lab[1] = 500.0 * (xyz[0] - xyz[1]);
+    lab[2] = 200.0 * (xyz[1] - xyz[2]);
+}
+
+static double deltaE76(const double* x, const double* y) {
+    return sqrt((x[0] - y[0]) * (x[0] - y[0]) + (x[1] - y[1]) * (x[1] - y[1]) + (x[2] - y[2]) * (x[2] - y[2]));
+}
+
+/**
+ * @brief CIEDE2000 written as Sharma, Wu and Dalal give it, with the hue angles.
+ */
+static double deltaE2000(const double* x, const double* y) {
+    double c1 = sqrt(x[1] * x[1] + x[2] * x[2]), c2 = sqrt(y[1] * y[1] + y[2] * y[2]);
+    double meanChroma7 = pow((c1 + c2) / 2.0, 7.0);
+    double g = 0.5 * (1.0 - sqrt(meanChroma7 / (meanChroma7 + pow(25.0, 7.0))));
+    double a1 = (1.0 + g) * x[1], a2 = (1.0 + g) * y[1];
+    double cp1 = sqrt(a1 * a1 + x[2] * x[2]), cp2 = sqrt(a2 * a2 + y[2] * y[2]);
+    double h1 = (cp1 == 0.0) ? 0.0 : atan2(x[2], a1) * 180.0 / PI;
+    double h2 = (cp2 == 0.0) ? 0.0 : atan2(y[2], a2) * 180.0 / PI;
+    h1 += (h1 < 0.0) ? 360.0 : 0.0;
+    h2 += (h2 < 0.0) ? 360.0 : 0.0;
+
+    double dh = 0.0;
+    if (cp1 * cp2 != 0.0) {
+        dh = h2 - h1;
+        dh += (dh > 180.0) ? -360.0 : (dh < -180.0) ? 360.0 : 0.0;
+    }
+    double dL = y[0] - x[0], dC = cp2 - cp1;
+    double dH = 2.0 * sqrt(cp1 * cp2) * sin(dh / 2.0 * PI / 180.0);
+
+    double meanL = (x[0] + y[0]) / 2.0, meanC = (cp1 + cp2) / 2.0;
+    double meanH = h1 + h2;
+    if (cp1 * cp2 != 0.0) {
+        meanH = (fabs(h1 - h2) <= 180.0) ? meanH / 2.0 : (meanH < 360.0) ? (meanH + 360.0) / 2.0 : (meanH - 360.0) / 2.0;
+    }
+    double t = 1.0 - 0.17 * cos((meanH - 30.0) * PI / 180.0) + 0.24 * cos(2.0 * meanH * PI / 180.0)
+             + 0.32 * cos((3.0 * meanH + 6.0) * PI / 180.0) - 0.20 * cos((4.0 * meanH - 63.0) * PI / 180.0);
+    double rotation = 30.0 * exp(-((meanH - 275.0) / 25.0) * ((meanH - 275.0) / 25.0));
+    double meanC7 = pow(meanC, 7.0);
+    double rc = 2.0 * sqrt(meanC7 / (meanC7 + pow(25.0, 7.0)));
+    double sl = 1.0 + 0.015 * (meanL - 50.0) * (meanL - 50.0) / sqrt(20.0 + (meanL - 50.0) * (meanL - 50.0));
+    double sc = 1.0 + 0.045 * meanC, sh = 1.0 + 0.015 * meanC * t;
+    double rt = -sin(2.0 * rotation * PI / 180.0) * rc;
+    double lightness = dL / sl, chroma = dC / sc, hue = dH / sh;
+    return sqrt(lightness * lightness + chroma * chroma + hue * hue + rt * chroma * hue);
+}
+
+/**
+ * @brief The smallest difference between a color and the `count` colors of `labs`, by a scan of every color.
+ */
+static double closestDifference(const double* labs, int count, const double* lab, double (*difference)(const double*, const double*)) {
+    double best = HUGE_VAL;
+    for (int i = 0; i < count; ++i) {
+        double distance = difference(lab, labs + 3 * i);
+        best = (distance < best) ? distance : best;
+    }
+    return best;
+}
+
+static void testLoad(Log log) {
+    FILE* file = fopen(PALETTE, "w");
+    fprintf(file, "130, 102, 68, Raw Umber\n");
+    fprintf(file, "1, 2\n");                       // Incomplete, skipped
+    fprintf(file, "255,111,255,  Shocking Pink (Crayola)  \r\n");
+    fprintf(file, "\n");
+    fprintf(file, "0, 0, 0, Black\n");
+    fclose(file);
+
+    ColorTable* colorTable = loadPalette(log);
+    CHECK(colorTable -> colorCount == 3);
+    CHECK(colorTable -> red[0] == 130 && colorTable -> green[0] == 102 && colorTable -> blue[0] == 68);
+    CHECK(colorTable -> red[1] == 255 && colorTable -> green[1] == 111 && colorTable -> blue[1] == 255);
+    CHECK(colorTable -> red[2] == 0 && colorTable -> green[2] == 0 && colorTable -> blue[2] == 0);
+    CHECK(strcmp(colorTableName(colorTable, 0), "Raw Umber") == 0);
+    CHECK(strcmp(colorTableName(colorTable, 1), "Shocking Pink (Crayola)") == 0);
+    CHECK(strcmp(colorTableName(colorTable, 2), "Black") == 0);
+
+    // The names follow each other in the arena, the channels in the block of the table
+    CHECK(colorTable -> nameBytes == sizeof("Raw Umber") + sizeof("Shocking Pink (Crayola)") + sizeof("Black"));
+    CHECK(colorTableName(colorTable, 2) + sizeof("Black") == colorTable -> nameArena + colorTable -> nameBytes);
+    CHECK(colorTable -> green == colorTable -> red + 3 && colorTable -> blue == colorTable -> green + 3);
+
+    // Colors changed in place are found once the index is built again
+    CHECK(colorTableFindClosest(colorTable, 250, 250, 250) == 1);
+    colorTable -> green[2] = 255;
+    colorTable -> red[2] = 255;
+    colorTable -> blue[2] = 255;
+    colorTableBuildIndex(colorTable, log);
+    CHECK(colorTableFindClosest(colorTable, 250, 250, 250) == 2);
+    colorTableDeconstructor(colorTable);
+}
+
+static void testClosest(Log log) {
+    int sizes[] = { 1, 2, 7, 64, 100, 513, 5000, 40000 };
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+        writePalette(sizes[s]);
+        ColorTable* colorTable = loadPalette(log);
+        CHECK(colorTable -> colorCount == sizes[s]);
+
+        int wrong = 0;
+        for (int i = 0; i < QUERIES; ++i) {
+            // Mostly any color, some of them the colors of the table, a few out of 0-255
+            int r = rand() & 255, g = rand() & 255, b = rand() & 255;
+            if (i % 5 == 0) {
+                int index = rand() % colorTable -> colorCount;
+                r = colorTable -> red[index];
+                g = colorTable -> green[index];
+                b = colorTable -> blue[index];
+            } else if (i % 17 == 0) {
+                r = rand() % 400 - 70;
+                b = rand() % 400 - 70;
+            }
+            wrong += (colorTableFindClosest(colorTable, r, g, b) != closestByScan(colorTable, r, g, b));
+        }
+        CHECK(wrong == 0);
+
+        // The corners of the cube, the farthest from most cells
+        for (int corner = 0; corner < 8; ++corner) {
+            int r = (corner & 1) ? 255 : 0, g = (corner & 2) ? 255 : 0, b = (corner & 4) ? 255 : 0;
+            CHECK(colorTableFindClosest(colorTable, r, g, b) == closestByScan(colorTable, r, g, b));
+        }
+        colorTableDeconstructor(colorTable);
+    }
+
+    // A table without colors finds none
+    writePalette(0);
+    ColorTable* empty = loadPalette(log);
+    CHECK(empty -> colorCount == 0);
+    CHECK(colorTableFindClosest(empty, 1, 2, 3) == -1);
+    colorTableDeconstructor(empty);
+}
+
+static void testDeltaE(Log log) {
+    // The reference itself, on pairs of the data of Sharma, Wu and Dalal
+    double pairs[][7] = {
+        { 50.0, 2.6772, -79.7751, 50.0, 0.0, -82.7485, 2.0425 },
+        { 50.0, -1.3802, -84.2814, 50.0, 0.0, -82.7485, 1.0000 },
+        { 50.0, 2.5, 0.0, 50.0, 0.0, -2.5, 4.3065 },
+        { 50.0, 2.5, 0.0, 56.0, -27.0, -3.0, 31.9030 },
+        { 60.2574, -34.0099, 36.2677, 60.4626, -34.1751, 39.4387, 1.2644 },
+        { 2.0776, 0.0795, -1.1350, 0.9033, -0.0636, -0.5514, 0.9082 }
+    };
+    for (int i = 0; i < (int)(sizeof(pairs) / sizeof(pairs[0])); ++i) {
+        CHECK(fabs(deltaE2000(pairs[i], pairs[i] + 3) - pairs[i][6]) < 1e-4);
+    }
+
+    int sizes[] = { 1, 7, 500, 40000 };
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+        writePalette(sizes[s]);
+        ColorTable* colorTable = loadPalette(log);
+        int queries = (sizes[s] > 1000) ? 200 : 1000;
+        double* labs = malloc(sizeof(double) * 3 * sizes[s]);
+        for (int i = 0; i < sizes[s]; ++i) {
+            toLab(colorTable -> red[i], colorTable -> green[i], colorTable -> blue[i], labs + 3 * i);
+        }
+
+        // The colors found are as close as the closest ones, within the rounding of floats
+        int wrong76 = 0, wrong2000 = 0;
+        uint32_t* colors = malloc(sizeof(uint32_t) * queries);
+        for (int i = 0; i < queries; ++i) {
+            int r = rand() & 255, g = rand() & 255, b = rand() & 255;
+            colors[i] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+            double lab[3], found[3];
+            toLab(r, g, b, lab);
+
+            int index = colorTableMatch(colorTable, r, g, b, COLOR_MATCH_DE76);
+            toLab(colorTable -> red[index], colorTable -> green[index], colorTable -> blue[index], found);
+            wrong76 += (deltaE76(lab, found) > closestDifference(labs, sizes[s], lab, deltaE76) + 1e-3);
+
+            index = colorTableMatch(colorTable, r, g, b, COLOR_MATCH_DE2000);
+            toLab(colorTable -> red[index], colorTable -> green[index], colorTable -> blue[index], found);
+            wrong2000 += (deltaE2000(lab, found) > closestDifference(labs, sizes[s], lab, deltaE2000) + 1e-3);
+        }
+        CHECK(wrong76 == 0);
+        CHECK(wrong2000 == 0);
+
+        // A batch, split between threads, finds what the colors one by one find
+        int* indices = malloc(sizeof(int) * queries);
+        for (ColorMatch match = COLOR_MATCH_RGB; match <= COLOR_MATCH_DE2000; ++match) {
+            colorTableMatchBatch(colorTable, colors, queries, match, indices, log);
+            int differences = 0;
+            for (int i = 0; i < queries; ++i) {
+                differences += (indices[i] != colorTableMatch(colorTable, (colors[i] >> 16) & 0xFF, (colors[i] >> 8) & 0xFF,
+                                                              colors[i] & 0xFF, match));
+            }
+            CHECK(differences == 0);
+        }
+
+        free(indices);
+        free(colors);
+        free(labs);
+        colorTableDeconstructor(colorTable);
+    }
+
+    CHECK(colorMatchFromName("de2000") == COLOR_MATCH_DE2000);
+    CHECK(colorMatchFromName("de76\n") == COLOR_MATCH_DE76);
+    CHECK(colorMatchFromName("lab") == COLOR_MATCH_RGB);
+}
+
+/**
+ * @brief The first color named `name` whatever the case, by a scan of every name.
+ */
+static int findNameByScan(const ColorTable* colorTable, const char* name) {
+    for (int i = 0; i < colorTable -> colorCount; ++i) {
+        const char* a = colorTableName(colorTable, i);
+        const char* b = name;
+        while (*a != '\0' && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void testNames(Log log) {
+    writePalette(40000);
+    ColorTable* colorTable = loadPalette(log);
+    char name[64];
+    int wrong = 0;
+    for (int i = 0; i < QUERIES; ++i) {
+        // Names of the table in any case, and names it does not have
+        int index = rand() % colorTable -> colorCount;
+        strcpy(name, colorTableName(colorTable, index));
+        for (char* c = name; *c != '\0'; ++c) {
+            *c = (rand() & 1) ? (char)toupper((unsigned char)*c) : (char)tolower((unsigned char)*c);
+        }
+        if (i % 4 == 0) {
+            strcat(name, (i % 8 == 0) ? "0" : " ");
+        }
+        int found = colorTableFindName(colorTable, name);
+        wrong += (found != findNameByScan(colorTable, name));
+        wrong += (i % 4 != 0 && found != index);
+    }
+    CHECK(wrong == 0);
+    CHECK(colorTableFindName(colorTable, "") == -1);
+    colorTableDeconstructor(colorTable);
+
+    // Of colors of the same name, the first one is found
+    FILE* file = fopen(PALETTE, "w");
+    fprintf(file, "10, 10, 10, Slate\n");
+    fprintf(file, "20, 20, 20, Ruby Red\n");
+    fprintf(file, "30, 30, 30, RUBY RED\n");
+    fprintf(file, "40, 40, 40, ruby red\n");
+    fclose(file);
+    colorTable = loadPalette(log);
+    CHECK(colorTableFindName(colorTable, "ruby red") == 1);
+    CHECK(colorTableFindName(colorTable, "Ruby Red") == 1);
+    CHECK(colorTableFindName(colorTable, "sLATE") == 0);
+    CHECK(colorTableFindName(colorTable, "ruby") == -1);
+    colorTableDeconstructor(colorTable);
+
+    writePalette(0);
+    colorTable = loadPalette(log);
+    CHECK(colorTableFindName(colorTable, "slate") == -1);
+    colorTableDeconstructor(colorTable);
+}
+
+static void testCache(Log log) {
+    writePalette(3000);
+    ColorTable* parsed = loadPalette(log);
+    long cacheSize = fileSize(CACHE);
+    CHECK(cacheSize == COLOR_CACHE_HEADER + 7 * 3000 + (long)parsed -> nameBytes);
+
+    // The cache is read back as it was written, grid and names included
+    ColorTable* cached = openPalette(log);
+    CHECK(sameTable(cached, parsed));
+    CHECK(colorTableFindClosest(cached, 12, 200, 99) == colorTableFindClosest(parsed, 12, 200, 99));
+    CHECK(colorTableFindName(cached, "color 2999") == 2999);
+    colorTableDeconstructor(cached);
+
+    // It is what is read, not the CSV: a name changed in the cache only shows
+    FILE* file = fopen(CACHE, "rb+");
+    fseek(file, cacheSize - 2, SEEK_SET);
+    fputc('X', file);
+    fclose(file);
+    cached = openPalette(log);
+    CHECK(strcmp(colorTableName(cached, 2999), "Color 299X") == 0);
+    colorTableDeconstructor(cached);
+
+    // A damaged cache is ignored and written again from the CSV
+    file = fopen(CACHE, "rb+");
+    fseek(file, 4, SEEK_SET);
+    fputc(COLOR_CACHE_VERSION + 1, file);
+    fclose(file);
+    cached = openPalette(log);
+    CHECK(sameTable(cached, parsed));
+    colorTableDeconstructor(cached);
+    cached = openPalette(log);
+    CHECK(sameTable(cached, parsed));
+    colorTableDeconstructor(cached);
+
+    // So is the cache of a CSV that changed since
+    writePalette(2000);
+    cached = openPalette(log);
+    CHECK(cached -> colorCount == 2000);
+    CHECK(fileSize(CACHE) < cacheSize);
+    colorTableDeconstructor(cached);
+    colorTableDeconstructor(parsed);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(18);
+
+    testLoad(log);
+    testClosest(log);
+    testDeltaE(log);
+    testNames(log);
+    testCache(log);
+    remove(PALETTE);
+    remove(CACHE);
+
+    if (failures > 0) {
+        fprintf(stderr, "colorTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("colorTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*
+    Tests of paintc-convert: snapshots converted to bitmaps, the bitmaps
+    to pixmaps and the pixmaps back to snapshots give the pixels they
+    started from, whatever the number of threads, legacy CSV saves are
+    loaded on the canvas size given, and bad inputs or options make it
+    fail. The converter is run as a program, from build/tests.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/snapshot.h"
+#include "../lib/imageFile.h"
+
+#define FILES      6
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define CONVERT    "../paintc-convert"
+#ifdef _WIN32
+#define QUIET      " > NUL 2>&1"
+#else
+#define QUIET      " > /dev/null 2>&1"
+#endif
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int sameCanvas(const Canvas* a, const Canvas* b) {
+    if (a -> width != b -> width || a -> height != b -> height) {
+        return 0;
+    }
+    for (int y = 0; y < a -> height; ++y) {
+        for (int x = 0; x < a -> width; ++x) {
+            if (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Runs the converter on the files convertTest<i>.<extension>.
+ *
+ * @return The exit status of the converter, 0 on success.
+ */
+static int convert(const char* options, const char* extension) {
+    char command[1024];
+    int length = snprintf(command, sizeof(command), CONVERT " %s", options);
+    for (int i = 0; i < FILES; ++i) {
+        length += snprintf(command + length, sizeof(command) - length, " convertTest%d.%s", i, extension);
+    }
+    snprintf(command + length, sizeof(command) - length, QUIET);
+    return system(command);
+}
+
+static Canvas* loadImage(const char* path, Log* log) {
+    ImageReader* reader = imageReaderConstructor(path, log);
+    if (reader == NULL) {
+        return NULL;
+    }
+    Canvas* canvas = canvasConstructor(reader -> width, reader -> height, BACKGROUND, log);
+    CHECK(imageLoadCanvas(reader, canvas));
+    imageReaderDeconstructor(reader);
+    return canvas;
+}
+
+static Canvas* loadSnapshot(const char* path, Log* log) {
+    int width, height;
+    uint32_t background;
+    if (!snapshotReadHeader(path, &width, &height, &background)) {
+        return NULL;
+    }
+    Canvas* canvas = canvasConstructor(width, height, background, log);
+    CHECK(snapshotLoad(canvas, path, log));
+    return canvas;
+}
+
+static void removeFiles(void) {
+    const char* extensions[] = { "pcnv", "bmp", "ppm", "csv" };
+    char path[64];
+    for (int i = 0; i < FILES; ++i) {
+        for (int e = 0; e < 4; ++e) {
+            snprintf(path, sizeof(path), "convertTest%d.%s", i, extensions[e]);
+            remove(path);
+        }
+    }
+}
+
+static void testRoundTrip(Log* log) {
+    // Canvases of their own sizes, noise, flat areas and blank tiles
+    Canvas* canvases[FILES];
+    char path[64];
+    for (int i = 0; i < FILES; ++i) {
+        int width = 50 + rand() % 300, height = 40 + rand() % 200;
+        canvases[i] = canvasConstructor(width, height, BACKGROUND, log);
+        canvasFillRect(canvases[i], 0, 0, width / 2, height / 3, CANVAS_RGB(i * 40, 100, 200));
+        for (int p = 0; p < 3000; ++p) {
+            canvasSetPixel(canvases[i], rand() % width, rand() % height, CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255));
+        }
+        snprintf(path, sizeof(path), "convertTest%d.pcnv", i);
+        CHECK(snapshotSave(canvases[i], path, log));
+    }
+
+    // Snapshots to bitmaps, on several threads, then to pixmaps on one, then back to snapshots
+    CHECK(convert("-f bmp -j 4", "pcnv") == 0);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "convertTest%d.bmp", i);
+        Canvas* image = loadImage(path, log);
+        CHECK(image != NULL && sameCanvas(image, canvases[i]));
+        canvasDeconstructor(image);
+    }
+    CHECK(convert("-f ppm -j 1", "bmp") == 0);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "convertTest%d.pcnv", i);
+        remove(path);
+    }
+    CHECK(convert("-f pcnv", "ppm") == 0);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "convertTest%d.pcnv", i);
+        Canvas* snapshot = loadSnapshot(path, log);
+        CHECK(snapshot != NULL && sameCanvas(snapshot, canvases[i]));
+        canvasDeconstructor(snapshot);
+    }
+
+    // Few enough colors for the palette: the indexed snapshot keeps every pixel
+    for (int i = 0; i < FILES; ++i) {
+        canvasClear(canvases[i]);
+        canvasFillRect(canvases[i], 5, 5, 40, 30, CANVAS_RGB(200, 0, 0));
+        canvasFillRect(canvases[i], 20, 10, 45, 35, CANVAS_RGB(0, 0, i));
+        snprintf(path, sizeof(path), "convertTest%d.bmp", i);
+        CHECK(imageSaveCanvas(canvases[i], path, IMAGE_FORMAT_BMP, log));
+    }
+    CHECK(convert("-f pcnv -p 8", "bmp") == 0);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "convertTest%d.pcnv", i);
+        Canvas* snapshot = loadSnapshot(path, log);
+        CHECK(snapshot != NULL && sameCanvas(snapshot, canvases[i]));
+        canvasDeconstructor(snapshot);
+        canvasDeconstructor(canvases[i]);
+    }
+}
+
+static void testCsv(Log* log) {
+    for (int i = 0; i < FILES; ++i) {
+        char path[64];
+        snprintf(path, sizeof(path), "convertTest%d.csv", i);
+        FILE* file = fopen(path, "w");
+        fprintf(file, "0,0,1,2,3\n%d,7,200,100,50\n99,79,9,9,9\n100,0,5,5,5\n", i);
+        fclose(file);
+    }
+    CHECK(convert("-f pcnv -s 100x80", "csv") == 0);
+    for (int i = 0; i < FILES; ++i) {
+        char path[64];
+        snprintf(path, sizeof(path), "convertTest%d.pcnv", i);
+        Canvas* canvas = loadSnapshot(path, log);
+        CHECK(canvas != NULL && canvas -> width == 100 && canvas -> height == 80);
+        if (canvas != NULL) {
+            CHECK(canvasGetPixel(canvas, 0, 0) == CANVAS_RGB(1, 2, 3));
+            CHECK(canvasGetPixel(canvas, i, 7) == CANVAS_RGB(200, 100, 50));
+            CHECK(canvasGetPixel(canvas, 99, 79) == CANVAS_RGB(9, 9, 9));
+            CHECK(canvasGetPixel(canvas, 50, 50) == CANVAS_RGB(255, 255, 255));
+            canvasDeconstructor(canvas);
+        }
+    }
+}
+
+static void testFailures(void) {
+    // Inputs that cannot be converted to the format, inputs missing, options unknown or out of range
+    CHECK(convert("-f pcnv", "pcnv") != 0);
+    remove("convertTest3.pcnv");
+    CHECK(convert("-f bmp", "pcnv") != 0);
+    CHECK(convert("-f gif", "csv") != 0);
+    CHECK(convert("-p 0", "csv") != 0);
+    CHECK(convert("-d ordered", "csv") != 0);
+    CHECK(system(CONVERT QUIET) != 0);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(15);
+
+    testRoundTrip(&log);
+    testCsv(&log);
+    testFailures();
+    removeFiles();
+
+    if (failures > 0) {
+        fprintf(stderr, "convertTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("convertTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/*
+    Tests of the damage list: every changed pixel stays covered by a
+    recorded rectangle, close changes are merged, far ones and long
+    diagonal strokes are not grown into one bounding box, and the
+    canvas records exactly what its operations change.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/damage.h"
+#include "../lib/stamp.h"
+#include "../lib/stroke.h"
+
+#define WIDTH      1024
+#define HEIGHT      768
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int covers(const Damage* damage, int x, int y) {
+    for (int i = 0; i < damage -> count; ++i) {
+        const DamageRect* rect = &damage -> rects[i];
+        if (x >= rect -> left && x < rect -> right && y >= rect -> top && y < rect -> bottom) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void testCoverage(void) {
+    static unsigned char changed[HEIGHT][WIDTH];
+    Damage damage = { 0 };
+    memset(changed, 0, sizeof(changed));
+
+    // Rectangles of any size anywhere, far more of them than the list holds
+    for (int i = 0; i < 500; ++i) {
+        int left = rand() % WIDTH, top = rand() % HEIGHT;
+        int right = left + 1 + rand() % ((i % 10 == 0) ? 200 : 8);
+        int bottom = top + 1 + rand() % ((i % 10 == 0) ? 200 : 8);
+        if (right > WIDTH) right = WIDTH;
+        if (bottom > HEIGHT) bottom = HEIGHT;
+        damageAdd(&damage, left, top, right, bottom);
+        for (int y = top; y < bottom; ++y) {
+            memset(&changed[y][left], 1, right - left);
+        }
+        CHECK(damage.count >= 1 && damage.count <= DAMAGE_MAX_RECTS);
+    }
+    int uncovered = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uncovered += (changed[y][x] && !covers(&damage, x, y));
+        }
+    }
+    CHECK(uncovered == 0);
+
+    // Empty rectangles are ignored, and a reset forgets everything but the counter of the last frame
+    damage.presentedPixels = 1234;
+    damageReset(&damage);
+    damageAdd(&damage, 10, 10, 10, 20);
+    damageAdd(&damage, 10, 20, 30, 20);
+    CHECK(damage.count == 0 && damageArea(&damage) == 0);
+    CHECK(damage.presentedPixels == 1234);
+}
+
+static void testMerging(void) {
+    Damage damage = { 0 };
+
+    // The rows of one stamp become one rectangle
+    for (int y = 100; y < 127; ++y) {
+        damageAdd(&damage, 200 - (y % 13), y, 227 - (y % 13), y + 1);
+    }
+    CHECK(damage.count == 1);
+
+    // Two far away changes stay apart, and are presented as their own pixels only
+    damageReset(&damage);
+    damageAdd(&damage, 0, 0, 10, 10);
+    damageAdd(&damage, 1000, 700, 1010, 710);
+    CHECK(damage.count == 2);
+    CHECK(damageArea(&damage) == 200);
+
+    // A change next to another one is merged with it
+    damageAdd(&damage, 10, 0, 20, 10);
+    CHECK(damage.count == 2);
+    CHECK(damageArea(&damage) == 300);
+}
+
+static void testCanvas(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Damage* damage = &canvas -> damage;
+    CHECK(damage -> count == 1 && damageArea(damage) == (long)WIDTH * HEIGHT); // The first frame is everything
+
+    // A long diagonal stroke is a chain of rectangles, not its bounding box
+    damageReset(damage);
+    strokeDrawSegment(canvas, 0, 0, WIDTH - 1, HEIGHT - 1, 14, STAMP_CIRCLE, CANVAS_RGB(0, 0, 0), log);
+    CHECK(damageArea(damage) < (long)WIDTH * HEIGHT / 8);
+    int uncovered = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uncovered += (canvasGetPixel(canvas, x, y) != BACKGROUND && !covers(damage, x, y));
+        }
+    }
+    CHECK(uncovered == 0);
+
+    // Writing the pixels already there records nothing
+    damageReset(damage);
+    uint32_t* pixels = malloc(sizeof(uint32_t) * 300 * 200);
+    canvasReadRegion(canvas, 100, 100, 300, 200, pixels, 300);
+    canvasWriteRegion(canvas, 100, 100, 300, 200, pixels, 300);
+    CHECK(damage -> count == 0);
+
+    // A single pixel records a single pixel
+    canvasSetPixel(canvas, 500, 10, CANVAS_RGB(1, 2, 3));
+    CHECK(damage -> count == 1 && damageArea(damage) == 1);
+    CHECK(covers(damage, 500, 10));
+
+    // Clearing records the whole canvas
+    damageReset(damage);
+    canvasClear(canvas);
+    CHECK(damageArea(damage) == (long)WIDTH * HEIGHT);
+
+    free(pixels);
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(5);
+
+    testCoverage();
+    testMerging();
+    testCanvas(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "damageTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("damageTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
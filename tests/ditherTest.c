@@ -0,0 +1,243 @@
+/*
+    Tests of the dithering: every method gives colors of the palette only,
+    keeps the areas already drawn with them, and gives the same pixels
+    whatever the number of threads.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/quantize.h"
+#include "../lib/dither.h"
+
+#define WIDTH  301 // Not a multiple of the SIMD width or of the pattern
+#define HEIGHT 203
+#define WHITE  CANVAS_RGB(255, 255, 255)
+#define BLACK  CANVAS_RGB(0, 0, 0)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static const DitherMethod methods[] = { DITHER_NONE, DITHER_FLOYD_STEINBERG, DITHER_BAYER };
+
+/**
+ * @brief Eight colors, none of them on the regular grid the Bayer thresholds assume but white and black.
+ */
+static void makePalette(Palette* palette) {
+    static const uint32_t colors[] = {
+        WHITE, BLACK, CANVAS_RGB(200, 30, 40), CANVAS_RGB(30, 160, 60), CANVAS_RGB(40, 60, 190),
+        CANVAS_RGB(240, 200, 20), CANVAS_RGB(128, 185, 196), CANVAS_RGB(90, 90, 90)
+    };
+    memset(palette, 0, sizeof(Palette));
+    palette -> count = 8;
+    palette -> exact = 0;
+    memcpy(palette -> colors, colors, sizeof(colors));
+}
+
+/**
+ * @brief A white image with a band of palette red, a gradient and a block of noise.
+ */
+static uint32_t* makeImage(void) {
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uint32_t color = WHITE;
+            if (y >= 20 && y < 60) {
+                color = CANVAS_RGB(200, 30, 40);
+            } else if (y >= 80 && y < 140 && x >= 20 && x < 280) {
+                color = CANVAS_RGB(x - 20, 255 - (x - 20), y);
+            } else if (y >= 160 && y < 190 && x >= 100 && x < 200) {
+                color = CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+            }
+            pixels[y * WIDTH + x] = color;
+        }
+    }
+    return pixels;
+}
+
+static int inPalette(const Palette* palette, uint32_t color) {
+    for (int i = 0; i < palette -> count; ++i) {
+        if (palette -> colors[i] == color) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void testPaletteColors(Log* log) {
+    Palette palette;
+    makePalette(&palette);
+    PaletteMap* map = paletteMapConstructor(&palette, log);
+    uint32_t* image = makeImage();
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+
+    for (int m = 0; m < 3; ++m) {
+        memcpy(pixels, image, sizeof(uint32_t) * WIDTH * HEIGHT);
+        ditherPixels(pixels, WIDTH, HEIGHT, WIDTH, map, methods[m], 1, log);
+        int outside = 0;
+        for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+            outside += !inPalette(&palette, pixels[i]);
+        }
+        CHECK(outside == 0);
+    }
+
+    // Colors of the palette map to themselves, whatever their grid cell
+    for (int i = 0; i < palette.count; ++i) {
+        CHECK(paletteMapFind(map, palette.colors[i]) == i);
+        CHECK(paletteMapIndex(map, palette.colors[i]) == i);
+    }
+    CHECK(paletteMapFind(map, CANVAS_RGB(1, 2, 3)) == -1);
+
+    free(pixels);
+    free(image);
+    paletteMapDeconstructor(map);
+}
+
+static void testFlatAreas(Log* log) {
+    Palette palette;
+    makePalette(&palette);
+    PaletteMap* map = paletteMapConstructor(&palette, log);
+    uint32_t* image = makeImage();
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+
+    // Without diffusion, every pixel of a palette color is kept
+    DitherMethod perPixel[] = { DITHER_NONE, DITHER_BAYER };
+    for (int m = 0; m < 2; ++m) {
+        memcpy(pixels, image, sizeof(uint32_t) * WIDTH * HEIGHT);
+        ditherPixels(pixels, WIDTH, HEIGHT, WIDTH, map, perPixel[m], 1, log);
+        int moved = 0;
+        for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+            if (inPalette(&palette, image[i])) {
+                moved += (pixels[i] != image[i]);
+            }
+        }
+        CHECK(moved == 0);
+    }
+
+    // An image drawn with the palette only is left as it is by every method
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        if (!inPalette(&palette, image[i])) {
+            image[i] = palette.colors[(i / 7) % palette.count];
+        }
+    }
+    for (int m = 0; m < 3; ++m) {
+        memcpy(pixels, image, sizeof(uint32_t) * WIDTH * HEIGHT);
+        ditherPixels(pixels, WIDTH, HEIGHT, WIDTH, map, methods[m], 4, log);
+        CHECK(memcmp(pixels, image, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+    }
+
+    // Mid gray between black and white comes out as about as many of each
+    Palette grays = { 0 };
+    grays.count = 2;
+    grays.colors[0] = BLACK;
+    grays.colors[1] = WHITE;
+    PaletteMap* grayMap = paletteMapConstructor(&grays, log);
+    for (int m = 1; m < 3; ++m) {
+        for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+            pixels[i] = CANVAS_RGB(128, 128, 128);
+        }
+        ditherPixels(pixels, WIDTH, HEIGHT, WIDTH, grayMap, methods[m], 1, log);
+        int white = 0;
+        for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+            white += (pixels[i] == WHITE);
+        }
+        CHECK(white > WIDTH * HEIGHT * 45 / 100 && white < WIDTH * HEIGHT * 55 / 100);
+    }
+    paletteMapDeconstructor(grayMap);
+
+    free(pixels);
+    free(image);
+    paletteMapDeconstructor(map);
+}
+
+static void testThreads(Log* log) {
+    Palette palette;
+    makePalette(&palette);
+    PaletteMap* map = paletteMapConstructor(&palette, log);
+    uint32_t* image = makeImage();
+    uint32_t* single = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    uint32_t* parallel = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+
+    for (int m = 0; m < 3; ++m) {
+        memcpy(single, image, sizeof(uint32_t) * WIDTH * HEIGHT);
+        ditherPixels(single, WIDTH, HEIGHT, WIDTH, map, methods[m], 1, log);
+        for (int threads = 2; threads <= 8; threads *= 2) {
+            memcpy(parallel, image, sizeof(uint32_t) * WIDTH * HEIGHT);
+            ditherPixels(parallel, WIDTH, HEIGHT, WIDTH, map, methods[m], threads, log);
+            CHECK(memcmp(single, parallel, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+        }
+    }
+
+    free(parallel);
+    free(single);
+    free(image);
+    paletteMapDeconstructor(map);
+}
+
+static void testCanvas(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, WHITE, log);
+    uint32_t* image = makeImage();
+    canvasWriteRegion(canvas, 0, 0, WIDTH, HEIGHT, image, WIDTH);
+
+    // An exact palette leaves the canvas unchanged
+    Palette palette;
+    CHECK(quantizeCanvasPalette(canvas, QUANTIZE_MAX_COLORS, 0, 2, &palette, log));
+    if (palette.exact) {
+        ditherCanvas(canvas, &palette, DITHER_FLOYD_STEINBERG, 2, log);
+        int differences = 0;
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                differences += (canvasGetPixel(canvas, x, y) != image[y * WIDTH + x]);
+            }
+        }
+        CHECK(differences == 0);
+    }
+
+    // A reduced palette leaves only its colors on the canvas
+    CHECK(quantizeCanvasPalette(canvas, 16, 0, 2, &palette, log));
+    CHECK(!palette.exact && palette.count <= 16);
+    ditherCanvas(canvas, &palette, DITHER_BAYER, 2, log);
+    int outside = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            outside += !inPalette(&palette, canvasGetPixel(canvas, x, y));
+        }
+    }
+    CHECK(outside == 0);
+
+    DitherMethod method;
+    CHECK(ditherMethodFromName("fs", &method) && method == DITHER_FLOYD_STEINBERG);
+    CHECK(ditherMethodFromName("bayer", &method) && method == DITHER_BAYER);
+    CHECK(!ditherMethodFromName("random", &method));
+
+    free(image);
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(24);
+
+    testPaletteColors(&log);
+    testFlatAreas(&log);
+    testThreads(&log);
+    testCanvas(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "ditherTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("ditherTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+/*
+    Tests of the document: commands saved and loaded draw the same
+    pixels, the batched stamps of documentRender() match the commands
+    drawn one by one, loading scales the commands to the canvas, and
+    undo, redo and loaded pixels decide what is saved.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/command.h"
+#include "../lib/document.h"
+
+#define WIDTH      300
+#define HEIGHT     200
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define DOCUMENT   "documentTest.pdoc"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int sameCanvas(const Canvas* a, const Canvas* b) {
+    if (a -> width != b -> width || a -> height != b -> height) {
+        return 0;
+    }
+    for (int y = 0; y < a -> height; ++y) {
+        for (int x = 0; x < a -> width; ++x) {
+            if (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief A stroke as the window records it: stamps and segments of one brush, in one operation.
+ */
+static void addStroke(Document* document, Canvas* canvas, int stroke, Log* log) {
+    documentBeginOperation(document);
+    PaintCommand command = { 0 };
+    command.size = 1 + rand() % 26;
+    command.shape = (StampShape)(stroke & 1);
+    command.color = CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+    command.x0 = rand() % WIDTH;
+    command.y0 = rand() % HEIGHT;
+    for (int i = 0; i < 20; ++i) {
+        // Mostly stamps close to each other, some of them on the same position
+        command.type = (i % 7 == 6) ? COMMAND_SEGMENT : (i % 9 == 8) ? COMMAND_LINE : COMMAND_STAMP;
+        command.x1 = command.x0 + rand() % 21 - 10;
+        command.y1 = command.y0 + rand() % 21 - 10;
+        if (command.type != COMMAND_STAMP) {
+            command.x0 = command.x1;
+            command.y0 = command.y1;
+        } else if (i % 4 != 0) {
+            command.x0 += rand() % 3 - 1;
+        }
+        commandApply(canvas, &command, NULL, NULL, log);
+        documentAdd(document, &command);
+    }
+    documentEndOperation(document, 1);
+}
+
+static void testSaveLoad(Log* log) {
+    Canvas* drawn = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Document* document = documentConstructor(WIDTH, HEIGHT, log);
+    for (int stroke = 0; stroke < 30; ++stroke) {
+        addStroke(document, drawn, stroke, log);
+    }
+
+    // The batched stamps draw the same pixels as the commands one by one
+    Canvas* rendered = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    documentRender(document, 0, document -> count, rendered, NULL, NULL);
+    CHECK(sameCanvas(rendered, drawn));
+
+    // A text survives the round trip, even if it cannot be drawn here
+    PaintCommand text = { 0 };
+    text.type = COMMAND_TEXT;
+    text.x0 = 20;
+    text.y0 = 30;
+    text.x1 = 200;
+    text.size = 18;
+    text.text = "Hello, journal";
+    documentBeginOperation(document);
+    documentAdd(document, &text);
+    documentEndOperation(document, 1);
+
+    CHECK(documentSave(document, DOCUMENT));
+    Document* loaded = documentConstructor(WIDTH, HEIGHT, log);
+    documentBeginOperation(loaded);
+    CHECK(documentLoad(loaded, DOCUMENT));
+    documentEndOperation(loaded, 1);
+    CHECK(loaded -> count == document -> count + 1); // A reset first
+    CHECK(loaded -> commands[0].type == COMMAND_RESET);
+    CHECK(loaded -> commands[loaded -> count - 1].type == COMMAND_TEXT);
+    CHECK(strcmp(loaded -> commands[loaded -> count - 1].text, "Hello, journal") == 0);
+
+    Canvas* replayed = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    canvasFillRect(replayed, 0, 0, WIDTH, HEIGHT, CANVAS_RGB(1, 1, 1)); // Cleared by the reset
+    documentRender(loaded, 0, loaded -> count, replayed, NULL, NULL);
+    CHECK(sameCanvas(replayed, drawn));
+
+    documentDeconstructor(loaded);
+    documentDeconstructor(document);
+    canvasDeconstructor(replayed);
+    canvasDeconstructor(rendered);
+    canvasDeconstructor(drawn);
+    remove(DOCUMENT);
+}
+
+static void testScaling(Log* log) {
+    Document* document = documentConstructor(WIDTH, HEIGHT, log);
+    documentBeginOperation(document);
+    PaintCommand command = { 0 };
+    command.type = COMMAND_LINE;
+    command.x0 = 10;
+    command.y0 = 20;
+    command.x1 = 150;
+    command.y1 = 100;
+    command.size = 8;
+    command.color = CANVAS_RGB(0, 0, 0);
+    documentAdd(document, &command);
+    command.type = COMMAND_STAMP;
+    command.size = 20;
+    documentAdd(document, &command);
+    documentEndOperation(document, 1);
+    CHECK(documentSave(document, DOCUMENT));
+
+    // Twice as large: coordinates and brushes double, brushes staying within STAMP_MAX_SIZE
+    Document* larger = documentConstructor(WIDTH * 2, HEIGHT * 2, log);
+    CHECK(documentLoad(larger, DOCUMENT));
+    CHECK(larger -> count == 3);
+    const PaintCommand* line = &larger -> commands[1];
+    CHECK(line -> x0 == 20 && line -> y0 == 40 && line -> x1 == 300 && line -> y1 == 200 && line -> size == 16);
+    CHECK(larger -> commands[2].size == STAMP_MAX_SIZE);
+
+    // Other proportions: the smaller scale keeps the drawing whole
+    Document* narrow = documentConstructor(WIDTH / 2, HEIGHT * 3, log);
+    CHECK(documentLoad(narrow, DOCUMENT));
+    line = &narrow -> commands[1];
+    CHECK(line -> x0 == 5 && line -> y0 == 10 && line -> x1 == 75 && line -> y1 == 50 && line -> size == 4);
+
+    // The scaled line is the line drawn at the larger size
+    Canvas* canvas = canvasConstructor(WIDTH * 2, HEIGHT * 2, BACKGROUND, log);
+    documentRender(larger, 0, larger -> count, canvas, NULL, NULL);
+    CHECK(canvasGetPixel(canvas, 20, 40) == CANVAS_RGB(0, 0, 0));
+    CHECK(canvasGetPixel(canvas, 300, 200) == CANVAS_RGB(0, 0, 0));
+    CHECK(canvasGetPixel(canvas, 300, 40) == BACKGROUND);
+
+    canvasDeconstructor(canvas);
+    documentDeconstructor(narrow);
+    documentDeconstructor(larger);
+    documentDeconstructor(document);
+    remove(DOCUMENT);
+}
+
+static long fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * @brief Cuts the file to `size` bytes, as a crash in the middle of a write would leave it.
+ */
+static void truncateFile(const char* path, long size) {
+    FILE* file = fopen(path, "rb");
+    char* content = malloc(size);
+    CHECK(file != NULL && fread(content, 1, size, file) == (size_t)size);
+    fclose(file);
+    file = fopen(path, "wb");
+    fwrite(content, 1, size, file);
+    fclose(file);
+    free(content);
+}
+
+static void testOperations(Log* log) {
+    // The refusals below are logged: keep them out of the output of the tests
+    Log quiet = { tmpfile() };
+    if (quiet.file != NULL) {
+        log = &quiet;
+    }
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Document* document = documentConstructor(WIDTH, HEIGHT, log);
+    addStroke(document, canvas, 0, log);
+    int firstStroke = document -> count;
+    addStroke(document, canvas, 1, log);
+
+    // Undone operations are not saved, and come back when redone
+    CHECK(documentUndo(document));
+    CHECK(documentSave(document, DOCUMENT));
+    Document* loaded = documentConstructor(WIDTH, HEIGHT, log);
+    CHECK(documentLoad(loaded, DOCUMENT));
+    CHECK(loaded -> count == firstStroke + 1);
+    documentDeconstructor(loaded);
+    CHECK(documentRedo(document));
+    CHECK(!documentRedo(document));
+
+    // An operation the history did not keep is dropped
+    int count = document -> count;
+    documentBeginOperation(document);
+    documentEndOperation(document, 0);
+    CHECK(document -> count == count);
+
+    // Loaded pixels cannot be saved as commands, until a reset clears them
+    documentBeginOperation(document);
+    documentMarkRaster(document);
+    documentEndOperation(document, 1);
+    CHECK(!documentSave(document, DOCUMENT));
+    PaintCommand reset = { 0 };
+    reset.type = COMMAND_RESET;
+    documentBeginOperation(document);
+    documentAdd(document, &reset);
+    documentEndOperation(document, 1);
+    CHECK(documentSave(document, DOCUMENT));
+    CHECK(fileSize(DOCUMENT) == DOCUMENT_HEADER_SIZE);
+
+    // Files cut short, or missing, are refused and change nothing
+    addStroke(document, canvas, 2, log);
+    CHECK(documentSave(document, DOCUMENT));
+    truncateFile(DOCUMENT, fileSize(DOCUMENT) - 3);
+    Document* other = documentConstructor(WIDTH, HEIGHT, log);
+    CHECK(!documentLoad(other, DOCUMENT));
+    CHECK(other -> count == 0);
+    CHECK(!documentLoad(other, "documentTest.missing"));
+    documentDeconstructor(other);
+
+    documentDeconstructor(document);
+    canvasDeconstructor(canvas);
+    if (quiet.file != NULL) {
+        fclose(quiet.file);
+    }
+    remove(DOCUMENT);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(13);
+
+    testSaveLoad(&log);
+    testScaling(&log);
+    testOperations(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "documentTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("documentTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/*
+    Tests of the undo/redo history: every state of the canvas comes back
+    when undoing and redoing, a new operation drops the redoable ones,
+    and the memory budget forgets the oldest operations.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/history.h"
+#include "../lib/stamp.h"
+#include "../lib/stroke.h"
+
+#define WIDTH      300
+#define HEIGHT     200
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define STEPS      12
+#define TILE_BYTES (sizeof(uint32_t) * CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static uint32_t* copyCanvas(const Canvas* canvas) {
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    canvasReadRegion(canvas, 0, 0, WIDTH, HEIGHT, pixels, WIDTH);
+    return pixels;
+}
+
+static int sameAs(const Canvas* canvas, const uint32_t* pixels) {
+    uint32_t* current = copyCanvas(canvas);
+    int same = (memcmp(current, pixels, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+    free(current);
+    return same;
+}
+
+/**
+ * @brief One operation: a stroke, a rectangle or a clear, as the window would record them.
+ */
+static void drawStep(History* history, Canvas* canvas, int step, Log* log) {
+    historyBeginOperation(history);
+    if (step % 5 == 4) {
+        canvasClear(canvas);
+    } else if (step % 2 == 0) {
+        strokeDrawSegment(canvas, rand() % WIDTH, rand() % HEIGHT, rand() % WIDTH, rand() % HEIGHT, 1 + rand() % 26,
+                          STAMP_CIRCLE, CANVAS_RGB(step, 0, 0), log);
+    } else {
+        int x = rand() % WIDTH, y = rand() % HEIGHT;
+        canvasFillRect(canvas, x, y, x + 1 + rand() % 100, y + 1 + rand() % 100, CANVAS_RGB(0, step, 0));
+    }
+    CHECK(historyEndOperation(history));
+}
+
+static void testUndoRedo(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    History* history = historyConstructor(canvas, 64 * 1024 * 1024, log);
+    uint32_t* states[STEPS + 1];
+
+    states[0] = copyCanvas(canvas);
+    for (int step = 1; step <= STEPS; ++step) {
+        drawStep(history, canvas, step, log);
+        states[step] = copyCanvas(canvas);
+    }
+
+    // All the way back, then all the way forward
+    for (int step = STEPS; step > 0; --step) {
+        CHECK(historyUndo(history));
+        CHECK(sameAs(canvas, states[step - 1]));
+    }
+    CHECK(!historyUndo(history));
+    for (int step = 1; step <= STEPS; ++step) {
+        CHECK(historyRedo(history));
+        CHECK(sameAs(canvas, states[step]));
+    }
+    CHECK(!historyRedo(history));
+
+    // The last change tells which tiles to present
+    CHECK(historyUndo(history));
+    const HistoryEntry* change = historyLastChange(history);
+    CHECK(change != NULL && change -> count > 0);
+
+    // A new operation after undoing drops what could be redone
+    drawStep(history, canvas, 1, log);
+    CHECK(!historyRedo(history));
+    CHECK(historyUndo(history));
+    CHECK(sameAs(canvas, states[STEPS - 1]));
+
+    // An operation that changes nothing is not kept
+    historyBeginOperation(history);
+    canvasFillRect(canvas, 10, 10, 10, 50, CANVAS_RGB(1, 1, 1));
+    CHECK(!historyEndOperation(history));
+    CHECK(historyUndo(history));
+    CHECK(sameAs(canvas, states[STEPS - 2]));
+
+    for (int step = 0; step <= STEPS; ++step) {
+        free(states[step]);
+    }
+    historyDeconstructor(history);
+    canvasDeconstructor(canvas);
+}
+
+static void testBudget(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    size_t budget = 3 * TILE_BYTES + TILE_BYTES / 2;
+    History* history = historyConstructor(canvas, budget, log);
+    uint32_t* states[STEPS + 1];
+
+    // Each operation changes a single tile, its own, which is not blank so that it costs a whole copy
+    canvasFillRect(canvas, 0, 0, WIDTH, HEIGHT, CANVAS_RGB(200, 200, 200));
+    states[0] = copyCanvas(canvas);
+    for (int step = 1; step <= STEPS; ++step) {
+        int x = (step % 4) * CANVAS_TILE_SIZE + 5;
+        int y = (step / 4) * CANVAS_TILE_SIZE + 5;
+        historyBeginOperation(history);
+        canvasFillRect(canvas, x, y, x + 20, y + 20, CANVAS_RGB(step, step, step));
+        CHECK(historyEndOperation(history));
+        CHECK(history -> bytes <= budget);
+        states[step] = copyCanvas(canvas);
+    }
+
+    // Only the last operations fitting in the budget can be undone
+    int undone = 0;
+    while (historyUndo(history)) {
+        undone++;
+        CHECK(sameAs(canvas, states[STEPS - undone]));
+    }
+    CHECK(undone >= 1 && undone <= 3);
+
+    // Redoing them brings back the last state
+    while (historyRedo(history)) {
+    }
+    CHECK(sameAs(canvas, states[STEPS]));
+
+    for (int step = 0; step <= STEPS; ++step) {
+        free(states[step]);
+    }
+    historyDeconstructor(history);
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(7);
+
+    testUndoRedo(&log);
+    testBudget(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "historyTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("historyTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
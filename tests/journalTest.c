@@ -0,0 +1,270 @@
+/*
+    Tests of the journal: the operations recorded by one run are replayed
+    on the next start, a record cut short by a crash is dropped with
+    everything after it, and a journal based on a snapshot replays only
+    what was drawn after the save.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/command.h"
+#include "../lib/journal.h"
+#include "../lib/history.h"
+#include "../lib/snapshot.h"
+
+#define WIDTH      300
+#define HEIGHT     200
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define JOURNAL    "journalTest.journal"
+#define SNAPSHOT   "journalTest.pcnv"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int sameCanvas(const Canvas* a, const Canvas* b) {
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            if (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static PaintCommand randomCommand(int i) {
+    PaintCommand command = { 0 };
+    command.type = (CommandType)(COMMAND_STAMP + i % 3);
+    command.x0 = rand() % WIDTH;
+    command.y0 = rand() % HEIGHT;
+    command.x1 = rand() % WIDTH;
+    command.y1 = rand() % HEIGHT;
+    command.size = 1 + rand() % 26;
+    command.shape = (StampShape)(rand() & 1);
+    command.color = (i % 4 == 0) ? CANVAS_RGB(0, 0, 0) : CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+    return command;
+}
+
+/**
+ * @brief Draws a command and records it, as the window does.
+ */
+static void draw(Canvas* canvas, Journal* journal, const PaintCommand* command, Log* log) {
+    commandApply(canvas, command, NULL, NULL, log);
+    journalRecord(journal, command);
+}
+
+static long fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * @brief Cuts the file to `size` bytes, as a crash in the middle of a write would leave it.
+ */
+static void truncateFile(const char* path, long size) {
+    FILE* file = fopen(path, "rb");
+    char* content = malloc(size);
+    CHECK(file != NULL && fread(content, 1, size, file) == (size_t)size);
+    fclose(file);
+    file = fopen(path, "wb");
+    fwrite(content, 1, size, file);
+    fclose(file);
+    free(content);
+}
+
+/**
+ * @brief Starts the journal of a new run on a blank canvas.
+ */
+static Journal* recover(Canvas** canvas, int* records, Log* log) {
+    *canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Journal* journal = journalConstructor(JOURNAL, WIDTH, HEIGHT, log);
+    *records = journalRecover(journal, *canvas, SNAPSHOT, NULL, NULL);
+    return journal;
+}
+
+static void testReplay(Log* log) {
+    remove(JOURNAL);
+    Canvas* drawn;
+    int records;
+    Journal* journal = recover(&drawn, &records, log);
+    CHECK(records == 0);
+
+    for (int i = 0; i < 40; ++i) {
+        PaintCommand command = randomCommand(i);
+        draw(drawn, journal, &command, log);
+        if (i == 20) {
+            journalFlush(journal);
+        }
+    }
+
+    // Operations kept as tiles: noise over a few tiles
+    History* history = historyConstructor(drawn, 1 << 24, log);
+    historyBeginOperation(history);
+    for (int y = 70; y < 130; ++y) {
+        for (int x = 100; x < 250; ++x) {
+            canvasSetPixel(drawn, x, y, CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255));
+        }
+    }
+    historyEndOperation(history);
+    journalRecordTiles(journal, drawn, historyLastChange(history));
+    historyDeconstructor(history);
+    PaintCommand last = randomCommand(1);
+    draw(drawn, journal, &last, log);
+    journalDeconstructor(journal);
+
+    Canvas* replayed;
+    journal = recover(&replayed, &records, log);
+    CHECK(records > 40);
+    CHECK(sameCanvas(replayed, drawn));
+    journalDeconstructor(journal);
+
+    // The recovered journal goes on: a second start gives the same canvas again
+    Canvas* again;
+    journal = recover(&again, &records, log);
+    CHECK(sameCanvas(again, drawn));
+    journalDeconstructor(journal);
+
+    canvasDeconstructor(again);
+    canvasDeconstructor(replayed);
+    canvasDeconstructor(drawn);
+}
+
+static void testTruncatedTail(Log* log) {
+    remove(JOURNAL);
+    Canvas* drawn;
+    int records;
+    Journal* journal = recover(&drawn, &records, log);
+    Canvas* beforeLast = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    for (int i = 0; i < 30; ++i) {
+        PaintCommand command = randomCommand(i);
+        draw(drawn, journal, &command, log);
+        commandApply(beforeLast, &command, NULL, NULL, log);
+    }
+    journalFlush(journal);
+    long complete = fileSize(JOURNAL);
+
+    // The last operation is a line, written only in part by the crash
+    PaintCommand line = randomCommand(2);
+    line.type = COMMAND_LINE;
+    line.color = CANVAS_RGB(1, 2, 3);
+    draw(drawn, journal, &line, log);
+    journalDeconstructor(journal);
+    long full = fileSize(JOURNAL);
+    CHECK(full > complete + 4);
+    truncateFile(JOURNAL, full - 4);
+
+    Canvas* replayed;
+    journal = recover(&replayed, &records, log);
+    CHECK(sameCanvas(replayed, beforeLast));
+    CHECK(!sameCanvas(replayed, drawn));
+
+    // The cut record is dropped from the file, and new records follow the complete ones
+    journalFlush(journal);
+    CHECK(fileSize(JOURNAL) <= full - 4);
+    draw(replayed, journal, &line, log);
+    journalDeconstructor(journal);
+
+    Canvas* again;
+    journal = recover(&again, &records, log);
+    CHECK(sameCanvas(again, drawn));
+    journalDeconstructor(journal);
+
+    // A file too short for its header is a blank canvas
+    truncateFile(JOURNAL, 5);
+    Canvas* blank;
+    journal = recover(&blank, &records, log);
+    CHECK(records == 0);
+    CHECK(blank -> allocatedTiles == 0);
+    journalDeconstructor(journal);
+
+    canvasDeconstructor(blank);
+    canvasDeconstructor(again);
+    canvasDeconstructor(replayed);
+    canvasDeconstructor(beforeLast);
+    canvasDeconstructor(drawn);
+}
+
+static void testSnapshotBase(Log* log) {
+    remove(JOURNAL);
+    remove(SNAPSHOT);
+    remove(SNAPSHOT ".delta");
+    Canvas* drawn;
+    int records;
+    Journal* journal = recover(&drawn, &records, log);
+
+    for (int i = 0; i < 20; ++i) {
+        PaintCommand command = randomCommand(i);
+        draw(drawn, journal, &command, log);
+    }
+
+    // A save: the journal keeps only what was drawn after the copy of the canvas
+    journalMarkSave(journal);
+    CHECK(snapshotSave(drawn, SNAPSHOT, log));
+    for (int i = 0; i < 5; ++i) {
+        PaintCommand command = randomCommand(i);
+        draw(drawn, journal, &command, log);
+    }
+    long before = journal -> size;
+    journalSaveDone(journal, 1);
+    CHECK(journal -> size < before);
+    journalDeconstructor(journal);
+
+    Canvas* replayed;
+    journal = recover(&replayed, &records, log);
+    CHECK(records >= 5 && records < 25);
+    CHECK(sameCanvas(replayed, drawn));
+
+    // A reset starts again from a blank canvas
+    PaintCommand reset = { 0 };
+    reset.type = COMMAND_RESET;
+    draw(replayed, journal, &reset, log);
+    journalDeconstructor(journal);
+
+    Canvas* blank;
+    journal = recover(&blank, &records, log);
+    CHECK(records == 0);
+    CHECK(blank -> allocatedTiles == 0);
+    journalDeconstructor(journal);
+
+    canvasDeconstructor(blank);
+    canvasDeconstructor(replayed);
+    canvasDeconstructor(drawn);
+    remove(SNAPSHOT);
+    remove(SNAPSHOT ".delta");
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(12);
+
+    testReplay(&log);
+    testTruncatedTail(&log);
+    testSnapshotBase(&log);
+    remove(JOURNAL);
+
+    if (failures > 0) {
+        fprintf(stderr, "journalTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("journalTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+    Tests of the legacy pixel_data.csv loader: a file of every pixel,
+    split between threads, gives the pixels its lines hold, white pixels
+    and malformed or out of range lines leaving the drawing as it was.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/pixelCsv.h"
+
+#define WIDTH      400
+#define HEIGHT     300
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define PIXELS     "pixelCsvTest.csv"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int sameAs(const Canvas* canvas, const uint32_t* pixels) {
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            if (canvasGetPixel(canvas, x, y) != pixels[y * WIDTH + x]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief A canvas with something already drawn, which the white pixels of the file leave alone.
+ */
+static Canvas* drawnCanvas(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    canvasFillRect(canvas, 50, 40, 250, 140, CANVAS_RGB(9, 9, 9));
+    return canvas;
+}
+
+/**
+ * @brief Writes a line per pixel in random order, as the old save did, with broken lines between
+ * them, and the pixels the old loader would have drawn.
+ */
+static void writePixels(uint32_t* expected) {
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        int x = i % WIDTH, y = i / WIDTH;
+        expected[i] = (x >= 50 && x < 250 && y >= 40 && y < 140) ? CANVAS_RGB(9, 9, 9) : BACKGROUND;
+    }
+    int* order = malloc(sizeof(int) * WIDTH * HEIGHT);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        order[i] = i;
+    }
+    for (int i = WIDTH * HEIGHT - 1; i > 0; --i) {
+        int j = rand() % (i + 1), swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    FILE* file = fopen(PIXELS, "wb");
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        int x = order[i] % WIDTH, y = order[i] / WIDTH;
+        int r = rand() & 255, g = rand() & 255, b = rand() & 255;
+        if (i % 3 == 0) {
+            r = g = b = 255;
+        }
+        fprintf(file, (i % 5 == 0) ? "%d,%d,%d,%d,%d\r\n" : "%d,%d,%d,%d,%d\n", x, y, r, g, b);
+        if (r != 255 || g != 255 || b != 255) {
+            expected[order[i]] = CANVAS_RGB(r, g, b);
+        }
+
+        // Lines the loader must ignore
+        switch (i % 1000) {
+            case 1: fprintf(file, "%d,%d,300,0,0\n", x, y); break;
+            case 2: fprintf(file, "%d,%d,1,2\n", x, y); break;
+            case 3: fprintf(file, "%d,%d,-1,0,0\n", x, y); break;
+            case 4: fprintf(file, "%d,%d,1,2,3\n", WIDTH, y); break;
+            case 5: fprintf(file, "x,y,r,g,b\n"); break;
+            case 6: fprintf(file, "\n"); break;
+            case 7: fprintf(file, "%d, %d,1,2,3\n", x, y); break;
+            case 8: fprintf(file, "%d,%d,1,2,99999999999\n", x, y); break;
+        }
+    }
+    fclose(file);
+    free(order);
+}
+
+static void testLoad(Log* log) {
+    uint32_t* expected = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    writePixels(expected);
+
+    // One thread, or the file split between several of them
+    int threadCounts[] = { 1, 2, 4, 64 };
+    for (int t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+        Canvas* canvas = drawnCanvas(log);
+        CHECK(pixelCsvLoad(canvas, PIXELS, threadCounts[t], log));
+        CHECK(sameAs(canvas, expected));
+        canvasDeconstructor(canvas);
+    }
+
+    // A file without a last newline still gives its last line
+    FILE* file = fopen(PIXELS, "wb");
+    fprintf(file, "1,1,10,20,30\n2,2,40,50,60");
+    fclose(file);
+    Canvas* canvas = drawnCanvas(log);
+    CHECK(pixelCsvLoad(canvas, PIXELS, 4, log));
+    CHECK(canvasGetPixel(canvas, 1, 1) == CANVAS_RGB(10, 20, 30));
+    CHECK(canvasGetPixel(canvas, 2, 2) == CANVAS_RGB(40, 50, 60));
+
+    // An empty file changes nothing, a missing one is refused
+    file = fopen(PIXELS, "wb");
+    fclose(file);
+    CHECK(pixelCsvLoad(canvas, PIXELS, 4, log));
+    CHECK(canvasGetPixel(canvas, 1, 1) == CANVAS_RGB(10, 20, 30));
+    remove(PIXELS);
+    Log quiet = { tmpfile() };
+    CHECK(!pixelCsvLoad(canvas, PIXELS, 4, (quiet.file != NULL) ? &quiet : log));
+    if (quiet.file != NULL) {
+        fclose(quiet.file);
+    }
+
+    canvasDeconstructor(canvas);
+    free(expected);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(11);
+
+    testLoad(&log);
+    remove(PIXELS);
+
+    if (failures > 0) {
+        fprintf(stderr, "pixelCsvTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("pixelCsvTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/*
+    Tests of the quantizer: the distinct colors of the tiles are counted
+    like a sort of every pixel counts them, a palette is exact while the
+    colors fit it and a median cut of them otherwise, and the palette map
+    gives each pixel its own color or one close to it.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/quantize.h"
+
+#define WIDTH      150
+#define HEIGHT     100
+#define TILES_X    ((WIDTH + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE)
+#define TILES_Y    ((HEIGHT + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE)
+#define TILE_PIXELS (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define OUTSIDE    CANVAS_RGB(1, 2, 3)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int compareColors(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static long squaredDistance(uint32_t a, uint32_t b) {
+    long dr = CANVAS_RED(a) - CANVAS_RED(b), dg = CANVAS_GREEN(a) - CANVAS_GREEN(b), db = CANVAS_BLUE(a) - CANVAS_BLUE(b);
+    return dr * dr + dg * dg + db * db;
+}
+
+/**
+ * @brief Tiles of a canvas, every other one blank, with a color of their own past the edges of the canvas.
+ */
+static uint32_t** makeTiles(int colors) {
+    uint32_t** tiles = calloc(TILES_X * TILES_Y, sizeof(uint32_t*));
+    for (int tile = 0; tile < TILES_X * TILES_Y; ++tile) {
+        if (tile % 2 == 1) {
+            continue;
+        }
+        tiles[tile] = malloc(sizeof(uint32_t) * TILE_PIXELS);
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            int x = (tile % TILES_X) * CANVAS_TILE_SIZE + i % CANVAS_TILE_SIZE;
+            int y = (tile / TILES_X) * CANVAS_TILE_SIZE + i / CANVAS_TILE_SIZE;
+            int color = rand() % colors;
+            tiles[tile][i] = (x >= WIDTH || y >= HEIGHT) ? OUTSIDE : CANVAS_RGB(color * 37 & 255, color * 11 & 255, color / 7);
+        }
+    }
+    return tiles;
+}
+
+static void freeTiles(uint32_t** tiles) {
+    for (int tile = 0; tile < TILES_X * TILES_Y; ++tile) {
+        free(tiles[tile]);
+    }
+    free(tiles);
+}
+
+/**
+ * @brief The distinct colors of the canvas, sorted, by a sort of every pixel.
+ */
+static int sortColors(uint32_t* const* tiles, uint32_t* colors) {
+    int count = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            const uint32_t* tile = tiles[(y / CANVAS_TILE_SIZE) * TILES_X + x / CANVAS_TILE_SIZE];
+            colors[count++] = (tile == NULL) ? BACKGROUND : tile[(y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + x % CANVAS_TILE_SIZE];
+        }
+    }
+    qsort(colors, count, sizeof(uint32_t), compareColors);
+    int distinct = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i == 0 || colors[i] != colors[i - 1]) {
+            colors[distinct++] = colors[i];
+        }
+    }
+    return distinct;
+}
+
+static void testCount(Log* log) {
+    static uint32_t colors[WIDTH * HEIGHT];
+    int counts[] = { 1, 2, 100, 256, 257, 5000 };
+    for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); ++c) {
+        uint32_t** tiles = makeTiles(counts[c]);
+        int distinct = sortColors(tiles, colors);
+        CHECK(quantizeCountColors(tiles, WIDTH, HEIGHT, BACKGROUND, 1, log) == distinct);
+        CHECK(quantizeCountColors(tiles, WIDTH, HEIGHT, BACKGROUND, 4, log) == distinct);
+
+        // The colors that fit a palette are the palette, in any order
+        Palette palette;
+        if (distinct <= QUANTIZE_MAX_COLORS) {
+            CHECK(quantizePalette(tiles, WIDTH, HEIGHT, BACKGROUND, QUANTIZE_MAX_COLORS, 1, 4, &palette, log));
+            CHECK(palette.exact && palette.count == distinct);
+            qsort(palette.colors, palette.count, sizeof(uint32_t), compareColors);
+            CHECK(memcmp(palette.colors, colors, sizeof(uint32_t) * distinct) == 0);
+        } else {
+            CHECK(!quantizePalette(tiles, WIDTH, HEIGHT, BACKGROUND, QUANTIZE_MAX_COLORS, 1, 4, &palette, log));
+        }
+        freeTiles(tiles);
+    }
+
+    // A blank canvas is its background
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Palette palette;
+    CHECK(quantizeCanvasPalette(canvas, 16, 1, 2, &palette, log));
+    CHECK(palette.exact && palette.count == 1 && palette.colors[0] == BACKGROUND);
+    canvasDeconstructor(canvas);
+}
+
+static void testMedianCut(Log* log) {
+    // Noise around a few colors, far more colors than the palette holds
+    uint32_t centers[] = { CANVAS_RGB(200, 30, 30), CANVAS_RGB(30, 200, 30), CANVAS_RGB(30, 30, 200), CANVAS_RGB(240, 240, 20) };
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uint32_t center = centers[(x / 40 + y / 30) % 4];
+            canvasSetPixel(canvas, x, y, CANVAS_RGB(CANVAS_RED(center) + rand() % 15, CANVAS_GREEN(center) + rand() % 15,
+                                                    CANVAS_BLUE(center) + rand() % 15));
+        }
+    }
+    Palette refused;
+    CHECK(!quantizeCanvasPalette(canvas, 16, 1, 4, &refused, log));
+
+    int sizes[] = { 1, 4, 16, 256 };
+    long previousError = -1;
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+        Palette palette;
+        CHECK(quantizeCanvasPalette(canvas, sizes[s], 0, 4, &palette, log));
+        CHECK(!palette.exact && palette.count >= 1 && palette.count <= sizes[s]);
+
+        // Every pixel goes to a color close to it, closer as the palette grows
+        PaletteMap* map = paletteMapConstructor(&palette, log);
+        long error = 0;
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                uint32_t pixel = canvasGetPixel(canvas, x, y);
+                error += squaredDistance(pixel, palette.colors[paletteMapIndex(map, pixel)]);
+            }
+        }
+        error /= WIDTH * HEIGHT;
+        CHECK(sizes[s] < 4 || error < 3 * 15 * 15);
+        CHECK(previousError < 0 || error <= previousError);
+        previousError = error;
+        paletteMapDeconstructor(map);
+    }
+
+    // One color is the average of the pixels
+    Palette single;
+    quantizeCanvasPalette(canvas, 1, 0, 1, &single, log);
+    long red = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            red += CANVAS_RED(canvasGetPixel(canvas, x, y));
+        }
+    }
+    red /= WIDTH * HEIGHT;
+    CHECK(single.count == 1 && labs((long)CANVAS_RED(single.colors[0]) - red) <= 8);
+
+    canvasDeconstructor(canvas);
+}
+
+static void testMap(Log* log) {
+    Palette palette = { 0 };
+    palette.count = 200;
+    for (int i = 0; i < palette.count; ++i) {
+        palette.colors[i] = CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+    }
+    palette.colors[7] = palette.colors[3]; // A color twice: the first one is found
+    PaletteMap* map = paletteMapConstructor(&palette, log);
+
+    for (int i = 0; i < palette.count; ++i) {
+        int expected = (i == 7) ? 3 : i;
+        CHECK(paletteMapFind(map, palette.colors[i]) == expected);
+        CHECK(paletteMapIndex(map, palette.colors[i]) == expected);
+    }
+
+    // Other colors are not found, and go to the closest color to the center of their grid cell:
+    // at most a cell diagonal (14) farther than the closest color
+    int wrong = 0;
+    uint32_t tile[TILE_PIXELS];
+    uint8_t indices[TILE_PIXELS];
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        uint32_t color = (i % 9 == 0) ? palette.colors[rand() % palette.count] : CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255);
+        tile[i] = color;
+        int found = paletteMapFind(map, color);
+        long best = -1;
+        for (int j = 0; j < palette.count; ++j) {
+            long distance = squaredDistance(color, palette.colors[j]);
+            best = (best < 0 || distance < best) ? distance : best;
+        }
+        int index = paletteMapIndex(map, color);
+        if (found >= 0) {
+            wrong += (index != found || palette.colors[found] != color);
+        } else {
+            wrong += (index != paletteMapClosest(map, color));
+            wrong += (sqrt((double)squaredDistance(color, palette.colors[index])) > sqrt((double)best) + 14.0);
+        }
+    }
+    CHECK(wrong == 0);
+
+    // A tile is mapped like its pixels one by one
+    paletteMapTile(map, tile, indices);
+    int differences = 0;
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        differences += (indices[i] != paletteMapIndex(map, tile[i]));
+    }
+    CHECK(differences == 0);
+    paletteMapDeconstructor(map);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(23);
+
+    testCount(&log);
+    testMedianCut(&log);
+    testMap(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "quantizeTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("quantizeTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
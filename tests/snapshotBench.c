@@ -0,0 +1,142 @@
+/*
+    Benchmark of the saves: the binary tile snapshot against the legacy
+    pixel_data.csv, on the same 1280x720 drawing of 300 strokes and one
+    tile of noise. The CSV is written the way the old save did, one
+    `x,y,r,g,b` line per pixel with fprintf (without the GetPixel calls
+    that made it slower still), and read back with pixelCsvLoad().
+
+        make bench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/stroke.h"
+#include "../lib/snapshot.h"
+#include "../lib/pixelCsv.h"
+#include "../lib/thread.h"
+
+#define WIDTH      1280
+#define HEIGHT      720
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define RUNS         20
+#define SNAPSHOT   "snapshotBench.pcnv"
+#define CSV        "snapshotBench.csv"
+
+static double seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static long fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * @brief Writes every pixel of the canvas as the old save did.
+ */
+static int csvSave(const Canvas* canvas, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    uint32_t* row = malloc(sizeof(uint32_t) * canvas -> width);
+    for (int y = 0; y < canvas -> height; ++y) {
+        canvasReadRegion(canvas, 0, y, canvas -> width, 1, row, canvas -> width);
+        for (int x = 0; x < canvas -> width; ++x) {
+            fprintf(file, "%d,%d,%d,%d,%d\n", x, y, CANVAS_RED(row[x]), CANVAS_GREEN(row[x]), CANVAS_BLUE(row[x]));
+        }
+    }
+    free(row);
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Counts the pixels that differ between two canvases.
+ */
+static int countDifferences(const Canvas* a, const Canvas* b) {
+    int differences = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            differences += (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y));
+        }
+    }
+    return differences;
+}
+
+int main(void) {
+    Log log = { stderr };
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, &log);
+    srand(8);
+    for (int i = 0; i < 300; ++i) {
+        int x = rand() % WIDTH;
+        int y = rand() % HEIGHT;
+        strokeDrawSegment(canvas, x, y, x + rand() % 200 - 100, y + rand() % 200 - 100, 2 + rand() % 24,
+                          (StampShape)(i & 1), CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255), &log);
+    }
+    for (int y = 320; y < 384; ++y) {
+        for (int x = 640; x < 704; ++x) {
+            canvasSetPixel(canvas, x, y, CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255));
+        }
+    }
+
+    double saveTime = 0, loadTime = 0;
+    int differences = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        remove(SNAPSHOT ".delta");
+        double start = seconds();
+        snapshotSave(canvas, SNAPSHOT, &log);
+        saveTime += seconds() - start;
+
+        // Tiles are decoded on demand: reading every pixel back is part of the load
+        Canvas* loaded = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, &log);
+        start = seconds();
+        snapshotLoad(loaded, SNAPSHOT, &log);
+        uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+        canvasReadRegion(loaded, 0, 0, WIDTH, HEIGHT, pixels, WIDTH);
+        loadTime += seconds() - start;
+        free(pixels);
+        differences += countDifferences(canvas, loaded);
+        canvasDeconstructor(loaded);
+    }
+
+    // The CSV is much slower, a few runs are enough
+    int csvRuns = 3;
+    double csvSaveTime = 0, csvLoadTime = 0;
+    for (int run = 0; run < csvRuns; ++run) {
+        double start = seconds();
+        csvSave(canvas, CSV);
+        csvSaveTime += seconds() - start;
+
+        Canvas* loaded = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, &log);
+        start = seconds();
+        pixelCsvLoad(loaded, CSV, threadProcessorCount(), &log);
+        csvLoadTime += seconds() - start;
+        differences += countDifferences(canvas, loaded);
+        canvasDeconstructor(loaded);
+    }
+
+    printf("%dx%d, 300 strokes and one tile of noise\n", WIDTH, HEIGHT);
+    printf("  snapshot save %8.1f ms  %10ld bytes\n", saveTime / RUNS * 1e3, fileSize(SNAPSHOT));
+    printf("  snapshot load %8.1f ms\n", loadTime / RUNS * 1e3);
+    printf("  CSV save      %8.1f ms  %10ld bytes\n", csvSaveTime / csvRuns * 1e3, fileSize(CSV));
+    printf("  CSV load      %8.1f ms  (%d threads)\n", csvLoadTime / csvRuns * 1e3, threadProcessorCount());
+    printf("  identical pixels after every load: %s\n", (differences == 0) ? "yes" : "NO");
+
+    remove(SNAPSHOT);
+    remove(SNAPSHOT ".delta");
+    remove(CSV);
+    canvasDeconstructor(canvas);
+    return (differences == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,332 @@
+/*
+    Tests of the snapshots: a loaded snapshot gives back the pixels it was
+    saved from, decoding each tile only when it is first read, and the
+    delta segments written by later saves are applied in order, dropped
+    when cut short or written for another snapshot, and grow until a
+    whole snapshot is needed again. A save written on a worker thread
+    holds the canvas as it was captured, and a cancelled one leaves the
+    previous snapshot in place.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/snapshot.h"
+#include "../lib/thread.h"
+
+#define WIDTH      600
+#define HEIGHT     400
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define SNAPSHOT   "snapshotTest.pcnv"
+#define DELTA      SNAPSHOT SNAPSHOT_DELTA_SUFFIX
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int sameCanvas(const Canvas* a, const Canvas* b) {
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            if (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static uint32_t* copyCanvas(const Canvas* canvas) {
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    canvasReadRegion(canvas, 0, 0, WIDTH, HEIGHT, pixels, WIDTH);
+    return pixels;
+}
+
+static int sameAs(const Canvas* canvas, const uint32_t* pixels) {
+    uint32_t* current = copyCanvas(canvas);
+    int same = (memcmp(current, pixels, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+    free(current);
+    return same;
+}
+
+static long fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static char* readFile(const char* path, long* size) {
+    *size = fileSize(path);
+    char* content = malloc(*size > 0 ? *size : 1);
+    FILE* file = fopen(path, "rb");
+    CHECK(file != NULL && fread(content, 1, *size, file) == (size_t)*size);
+    fclose(file);
+    return content;
+}
+
+static void writeFile(const char* path, const char* content, long size) {
+    FILE* file = fopen(path, "wb");
+    fwrite(content, 1, size, file);
+    fclose(file);
+}
+
+/**
+ * @brief Noise over a rectangle, which no run-length or palette encoding makes smaller.
+ */
+static void drawNoise(Canvas* canvas, int left, int top, int right, int bottom) {
+    for (int y = top; y < bottom; ++y) {
+        for (int x = left; x < right; ++x) {
+            canvasSetPixel(canvas, x, y, CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255));
+        }
+    }
+}
+
+static Canvas* loadCanvas(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    CHECK(snapshotLoad(canvas, SNAPSHOT, log));
+    return canvas;
+}
+
+/**
+ * @brief Saves the tiles changed since `since` as a delta segment, as the window does.
+ */
+static uint64_t saveChanges(const Canvas* canvas, uint64_t since, Log* log) {
+    SnapshotFrame* frame = snapshotCaptureChanges(canvas, since, log);
+    CHECK(snapshotWrite(frame, SNAPSHOT, NULL, log));
+    uint64_t generation = frame -> generation;
+    snapshotFrameDeconstructor(frame);
+    return generation;
+}
+
+static void testLazyLoad(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    canvasFillRect(canvas, 10, 10, 300, 150, CANVAS_RGB(200, 30, 30));
+    drawNoise(canvas, 320, 200, 500, 330);
+    canvasSetPixel(canvas, WIDTH - 1, HEIGHT - 1, CANVAS_RGB(0, 0, 0));
+    int drawnTiles = canvas -> allocatedTiles;
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+
+    // Only the index is read: every drawn tile waits until it is looked at
+    Canvas* loaded = loadCanvas(log);
+    CHECK(loaded -> pendingCount == drawnTiles);
+    CHECK(canvasGetPixel(loaded, 400, 250) == canvasGetPixel(canvas, 400, 250));
+    CHECK(loaded -> pendingCount == drawnTiles - 1);
+    CHECK(canvasGetPixel(loaded, 5, HEIGHT - 5) == BACKGROUND); // A blank tile never waits
+    CHECK(loaded -> pendingCount == drawnTiles - 1);
+
+    // Drawing on a waiting tile decodes it first
+    canvasSetPixel(loaded, 20, 20, CANVAS_RGB(0, 0, 255));
+    CHECK(canvasGetPixel(loaded, 21, 20) == CANVAS_RGB(200, 30, 30));
+    canvasSetPixel(loaded, 20, 20, CANVAS_RGB(200, 30, 30));
+
+    CHECK(sameCanvas(loaded, canvas));
+    CHECK(loaded -> pendingCount == 0);
+    canvasDeconstructor(loaded);
+
+    // A canvas of few colors is saved with a palette, and comes back the same
+    canvasClear(canvas);
+    canvasFillRect(canvas, 0, 0, 250, 180, CANVAS_RGB(10, 20, 30));
+    for (int i = 0; i < 2000; ++i) {
+        canvasSetPixel(canvas, rand() % WIDTH, rand() % HEIGHT, CANVAS_RGB(rand() % 8, 0, 0));
+    }
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+    CHECK(fileSize(SNAPSHOT) < (long)WIDTH * HEIGHT);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+
+    // A smaller canvas keeps the part of the snapshot that fits it
+    Canvas* smaller = canvasConstructor(WIDTH / 2, HEIGHT / 2, BACKGROUND, log);
+    CHECK(snapshotLoad(smaller, SNAPSHOT, log));
+    int differences = 0;
+    for (int y = 0; y < HEIGHT / 2; ++y) {
+        for (int x = 0; x < WIDTH / 2; ++x) {
+            differences += (canvasGetPixel(smaller, x, y) != canvasGetPixel(canvas, x, y));
+        }
+    }
+    CHECK(differences == 0);
+
+    canvasDeconstructor(smaller);
+    canvasDeconstructor(canvas);
+    remove(SNAPSHOT);
+}
+
+static void testDeltas(Log* log) {
+    remove(DELTA);
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    drawNoise(canvas, 0, 0, WIDTH, HEIGHT);
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+    uint64_t saved = canvas -> generation;
+    long baseSize = fileSize(SNAPSHOT);
+
+    // Each save appends the changed tiles only, the snapshot itself is left as it was
+    canvasFillRect(canvas, 100, 100, 140, 130, CANVAS_RGB(0, 0, 0));
+    saved = saveChanges(canvas, saved, log);
+    CHECK(fileSize(SNAPSHOT) == baseSize);
+    long firstDelta = fileSize(DELTA);
+    CHECK(firstDelta > 0 && firstDelta < baseSize / 10);
+    CHECK(!snapshotNeedsBase(SNAPSHOT));
+    Canvas* loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+
+    // Segments are applied in order, a later one covering an earlier one
+    uint32_t* afterFirst = copyCanvas(canvas);
+    canvasFillRect(canvas, 120, 110, 300, 200, CANVAS_RGB(0, 128, 0));
+    saved = saveChanges(canvas, saved, log);
+    CHECK(fileSize(DELTA) > firstDelta);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+
+    // A segment cut short by a crash is dropped, the segments before it are kept
+    long deltaSize;
+    char* delta = readFile(DELTA, &deltaSize);
+    writeFile(DELTA, delta, deltaSize - 3);
+    Log quiet = { tmpfile() }; // The damage is logged, keep it out of the output of the tests
+    loaded = loadCanvas((quiet.file != NULL) ? &quiet : log);
+    CHECK(sameAs(loaded, afterFirst));
+    canvasDeconstructor(loaded);
+    if (quiet.file != NULL) {
+        fclose(quiet.file);
+    }
+
+    // A whole snapshot removes the delta file, and the delta of the previous snapshot is ignored
+    writeFile(DELTA, delta, deltaSize);
+    canvasFillRect(canvas, 0, 0, WIDTH, 250, CANVAS_RGB(40, 40, 40));
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+    CHECK(fileSize(DELTA) == -1);
+    writeFile(DELTA, delta, deltaSize);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+    free(delta);
+
+    // The next delta starts that file anew, for the new snapshot
+    saved = canvas -> generation;
+    canvasFillRect(canvas, 500, 300, 520, 320, CANVAS_RGB(1, 2, 3));
+    saved = saveChanges(canvas, saved, log);
+    CHECK(fileSize(DELTA) < deltaSize);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+
+    // Large changes make the delta file grow until a whole snapshot is worth writing again
+    int saves = 0;
+    while (!snapshotNeedsBase(SNAPSHOT) && saves < 20) {
+        drawNoise(canvas, 500, 300, WIDTH, HEIGHT);
+        saved = saveChanges(canvas, saved, log);
+        saves++;
+    }
+    CHECK(saves > 1 && saves < 20);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+    CHECK(snapshotSave(canvas, SNAPSHOT, log));
+    CHECK(!snapshotNeedsBase(SNAPSHOT));
+
+    free(afterFirst);
+    canvasDeconstructor(canvas);
+    remove(SNAPSHOT);
+    remove(DELTA);
+}
+
+/**
+ * @brief A save running on a worker thread, as the window starts it.
+ */
+typedef struct SaveJob {
+    SnapshotFrame* frame;
+    SnapshotProgress progress;
+    Log* log;
+    int saved;
+} SaveJob;
+
+static void runSave(void* argument) {
+    SaveJob* job = argument;
+    job -> saved = snapshotWrite(job -> frame, SNAPSHOT, &job -> progress, job -> log);
+}
+
+static void testBackgroundSave(Log* log) {
+    remove(DELTA);
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    drawNoise(canvas, 0, 0, WIDTH, HEIGHT / 2);
+    uint32_t* captured = copyCanvas(canvas);
+
+    // The canvas keeps changing while the frame is written
+    SaveJob job = { snapshotCapture(canvas, log), { 0 }, log, 0 };
+    snapshotProgressInit(&job.progress, job.frame);
+    Thread* thread = threadStart(runSave, &job, log);
+    canvasFillRect(canvas, 0, 0, WIDTH, HEIGHT, CANVAS_RGB(0, 0, 0));
+    if (thread != NULL) {
+        threadJoin(thread);
+    } else {
+        runSave(&job);
+    }
+    CHECK(job.saved);
+    CHECK(atomic_load(&job.progress.tilesDone) == job.progress.tilesTotal);
+    CHECK(job.progress.tilesTotal == canvas -> tilesX * canvas -> tilesY);
+    snapshotFrameDeconstructor(job.frame);
+    Canvas* loaded = loadCanvas(log);
+    CHECK(sameAs(loaded, captured));
+    canvasDeconstructor(loaded);
+
+    // A cancelled save, whole or delta, changes nothing a load reads
+    long size = fileSize(SNAPSHOT);
+    job.frame = snapshotCapture(canvas, log);
+    snapshotProgressInit(&job.progress, job.frame);
+    atomic_store(&job.progress.cancelled, 1);
+    runSave(&job);
+    CHECK(!job.saved);
+    snapshotFrameDeconstructor(job.frame);
+    job.frame = snapshotCaptureChanges(canvas, 0, log);
+    snapshotProgressInit(&job.progress, job.frame);
+    atomic_store(&job.progress.cancelled, 1);
+    runSave(&job);
+    CHECK(!job.saved);
+    snapshotFrameDeconstructor(job.frame);
+    CHECK(fileSize(SNAPSHOT) == size);
+    loaded = loadCanvas(log);
+    CHECK(sameAs(loaded, captured));
+    canvasDeconstructor(loaded);
+
+    // The next delta takes the place of the cancelled one
+    saveChanges(canvas, 0, log);
+    loaded = loadCanvas(log);
+    CHECK(sameCanvas(loaded, canvas));
+    canvasDeconstructor(loaded);
+
+    free(captured);
+    canvasDeconstructor(canvas);
+    remove(SNAPSHOT);
+    remove(DELTA);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(14);
+
+    testLazyLoad(&log);
+    testDeltas(&log);
+    testBackgroundSave(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "snapshotTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("snapshotTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/*
+    Tests of the brush stamps: the spans of a stamp cover the pixels the
+    historical per-pixel test of drawPixel covers, for every size and
+    shape, across the edges and the clip rectangle, and the span tables
+    built by the first threads to draw are the same for all of them.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/stamp.h"
+#include "../lib/thread.h"
+
+#define WIDTH      120
+#define HEIGHT     90
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define THREADS    4
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Whether the pixel (x, y) is under a stamp centered on (cx, cy), tested pixel by pixel.
+ */
+static int covered(int x, int y, int cx, int cy, int size, StampShape shape) {
+    int radius = size / 2;
+    if (radius > STAMP_MAX_SIZE / 2) radius = STAMP_MAX_SIZE / 2;
+    int i = x - cx, j = y - cy;
+    if (shape == STAMP_SQUARE) {
+        return abs(i) <= radius && abs(j) <= radius;
+    }
+    return i * i + j * j <= radius * radius;
+}
+
+/**
+ * @brief Pixels that differ from the stamp tested pixel by pixel, given the clip rectangle.
+ */
+static int countWrong(const Canvas* canvas, int cx, int cy, int size, StampShape shape, uint32_t color) {
+    int wrong = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            int inside = x >= canvas -> clipLeft && x < canvas -> clipRight && y >= canvas -> clipTop && y < canvas -> clipBottom;
+            uint32_t expected = (inside && covered(x, y, cx, cy, size, shape)) ? color : BACKGROUND;
+            wrong += (canvasGetPixel(canvas, x, y) != expected);
+        }
+    }
+    return wrong;
+}
+
+/**
+ * @brief Draws every stamp on a canvas of its own, for the threads that build the tables together.
+ */
+static void drawAll(void* argument) {
+    int* wrong = argument;
+    Log log = { stderr };
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, &log);
+    for (int size = 0; size <= STAMP_MAX_SIZE; ++size) {
+        for (int shape = STAMP_SQUARE; shape <= STAMP_CIRCLE; ++shape) {
+            canvasClear(canvas);
+            stampDraw(canvas, 60, 45, size, (StampShape)shape, CANVAS_RGB(0, 0, 0));
+            *wrong += countWrong(canvas, 60, 45, size, (StampShape)shape, CANVAS_RGB(0, 0, 0));
+        }
+    }
+    canvasDeconstructor(canvas);
+}
+
+static void testFirstUse(Log* log) {
+    // Several threads draw their first stamps at once
+    Thread* threads[THREADS];
+    int wrong[THREADS] = { 0 };
+    for (int i = 0; i < THREADS; ++i) {
+        threads[i] = threadStart(drawAll, &wrong[i], log);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        if (threads[i] != NULL) {
+            threadJoin(threads[i]);
+        } else {
+            drawAll(&wrong[i]);
+        }
+        CHECK(wrong[i] == 0);
+    }
+}
+
+static void testStamps(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Every size, sizes past the largest one included, at the center and across the edges
+    int centers[][2] = { { 60, 45 }, { 0, 0 }, { WIDTH - 1, 5 }, { -5, 40 }, { 70, HEIGHT + 6 } };
+    for (int size = 0; size <= STAMP_MAX_SIZE + 4; ++size) {
+        for (int shape = STAMP_SQUARE; shape <= STAMP_CIRCLE; ++shape) {
+            for (int c = 0; c < (int)(sizeof(centers) / sizeof(centers[0])); ++c) {
+                canvasClear(canvas);
+                stampDraw(canvas, centers[c][0], centers[c][1], size, (StampShape)shape, CANVAS_RGB(size, shape, c));
+                CHECK(countWrong(canvas, centers[c][0], centers[c][1], size, (StampShape)shape, CANVAS_RGB(size, shape, c)) == 0);
+            }
+        }
+    }
+
+    // The clip rectangle cuts the stamps
+    canvasSetClip(canvas, 30, 20, 65, 50);
+    for (int i = 0; i < 50; ++i) {
+        int x = 20 + rand() % 60, y = 10 + rand() % 50, size = rand() % (STAMP_MAX_SIZE + 1);
+        StampShape shape = (StampShape)(rand() & 1);
+        canvasClear(canvas);
+        stampDraw(canvas, x, y, size, shape, CANVAS_RGB(0, 0, 0));
+        CHECK(countWrong(canvas, x, y, size, shape, CANVAS_RGB(0, 0, 0)) == 0);
+    }
+
+    // The table rows are symmetric, the widest one in the middle
+    for (int size = 0; size <= STAMP_MAX_SIZE; ++size) {
+        const int* widths = stampHalfWidths(STAMP_CIRCLE, size);
+        int radius = size / 2;
+        CHECK(widths[radius] == radius);
+        for (int dy = 0; dy < radius; ++dy) {
+            CHECK(widths[dy] == widths[2 * radius - dy] && widths[dy] <= widths[dy + 1]);
+        }
+    }
+
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(2);
+
+    testFirstUse(&log);
+    testStamps(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "stampTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("stampTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
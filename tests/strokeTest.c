@@ -0,0 +1,163 @@
+/*
+    Tests of the strokes: a segment drawn by strokeDrawSegment() must give
+    the pixels of the brush stamped on every pixel of the segment, for
+    every size and shape, across the clip rectangle, and consecutive
+    segments must leave no gap between them.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/stamp.h"
+#include "../lib/stroke.h"
+
+#define WIDTH      200
+#define HEIGHT     150
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief The stroke as the brush stamped on each pixel of the Bresenham segment.
+ */
+static void stampSegment(Canvas* canvas, int x0, int y0, int x1, int y1, int size, StampShape shape, uint32_t color) {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int stepX = (x0 < x1) ? 1 : -1;
+    int stepY = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+    for (;;) {
+        stampDraw(canvas, x0, y0, size, shape, color);
+        if (x0 == x1 && y0 == y1) {
+            break;
+        }
+        int doubled = 2 * error;
+        if (doubled >= dy) {
+            error += dy;
+            x0 += stepX;
+        }
+        if (doubled <= dx) {
+            error += dx;
+            y0 += stepY;
+        }
+    }
+}
+
+static int countDifferences(const Canvas* a, const Canvas* b) {
+    int differences = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            differences += (canvasGetPixel(a, x, y) != canvasGetPixel(b, x, y));
+        }
+    }
+    return differences;
+}
+
+static void testSegments(Log* log) {
+    Canvas* swept = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+    Canvas* stamped = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Every size and shape, with segments of every direction, points and ends outside of the canvas
+    for (int size = 0; size <= STAMP_MAX_SIZE; ++size) {
+        for (int shape = STAMP_SQUARE; shape <= STAMP_CIRCLE; ++shape) {
+            canvasClear(swept);
+            canvasClear(stamped);
+            for (int i = 0; i < 12; ++i) {
+                int x0 = rand() % (WIDTH + 40) - 20, y0 = rand() % (HEIGHT + 40) - 20;
+                int x1 = (i % 4 == 0) ? x0 : rand() % (WIDTH + 40) - 20;
+                int y1 = (i % 4 == 1) ? y0 : rand() % (HEIGHT + 40) - 20;
+                uint32_t color = CANVAS_RGB(i, size, shape);
+                strokeDrawSegment(swept, x0, y0, x1, y1, size, (StampShape)shape, color, log);
+                stampSegment(stamped, x0, y0, x1, y1, size, (StampShape)shape, color);
+            }
+            CHECK(countDifferences(swept, stamped) == 0);
+        }
+    }
+
+    // The clip rectangle cuts the swept area like the stamps
+    canvasClear(swept);
+    canvasClear(stamped);
+    canvasSetClip(swept, 40, 30, 160, 120);
+    canvasSetClip(stamped, 40, 30, 160, 120);
+    for (int i = 0; i < 30; ++i) {
+        int x0 = rand() % WIDTH, y0 = rand() % HEIGHT;
+        int x1 = rand() % WIDTH, y1 = rand() % HEIGHT;
+        strokeDrawSegment(swept, x0, y0, x1, y1, 14, STAMP_CIRCLE, CANVAS_RGB(0, 0, i), log);
+        stampSegment(stamped, x0, y0, x1, y1, 14, STAMP_CIRCLE, CANVAS_RGB(0, 0, i));
+    }
+    CHECK(countDifferences(swept, stamped) == 0);
+
+    canvasDeconstructor(swept);
+    canvasDeconstructor(stamped);
+}
+
+static void testPolyline(Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Segments between mouse positions far apart, as the messages of a fast drag give them
+    int points[][2] = { { 10, 10 }, { 190, 20 }, { 30, 140 }, { 31, 141 }, { 180, 130 }, { 100, 5 } };
+    int count = sizeof(points) / sizeof(points[0]);
+    for (int i = 1; i < count; ++i) {
+        strokeDrawSegment(canvas, points[i - 1][0], points[i - 1][1], points[i][0], points[i][1], 0, STAMP_SQUARE,
+                          CANVAS_RGB(0, 0, 0), log);
+    }
+
+    // A one pixel stroke is 8-connected: a fill from its first point reaches every drawn pixel
+    static int stack[WIDTH * HEIGHT];
+    static unsigned char reached[WIDTH * HEIGHT];
+    int top = 0;
+    stack[top++] = points[0][1] * WIDTH + points[0][0];
+    reached[stack[0]] = 1;
+    while (top > 0) {
+        int pixel = stack[--top];
+        int x = pixel % WIDTH, y = pixel / WIDTH;
+        for (int j = -1; j <= 1; ++j) {
+            for (int i = -1; i <= 1; ++i) {
+                int nx = x + i, ny = y + j;
+                if (nx >= 0 && nx < WIDTH && ny >= 0 && ny < HEIGHT && !reached[ny * WIDTH + nx]
+                    && canvasGetPixel(canvas, nx, ny) != BACKGROUND) {
+                    reached[ny * WIDTH + nx] = 1;
+                    stack[top++] = ny * WIDTH + nx;
+                }
+            }
+        }
+    }
+    int unreached = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            unreached += (canvasGetPixel(canvas, x, y) != BACKGROUND && !reached[y * WIDTH + x]);
+        }
+    }
+    CHECK(unreached == 0);
+    for (int i = 0; i < count; ++i) {
+        CHECK(canvasGetPixel(canvas, points[i][0], points[i][1]) == CANVAS_RGB(0, 0, 0));
+    }
+
+    canvasDeconstructor(canvas);
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(3);
+
+    testSegments(&log);
+    testPolyline(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "strokeTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("strokeTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/*
+    Tests of the tile store: each distinct tile is written once whatever
+    the number of versions and slots using it, every version loads back
+    the pixels it was saved from, and deleting versions releases their
+    tiles until the pack is rewritten without them.
+
+        make test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/logger.h"
+#include "../lib/canvas.h"
+#include "../lib/snapshot.h"
+#include "../lib/tileStore.h"
+
+#define WIDTH      400
+#define HEIGHT     300
+#define BACKGROUND CANVAS_RGB(255, 255, 255)
+#define STORE      "tileStoreTest.store"
+#define PACK       STORE "/tiles.pack"
+#define TILE_BYTES (sizeof(uint32_t) * CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static uint32_t* copyCanvas(const Canvas* canvas) {
+    uint32_t* pixels = malloc(sizeof(uint32_t) * WIDTH * HEIGHT);
+    canvasReadRegion(canvas, 0, 0, WIDTH, HEIGHT, pixels, WIDTH);
+    return pixels;
+}
+
+static int sameAs(const Canvas* canvas, const uint32_t* pixels) {
+    uint32_t* current = copyCanvas(canvas);
+    int same = (memcmp(current, pixels, sizeof(uint32_t) * WIDTH * HEIGHT) == 0);
+    free(current);
+    return same;
+}
+
+/**
+ * @brief Noise over a rectangle, so that each tile it covers is stored raw.
+ */
+static void drawNoise(Canvas* canvas, int left, int top, int right, int bottom) {
+    for (int y = top; y < bottom; ++y) {
+        for (int x = left; x < right; ++x) {
+            canvasSetPixel(canvas, x, y, CANVAS_RGB(rand() & 255, rand() & 255, rand() & 255));
+        }
+    }
+}
+
+static int save(TileStore* store, const Canvas* canvas, const char* slot, Log* log) {
+    SnapshotFrame* frame = snapshotCapture(canvas, log);
+    int version = tileStoreSave(store, frame, slot);
+    snapshotFrameDeconstructor(frame);
+    return version;
+}
+
+/**
+ * @brief Loads a version in a new canvas and compares it with the pixels it was saved from.
+ */
+static int loadsAs(TileStore* store, const char* slot, int version, const uint32_t* pixels, Log* log) {
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, CANVAS_RGB(0, 0, 0), log);
+    int same = tileStoreLoad(store, canvas, slot, version) && sameAs(canvas, pixels);
+    canvasDeconstructor(canvas);
+    return same;
+}
+
+static void removeStore(void) {
+    char path[FILENAME_MAX];
+    const char* slots[] = { "drawing", "copy" };
+    for (int slot = 0; slot < 2; ++slot) {
+        for (int version = 1; version <= 10; ++version) {
+            snprintf(path, sizeof(path), STORE "/%s.%d.pman", slots[slot], version);
+            remove(path);
+        }
+    }
+    remove(PACK);
+    remove(STORE);
+}
+
+static void testDedupe(Log* log) {
+    removeStore();
+    TileStore* store = tileStoreConstructor(STORE, log);
+    CHECK(store != NULL);
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Six raw tiles and a flat area
+    drawNoise(canvas, 0, 0, 3 * CANVAS_TILE_SIZE, 2 * CANVAS_TILE_SIZE);
+    canvasFillRect(canvas, 200, 150, WIDTH, HEIGHT, CANVAS_RGB(0, 0, 200));
+    uint32_t* first = copyCanvas(canvas);
+    CHECK(save(store, canvas, "drawing", log) == 1);
+    long firstPack = store -> packSize;
+    CHECK(firstPack > 6 * (long)TILE_BYTES);
+
+    // A change of one tile writes that tile only
+    canvasFillRect(canvas, 10, 10, 30, 30, CANVAS_RGB(0, 0, 0));
+    uint32_t* second = copyCanvas(canvas);
+    CHECK(save(store, canvas, "drawing", log) == 2);
+    long secondPack = store -> packSize;
+    CHECK(secondPack - firstPack <= (long)TILE_BYTES + 64);
+
+    // The same canvas again, in the same slot or another one, writes no tile
+    CHECK(save(store, canvas, "drawing", log) == 3);
+    CHECK(save(store, canvas, "copy", log) == 1);
+    CHECK(store -> packSize == secondPack);
+
+    // A frame of changes takes the other tiles from the latest version
+    uint64_t saved = canvas -> generation;
+    canvasFillRect(canvas, 300, 20, 340, 60, CANVAS_RGB(0, 150, 0));
+    uint32_t* third = copyCanvas(canvas);
+    SnapshotFrame* changes = snapshotCaptureChanges(canvas, saved, log);
+    CHECK(tileStoreSave(store, changes, "drawing") == 4);
+    snapshotFrameDeconstructor(changes);
+
+    int versions[8];
+    CHECK(tileStoreVersions(store, "drawing", versions, 8) == 4);
+    CHECK(versions[0] == 1 && versions[3] == 4);
+    int width, height;
+    uint32_t background;
+    CHECK(tileStoreReadInfo(store, "drawing", 2, &width, &height, &background));
+    CHECK(width == WIDTH && height == HEIGHT && background == BACKGROUND);
+
+    CHECK(loadsAs(store, "drawing", 1, first, log));
+    CHECK(loadsAs(store, "drawing", 2, second, log));
+    CHECK(loadsAs(store, "drawing", 0, third, log));
+    CHECK(loadsAs(store, "copy", 1, second, log));
+
+    // A store opened again finds every tile and version
+    long packSize = store -> packSize;
+    tileStoreDeconstructor(store);
+    store = tileStoreConstructor(STORE, log);
+    CHECK(store -> packSize == packSize);
+    CHECK(tileStoreVersions(store, "drawing", NULL, 0) == 4);
+    CHECK(loadsAs(store, "drawing", 1, first, log));
+    CHECK(loadsAs(store, "drawing", 4, third, log));
+
+    free(third);
+    free(second);
+    free(first);
+    canvasDeconstructor(canvas);
+    tileStoreDeconstructor(store);
+}
+
+static void testCollect(Log* log) {
+    removeStore();
+    TileStore* store = tileStoreConstructor(STORE, log);
+    Canvas* canvas = canvasConstructor(WIDTH, HEIGHT, BACKGROUND, log);
+
+    // Versions with tiles of their own, and a slot sharing the first one
+    drawNoise(canvas, 0, 0, 2 * CANVAS_TILE_SIZE, CANVAS_TILE_SIZE);
+    uint32_t* first = copyCanvas(canvas);
+    save(store, canvas, "drawing", log);
+    save(store, canvas, "copy", log);
+    for (int i = 0; i < 5; ++i) {
+        drawNoise(canvas, 2 * CANVAS_TILE_SIZE, 0, WIDTH, 2 * CANVAS_TILE_SIZE);
+        save(store, canvas, "drawing", log);
+    }
+    uint32_t* last = copyCanvas(canvas);
+    long fullPack = store -> packSize;
+    CHECK(store -> garbageBytes == 0);
+
+    // Deleting a version releases the tiles no other version uses
+    CHECK(tileStoreDelete(store, "drawing", 3));
+    CHECK(!tileStoreDelete(store, "drawing", 3));
+    CHECK(store -> garbageBytes > 0);
+    CHECK(tileStoreVersions(store, "drawing", NULL, 0) == 5);
+
+    // Pruning makes most of the pack garbage, which has the pack rewritten
+    tileStorePrune(store, "drawing", 1);
+    int versions[8];
+    CHECK(tileStoreVersions(store, "drawing", versions, 8) == 1 && versions[0] == 6);
+    CHECK(store -> packSize < fullPack / 2);
+    CHECK(store -> garbageBytes < store -> packSize / 2);
+    CHECK(loadsAs(store, "drawing", 0, last, log));
+    CHECK(loadsAs(store, "copy", 1, first, log)); // Its tiles are still used by the other slot
+
+    // Collecting by hand leaves no garbage, and the store opened again agrees
+    CHECK(tileStoreCollect(store));
+    CHECK(store -> garbageBytes == 0);
+    long packSize = store -> packSize;
+    tileStoreDeconstructor(store);
+    store = tileStoreConstructor(STORE, log);
+    CHECK(store -> packSize == packSize);
+    CHECK(store -> garbageBytes == 0);
+    CHECK(loadsAs(store, "drawing", 6, last, log));
+    CHECK(loadsAs(store, "copy", 0, first, log));
+
+    // The next version is numbered after the deleted ones
+    CHECK(save(store, canvas, "drawing", log) == 7);
+
+    free(last);
+    free(first);
+    canvasDeconstructor(canvas);
+    tileStoreDeconstructor(store);
+    removeStore();
+}
+
+int main(void) {
+    Log log = { stderr };
+    srand(16);
+
+    testDedupe(&log);
+    testCollect(&log);
+
+    if (failures > 0) {
+        fprintf(stderr, "tileStoreTest: %d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("tileStoreTest: all checks passed\n");
+    return EXIT_SUCCESS;
+}